@@ -30,6 +30,7 @@
 #include "mpose.h"
 #include "steensy.h"
 #include "uservice.h"
+#include "uclock.h"
 #include "sencoder.h"
 #include "utime.h"
 #include "cmotor.h"
@@ -38,6 +39,7 @@
 #include "cedge.h"
 #include "cmixer.h"
 #include "sdist.h"
+#include "usubscribe.h"
 
 #include "astatemachine.h"
 
@@ -59,10 +61,10 @@ void AStateMachine::setup()
     // get values from ini-file
     toConsole = ini["state_machine"]["print"] == "true";
     //
-    if (ini["state_machine"]["log"] == "true")
+    if (ini["state_machine"]["log"] == "true" or logger.recorder)
     { // open logfile
         std::string fn = service.logPath + "log_state_machine.txt";
-        logfile = fopen(fn.c_str(), "w");
+        logfile = logRow.open(fn, "%lu.%04ld %d %% %s\n");
         fprintf(logfile, "%% Mission state_machine logfile\n");
         fprintf(logfile, "%% 1 \tTime (sec)\n");
         fprintf(logfile, "%% 2 \tMission state\n");
@@ -195,12 +197,13 @@ enum door_states
 
 bool AStateMachine::isLineDetected()
 {
-    return medge.edgeValid;
+    return medge.topic.read().edgeValid;
 }
 
 bool AStateMachine::isLineLost()
 {
-    if (!medge.edgeValid)
+    bool edgeValid = medge.topic.read().edgeValid;
+    if (!edgeValid)
         edge_counter++;
     else
         edge_counter = 0;
@@ -210,7 +213,7 @@ bool AStateMachine::isLineLost()
         edge_counter = 0;
         return true;
     }
-    else if (!medge.edgeValid)
+    else if (!edgeValid)
     {
         return false;
     }
@@ -224,10 +227,10 @@ bool AStateMachine::isLineLost()
 
 bool AStateMachine::detectIntersection()
 {
-    if (pose.dist <= threshold_distance_to_start_detection)
+    if (pose.topic.read().dist <= threshold_distance_to_start_detection)
         return false;
 
-    if (medge.width > minimum_line_width)
+    if (medge.topic.read().width > minimum_line_width)
         intersection_detection_counter++;
     else
         intersection_detection_counter = 0;
@@ -253,48 +256,48 @@ void AStateMachine::turnOnItself(float target_angle)
 {
     std::cout << "Turning to " << target_angle * 180 / M_PI << " degrees with turn rate " << turn_speed << std::endl;
     mixer.setVelocity(0.0);
-    usleep(5000);
+    clockService.sleepUs(5000);
     resetPose();
     if (target_angle < 0.0)
     {
         mixer.setTurnrate(-turn_speed);
 
-        while (pose.h > target_angle)
+        while (pose.topic.read().h > target_angle)
         {
             // std::cout << pose.h << std::endl;
-            usleep(2000);
+            clockService.sleepUs(2000);
         }
     }
     else
     {
         mixer.setTurnrate(turn_speed);
 
-        while (pose.h < target_angle)
+        while (pose.topic.read().h < target_angle)
         {
             // std::cout << pose.h << std::endl;
-            usleep(2000);
+            clockService.sleepUs(2000);
         }
     }
     // mixer.setManualControl(false, 0.0, 0.0);
     mixer.setTurnrate(0.0);
-    usleep(20000);
+    clockService.sleepUs(20000);
     std::cout << "Finished turning" << std::endl;
-    usleep(ONE_SECOND);
+    clockService.sleepUs(ONE_SECOND);
 }
 
 void AStateMachine::stopMovement(int wait_time = ONE_SECOND)
 {
     mixer.setVelocity(0.0);
-    usleep(20000);
+    clockService.sleepUs(20000);
     mixer.setTurnrate(0.0);
-    usleep(20000);
-    usleep(wait_time);
+    clockService.sleepUs(20000);
+    clockService.sleepUs(wait_time);
 }
 
 void AStateMachine::resetPose()
 {
     pose.resetPose();
-    usleep(50000);
+    clockService.sleepUs(50000);
 }
 
 void AStateMachine::run()
@@ -329,13 +332,28 @@ void AStateMachine::run()
     bool intersection_detected = false;
     bool calibration_changed_chrono = false;
     bool first_intersection = false;
+    // consistent copy of both distance values
+    UIrSample ir;
 
     toLog("Starting loop");
+    // distance sensor is used in some states only
+    int distRateMs = strtol(ini["dist"]["rate_ms"].c_str(), nullptr, 10);
+    bool distRequested = false;
 
     while (not finished and not lost and not service.stop)
     {
         intersection_detected = detectIntersection();
 
+        bool distNeeded = state == ROUNDABOUT or state == AXE or state == DOORS;
+        if (distNeeded != distRequested)
+        {
+            if (distNeeded)
+                subscribe.request("ir", distRateMs, "mission");
+            else
+                subscribe.release("ir", "mission");
+            distRequested = distNeeded;
+        }
+
         switch (state)
         {
         case START_TO_FIRST_INTERSECTION:
@@ -364,7 +382,7 @@ void AStateMachine::run()
                 followLine(FOLLOW_LEFT, avoid_regbot_margin);
                 just_entered_new_state = false;
             }
-            if (pose.dist > distance_to_roundabout)
+            if (pose.topic.read().dist > distance_to_roundabout)
             {
                 state = ROUNDABOUT;
                 resetPose();
@@ -388,7 +406,7 @@ void AStateMachine::run()
                     mixer.setVelocity(-0.1);
                     t.now();
                     while (t.getTimePassed() < 0.8)
-                        usleep(2000);
+                        clockService.sleepUs(2000);
                     just_entered_new_state = true;
                     enter_roundabout_state = ROUNDABOUT_WAIT_FOR_REGBOT_TO_ARRIVE;
                 }
@@ -401,7 +419,7 @@ void AStateMachine::run()
                     stopMovement(2000);
                     just_entered_new_state = false;
                 }
-                if (dist.dist[0] < minimum_distance_to_regbot)
+                if (dist.topic.read().dist[0] < minimum_distance_to_regbot)
                 {
                     std::cout << "Regbot detected!" << std::endl;
                     enter_roundabout_state = ROUNDABOUT_WAIT_FOR_REGBOT_TO_GO;
@@ -437,7 +455,7 @@ void AStateMachine::run()
                     mixer.setVelocity(follow_line_speed);
                     just_entered_new_state = false;
                 }
-                if (isLineDetected() && pose.dist > approximation_distance_to_roundabout)
+                if (isLineDetected() && pose.topic.read().dist > approximation_distance_to_roundabout)
                 {
                     enter_roundabout_state = ROUNDABOUT_FOLLOW_LINE;
                     resetPose();
@@ -519,7 +537,7 @@ void AStateMachine::run()
             switch (axe_state)
             {
             case AXE_GET_NEAR_AXE:
-                if (pose.dist > approximation_distance_to_axe)
+                if (pose.topic.read().dist > approximation_distance_to_axe)
                 {
                     std::cout << "[GET_NEAR_AXE] Changing to WAIT_FOR_AXE" << std::endl;
                     axe_state = AXE_WAIT_FOR_AXE;
@@ -527,28 +545,28 @@ void AStateMachine::run()
                 }
                 break;
             case AXE_WAIT_FOR_AXE:
-                if (dist.dist[0] < minimum_distance_to_axe)
+                if (dist.topic.read().dist[0] < minimum_distance_to_axe)
                 {
-                    std::cout << "[WAIT_FOR_AXE] Measured distance: " << dist.dist[0] << std::endl;
+                    std::cout << "[WAIT_FOR_AXE] Measured distance: " << dist.topic.read().dist[0] << std::endl;
                     std::cout << "[WAIT_FOR_AXE] Changing to WAIT_FOR_FREE" << std::endl;
                     axe_state = AXE_WAIT_FOR_FREE;
                 }
                 break;
 
             case AXE_WAIT_FOR_FREE:
-                if (dist.dist[0] > free_distance_to_axe)
+                if (dist.topic.read().dist[0] > free_distance_to_axe)
                 {
                     std::cout << "[WAIT_FOR_FREE] Changing to CROSS" << std::endl;
                     axe_state = AXE_CROSS;
                     pose.resetPose();
-                    usleep(2000);
+                    clockService.sleepUs(2000);
                     mixer.setVelocity(axe_cross_speed);
                 }
 
                 break;
 
             case AXE_CROSS:
-                if (pose.dist > distance_to_cross_axe)
+                if (pose.topic.read().dist > distance_to_cross_axe)
                 {
                     std::cout << "[CROSS] Changing to FOLLOW_LINE" << std::endl;
                     axe_state = AXE_TO_INTERSECTION;
@@ -565,11 +583,11 @@ void AStateMachine::run()
                 if (intersection_detected)
                 {
                     std::cout << "[TO_INTERSECTION] Turning" << std::endl;
-                    usleep(ONE_SECOND / 3);
+                    clockService.sleepUs(ONE_SECOND / 3);
                     stopMovement();
                     turnOnItself(-M_PI / 2 + M_PI / 8);
                     mixer.setVelocity(follow_line_speed);
-                    usleep(ONE_SECOND * 2);
+                    clockService.sleepUs(ONE_SECOND * 2);
                     resetPose();
                     intersection_detected = false;
                     just_entered_new_state = true;
@@ -587,7 +605,7 @@ void AStateMachine::run()
                     std::cout << "[DOORS] wait to travel" << std::endl;
                     just_entered_new_state = false;
                 }
-                if (pose.dist > approximation_distance_to_doors)
+                if (pose.topic.read().dist > approximation_distance_to_doors)
                 {
                     stopMovement(4000);
                     door_state = DOOR_TURN_TO_WALL;
@@ -617,7 +635,7 @@ void AStateMachine::run()
                     mixer.setVelocity(0.15);
                     just_entered_new_state = false;
                 }
-                if (dist.dist[0] < minimum_distance_to_wall)
+                if (dist.topic.read().dist[0] < minimum_distance_to_wall)
                 {
                     std::cout << "[DOORS] wall detected!" << std::endl;
                     door_state = DOOR_PERPENDICULAR_TO_WALL;
@@ -638,7 +656,8 @@ void AStateMachine::run()
                     mixer.setTurnrate(-0.07);
                     just_entered_new_state = false;
                 }
-                if (abs(dist.dist[0] - dist.dist[1]) < dist_threshold)
+                ir = dist.topic.read();
+                if (abs(ir.dist[0] - ir.dist[1]) < dist_threshold)
                 {
                     std::cout << "[DOORS] Perpendicular detected!" << std::endl;
                     // door_state = DOOR_PERPENDICULAR_TO_WALL;
@@ -681,7 +700,7 @@ void AStateMachine::run()
                     mixer.setVelocity(0.9);
                     just_entered_new_state = false;
                 }
-                if (pose.dist > 0.7)
+                if (pose.topic.read().dist > 0.7)
                 {
                     std::cout << "[DOORS] Door #1 Openend!" << std::endl;
                     stopMovement(2000);
@@ -705,7 +724,7 @@ void AStateMachine::run()
 
                 if (intersection_detected)
                 {
-                    usleep(ONE_SECOND / 4);
+                    clockService.sleepUs(ONE_SECOND / 4);
                     stopMovement(2000);
                     turnOnItself(M_PI / 2);
                     door_state = DOOR_SECOND_DOOR;
@@ -753,17 +772,17 @@ void AStateMachine::run()
                         if (speed == 3)
                             cedge.maxTurnrate = to_chrono_turnrate;
                         followLine(FOLLOW_LEFT, 0.000000001, to_chrono_straight_speed / (4 - speed));
-                        usleep(ONE_SECOND / 2);
+                        clockService.sleepUs(ONE_SECOND / 2);
                     }
                     just_entered_new_state = false;
                 }
-                if (pose.dist > chrono_calib_change && !calibration_changed_chrono)
+                if (pose.topic.read().dist > chrono_calib_change && !calibration_changed_chrono)
                 {
                     std::cout << "UPDATED CALIBRATION TO WOOD" << std::endl;
                     medge.updateCalibrationBlack(calibWood);
                     calibration_changed_chrono = true;
                 }
-                if (pose.dist > chrono_distance_1)
+                if (pose.topic.read().dist > chrono_distance_1)
                 {
                     to_chrono_state = TO_CHRONO_FIRST_CURVE;
                     just_entered_new_state = true;
@@ -778,7 +797,7 @@ void AStateMachine::run()
                     followLine(FOLLOW_RIGHT, 0.015, to_chrono_curve_speed);
                     just_entered_new_state = false;
                 }
-                if (pose.dist > chrono_distance_2)
+                if (pose.topic.read().dist > chrono_distance_2)
                 {
                     to_chrono_state = TO_CHRONO_SECOND_STRAIGHT;
                     just_entered_new_state = true;
@@ -793,7 +812,7 @@ void AStateMachine::run()
                     followLine(FOLLOW_RIGHT, 0.015, to_chrono_straight_speed - 0.3);
                     just_entered_new_state = false;
                 }
-                if (pose.dist > chrono_distance_3)
+                if (pose.topic.read().dist > chrono_distance_3)
                 {
                     to_chrono_state = TO_CHRONO_SECOND_CURVE;
                     just_entered_new_state = true;
@@ -829,7 +848,7 @@ void AStateMachine::run()
             if (isLineDetected())
             {
                 state = UP_RAMP;
-                usleep(ONE_SECOND / 4);
+                clockService.sleepUs(ONE_SECOND / 4);
                 stopMovement();
                 turnOnItself(M_PI / 2);
                 resetPose();
@@ -847,7 +866,7 @@ void AStateMachine::run()
                 followLine(FOLLOW_LEFT);
                 just_entered_new_state = false;
             }
-            if (pose.dist > distance_before_180_turn)
+            if (pose.topic.read().dist > distance_before_180_turn)
             {
                 state = TO_SEESAW;
                 resetPose();
@@ -867,7 +886,7 @@ void AStateMachine::run()
                 followLine(FOLLOW_RIGHT);
                 just_entered_new_state = false;
             }
-            if (detectIntersection() && (pose.dist > seesaw_avoid_wood_as_intersection_distance))
+            if (detectIntersection() && (pose.topic.read().dist > seesaw_avoid_wood_as_intersection_distance))
             {
                 std::cout << "Arrived to 1rst intersection" << std::endl;
                 just_entered_new_state = true;
@@ -881,14 +900,14 @@ void AStateMachine::run()
             {
                 std::cout << "Seesaw" << std::endl;
                 followLine(FOLLOW_LEFT);
-                usleep(ONE_SECOND / 2);
+                clockService.sleepUs(ONE_SECOND / 2);
                 turnOnItself(M_PI / 2);
                 resetPose();
                 followLine(FOLLOW_RIGHT, 0.000001, 0.1);
                 just_entered_new_state = false;
             }
 
-            if ((pose.dist > seesaw_advance_dist) && detectIntersection())
+            if ((pose.topic.read().dist > seesaw_advance_dist) && detectIntersection())
             {
                 stopMovement();
                 std::cout << "Detected line" << std ::endl;
@@ -908,7 +927,7 @@ void AStateMachine::run()
                 turnOnItself(-M_PI / 2 + M_PI / 9);
 
                 resetPose();
-                usleep(ONE_SECOND / 2);
+                clockService.sleepUs(ONE_SECOND / 2);
                 followLine(FOLLOW_RIGHT, 0.0001);
                 just_entered_new_state = false;
             }
@@ -919,7 +938,7 @@ void AStateMachine::run()
                 first_intersection = true;
                 stopMovement();
                 mixer.setVelocity(follow_line_speed);
-                usleep(ONE_SECOND / 2);
+                clockService.sleepUs(ONE_SECOND / 2);
             }
             else if (detectIntersection() && (first_intersection))
             {
@@ -933,8 +952,10 @@ void AStateMachine::run()
         default:
             break;
         }
-        usleep(2000);
+        clockService.sleepUs(2000);
     }
+    if (distRequested)
+        subscribe.release("ir", "mission");
     mixer.setVelocity(0.0);
 }
 
@@ -952,7 +973,7 @@ void AStateMachine::toLog(const char *message)
     UTime t("now");
     if (logfile != nullptr)
     {
-        fprintf(logfile, "%lu.%04ld %d %% %s\n", t.getSec(), t.getMicrosec() / 100,
+        logRow.add(logfile, t.getSec(), t.getMicrosec() / 100,
                 oldstate,
                 message);
     }
@@ -22,6 +22,8 @@
 
 #pragma once
 
+#include "ulogger.h"
+
 using namespace std;
 
 /**
@@ -61,6 +63,7 @@ private:
     bool toConsole = true;
     // logfile
     FILE *logfile = nullptr;
+    ULogStream logRow;
     bool setupDone = false;
 
     // general parameters
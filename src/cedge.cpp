@@ -28,7 +28,10 @@
 #include "steensy.h"
 #include "uservice.h"
 #include "medge.h"
+#include "cpipeline.h"
 #include "cedge.h"
+#include "uthreads.h"
+#include "uloopstat.h"
 #include "cmixer.h"
 
 // create value
@@ -65,14 +68,15 @@ void CEdge::setup()
   maxTurnrate = strtof(ini["edge"]["maxTurnrate"].c_str(), nullptr);
   //
   // should debug print be enabled
-  pid.toConsole = ini["edge"]["printCtrl"] == "true";
-  toConsole = ini["edge"]["print"] == "true";
+  pid.printCh = logChannels.add("edge.printCtrl", ini["edge"]["printCtrl"] == "true");
+  printCh = logChannels.add("edge.print_cedge", ini["edge"]["print"] == "true");
   //
   // initialize logfile
-  if (ini["edge"]["logCtrl"] == "true")
-  { // open logfile
+  logCtrlCh = logChannels.add("edge.logCtrl", ini["edge"]["logCtrl"] == "true" or logger.recorder);
+  logCtrlCh->setOpen([this]()
+  { // open logfile when the channel is first on
     std::string fn = service.logPath + "log_edge_pid.txt";
-    logfileCtrl = fopen(fn.c_str(), "w");
+    logfileCtrl = pid.openLog(fn);
     if (logfileCtrl != nullptr)
     {
       fprintf(logfileCtrl, "%% Edge control logfile: %s\n", fn.c_str());
@@ -81,11 +85,12 @@ void CEdge::setup()
     else
       printf("# cedge - Failed to create logfile at %s\n", fn.c_str());
 
-  }
-  if (ini["edge"]["logCedge"] == "true")
-  { // open logfile
+  });
+  logCh = logChannels.add("edge.logCedge", ini["edge"]["logCedge"] == "true" or logger.recorder);
+  logCh->setOpen([this]()
+  { // open logfile when the channel is first on
     std::string fn = service.logPath + "log_edge_ctrl.txt";
-    logfile = fopen(fn.c_str(), "w");
+    logfile = logRow.open(fn, "%lu.%04ld %d %d %.4f %.4f %.4f %d\n");
     if (logfile != nullptr)
     {
       fprintf(logfile, "%% Edge logfile: %s\n", fn.c_str());
@@ -99,25 +104,27 @@ void CEdge::setup()
     }
     else
       printf("# cedge - Failed to create logfile at %s\n", fn.c_str());
-  }
-  th1 = new std::thread(runObj, this);
+  });
+  // the control pipeline does the update, if enabled
+  if (not pipeline.enabled)
+    th1 = threads.spawn("edge_ctrl", runObj, this);
 }
 
 void CEdge::toLog()
 {
   if (service.stop)
     return;
-  if (logfile != nullptr)
+  if (logCh->active() and logfile != nullptr)
   {
-    fprintf(logfile, "%lu.%04ld %d %d %.4f %.4f %.4f %d\n",
-            medge.updTime.getSec(), medge.updTime.getMicrosec()/100,
+    logRow.add(logfile,
+            edge.updTime.getSec(), edge.updTime.getMicrosec()/100,
             mixer.headingMode, followLeft, followOffset, measuredValue,
             u, limited);
   }
-  if (toConsole)
+  if (printCh != nullptr and printCh->active())
   { // debug print to console
     printf("%lu.%04ld %d %d %.4f %.4f %.4f %d\n",
-           medge.updTime.getSec(), medge.updTime.getMicrosec()/100,
+           edge.updTime.getSec(), edge.updTime.getMicrosec()/100,
            mixer.headingMode, followLeft, followOffset, measuredValue,
            u, limited);
   }
@@ -137,61 +144,70 @@ void CEdge::terminate()
 void CEdge::run()
 {
   int loop = 0;
-  bool wasEnabled = false;
-  int updateCnt = medge.updateCnt;
+  UEdgeSample e;
+  edgeSeq = medge.topic.getSeq();
+  ULoopProbe * probe = loopStat.probe("edge_ctrl");
   while (not service.stop)
-  {
-    if (medge.updateCnt != updateCnt)
+  { // wait for new edge values (timeout to check for stop)
+    int n = medge.topic.wait(e, edgeSeq, 0.1);
+    if (n > 0)
     {
-      if (mixer.headingMode == CMixer::HM_EDGE)
-      { // follow edge
-        if (followLeft)
-          measuredValue = medge.leftEdge;
-        else
-          measuredValue = medge.rightEdge;
-        if (medge.edgeValid)
-        { // when measured are too positive, i.e. too far left
-          // we should go clockwise (CV), i.e positive turn-rate.
-          u = - pid.pid(followOffset, measuredValue, limited);
-          if (u > maxTurnrate)
-          {
-            limited = true;
-            u = maxTurnrate;
-          }
-          else if (u < -maxTurnrate)
-          {
-            limited = true;
-            u = -maxTurnrate;
-          }
-          else
-            limited = motor.limited;
-        }
-        else
-        {
-          u = 0.0;
-          limited = motor.limited;
-        }
-        // finished calculating turn rate
-        mixer.setInModeTurnrate(u);
-        // log control values
-        pid.saveToLog(logfileCtrl, medge.updTime);
-        toLog();
-        wasEnabled = true;
+      probe->begin();
+      probe->missed(n - 1);
+      update(e);
+      probe->end();
+      loop++;
+    }
+  }
+}
+
+void CEdge::update(const UEdgeSample & newEdge)
+{
+  edge = newEdge;
+  if (mixer.headingMode == CMixer::HM_EDGE)
+  { // follow edge
+    if (followLeft)
+      measuredValue = edge.leftEdge;
+    else
+      measuredValue = edge.rightEdge;
+    if (edge.edgeValid)
+    { // when measured are too positive, i.e. too far left
+      // we should go clockwise (CV), i.e positive turn-rate.
+      u = - pid.pid(followOffset, measuredValue, limited);
+      if (u > maxTurnrate)
+      {
+        limited = true;
+        u = maxTurnrate;
       }
-      else if (wasEnabled)
+      else if (u < -maxTurnrate)
       {
-        wasEnabled = false;
-        u = 0;
-        mixer.setInModeTurnrate(u);
-        pid.resetHistory();
-        // log control values
-        pid.saveToLog(logfileCtrl, medge.updTime);
-        toLog();
+        limited = true;
+        u = -maxTurnrate;
       }
-      loop++;
-      updateCnt = medge.updateCnt;
+      else
+        limited = motor.limited;
     }
-    usleep(2000);
+    else
+    {
+      u = 0.0;
+      limited = motor.limited;
+    }
+    // finished calculating turn rate
+    mixer.setInModeTurnrate(u);
+    // log control values
+    pid.saveToLog(logCtrlCh->active() and logfileCtrl != nullptr ? logfileCtrl : nullptr, edge.updTime);
+    toLog();
+    wasEnabled = true;
+  }
+  else if (wasEnabled)
+  {
+    wasEnabled = false;
+    u = 0;
+    mixer.setInModeTurnrate(u);
+    pid.resetHistory();
+    // log control values
+    pid.saveToLog(logCtrlCh->active() and logfileCtrl != nullptr ? logfileCtrl : nullptr, edge.updTime);
+    toLog();
   }
 }
 
@@ -45,6 +45,10 @@ public:
   /**
    * thread to do updates, when new data is available */
   void run();
+  /**
+   * Calculate new turnrate from new edge values (if in edge mode),
+   * called by run() or by the control pipeline */
+  void update(const UEdgeSample & newEdge);
   /**
    * terminate */
   void terminate();
@@ -76,11 +80,20 @@ private:
   // support variables
   FILE * logfileCtrl = {nullptr};
   FILE * logfile = {nullptr};
-  bool toConsole;
+  ULogStream logRow;
+  /// log and print channels (can be switched while running)
+  ULogChannel * logCh = nullptr;
+  ULogChannel * logCtrlCh = nullptr;
+  ULogChannel * printCh = nullptr;
   //   mutex dataLock; // data consistency lock, should not be needed
-  std::thread * th1;
+  std::thread * th1 = nullptr;
   bool stop = false;
   float measuredValue;
+  /// latest edge sample
+  UEdgeSample edge;
+  uint64_t edgeSeq = 0;
+  /// edge control was active at last update
+  bool wasEnabled = false;
 };
 
 /**
@@ -32,6 +32,9 @@
 #include "cmixer.h"
 
 #include "cheading.h"
+#include "uthreads.h"
+#include "uloopstat.h"
+#include "cpipeline.h"
 
 // create value
 CHeading heading;
@@ -65,16 +68,21 @@ void CHeading::setup()
   pid.setup(sampleTime, kp, taud, alpha, taui);
   pid.doAngleFolding(true);
   // should debug print be enabled
-  pid.toConsole = ini["heading"]["print"] == "true";
+  pid.printCh = logChannels.add("heading.print", ini["heading"]["print"] == "true");
   // initialize logfile
-  if (ini["heading"]["log"] == "true")
-  { // open logfile
+  logCh = logChannels.add("heading.log", ini["heading"]["log"] == "true" or logger.recorder);
+  logCh->setOpen([this]()
+  { // open logfile when the channel is first on
     std::string fn = service.logPath + "log_heading.txt";
-    logfile = fopen(fn.c_str(), "w");
+    logfile = pid.openLog(fn);
+    if (logfile == nullptr)
+      return;
     logfileLeadText(logfile);
     pid.logPIDparams(logfile, false);
-  }
-  th1 = new std::thread(runObj, this);
+  });
+  // the control pipeline does the update, if enabled
+  if (not pipeline.enabled)
+    th1 = threads.spawn("heading", runObj, this);
 }
 
 void CHeading::logfileLeadText(FILE * f)
@@ -112,44 +120,23 @@ void CHeading::setRef(bool useTurnrate, float turnrate, float absHeading)
 void CHeading::run()
 {
   int loop = 0;
+  UPoseSample ps;
+  poseSeq = pose.topic.getSeq();
+  ULoopProbe * probe = loopStat.probe("heading");
   while (not service.stop)
   {
-    if (pose.updateCnt != poseUpdateCnt)
+    int n = pose.topic.wait(ps, poseSeq, 0.1);
+    if (n > 0)
     { // do constant rate control
       // that is; every time new encoder data is available,
-      // and therefore pose.updateCnt increased,
+      // and therefore a new pose is published,
       // then new motor control values should be calculated.
-      poseUpdateCnt = pose.updateCnt;
-      // do control.
-      // got new encoder data
-      float dt = pose.poseTime - lastPose;
-      lastPose = pose.poseTime;
-      // calculate new reference turnrate
-      if (turnrateControl)
-        desiredHeading += turnrateRef * dt;
-      else
-      {
-        desiredHeading = headingRef;
-      }
-      if (dt < 1.0)
-      { // valid control timing
-        u = pid.pid(desiredHeading, pose.h, limited);
-        // test for output limiting
-        if (fabsf(u) > maxTurnrate or motor.limited)
-        { // don't turn too fast
-          limited = true;
-          if (u > maxTurnrate)
-            u = maxTurnrate;
-          else if (u < -maxTurnrate)
-            u = -maxTurnrate;
-        }
-        else
-          limited = false;
-      }
-      // log control values
-      pid.saveToLog(logfile, pose.poseTime);
+      probe->begin();
+      probe->missed(n - 1);
+      update(ps);
       // finished calculating turn rate
       mixer.updateWheelVelocity();
+      probe->end();
     }
 //     else
 //     { // no control - rely on motor velocity controller
@@ -158,8 +145,36 @@ void CHeading::run()
 //       mixer.translateToWheelVelocity();
 //     }
     loop++;
-    usleep(2000);
   }
 }
 
-
+void CHeading::update(UPoseSample & ps)
+{ // do control.
+  // got new encoder data
+  float dt = ps.poseTime - lastPose;
+  lastPose = ps.poseTime;
+  // calculate new reference turnrate
+  if (turnrateControl)
+    desiredHeading += turnrateRef * dt;
+  else
+  {
+    desiredHeading = headingRef;
+  }
+  if (dt < 1.0)
+  { // valid control timing
+    u = pid.pid(desiredHeading, ps.h, limited);
+    // test for output limiting
+    if (fabsf(u) > maxTurnrate or motor.limited)
+    { // don't turn too fast
+      limited = true;
+      if (u > maxTurnrate)
+        u = maxTurnrate;
+      else if (u < -maxTurnrate)
+        u = -maxTurnrate;
+    }
+    else
+      limited = false;
+  }
+  // log control values
+  pid.saveToLog(logCh->active() and logfile != nullptr ? logfile : nullptr, ps.poseTime);
+}
@@ -28,6 +28,7 @@
 #include "sencoder.h"
 #include "utime.h"
 #include "upid.h"
+#include "mpose.h"
 
 using namespace std;
 
@@ -45,6 +46,11 @@ public:
   /**
    * thread to do updates, when new data is available */
   void run();
+  /**
+   * Calculate new turnrate from a new pose,
+   * called by run() or by the control pipeline
+   * (the mixer is not updated here) */
+  void update(UPoseSample & ps);
   /**
    * terminate */
   void terminate();
@@ -101,13 +107,15 @@ private:
   float u;
   // support variables
   FILE * logfile = {nullptr};
+  /// log channel (can be switched while running)
+  ULogChannel * logCh = nullptr;
 //   mutex dataLock; // data consistency lock, should not be needed
-  std::thread * th1;
+  std::thread * th1 = nullptr;
   bool stop = false;
   int dataCnt = 0;
   /// old mixer update count
   int mixerUpdateCnt = 0;
-  int poseUpdateCnt = 0;
+  uint64_t poseSeq = 0;
 };
 
 /**
@@ -53,11 +53,14 @@ void CMixer::setup()
   if (wheelbase < 0.005)
     wheelbase = 0.22;
   //
-  toConsole = ini["mixer"]["print"] == "true";
-  if (ini["mixer"]["log"] == "true")
-  { // open logfile
+  printCh = logChannels.add("mixer.print", ini["mixer"]["print"] == "true");
+  logCh = logChannels.add("mixer.log", ini["mixer"]["log"] == "true" or logger.recorder);
+  logCh->setOpen([this]()
+  { // open logfile when the channel is first on
     std::string fn = service.logPath + "log_mixer.txt";
-    logfile = fopen(fn.c_str(), "w");
+    logfile = logRow.open(fn, "%lu.%04ld %d %.3f %d %.4f %.4f %.4f %.3f %.3f %.2f\n");
+    if (logfile == nullptr)
+      return;
     fprintf(logfile, "%% Mixer logfile\n");
     fprintf(logfile, "%% Wheel base used in calculation: %g m\n", wheelbase);
     fprintf(logfile, "%% 1 \tTime (sec)\n");
@@ -70,7 +73,7 @@ void CMixer::setup()
     fprintf(logfile, "%% 8 \tDesired left wheel velocity (m/s)\n");
     fprintf(logfile, "%% 9 \tDesired right wheel velocity (m/s)\n");
     fprintf(logfile, "%% 10 \tCalculated commanded turn radius (999 if straight) (m)\n");
-  }
+  });
 }
 
 void CMixer::terminate()
@@ -191,15 +194,15 @@ void CMixer::toLog()
 {
   if (service.stop)
     return;
-  if (logfile != nullptr)
+  if (logCh->active() and logfile != nullptr)
   { // add to log after update
-    fprintf(logfile, "%lu.%04ld %d %.3f %d %.4f %.4f %.4f %.3f %.3f %.2f\n",
+    logRow.add(logfile,
             updateTime.getSec(), updateTime.getMicrosec() / 100,
             manualOverride, linVel, headingMode, desiredHeading,
             heading.getTurnrateRef(), heading.getTurnrate(),
             wheelVelRef[0], wheelVelRef[1], turnRadius);
   }
-  if (toConsole)
+  if (printCh != nullptr and printCh->active())
   {
     printf("%lu.%04ld %d %.3f %d %.4f %.4f %.4f %.3f %.3f %.2f\n",
            updateTime.getSec(), updateTime.getMicrosec() / 100,
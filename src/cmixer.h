@@ -113,7 +113,10 @@ private:
   void toLog();
   //
   FILE *logfile = nullptr;
-  bool toConsole = false;
+  ULogStream logRow;
+  /// log and print channels (can be switched while running)
+  ULogChannel * logCh = nullptr;
+  ULogChannel * printCh = nullptr;
   /// Turnrate in radians per second
   //   float turnrateRef = 0; // desired
   /// Linear velocity (m/s)
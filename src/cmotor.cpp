@@ -27,10 +27,13 @@
 #include <math.h>
 #include "sencoder.h"
 #include "cmotor.h"
+#include "uthreads.h"
+#include "uloopstat.h"
 #include "steensy.h"
 #include "uservice.h"
 #include "mpose.h"
 #include "cmixer.h"
+#include "cpipeline.h"
 
 // create value
 CMotor motor;
@@ -65,21 +68,26 @@ void CMotor::setup()
   pid[0].setup(sampleTime, kp, taud, alpha, taui);
   pid[1].setup(sampleTime, kp, taud, alpha, taui);
   //
-  pid[0].toConsole = ini["motor"]["print_m1"] == "true";
-  pid[1].toConsole = ini["motor"]["print_m2"] == "true";
+  pid[0].printCh = logChannels.add("motor.print_m1", ini["motor"]["print_m1"] == "true");
+  pid[1].printCh = logChannels.add("motor.print_m2", ini["motor"]["print_m2"] == "true");
   // initialize logfile
-  if (ini["motor"]["log"] == "true")
-  { // open logfile
+  logCh = logChannels.add("motor.log", ini["motor"]["log"] == "true" or logger.recorder);
+  logCh->setOpen([this]()
+  { // open logfile when the channel is first on
     std::string fn = service.logPath + "log_motor_0.txt";
-    logfile[0] = fopen(fn.c_str(), "w");
+    logfile[0] = pid[0].openLog(fn);
     fn = service.logPath + "log_motor_1.txt";
-    logfile[1] = fopen(fn.c_str(), "w");
+    logfile[1] = pid[1].openLog(fn);
+    if (logfile[0] == nullptr or logfile[1] == nullptr)
+      return;
     logfileLeadText(logfile[0], "left");
     pid[0].logPIDparams(logfile[0], false);
     logfileLeadText(logfile[1], "right");
     pid[1].logPIDparams(logfile[1], false);
-  }
-  th1 = new std::thread(runObj, this);
+  });
+  // the control pipeline does the update, if enabled
+  if (not pipeline.enabled)
+    th1 = threads.spawn("motor", runObj, this);
 }
 
 void CMotor::logfileLeadText(FILE * f, const char * side)
@@ -111,6 +119,9 @@ void CMotor::terminate()
     logfile[0] = nullptr;
     logfile[1] = nullptr;
   }
+  if (latencyCnt > 0)
+    printf("# CMotor:: encoder decode to motor voltage send, avg %.3f ms, max %.3f ms (%d samples)\n",
+           latencySum / latencyCnt * 1000.0, latencyMax * 1000.0, latencyCnt);
 }
 
 
@@ -118,7 +129,10 @@ void CMotor::run()
 {
 //   printf("# CMotor::run\n");
   int loop = 0;
-  UTime lastPose;
+  UPoseSample ps;
+  poseSeq = pose.topic.getSeq();
+  ULoopProbe * probe = loopStat.probe("motor");
+  int n;
   while (not service.stop)
   {
     if (false) //useTeensyControl)
@@ -135,59 +149,69 @@ void CMotor::run()
         teensy1.send(s, true);
       }
     }
-    else if (pose.updateCnt != poseUpdateCnt)
+    else if ((n = pose.topic.wait(ps, poseSeq, 0.1)) > 0)
     { // do constant rate control
       // that is every time new encoder data is available
       // new motor control values should be calculated.
-      poseUpdateCnt = pose.updateCnt;
-      // do velocity control.
-      // got new encoder data
-      float dt = lastPose - pose.poseTime;
-      // desired velocity from mixer
-      float * vr = mixer.getWheelVelocityArray();
-      if (dt < 1.0)
-      { // valid control timing
-        u[0] = pid[0].pid(vr[0], pose.wheelVel[0], limited);
-        u[1] = pid[1].pid(vr[1], pose.wheelVel[1], limited);
-        // test for output limiting
-        if (fabsf(u[0]) > maxMotV or fabsf(u[1]) > maxMotV)
-        { // some speed reduction is needed
-          limited = true;
-          // find speed reduction factor to allow turning
-          float fac;
-          if (fabsf(u[0]) > fabsf(u[1]))
-            fac = maxMotV/(fabsf(u[0]));
-          else
-            fac = maxMotV/(fabsf(u[1]));
-          u[0] *= fac;
-          u[1] *= fac;
-        }
-        else
-          limited = false;
-      }
-      lastPose = pose.poseTime;
-      // log_pose - for both motors
-      pid[0].saveToLog(logfile[0], pose.poseTime);
-      pid[1].saveToLog(logfile[1], pose.poseTime);
-      // finished calculating motor voltage
-      const int MSL = 100;
-      char s[MSL];
-      /// Left motor output actually inverts motor voltage.
-      /// So if both are commanded with a positive voltage
-      /// robot drives forward,
-      /// Here the sign must therefore be changed to compensate.
-      snprintf(s, MSL, "motv %.2f %.2f\n", u[0], u[1]);
-      teensy1.send(s, true);
+      // The wait returns as soon as a new pose is published
+      // (or after 100ms to check for stop).
+      // Skipped poses (n > 1) are counted by the probe.
+      probe->begin();
+      probe->missed(n - 1);
+      update(ps);
+      probe->end();
     }
     loop++;
-    // sleep a little while, the sample time is
-    // determined by the encoder (longer than 2ms)
+    // no sleep, the sample time is
+    // determined by the pose topic (i.e. encoder update),
     // actually determined by the Teensy, so on average
     // a constant sample rate (defined in the robot.ini file)
-    usleep(2000);
   }
   // stop motors
   teensy1.send("motv 0 0\n");
 }
 
-
+void CMotor::update(UPoseSample & ps)
+{ // do velocity control.
+  // got new encoder data
+  float dt = lastPose - ps.poseTime;
+  // desired velocity from mixer
+  float * vr = mixer.getWheelVelocityArray();
+  if (dt < 1.0)
+  { // valid control timing
+    u[0] = pid[0].pid(vr[0], ps.wheelVel[0], limited);
+    u[1] = pid[1].pid(vr[1], ps.wheelVel[1], limited);
+    // test for output limiting
+    if (fabsf(u[0]) > maxMotV or fabsf(u[1]) > maxMotV)
+    { // some speed reduction is needed
+      limited = true;
+      // find speed reduction factor to allow turning
+      float fac;
+      if (fabsf(u[0]) > fabsf(u[1]))
+        fac = maxMotV/(fabsf(u[0]));
+      else
+        fac = maxMotV/(fabsf(u[1]));
+      u[0] *= fac;
+      u[1] *= fac;
+    }
+    else
+      limited = false;
+  }
+  lastPose = ps.poseTime;
+  // log_pose - for both motors
+  bool toLog = logCh->active() and logfile[0] != nullptr;
+  pid[0].saveToLog(toLog ? logfile[0] : nullptr, ps.poseTime);
+  pid[1].saveToLog(toLog ? logfile[1] : nullptr, ps.poseTime);
+  // finished calculating motor voltage
+  /// Left motor output actually inverts motor voltage.
+  /// So if both are commanded with a positive voltage
+  /// robot drives forward,
+  /// Here the sign must therefore be changed to compensate.
+  teensy1.sendMotv(u[0], u[1]);
+  // latency from encoder decode to motor voltage send
+  float lat = ps.encPublished.getTimePassed();
+  latencySum += lat;
+  if (lat > latencyMax)
+    latencyMax = lat;
+  latencyCnt++;
+}
@@ -29,6 +29,7 @@
 #include "sencoder.h"
 #include "utime.h"
 #include "upid.h"
+#include "mpose.h"
 
 using namespace std;
 
@@ -46,6 +47,10 @@ public:
   /**
    * thread to do updates, when new data is available */
   void run();
+  /**
+   * Calculate and send new motor voltage from a new pose,
+   * called by run() or by the control pipeline */
+  void update(UPoseSample & ps);
   /**
    * terminate */
   void terminate();
@@ -89,13 +94,21 @@ private:
   float u[2];
   // support variables
   FILE * logfile[2] = {nullptr};
+  /// log channel for both motors (can be switched while running)
+  ULogChannel * logCh = nullptr;
 //   mutex dataLock; // data consistency lock, should not be needed
-  std::thread * th1;
+  std::thread * th1 = nullptr;
   bool stop = false;
   int dataCnt = 0;
   /// old mixer update count
   int mixerUpdateCnt = 0;
-  int poseUpdateCnt = 0;
+  uint64_t poseSeq = 0;
+  /// time of last pose used
+  UTime lastPose;
+  /// latency from encoder decode to motor voltage send (sec)
+  double latencySum = 0;
+  float latencyMax = 0;
+  int latencyCnt = 0;
 };
 
 /**
@@ -0,0 +1,181 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cpipeline.h"
+#include "uthreads.h"
+#include "uloopstat.h"
+#include "uservice.h"
+#include "steensy.h"
+#include "sencoder.h"
+#include "mpose.h"
+#include "medge.h"
+#include "cedge.h"
+#include "cheading.h"
+#include "cmixer.h"
+#include "cmotor.h"
+
+CPipeline pipeline;
+
+const char * CPipeline::stageName[STAGE_CNT] = {"pose", "edge", "heading", "mixer", "motor"};
+
+
+void CPipeline::setup()
+{ // ensure default values
+  if (not ini.has("pipeline"))
+  { // no data yet, so generate some default values
+    ini["pipeline"]["enabled"] = "false";
+    ini["pipeline"]["log"] = "true";
+    ini["pipeline"]["print"] = "false";
+  }
+  enabled = ini["pipeline"]["enabled"] == "true";
+  printCh = logChannels.add("pipeline.print", ini["pipeline"]["print"] == "true");
+  logCh = logChannels.add("pipeline.log", ini["pipeline"]["log"] == "true" or logger.recorder);
+  logCh->setOpen([this]()
+  { // open logfile when the channel is first on
+    std::string fn = service.logPath + "log_pipeline.txt";
+    logfile = logRow.open(fn, "%lu.%04ld %.3f %.3f %.3f %.3f %.3f %.3f %d\n");
+    if (logfile == nullptr)
+      return;
+    fprintf(logfile, "%% Control pipeline stage timing (%s)\n", fn.c_str());
+    fprintf(logfile, "%% 1 \tTime of encoder sample (sec)\n");
+    fprintf(logfile, "%% 2 \tEncoder decode to pass start (ms)\n");
+    fprintf(logfile, "%% 3 \tPose integration (ms)\n");
+    fprintf(logfile, "%% 4 \tEdge control (ms), -1 if no new edge values\n");
+    fprintf(logfile, "%% 5 \tHeading control (ms)\n");
+    fprintf(logfile, "%% 6 \tMixer (ms)\n");
+    fprintf(logfile, "%% 7 \tMotor control and motv send (ms)\n");
+    fprintf(logfile, "%% 8 \tEncoder samples missed (total)\n");
+  });
+}
+
+void CPipeline::start()
+{
+  if (enabled)
+    th1 = threads.spawn("pipeline", runObj, this);
+}
+
+void CPipeline::terminate()
+{
+  if (th1 != nullptr)
+  {
+    th1->join();
+    th1 = nullptr;
+  }
+  if (logfile != nullptr)
+  {
+    fclose(logfile);
+    logfile = nullptr;
+  }
+  if (passCnt > 0)
+  {
+    printf("# CPipeline:: %d passes, %d encoder samples missed\n",
+           passCnt, encoderMissed);
+    printf("# CPipeline::   decode to start avg %.3f ms, max %.3f ms\n",
+           latencySum / passCnt * 1000, latencyMax * 1000);
+    for (int i = 0; i < STAGE_CNT; i++)
+    {
+      if (stageCnt[i] > 0)
+        printf("# CPipeline::   %-8s passes %5d, avg %.3f ms, max %.3f ms\n",
+               stageName[i], stageCnt[i], stageSum[i] / stageCnt[i] * 1000, stageMax[i] * 1000);
+    }
+  }
+}
+
+void CPipeline::run()
+{ // scheduling policy and CPU are set by UThreads ([threads] pipeline)
+  uint64_t encoderSeq = encoder.topic.getSeq();
+  uint64_t edgeSeq = medge.topic.getSeq();
+  UEncSample es;
+  UEdgeSample edgeSample;
+  UTime published;
+  float st[STAGE_CNT];
+  ULoopProbe * probe = loopStat.probe("pipeline");
+  while (not service.stop)
+  { // wait for new encoder values (timeout to check for stop)
+    int n = encoder.topic.wait(es, encoderSeq, 0.1, &published);
+    if (n <= 0)
+      continue;
+    probe->begin();
+    encoderMissed += n - 1;
+    probe->missed(n - 1);
+    float latency = published.getTimePassed();
+    UTime t("now");
+    pose.update(es, published);
+    st[POSE] = t.getTimePassed();
+    t.now();
+    // edge control, if new edge values
+    bool edge = medge.topic.get(edgeSample, edgeSeq) > 0;
+    if (edge)
+      cedge.update(edgeSample);
+    st[EDGE] = t.getTimePassed();
+    t.now();
+    UPoseSample ps = pose.topic.read();
+    heading.update(ps);
+    st[HEADING] = t.getTimePassed();
+    t.now();
+    mixer.updateWheelVelocity();
+    st[MIXER] = t.getTimePassed();
+    t.now();
+    motor.update(ps);
+    st[MOTOR] = t.getTimePassed();
+    // statistics
+    for (int i = 0; i < STAGE_CNT; i++)
+    {
+      if (i == EDGE and not edge)
+        continue;
+      stageSum[i] += st[i];
+      if (st[i] > stageMax[i])
+        stageMax[i] = st[i];
+      stageCnt[i]++;
+    }
+    latencySum += latency;
+    if (latency > latencyMax)
+      latencyMax = latency;
+    passCnt++;
+    toLog(es.encTime, latency, st, edge);
+    probe->end();
+  }
+  // stop motors (real-time lane, as in the passes)
+  teensy1.sendMotv(0, 0);
+}
+
+void CPipeline::toLog(UTime & encTime, float latency, float stageTime[], bool edge)
+{ // in binary mode the row is just packed to the logger ring
+  if (service.stop)
+    return;
+  float edgeTime = edge ? stageTime[EDGE] * 1000 : -1.0;
+  if (logCh->active() and logfile != nullptr)
+    logRow.add(logfile, encTime.getSec(), encTime.getMicrosec() / 100,
+               latency * 1000, stageTime[POSE] * 1000, edgeTime,
+               stageTime[HEADING] * 1000, stageTime[MIXER] * 1000,
+               stageTime[MOTOR] * 1000, encoderMissed);
+  if (printCh != nullptr and printCh->active())
+    printf("%lu.%04ld %.3f %.3f %.3f %.3f %.3f %.3f %d\n",
+           encTime.getSec(), encTime.getMicrosec() / 100,
+           latency * 1000, stageTime[POSE] * 1000, edgeTime,
+           stageTime[HEADING] * 1000, stageTime[MIXER] * 1000,
+           stageTime[MOTOR] * 1000, encoderMissed);
+}
@@ -0,0 +1,91 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <thread>
+
+#include "utime.h"
+#include "ulogger.h"
+
+/**
+ * Optional control pipeline, that runs the inner control loop
+ * in one pass for every encoder sample:
+ * pose integration, edge control (if new edge values),
+ * heading control, mixer and motor control (sending motv).
+ * The pass runs in one thread, that may be real-time (SCHED_FIFO)
+ * and pinned to one CPU core (see 'pipeline' in the [threads] ini section).
+ * If not enabled, each module runs in its own thread (as default).
+ * The time used by each stage is recorded.
+ * */
+class CPipeline
+{
+public:
+  /** read settings, must be called before the control modules are set up */
+  void setup();
+  /**
+   * start the pipeline thread (if enabled),
+   * when all control modules are set up */
+  void start();
+  /**
+   * thread doing a pass for every encoder sample */
+  void run();
+  /**
+   * terminate */
+  void terminate();
+
+public:
+  /// pipeline is used (from ini-file)
+  bool enabled = false;
+
+private:
+  static void runObj(CPipeline * obj)
+  { // called, when thread is started
+    // transfer to the class run() function.
+    obj->run();
+  }
+  void toLog(UTime & encTime, float latency, float stageTime[], bool edge);
+  /// pipeline stages
+  enum Stages {POSE, EDGE, HEADING, MIXER, MOTOR, STAGE_CNT};
+  static const char * stageName[STAGE_CNT];
+  /// time used by each stage (sec)
+  double stageSum[STAGE_CNT] = {0};
+  float stageMax[STAGE_CNT] = {0};
+  int stageCnt[STAGE_CNT] = {0};
+  /// from encoder decode to pass start (sec)
+  double latencySum = 0;
+  float latencyMax = 0;
+  int passCnt = 0;
+  int encoderMissed = 0;
+  FILE * logfile = nullptr;
+  /// row format
+  ULogStream logRow;
+  /// log and print channels (can be switched while running)
+  ULogChannel * logCh = nullptr;
+  ULogChannel * printCh = nullptr;
+  std::thread * th1 = nullptr;
+};
+
+/**
+ * Make this visible to the rest of the software */
+extern CPipeline pipeline;
@@ -27,6 +27,8 @@
 #include "cservo.h"
 #include "steensy.h"
 #include "uservice.h"
+#include "ufields.h"
+#include "usubscribe.h"
 // create value
 CServo servo;
 
@@ -39,17 +41,21 @@ void CServo::setup()
     ini["servo"]["log"] = "true";
     ini["servo"]["print"] = "true";
   }
+  // decode servo status messages
+  teensy1.addDecoder("svo", [](const char * msg, UTime & msgTime)
+                     { return servo.decode(msg, msgTime); });
   // use values and subscribe to source data
   // like teensy1.send("sub pose 4\n");
-  std::string s = "sub svo " + ini["servo"]["rate_ms"] + "\n";
-  teensy1.send(s.c_str());
+  subscribe.request("svo", strtol(ini["servo"]["rate_ms"].c_str(), nullptr, 10), "servo");
   // debug print
   toConsole = ini["servo"]["print"] == "true";
   // set servo
-  if (ini["servo"]["log"] == "true")
+  if (ini["servo"]["log"] == "true" or logger.recorder)
   { // open logfile for servo data from Teensy
     std::string fn = service.logPath + "log_servo.txt";
-    logfile = fopen(fn.c_str(), "w");
+    logfile = logRow.open(fn, "%lu.%03ld %d %d %d  %d %d %d  %d %d %d  %d %d %d %d %d %d\n");
+    if (logfile == nullptr)
+      return;
     fprintf(logfile, "%% Servo logfile\n");
     fprintf(logfile, "%% 1 \tTime (sec)\n");
     fprintf(logfile, "%% 2,3,4 \tservo 1: enabled, position, velocity\n");
@@ -58,7 +64,9 @@ void CServo::setup()
     fprintf(logfile, "%% 11,12,13 \tservo 1: enabled, position, velocity\n");
     fprintf(logfile, "%% 14,15,16 \tservo 1: enabled, position, velocity\n");
     fn = service.logPath + "log_servo_ctrl.txt";
-    logfileCtrl = fopen(fn.c_str(), "w");
+    logfileCtrl = logCtrlRow.open(fn, "%lu.%03ld %d %d %d\n");
+    if (logfileCtrl == nullptr)
+      return;
     fprintf(logfileCtrl, "%% Servo commands logfile\n");
     fprintf(logfileCtrl, "%% 1 \tTime (sec)\n");
     fprintf(logfileCtrl, "%% 2 \tServo number\n");
@@ -72,13 +80,18 @@ void CServo::setServo(int servo, bool enabled, int position, int velocity)
   char s[MSL];
   UTime t("now");
   if (enabled)
+  { // latest position for this servo wins
     snprintf(s, MSL, "servo %d %d %d\n", servo, position, velocity);
+    teensy1.sendLatest(s, 2);
+  }
   else
+  { // disable must get through
     snprintf(s, MSL, "servo %d 10000 0\n", servo);
-  teensy1.send(s);
+    teensy1.send(s);
+  }
   if (logfileCtrl != nullptr)
   {
-    fprintf(logfileCtrl, "%lu.%03ld %d %d %d\n",
+    logCtrlRow.add(logfileCtrl,
             t.getSec(), t.getMilisec(),
             enabled, position, velocity);
   }
@@ -97,19 +110,24 @@ void CServo::terminate()
 bool CServo::decode(const char* msg, UTime & msgTime)
 {
   bool used = true;
-  const char * p1 = msg;
-  if (strncmp(p1, "svo ", 4) == 0)
+  if (strncmp(msg, "svo ", 4) == 0)
   {
-    if (strlen(p1) > 4)
-      p1 += 4;
-    else
+    UFields f(msg);
+    int v[5][3];
+    for (int i = 0; i < 5; i++)
+    {
+      f.get(v[i][0]);
+      f.get(v[i][1]);
+      f.get(v[i][2]);
+    }
+    if (not f.isOK())
       return false;
     updTime = msgTime;
     for (int i = 0; i < 5; i++)
     {
-      servo_enabled[i] = strtol(p1, (char**)&p1, 10);
-      servo_position[i] = strtol(p1, (char**)&p1, 10);
-      servo_velocity[i] = strtol(p1, (char**)&p1, 10);
+      servo_enabled[i] = v[i][0];
+      servo_position[i] = v[i][1];
+      servo_velocity[i] = v[i][2];
     }
     // notify users of a new update
     updateCnt++;
@@ -125,7 +143,7 @@ void CServo::toLog()
 {
   if (logfile != nullptr and not service.stop)
   {
-    fprintf(logfile, "%lu.%03ld %d %d %d  %d %d %d  %d %d %d  %d %d %d %d %d %d\n",
+    logRow.add(logfile,
             updTime.getSec(), updTime.getMilisec(),
             servo_enabled[0], servo_position[0], servo_velocity[0],
             servo_enabled[1], servo_position[1], servo_velocity[1],
@@ -25,6 +25,7 @@
 #define CSERVO_H
 
 #include "utime.h"
+#include "ulogger.h"
 
 using namespace std;
 
@@ -66,6 +67,9 @@ private:
   bool toConsole = false;
   FILE * logfile = nullptr;
   FILE * logfileCtrl = nullptr;
+  /// row formats
+  ULogStream logRow;
+  ULogStream logCtrlRow;
 };
 
 /**
@@ -32,6 +32,8 @@
 #include "cmixer.h"
 #include "sgpiod.h"
 #include "astatemachine.h"
+#include "steensy.h"
+#include "uclock.h"
 
 int main(int argc, char **argv)
 { // prepare all modules and start data flow
@@ -44,10 +46,13 @@ int main(int argc, char **argv)
     gpio.setPin(16, 1);
     // run the planned missions
     state_machine.run();
+    // a recorded session is replayed to the end
+    while (teensy1.replaying and not service.stop)
+      clockService.sleepUs(10000);
     //
     mixer.setVelocity(0.0);
     mixer.setTurnrate(0.0);
-    sleep(1); // to allow robot to stop
+    clockService.sleepUs(1000000); // to allow robot to stop
     // turn off led 16
     gpio.setPin(16, 0);
   }
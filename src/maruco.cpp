@@ -59,7 +59,7 @@ void MArUco::setup()
   if (ini["aruco"]["log"] == "true")
   { // open logfile
     std::string fn = service.logPath + "log_aruco.txt";
-    logfile = fopen(fn.c_str(), "w");
+    logfile = service.openLog(fn);
     fprintf(logfile, "%% Vision activity (%s)\n", fn.c_str());
     fprintf(logfile, "%% 1 \tTime (sec)\n");
     fprintf(logfile, "%% 2 \tDetected marker in this image\n");
@@ -28,6 +28,8 @@
 #include <math.h>
 #include "sencoder.h"
 #include "medge.h"
+#include "uthreads.h"
+#include "uloopstat.h"
 #include "sencoder.h"
 #include "steensy.h"
 #include "uservice.h"
@@ -74,11 +76,14 @@ void MEdge::setup()
   sensorWidth = strtod(ini["edge"]["sensorWidth"].c_str(), nullptr);
   //
   // initiate data log for this module
-  toConsole = ini["edge"]["print"] == "true";
-  if (ini["edge"]["log"] == "true")
-  { // open logfile
+  printCh = logChannels.add("edge.print", ini["edge"]["print"] == "true");
+  logCh = logChannels.add("edge.log", ini["edge"]["log"] == "true" or logger.recorder);
+  logCh->setOpen([this]()
+  { // open logfiles when the channel is first on
     std::string fn = service.logPath + "log_edge.txt";
-    logfile = fopen(fn.c_str(), "w");
+    logfile = logRow.open(fn, "%lu.%04ld %d %.3f %.3f %.4f\n");
+    if (logfile == nullptr)
+      return;
     fprintf(logfile, "%% Edge sensor logfile %s\n", fn.c_str());
     // save calibration values as text
     fprintf(logfile, "%% \tCalib white");
@@ -100,11 +105,11 @@ void MEdge::setup()
     fprintf(logfile, "%% 5 \tLine width (m)\n");
     if (not calibrationValid)
       fprintf(logfile, "\n ### Calibration is not valid - see values above\n");
-  }
-  if (ini["edge"]["log"] == "true")
-  { // open logfile
-    std::string fn = service.logPath + "log_edge_normalized.txt";
-    logfileNorm = fopen(fn.c_str(), "w");
+    // and the normalized values (same log channel)
+    fn = service.logPath + "log_edge_normalized.txt";
+    logfileNorm = logNormRow.open(fn, "%lu.%04ld %d %d %d %d %d %d %d %d  %.4f\n");
+    if (logfileNorm == nullptr)
+      return;
     fprintf(logfileNorm, "%% Edge sensor logfile normalized '%s'\n", fn.c_str());
     // and extracted values
     fprintf(logfileNorm, "%% 1 \tTime (sec)\n");
@@ -113,8 +118,8 @@ void MEdge::setup()
     fprintf(logfileNorm, "%% 10 \tLine width (m)\n");
     if (not calibrationValid)
       fprintf(logfile, "\n ### Calibration is not valid - see log_edge.txt or robot.ini\n");
-  }
-  th1 = new std::thread(runObj, this);
+  });
+  th1 = threads.spawn("edge", runObj, this);
 }
 
 void MEdge::terminate()
@@ -140,7 +145,7 @@ void MEdge::findEdge()
   // make calibrated values and scale to 1000
   for (int i = 0; i < 8; i++)
   {
-    int v = sedge.edgeRaw[i] - calibBlack[i];
+    int v = raw.edgeRaw[i] - calibBlack[i];
     v = (v * 1000) / (calibWhite[i] - calibBlack[i]);
     if (v > 1000)
       v = 1000;
@@ -213,6 +218,7 @@ void MEdge::findEdge()
 void MEdge::run()
 {
   int loop = 0;
+  ULoopProbe * probe = loopStat.probe("edge");
   while (not service.stop)
   {
     if ((sensorCalibrateWhite or sensorCalibrateBlack) and
@@ -225,10 +231,15 @@ void MEdge::run()
           sensorCalibrateValue[i] = 0;
       }
     }
-    if (sedge.updateCnt != lineUpdateCnt)
+    // wait for new values (timeout to check for stop)
+    int n = sedge.topic.wait(raw, lineSeq, 0.1);
+    if (n > 0)
     { // new values are available
-      updTime = sedge.updTime;
-      lineUpdateCnt = sedge.updateCnt;
+      probe->begin();
+      probe->missed(n - 1);
+      updTime = raw.updTime;
+      // time from decode to use
+      teensy1.linkStat.consumed("liv");
       loop++;
       // calculate edge position
       if (not(sensorCalibrateWhite or sensorCalibrateBlack))
@@ -236,12 +247,19 @@ void MEdge::run()
         findEdge();
         // inform users of update
         updateCnt++;
+        UEdgeSample es;
+        es.updTime = updTime;
+        es.edgeValid = edgeValid;
+        es.leftEdge = leftEdge;
+        es.rightEdge = rightEdge;
+        es.width = width;
+        topic.publish(es);
       }
       else if (sensorCalibrateCount > 0)
       { // calibration active
         for (int i = 0; i < 8; i++)
         { // add new value
-          sensorCalibrateValue[i] += sedge.edgeRaw[i];
+          sensorCalibrateValue[i] += raw.edgeRaw[i];
         }
         sensorCalibrateCount--;
         if (sensorCalibrateCount <= 0)
@@ -279,10 +297,8 @@ void MEdge::run()
           }
         }
       }
+      probe->end();
     }
-    else
-      // no new value; just wait a bit (1000 = 1ms)
-      usleep(2000);
   }
   if (logfile != nullptr)
   {
@@ -298,24 +314,22 @@ void MEdge::toLog()
 {
   if (not service.stop)
   {
-    if (logfile != nullptr)
+    if (logCh->active() and logfile != nullptr)
     { // log_line sensor detection
-      fprintf(logfile, "%lu.%04ld %d %.3f %.3f %.4f\n", updTime.getSec(), updTime.getMicrosec() / 100,
+      logRow.add(logfile, updTime.getSec(), updTime.getMicrosec() / 100,
               edgeValid, leftEdge, rightEdge, leftEdge - rightEdge);
+      if (logfileNorm != nullptr)
+        logNormRow.add(logfileNorm,
+                raw.updTime.getSec(),
+                raw.updTime.getMicrosec() / 100,
+                ls[0], ls[1], ls[2], ls[3],
+                ls[4], ls[5], ls[6], ls[7], leftEdge - rightEdge);
     }
-    if (toConsole)
+    if (printCh != nullptr and printCh->active())
     { // debug print to console
       printf("%lu.%04ld %d %.4f %.4f %.4f\n", updTime.getSec(), updTime.getMicrosec() / 100,
              edgeValid, leftEdge, rightEdge, leftEdge - rightEdge);
     }
-    if (logfileNorm != nullptr)
-    {
-      fprintf(logfileNorm, "%lu.%04ld %d %d %d %d %d %d %d %d  %.4f\n",
-              sedge.updTime.getSec(),
-              sedge.updTime.getMicrosec() / 100,
-              ls[0], ls[1], ls[2], ls[3],
-              ls[4], ls[5], ls[6], ls[7], leftEdge - rightEdge);
-    }
   }
 }
 
@@ -25,13 +25,28 @@
 
 #include "sedge.h"
 #include "utime.h"
+#include "utopic.h"
+#include "ulogger.h"
 
 using namespace std;
 
+/**
+ * Edge sample published to users (edge control) */
+class UEdgeSample
+{
+public:
+  UTime updTime;
+  bool edgeValid = false;
+  float leftEdge = 0.0;
+  float rightEdge = 0.0;
+  float width = 0.0;
+};
+
 /**
  * Class that extrach edge position of the line sensor
  * as well as crossing lines.
- * An updateCnt is incremented at every update
+ * An updateCnt is incremented at every update,
+ * and the edge values are published on the edge topic
  * */
 class MEdge
 {
@@ -71,6 +86,8 @@ public:
   // flag for doing a white line sensor calibration
   bool sensorCalibrateWhite = false;
   bool sensorCalibrateBlack = false;
+  /// new edge values are published here
+  UTopic<UEdgeSample> topic;
 
 private:
   /// private stuff
@@ -84,11 +101,16 @@ private:
   void toLog();
   //
   int ls[8] = {0};
-  int lineUpdateCnt = 0;
-  // debug print
-  bool toConsole = false;
+  /// latest line sensor sample
+  UEdgeRawSample raw;
+  uint64_t lineSeq = 0;
+  /// log and print channels (can be switched while running)
+  ULogChannel * logCh = nullptr;
+  ULogChannel * printCh = nullptr;
   FILE *logfile = nullptr;
   FILE *logfileNorm = nullptr;
+  ULogStream logRow;
+  ULogStream logNormRow;
   std::thread *th1;
   // mostly debug
   int eeL, ddL, eeR, ddR;
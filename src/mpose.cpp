@@ -28,10 +28,13 @@
 #include <math.h>
 #include "sencoder.h"
 #include "mpose.h"
+#include "uthreads.h"
+#include "uloopstat.h"
 #include "sencoder.h"
 #include "steensy.h"
 #include "uservice.h"
 #include "cmixer.h"
+#include "cpipeline.h"
 
 // create value
 MPose pose;
@@ -55,11 +58,14 @@ void MPose::setup()
   wheelBase = strtof(ini["pose"]["wheelBase"].c_str(), nullptr);
   distPerTick = (wheelDiameter * M_PI) / gear / encTickPerRev;
   //
-  toConsole = ini["pose"]["print"] == "true";
-  if (ini["pose"]["log"] == "true")
-  { // open logfile
+  printCh = logChannels.add("pose.print", ini["pose"]["print"] == "true");
+  logCh = logChannels.add("pose.log", ini["pose"]["log"] == "true" or logger.recorder);
+  logCh->setOpen([this]()
+  { // open logfile when the channel is first on
     std::string fn = service.logPath + "log_pose.txt";
-    logfile = fopen(fn.c_str(), "w");
+    logfile = logRow.open(fn, "%lu.%04ld %.4f %.4f %.4f %.5f %.3f %.3f %.3f %.4f %.3f %.4f\n");
+    if (logfile == nullptr)
+      return;
     fprintf(logfile, "%% Pose and velocity (%s)\n", fn.c_str());
     fprintf(logfile, "%% 1 \tTime (sec)\n");
     fprintf(logfile, "%% 2,3 \tVelocity left, right (m/s)\n");
@@ -72,15 +78,21 @@ void MPose::setup()
     fprintf(logfile, "%% 11 \tTurned angle (rad) - signed\n");
     // and absolute pose
     fn = service.logPath + "log_pose_abs.txt";
-    logAbs = fopen(fn.c_str(), "w");
+    logAbs = logAbsRow.open(fn, "%lu.%04ld %.3f %.3f %.4f %.3f %.4f\n");
+    if (logAbs == nullptr)
+      return;
     fprintf(logAbs, "%% Pose without folding and reset (%s)\n", fn.c_str());
     fprintf(logAbs, "%% 1 \tTime (sec)\n");
     fprintf(logAbs, "%% 2,3 \tPosition x,y (m)\n");
     fprintf(logAbs, "%% 4 \theading (rad)\n");
     fprintf(logAbs, "%% 5 \tDriven distance (m) - signed\n");
     fprintf(logAbs, "%% 6 \tTurned angle (rad) - signed\n");
-  }
-  th1 = new std::thread(runObj, this);
+  });
+  encTimeLast[0].now();
+  encTimeLast[1].now();
+  // the control pipeline does the update, if enabled
+  if (not pipeline.enabled)
+    th1 = threads.spawn("pose", runObj, this);
 }
 
 
@@ -91,154 +103,212 @@ void MPose::terminate()
     th1->join();
     th1 = nullptr;
   }
+  if (logfile != nullptr)
+  {
+    fclose(logfile);
+    logfile = nullptr;
+  }
+  if (logAbs != nullptr)
+  {
+    fclose(logAbs);
+    logAbs = nullptr;
+  }
+  if (encoderMissed > 0)
+    printf("# MPose:: %d encoder samples missed (newer arrived before use)\n", encoderMissed);
 }
 
 
 void MPose::run()
 {
 //   printf("# MPose::run started\n");
-  int loop = 0;
-  int64_t encLast[2] = {0};
-  UTime t("now"); // time of update
-  UTime encTimeLast[2];
-  encTimeLast[0].now();
-  encTimeLast[1].now();
-  float dd[2]; // wheel moved since last update
+  encoderSeq = encoder.topic.getSeq();
+  ULoopProbe * probe = loopStat.probe("pose");
   while (not service.stop)
   {
-    if (encoder.updateCnt != encoderUpdateCnt)
+    UEncSample es;
+    UTime encPublished;
+    // wait for new encoder values (timeout to check for stop)
+    int n = encoder.topic.wait(es, encoderSeq, 0.1, &encPublished);
+    if (n > 0)
     {
-      encoderUpdateCnt = encoder.updateCnt;
-      // get new data
-      t = encoder.encTime;
-      int64_t enc[2] = {encoder.enc[0], encoder.enc[1]};
-      // debug
+      probe->begin();
+      encoderMissed += n - 1;
+      probe->missed(n - 1);
+      update(es, encPublished);
+      probe->end();
+    }
+  }
+}
+
+void MPose::update(const UEncSample & es, UTime & encPublished)
+{
+  // get new data
+  UTime t = es.encTime; // time of update
+  int64_t enc[2] = {es.enc[0], es.enc[1]};
+  float dd[2]; // wheel moved since last update
+  // time from decode to use
+  teensy1.linkStat.consumed("enc");
+  // debug
 //       printf("# Pose got new encoder data %d,%d, at %.3fs\n",
 //              enc[0], enc[1], t.getDecSec(teensy1.justConnectedTime));
-      // debug end
-      if (loop < 2)
-      { // first two updates take last value as current
-        encLast[0] = enc[0]; // left
-        encLast[1] = enc[1]; // right
-      }
-      float dtt = 1.0; // in seconds - for turnrate
-      float dt[2];
-      int64_t de[2];
-      for (int i = 0; i < 2; i++)
-      { // find movement in time and distance for each wheel
-        dt[i] = t - encTimeLast[i]; // time
-        if (dt[i] < dtt)
-        { // the minimum update time (the other wheel may be stationary)
-          dtt = dt[i];
-        }
-        // left wheel - gives wrong results on Teensy
-        // so calculate folding explicitly
-        de[i] = enc[i] - encLast[i];
-        if (llabs(de[i]) > 1000)
-        { // given up in calculating folding around MAXINT,
-          // so one sample of zero change should be OK.
-          de[i] = 0;
-        }
-        // distance traveled since last
-        dd[i] = float(de[i]) * distPerTick; // encoder ticks
-        if (enc[i] != encLast[i])
-        { // wheel has moved since last update
-          encLast[i] = enc[i];
-          encTimeLast[i] = t;
-          wheelVel[i] = dd[i]/dt[i];
-        }
-        else
-        { // no tick change since last update
-          // update (reduce) velocity waiting for next tick
-          wheelVel[i] = copysignf(1.0, wheelVel[i]) * distPerTick/dt[i];
-        }
-      }
-      // turned angle in radians
-      // dh is positive for CCV, i.e. when right wheel (dd[1]) goes faster
-      float dh = (dd[1] - dd[0])/wheelBase;
-      // moved distance in meters
-      float ds = (dd[0] + dd[1])/2.0;
-      // update position
-      // both relative (x,y,h) and absolute (x2,y2,h2)
-      h += dh/2.0;
-      h2 += dh/2.0;
-      x += cosf(h) * ds;
-      y += sinf(h) * ds;
-      x2 += cosf(h2) * ds;
-      y2 += sinf(h2) * ds;
-      h += dh/2.0;
-      h2 += dh/2.0;
-      // fold angle
-      if (h > M_PI)
-        h -= M_PI * 2;
-      else if (h < -M_PI)
-        h += M_PI * 2;
-      if (h2 > M_PI)
-        h2 -= M_PI * 2;
-      else if (h2 < -M_PI)
-        h2 += M_PI * 2;
-      // update traveled distance and turned angle
-      dist += ds;
-      dist2 += ds;
-      //
-      turned += dh;
-      turned2 += dh;
-      //
-      turnrate = dh/dtt;
-      robVel = ds/dtt;
-      const float minTurnrate = 0.001;
-      if (fabs(turnrate) > minTurnrate)
-        // positive radius for positive turn-rate
-        turnRadius = robVel / turnrate;
-      else
-        // max radius is limited to minimum about 30m (at low speed (3cm/s))
-        // to avoid infinity
-        turnRadius = robVel / minTurnrate * copysignf(1.0, turnrate);
-      //
-      poseTime = t;
-      updateCnt++;
-      // finished making a new pose
-      toLog();
-      loop++;
+  // debug end
+  if (loop < 2)
+  { // first two updates take last value as current
+    encLast[0] = enc[0]; // left
+    encLast[1] = enc[1]; // right
+  }
+  float dtt = 1.0; // in seconds - for turnrate
+  float dt[2];
+  int64_t de[2];
+  for (int i = 0; i < 2; i++)
+  { // find movement in time and distance for each wheel
+    dt[i] = t - encTimeLast[i]; // time
+    if (dt[i] < dtt)
+    { // the minimum update time (the other wheel may be stationary)
+      dtt = dt[i];
+    }
+    // left wheel - gives wrong results on Teensy
+    // so calculate folding explicitly
+    de[i] = enc[i] - encLast[i];
+    if (llabs(de[i]) > 1000)
+    { // given up in calculating folding around MAXINT,
+      // so one sample of zero change should be OK.
+      de[i] = 0;
+    }
+    // distance traveled since last
+    dd[i] = float(de[i]) * distPerTick; // encoder ticks
+    if (enc[i] != encLast[i])
+    { // wheel has moved since last update
+      encLast[i] = enc[i];
+      encTimeLast[i] = t;
+      wheelVel[i] = dd[i]/dt[i];
     }
     else
-      // just wait a bit (1ms)
-      usleep(1000);
+    { // no tick change since last update
+      // update (reduce) velocity waiting for next tick
+      wheelVel[i] = copysignf(1.0, wheelVel[i]) * distPerTick/dt[i];
+    }
   }
-  if (logfile != nullptr)
-  {
-    fclose(logfile);
+  // turned angle in radians
+  // dh is positive for CCV, i.e. when right wheel (dd[1]) goes faster
+  float dh = (dd[1] - dd[0])/wheelBase;
+  // moved distance in meters
+  float ds = (dd[0] + dd[1])/2.0;
+  // a reset is published with this pose
+  poseLock.lock();
+  if (resetRequested.exchange(false))
+  { // requested by resetPose()
+    x = 0.0;
+    y = 0.0;
+    h = 0.0;
+    dist = 0.0;
+    turned = 0.0;
   }
+  // update position
+  // both relative (x,y,h) and absolute (x2,y2,h2)
+  h += dh/2.0;
+  h2 += dh/2.0;
+  x += cosf(h) * ds;
+  y += sinf(h) * ds;
+  x2 += cosf(h2) * ds;
+  y2 += sinf(h2) * ds;
+  h += dh/2.0;
+  h2 += dh/2.0;
+  // fold angle
+  if (h > M_PI)
+    h -= M_PI * 2;
+  else if (h < -M_PI)
+    h += M_PI * 2;
+  if (h2 > M_PI)
+    h2 -= M_PI * 2;
+  else if (h2 < -M_PI)
+    h2 += M_PI * 2;
+  // update traveled distance and turned angle
+  dist += ds;
+  dist2 += ds;
+  //
+  turned += dh;
+  turned2 += dh;
+  //
+  turnrate = dh/dtt;
+  robVel = ds/dtt;
+  const float minTurnrate = 0.001;
+  if (fabs(turnrate) > minTurnrate)
+    // positive radius for positive turn-rate
+    turnRadius = robVel / turnrate;
+  else
+    // max radius is limited to minimum about 30m (at low speed (3cm/s))
+    // to avoid infinity
+    turnRadius = robVel / minTurnrate * copysignf(1.0, turnrate);
+  //
+  poseTime = t;
+  updateCnt++;
+  UPoseSample ps;
+  ps.poseTime = t;
+  ps.encPublished = encPublished;
+  ps.x = x;
+  ps.y = y;
+  ps.h = h;
+  ps.dist = dist;
+  ps.turned = turned;
+  ps.wheelVel[0] = wheelVel[0];
+  ps.wheelVel[1] = wheelVel[1];
+  ps.turnrate = turnrate;
+  ps.robVel = robVel;
+  topic.publish(ps);
+  poseLock.unlock();
+  // finished making a new pose
+  toLog();
+  loop++;
 }
 
 void MPose::resetPose()
-{
-  x = 0.0;
-  y = 0.0;
-  h = 0.0;
-  dist = 0.0;
-  turned = 0.0;
+{ // let the pose thread do the reset, to get a consistent pose
+  uint64_t seq = topic.getSeq();
+  resetRequested = true;
   mixer.setDesiredHeading(0);
+  // wait for the pose with the reset (encoder updates are a few ms apart)
+  UPoseSample ps;
+  UTime t("now");
+  while (resetRequested and not service.stop and t.getTimePassed() < 0.1)
+    topic.wait(ps, seq, 0.02);
+  poseLock.lock();
+  if (resetRequested.exchange(false))
+  { // no encoder data, so publish the reset pose from here
+    x = 0.0;
+    y = 0.0;
+    h = 0.0;
+    dist = 0.0;
+    turned = 0.0;
+    ps = topic.read();
+    ps.x = 0.0;
+    ps.y = 0.0;
+    ps.h = 0.0;
+    ps.dist = 0.0;
+    ps.turned = 0.0;
+    topic.publish(ps);
+  }
+  // else the pose thread has published the reset pose (it holds the lock until then)
+  poseLock.unlock();
 }
 
 void MPose::toLog()
 {
   if (not service.stop)
   {
-    if (logfile != nullptr)
+    if (logCh->active() and logfile != nullptr)
     { // log_pose
-      fprintf(logfile, "%lu.%04ld %.4f %.4f %.4f %.5f %.3f %.3f %.3f %.4f %.3f %.4f\n", poseTime.getSec(), poseTime.getMicrosec()/100,
+      logRow.add(logfile, poseTime.getSec(), poseTime.getMicrosec()/100,
               wheelVel[0], wheelVel[1], robVel,
               turnrate, turnRadius,
               x, y, h, dist, turned);
+      // log_absolute pose
+      if (logAbs != nullptr)
+        logAbsRow.add(logAbs,
+                poseTime.getSec(), poseTime.getMicrosec()/100,
+                x2, y2, h2, dist2, turned2);
     }
-    if (logAbs != nullptr)
-    { // log_absolute pose
-      fprintf(logAbs, "%lu.%04ld %.3f %.3f %.4f %.3f %.4f\n",
-              poseTime.getSec(), poseTime.getMicrosec()/100,
-              x2, y2, h2, dist2, turned2);
-    }
-    if (toConsole)
+    if (printCh != nullptr and printCh->active())
     { // print_pose
       printf("%lu.%04ld %.4f %.4f %.4f %.5f %.3f %.3f %.3f %.4f %.3f %.4f\n", poseTime.getSec(), poseTime.getMicrosec()/100,
               wheelVel[0], wheelVel[1], robVel,
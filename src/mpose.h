@@ -26,10 +26,31 @@
 
 #include "sencoder.h"
 #include "utime.h"
+#include "utopic.h"
+#include "ulogger.h"
 #include "thread"
+#include <atomic>
+#include <mutex>
 
 using namespace std;
 
+/**
+ * Pose sample published to users (e.g. motor and heading control) */
+class UPoseSample
+{
+public:
+  /// time of the encoder update
+  UTime poseTime;
+  /// time the encoder values were published (decoded)
+  UTime encPublished;
+  float x = 0.0, y = 0.0, h = 0.0;
+  float dist = 0;
+  float turned = 0;
+  float wheelVel[2] = {0.0};
+  float turnrate = 0.0;
+  float robVel = 0.0;
+};
+
 /**
  * Class that update robot based on wheel encoder update.
  * The result is odometry coordinate update
@@ -37,7 +58,10 @@ using namespace std;
  *   h (heading)
  *   time of last encoder update (poseTime)
  *   wheel velocity (eheelVel)
- * An updateCnt is incremented at every update
+ * An updateCnt is incremented at every update,
+ * and the new pose is published on the pose topic.
+ * Other threads should use a copy from the topic (topic.read()),
+ * as the public values are updated one at a time.
  * */
 class MPose
 {
@@ -47,11 +71,21 @@ public:
   /**
    * thread to do updates, when new data is available */
   void run();
+  /**
+   * Calculate new pose from new encoder values,
+   * called by run() or by the control pipeline.
+   * \param es is the new encoder sample
+   * \param encPublished is the time the encoder sample was published */
+  void update(const UEncSample & es, UTime & encPublished);
   /**
    * terminate */
   void terminate();
   /**
-   * Set pose to 0,0,0 */
+   * Set pose to 0,0,0 (and distance and turned angle to 0).
+   * The reset is done by the pose thread at the next encoder update,
+   * this call waits for that pose to be published (or, if no encoder data
+   * arrive, publishes the reset pose itself), so that a following
+   * topic.read() gets the reset pose */
   void resetPose();
 
 protected:
@@ -78,6 +112,8 @@ public:
   float robVel = 0.0;
   // new pose is calculated count
   int updateCnt = 0;
+  /// new pose is published here
+  UTopic<UPoseSample> topic;
 
 private:
   /// private stuff
@@ -91,15 +127,29 @@ private:
   void toLog();
   // support variables
   bool firstEnc = true;
-  /// Debug print
-  bool toConsole = false;
+  /// log and print channels (can be switched while running)
+  ULogChannel * logCh = nullptr;
+  ULogChannel * printCh = nullptr;
   /// Logfile - most details
   FILE * logfile = nullptr;
   // just absolute pose (and distance)
   FILE * logAbs = nullptr;
-  std::thread * th1;
-  // source data iteration
-  int encoderUpdateCnt = 0;
+  /// row formats
+  ULogStream logRow;
+  ULogStream logAbsRow;
+  std::thread * th1 = nullptr;
+  /// update count and last encoder values (and their time)
+  int loop = 0;
+  int64_t encLast[2] = {0};
+  UTime encTimeLast[2];
+  /// reset requested by resetPose()
+  std::atomic<bool> resetRequested{false};
+  /// held from the reset test until the pose is published
+  std::mutex poseLock;
+  // source data sequence number
+  uint64_t encoderSeq = 0;
+  /// encoder samples not used, as a newer arrived first
+  int encoderMissed = 0;
   /// pose that can't be reset (for debug/map use)
   float x2 = 0.0, y2 = 0.0, h2 = 0.0;
   float dist2 = 0;
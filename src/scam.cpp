@@ -33,7 +33,10 @@
 #include <iostream>
 
 #include "scam.h"
+#include "uthreads.h"
+#include "uloopstat.h"
 #include "uservice.h"
+#include "uclock.h"
 
 // create connection object
 UCam cam;
@@ -105,7 +108,7 @@ void UCam::setup()
     if (ini["camera"]["log"] == "true")
     { // open logfile
       std::string fn = service.logPath + "log_camera.txt";
-      logfile = fopen(fn.c_str(), "w");
+      logfile = service.openLog(fn);
       fprintf(logfile, "%% Camera (not vision) - logfile\n");
       fprintf(logfile, "%% connection to camera %d\n", device);
       fprintf(logfile, "%% Image path '%s'\n", ini["camera"]["imagepath"].c_str());
@@ -157,7 +160,7 @@ void UCam::setup()
     }
     if (cam.isOpened())
       // start capturing images
-      th1 = new std::thread(runObj, this);
+      th1 = threads.spawn("cam", runObj, this);
   }
   else
     printf("# UCam:: disabled in robot.ini\n");
@@ -184,8 +187,10 @@ void UCam::run()
 {
   printf("# Camera is running (to stabilize illumination)\n");
   toLog("Camera open");
+  ULoopProbe * probe = loopStat.probe("cam");
   while (not service.stop and not stopCam)
   { // wait for reply
+    probe->begin();
     if (getNewFrame and not gotFrame and frameCnt > 10)
     {
       cam.read(frame);
@@ -203,6 +208,7 @@ void UCam::run()
       cam.grab();
     }
     frameCnt++;
+    probe->end();
 //    if (frameCnt % 100 == 3)
 //      printf("# cam got frame %d/%d\n", gotFrameCnt, frameCnt);
   }
@@ -226,7 +232,7 @@ cv::Mat UCam::getFrameRaw()
   t.now();
   while (not gotFrame and t.getTimePassed() < 5.0)
   { // wait for frame (or timeout of 1 second)
-    usleep(3000);
+    clockService.sleepUs(3000);
   }
   if (gotFrame)
     ; // printf("# Got an image frame\n");
@@ -27,6 +27,8 @@
 #include "sdist.h"
 #include "steensy.h"
 #include "uservice.h"
+#include "ufields.h"
+#include "usubscribe.h"
 // create value
 SIrDist dist;
 
@@ -69,15 +71,15 @@ void SIrDist::setup()
   char s[MSL];
   snprintf(s, MSL, "irc %d %d %d %d 1\n", ir13cm[0], ir50cm[0], ir13cm[1], ir50cm[1]);
   teensy1.send(s);
-  // subscribe to sensor data
-  std::string ss = "sub ir " + ini["dist"]["rate_ms"] + "\n";
-  teensy1.send(ss.c_str());
   // logfiles
-  toConsole = ini["dist"]["print"] == "true";
-  if (ini["dist"]["log"] == "true")
-  { // open logfile
+  printCh = logChannels.add("dist.print", ini["dist"]["print"] == "true");
+  logCh = logChannels.add("dist.log", ini["dist"]["log"] == "true" or logger.recorder);
+  logCh->setOpen([this]()
+  { // open logfile when the channel is first on
     std::string fn = service.logPath + "log_irdist.txt";
-    logfile = fopen(fn.c_str(), "w");
+    logfile = logRow.open(fn, "%lu.%04ld %.3f %.3f %d %d\n");
+    if (logfile == nullptr)
+      return;
     fprintf(logfile, "%% IR distance sensor logfile %s\n", fn.c_str());
     fprintf(logfile, "%% 1 \tTime (sec)\n");
     fprintf(logfile, "%% 2,3 \tsensor 1, 2 (m)\n");
@@ -87,7 +89,19 @@ void SIrDist::setup()
     fprintf(logfile, "%% sensor 1 sharp calib: 13cm: %d, 50cm: %d\n", ir13cm[0], ir50cm[0]);
     fprintf(logfile, "%% sensor 2 sharp calib: 13cm: %d, 50cm: %d\n", ir13cm[1], ir50cm[1]);
     fprintf(logfile, "%% sensor ultrasound URM09 factor (both): %f\n", urm09factor);
-  }
+  });
+  // decode distance sensor messages
+  teensy1.addDecoder("ir", [](const char * msg, UTime & msgTime)
+                     { return ::dist.decode(msg, msgTime); });
+  teensy1.addBinDecoder(BIN_IR, [](uint8_t type, const uint8_t * data, int n, UTime & msgTime)
+                        { return ::dist.decodeBin(type, data, n, msgTime); });
+  // subscribe to sensor data, or leave it to the users (like the mission).
+  // Users reading the sensor on demand must wait for new data after
+  // the request (dist.topic.getSeq()), else the distance may be old.
+  if (not ini["dist"].has("on_demand"))
+    ini["dist"]["on_demand"] = "false";
+  if (ini["dist"]["on_demand"] != "true")
+    subscribe.request("ir", strtol(ini["dist"]["rate_ms"].c_str(), nullptr, 10), "dist");
 }
 
 void SIrDist::terminate()
@@ -101,87 +115,115 @@ void SIrDist::terminate()
 bool SIrDist::decode(const char* msg, UTime & msgTime)
 {
   bool used = true;
-  const char * p1 = msg;
-  if (strncmp(p1, "ir ", 3) == 0)
+  if (strncmp(msg, "ir ", 3) == 0)
   {
-    if (strlen(p1) > 3)
-      p1 += 3;
-    else
-      return false;
-    updTime = msgTime;
+    UFields f(msg);
+    UBinIr d;
     // get values
-    dist[0] = strtof(p1, (char**)&p1); // already converted by Teensy as sharp sensor
-    dist[1] = strtof(p1, (char**)&p1);
-    distAD[0] = strtol(p1, (char**)&p1, 10);
-    distAD[1] = strtol(p1, (char**)&p1, 10);
-    // could be an URM09 sensor
-    if (sensortype[0] == URM09)
-      dist[0] = distAD[0] * urm09factor;
-    if (sensortype[1] == URM09)
-      dist[1] = distAD[1] * urm09factor;
-    // notify users of a new update
-    updateCnt++;
-    // save to log_encoder_pose
-    toLog();
-    // calibration
-    if (inCalibration)
+    f.get(d.dist[0]); // already converted by Teensy as sharp sensor
+    f.get(d.dist[1]);
+    f.get(d.ad[0]);
+    f.get(d.ad[1]);
+    if (not f.isOK())
+      return false;
+    newData(d, msgTime);
+  }
+  else
+    used = false;
+  return used;
+}
+
+bool SIrDist::decodeBin(uint8_t type, const uint8_t * data, int n, UTime & msgTime)
+{
+  bool used = type == BIN_IR and n == sizeof(UBinIr);
+  if (used)
+  {
+    UBinIr d;
+    memcpy(&d, data, n);
+    newData(d, msgTime);
+  }
+  return used;
+}
+
+void SIrDist::newData(const UBinIr & d, UTime & msgTime)
+{
+  updTime = msgTime;
+  dist[0] = d.dist[0];
+  dist[1] = d.dist[1];
+  distAD[0] = d.ad[0];
+  distAD[1] = d.ad[1];
+  // could be an URM09 sensor
+  if (sensortype[0] == URM09)
+    dist[0] = distAD[0] * urm09factor;
+  if (sensortype[1] == URM09)
+    dist[1] = distAD[1] * urm09factor;
+  // notify users of a new update
+  updateCnt++;
+  UIrSample s;
+  s.updTime = updTime;
+  for (int i = 0; i < 2; i++)
+  {
+    s.dist[i] = dist[i];
+    s.distAD[i] = distAD[i];
+  }
+  topic.publish(s);
+  // save to log_encoder_pose
+  toLog();
+  // calibration
+  if (inCalibration)
+  {
+    if (calibSensor == 1)
+      calibSum += distAD[0];
+    else
+      calibSum += distAD[1];
+    calibCount++;
+    if (calibCount >= calibCountMax)
     {
       if (calibSensor == 1)
-        calibSum += distAD[0];
-      else
-        calibSum += distAD[1];
-      calibCount++;
-      if (calibCount >= calibCountMax)
       {
-        if (calibSensor == 1)
-        {
-          if (calibDist == 13)
-            ir13cm[0] = calibSum / calibCount;
-          else
-            ir50cm[0] = calibSum / calibCount;
-        }
+        if (calibDist == 13)
+          ir13cm[0] = calibSum / calibCount;
         else
-        {
-          if (calibDist == 13)
-            ir13cm[1] = calibSum / calibCount;
-          else
-            ir50cm[1] = calibSum / calibCount;
-        }
-        // save as new value to the ini structure
-        const int MSL = 100;
-        char s[MSL];
+          ir50cm[0] = calibSum / calibCount;
+      }
+      else
+      {
         if (calibDist == 13)
-        {
-          snprintf(s, MSL, "%d %d", ir13cm[0], ir13cm[1]);
-          ini["dist"]["ir13cm"] = s;
-        }
+          ir13cm[1] = calibSum / calibCount;
         else
-        {
-          snprintf(s, MSL, "%d %d", ir50cm[0], ir50cm[1]);
-          ini["dist"]["ir50cm"] = s;
-        }
-        //
-        inCalibration = false;
-        printf("# IR distance for sensor %d at %dcm finished: %s\n", calibSensor, calibDist, s);
+          ir50cm[1] = calibSum / calibCount;
       }
+      // save as new value to the ini structure
+      const int MSL = 100;
+      char s[MSL];
+      if (calibDist == 13)
+      {
+        snprintf(s, MSL, "%d %d", ir13cm[0], ir13cm[1]);
+        ini["dist"]["ir13cm"] = s;
+      }
+      else
+      {
+        snprintf(s, MSL, "%d %d", ir50cm[0], ir50cm[1]);
+        ini["dist"]["ir50cm"] = s;
+      }
+      //
+      inCalibration = false;
+      printf("# IR distance for sensor %d at %dcm finished: %s\n", calibSensor, calibDist, s);
     }
   }
-  else
-    used = false;
-  return used;
 }
 
 void SIrDist::toLog()
 {
   if (not service.stop)
   {
-    if (logfile != nullptr)
+    if (logCh->active() and logfile != nullptr)
     {
-      fprintf(logfile,"%lu.%04ld %.3f %.3f %d %d\n", updTime.getSec(), updTime.getMicrosec()/100,
+      logRow.add(logfile, updTime.getSec(), updTime.getMicrosec()/100,
               dist[0], dist[1],
               distAD[0], distAD[1]);
     }
-    if (toConsole)
+    if (printCh != nullptr and printCh->active())
     {
       printf("%lu.%04ld %.3f %.3f %d %d\n", updTime.getSec(), updTime.getMicrosec()/100,
               dist[0], dist[1],
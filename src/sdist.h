@@ -26,6 +26,20 @@
 
 
 #include "utime.h"
+#include "ubinlink.h"
+#include "utopic.h"
+#include "ulogchannel.h"
+#include "ulogger.h"
+
+/**
+ * IR distance sample published to users (e.g. mission) */
+class UIrSample
+{
+public:
+  UTime updTime;
+  float dist[2] = {0};
+  int distAD[2] = {0};
+};
 
 /**
  * Class to receive the IR (sharp 2Y0A21) sensor
@@ -43,6 +57,9 @@ public:
   /** decode an unpacked incoming messages
    * \returns true if the message us used */
   bool decode(const char * msg, UTime & msgTime);
+  /** decode a binary packet (BIN_IR)
+   * \returns true if the packet is used */
+  bool decodeBin(uint8_t type, const uint8_t * data, int n, UTime & msgTime);
   /**
    * terminate */
   void terminate();
@@ -57,6 +74,8 @@ public:
   float urm09factor;
   enum sensortypes {sharp, URM09};
   sensortypes sensortype[2];
+  /// new distance values are published here
+  UTopic<UIrSample> topic;
 
 public:
 //   mutex dataLock; // ensure consistency
@@ -64,9 +83,15 @@ public:
   void calibrate(int sensor, int distance_cm);
   bool inCalibration = false;
 private:
+  /** use new values from either text or binary message */
+  void newData(const UBinIr & d, UTime & msgTime);
   void toLog();
-  bool toConsole = false;
+  /// log and print channels (can be switched while running)
+  ULogChannel * logCh = nullptr;
+  ULogChannel * printCh = nullptr;
   FILE * logfile = nullptr;
+  /// row format
+  ULogStream logRow;
   //
   int calibSensor;
   int calibDist;
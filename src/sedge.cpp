@@ -27,6 +27,8 @@
 #include "sedge.h"
 #include "steensy.h"
 #include "uservice.h"
+#include "ufields.h"
+#include "usubscribe.h"
 // create value
 SEdge sedge;
 
@@ -44,21 +46,30 @@ void SEdge::setup()
   // like teensy1.send("sub pose 4\n");
   bool high = ini["edge"]["highPower"] == "true";
   setSensor(true, high);
-  //
-  std::string s = "sub liv " + ini["edge"]["rate_ms"] + "\n";
-  teensy1.send(s.c_str());
-  //
-  toConsole = ini["edge"]["printRaw"] == "true";
+  // decode line sensor messages
+  printCh = logChannels.add("edge.printRaw", ini["edge"]["printRaw"] == "true");
   // logfile
-  if (ini["edge"]["logRaw"] == "true")
-  { // open logfile
+  logCh = logChannels.add("edge.logRaw", ini["edge"]["logRaw"] == "true" or logger.recorder);
+  logCh->setOpen([this, high]()
+  { // open logfile when the channel is first on
     std::string fn = service.logPath + "log_edge_raw.txt";
-    logfile = fopen(fn.c_str(), "w");
+    logfile = logRow.open(fn, "%lu.%04ld %d %d %d %d %d %d %d %d\n");
+    if (logfile == nullptr)
+      return;
     fprintf(logfile, "%% Linesensor raw values logfile (reflectance values)\n");
     fprintf(logfile, "%% Sensor power high=%d\n", high);
     fprintf(logfile, "%% 1 \tTime (sec)\n");
     fprintf(logfile, "%% 2..9 \tSensor 1..8 AD value difference (illuminated - not illuminated)\n");
-  }
+  });
+  teensy1.addDecoder("liv", [](const char * msg, UTime & msgTime)
+                     { return sedge.decode(msg, msgTime); });
+  teensy1.addDecoder("ls", [](const char * msg, UTime & msgTime)
+                     { return sedge.decode(msg, msgTime); });
+  teensy1.addBinDecoder(BIN_LIV, [](uint8_t type, const uint8_t * data, int n, UTime & msgTime)
+                        { return sedge.decodeBin(type, data, n, msgTime); });
+  //
+  subscribe.request("liv", strtol(ini["edge"]["rate_ms"].c_str(), nullptr, 10), "edge");
+  //
 }
 
 void SEdge::terminate()
@@ -73,25 +84,22 @@ void SEdge::terminate()
 bool SEdge::decode(const char* msg, UTime & msgTime)
 {
   bool used = true;
-  const char * p1 = msg;
-  if (strncmp(p1, "liv ", 4) == 0)
+  if (strncmp(msg, "liv ", 4) == 0)
   {
-    if (strlen(p1) > 4)
-      p1 += 4;
-    else
-      return false;
-    updTime = msgTime;
+    UFields f(msg);
+    UBinLiv d;
 //     printf("# edgeraw: %s", msg);
     for (int i = 0; i < 8; i++)
     { // get integer value (averaged over sample time)
-      edgeRaw[i] = strtol(p1, (char**)&p1, 10);
+      int v;
+      f.get(v);
+      d.liv[i] = v;
     }
-    // notify users of a new update
-    updateCnt++;
-    // save received data (if desired)
-    toLog();
+    if (not f.isOK())
+      return false;
+    newData(d, msgTime);
   }
-  else if (strncmp(p1, "ls ", 3) == 0)
+  else if (strncmp(msg, "ls ", 3) == 0)
   { // debug for very raw values (illuminated and not illuminated values)
     // not used here
     printf("# edge AD: %s", msg);
@@ -101,6 +109,34 @@ bool SEdge::decode(const char* msg, UTime & msgTime)
   return used;
 }
 
+bool SEdge::decodeBin(uint8_t type, const uint8_t * data, int n, UTime & msgTime)
+{
+  bool used = type == BIN_LIV and n == sizeof(UBinLiv);
+  if (used)
+  {
+    UBinLiv d;
+    memcpy(&d, data, n);
+    newData(d, msgTime);
+  }
+  return used;
+}
+
+void SEdge::newData(const UBinLiv & d, UTime & msgTime)
+{
+  updTime = msgTime;
+  for (int i = 0; i < 8; i++)
+    edgeRaw[i] = d.liv[i];
+  // notify users of a new update
+  updateCnt++;
+  UEdgeRawSample s;
+  s.updTime = updTime;
+  for (int i = 0; i < 8; i++)
+    s.edgeRaw[i] = edgeRaw[i];
+  topic.publish(s);
+  // save received data (if desired)
+  toLog();
+}
+
 void SEdge::setSensor(bool on, bool high)
 {
   const int MSL = 150;
@@ -119,9 +155,9 @@ void SEdge::toLog()
 {
   if (not service.stop)
   {
-    if (logfile != nullptr)
+    if (logCh->active() and logfile != nullptr)
     {
-      fprintf(logfile,"%lu.%04ld %d %d %d %d %d %d %d %d\n", updTime.getSec(), updTime.getMicrosec()/100,
+      logRow.add(logfile, updTime.getSec(), updTime.getMicrosec()/100,
               edgeRaw[0],
               edgeRaw[1],
               edgeRaw[2],
@@ -132,7 +168,7 @@ void SEdge::toLog()
               edgeRaw[7]
       );
     }
-    if (toConsole)
+    if (printCh != nullptr and printCh->active())
     {
       printf("%lu.%04ld %d %d %d %d %d %d %d %d\n", updTime.getSec(), updTime.getMicrosec()/100,
               edgeRaw[0],
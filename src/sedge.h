@@ -25,9 +25,21 @@
 
 
 #include "utime.h"
+#include "ubinlink.h"
+#include "utopic.h"
+#include "ulogger.h"
 
 using namespace std;
 
+/**
+ * Line sensor sample published to users (edge detection) */
+class UEdgeRawSample
+{
+public:
+  UTime updTime;
+  int edgeRaw[8] = {0};
+};
+
 /**
  * Class to receive the line sensor AD values
  * The AD values are the difference in intensity
@@ -44,6 +56,9 @@ public:
   /** decode an unpacked incoming messages
    * \returns true if the message us used */
   bool decode(const char * msg, UTime & msgTime);
+  /** decode a binary packet (BIN_LIV)
+   * \returns true if the packet is used */
+  bool decodeBin(uint8_t type, const uint8_t * data, int n, UTime & msgTime);
   /**
    * terminate */
   void terminate();
@@ -56,11 +71,18 @@ public:
   int updateCnt = false;
   UTime updTime;
   int edgeRaw[8];
+  /// new line sensor values are published here
+  UTopic<UEdgeRawSample> topic;
 
 private:
+  /** use new values from either text or binary message */
+  void newData(const UBinLiv & d, UTime & msgTime);
   void toLog();
-  bool toConsole = false;
+  /// log and print channels (can be switched while running)
+  ULogChannel * logCh = nullptr;
+  ULogChannel * printCh = nullptr;
   FILE * logfile = nullptr;
+  ULogStream logRow;
   //   std::condition_variable_any nd; // new data service
 };
 
@@ -27,6 +27,8 @@
 #include "sencoder.h"
 #include "steensy.h"
 #include "uservice.h"
+#include "ufields.h"
+#include "usubscribe.h"
 // create value
 SEncoder encoder;
 
@@ -40,33 +42,41 @@ void SEncoder::setup()
     ini["encoder"]["print"] = "false";
     ini["encoder"]["encoder_reversed"] = "true";
   }
+  // log channels first, as data may arrive when the decoders are added
+  logCh = logChannels.add("encoder.log", ini["encoder"]["log"] == "true" or logger.recorder);
+  logCh->setOpen([this]()
+  { // open logfile when the channel is first on
+    std::string fn = service.logPath + "log_encoder.txt";
+    logfile = logRow.open(fn, "%lu.%04ld %lu %lu %d %d\n");
+    if (logfile == nullptr)
+      return;
+    fprintf(logfile, "%% Encoder logfile\n");
+    fprintf(logfile, "%% 1 \tTime (sec)\n");
+    fprintf(logfile, "%% 2,3 \tenc left, right\n");
+    fprintf(logfile, "%% 4,5 \tencoder change left, right\n");
+  });
+  // decode encoder messages
+  teensy1.addDecoder("enc", [](const char * msg, UTime & msgTime)
+                     { return encoder.decode(msg, msgTime); });
+  teensy1.addBinDecoder(BIN_ENC, [](uint8_t type, const uint8_t * data, int n, UTime & msgTime)
+                        { return encoder.decodeBin(type, data, n, msgTime); });
   // reset encoder and pose
   teensy1.send("enc0\n");
   // use values and subscribe to source data
-  std::string s = "sub enc " + ini["encoder"]["rate_ms"] + "\n";
-  teensy1.send(s.c_str());
-  toConsole = ini["encoder"]["print"] == "true";
+  subscribe.request("enc", strtol(ini["encoder"]["rate_ms"].c_str(), nullptr, 10), "encoder");
+  printCh = logChannels.add("encoder.print", ini["encoder"]["print"] == "true");
   // ensure default is true if no 'encoder_reversed' entry is available
   // Robobot motors has reversed encoders (encoder A and B is swapped)
   // this will be fixed in the Regbot firmware by this command
   encoder_reversed = true;
   if (ini["encoder"].has("encoder_reversed"))
     encoder_reversed = ini["encoder"]["encoder_reversed"] == "true";
+  std::string s;
   if (encoder_reversed)
     s = "encrev 1\n";
   else
     s = "encrev 0\n";
   teensy1.send(s.c_str());
-
-  if (ini["encoder"]["log"] == "true")
-  { // open logfile
-    std::string fn = service.logPath + "log_encoder.txt";
-    logfile = fopen(fn.c_str(), "w");
-    fprintf(logfile, "%% Encoder logfile\n");
-    fprintf(logfile, "%% 1 \tTime (sec)\n");
-    fprintf(logfile, "%% 2,3 \tenc left, right\n");
-    fprintf(logfile, "%% 4,5 \tencoder change left, right\n");
-  }
 }
 
 void SEncoder::terminate()
@@ -80,39 +90,62 @@ void SEncoder::terminate()
 bool SEncoder::decode(const char* msg, UTime & msgTime)
 {
   bool used = true;
-  const char * p1 = msg;
-  if (strncmp(p1, "enc ", 4) == 0)
+  if (strncmp(msg, "enc ", 4) == 0)
   {
-    if (strlen(p1) > 4)
-      p1 += 4;
-    else
+    UFields f(msg);
+    UBinEnc d;
+    f.get(d.enc[0]);
+    f.get(d.enc[1]);
+    if (not f.isOK())
       return false;
-    encTime = msgTime;
-    enc[0] = -strtoll(p1, (char**)&p1, 10);
-    enc[1] = strtoll(p1, (char**)&p1, 10);
-    // notify users of a new update
-    updateCnt++;
-    // save to log_encoder_pose
-    toLog();
-    // save new value as old value
-    encLast[0] = enc[0];
-    encLast[1] = enc[1];
+    newData(d, msgTime);
   }
   else
     used = false;
   return used;
 }
 
+bool SEncoder::decodeBin(uint8_t type, const uint8_t * data, int n, UTime & msgTime)
+{
+  bool used = type == BIN_ENC and n == sizeof(UBinEnc);
+  if (used)
+  {
+    UBinEnc d;
+    memcpy(&d, data, n);
+    newData(d, msgTime);
+  }
+  return used;
+}
+
+void SEncoder::newData(const UBinEnc & d, UTime & msgTime)
+{
+  encTime = msgTime;
+  enc[0] = -d.enc[0];
+  enc[1] = d.enc[1];
+  // notify users of a new update
+  updateCnt++;
+  UEncSample s;
+  s.encTime = encTime;
+  s.enc[0] = enc[0];
+  s.enc[1] = enc[1];
+  topic.publish(s);
+  // save to log_encoder_pose
+  toLog();
+  // save new value as old value
+  encLast[0] = enc[0];
+  encLast[1] = enc[1];
+}
+
 void SEncoder::toLog()
 {
   if (not service.stop)
   {
-    if (logfile != nullptr)
+    if (logCh->active() and logfile != nullptr)
     {
-      fprintf(logfile,"%lu.%04ld %lu %lu %d %d\n", encTime.getSec(), encTime.getMicrosec()/100,
+      logRow.add(logfile, encTime.getSec(), encTime.getMicrosec()/100,
               (unsigned long int)enc[0], (unsigned long int)enc[1], int(enc[0] - encLast[0]), int(enc[1] - encLast[1]));
     }
-    if (toConsole)
+    if (printCh != nullptr and printCh->active())
     {
       printf("%lu.%04ld %lu %lu %d %d\n", encTime.getSec(), encTime.getMicrosec()/100,
               (unsigned long int)enc[0], (unsigned long int)enc[1], int(enc[0] - encLast[0]), int(enc[1] - encLast[1]));
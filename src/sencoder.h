@@ -36,9 +36,21 @@
 #include <math.h>
 
 #include "utime.h"
+#include "ubinlink.h"
+#include "utopic.h"
+#include "ulogger.h"
 
 using namespace std;
 
+/**
+ * Encoder sample published to users (e.g. pose) */
+class UEncSample
+{
+public:
+  UTime encTime;
+  int64_t enc[2] = {0};
+};
+
 /**
  * Class to receive the motor encoder values.
  * */
@@ -53,6 +65,9 @@ public:
   /** decode an unpacked incoming messages
    * \returns true if the message us used */
   bool decode(const char * msg, UTime & msgTime);
+  /** decode a binary packet (BIN_ENC)
+   * \returns true if the packet is used */
+  bool decodeBin(uint8_t type, const uint8_t * data, int n, UTime & msgTime);
   /**
    * terminate */
   void terminate();
@@ -62,14 +77,21 @@ public:
   int updateCnt = false;
   UTime encTime, encTimeLast;
   int64_t enc[2] = {0};
+  /// new encoder values are published here (at decode time)
+  UTopic<UEncSample> topic;
 
 private:
+  /** use new encoder values from either text or binary message */
+  void newData(const UBinEnc & d, UTime & msgTime);
   void toLog();
   int64_t encLast[2] = {0};
   bool firstEnc = true;
   bool encoder_reversed = true;
-  bool toConsole = false;
+  /// log and print channels (can be switched while running)
+  ULogChannel * logCh = nullptr;
+  ULogChannel * printCh = nullptr;
   FILE * logfile = nullptr;
+  ULogStream logRow;
 //   std::condition_variable_any nd; // new data service
 };
 
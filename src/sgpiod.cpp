@@ -30,6 +30,8 @@
 #include <iostream>
 #include "uservice.h"
 #include "sgpiod.h"
+#include "uthreads.h"
+#include "uloopstat.h"
 
 // inspired from https://github.com/brgl/libgpiod/blob/master/bindings/cxx/gpiod.hpp
 #include "gpiod.h"
@@ -129,10 +131,10 @@ void SGpiod::setup()
   }
   // logfiles
   toConsole = ini["gpio"]["print"] == "true";
-  if (ini["gpio"]["log"] == "true")
+  if (ini["gpio"]["log"] == "true" or logger.recorder)
   { // open logfile
     std::string fn = service.logPath + "log_gpio.txt";
-    logfile = fopen(fn.c_str(), "w");
+    logfile = logRow.open(fn, "%lu.%04ld %d %d %d %d %d %d %d\n");
     fprintf(logfile, "%% gpio logfile\n");
     fprintf(logfile, "%% pins_out %s\n", ini["gpio"]["pins_out"].c_str());
     fprintf(logfile, "%% 1 \tTime (sec)\n");
@@ -147,7 +149,7 @@ void SGpiod::setup()
   }
   if (not service.stop)
     // start listen to the keyboard
-    th1 = new std::thread(runObj, this);
+    th1 = threads.spawn("gpio", runObj, this);
 }
 
 void SGpiod::terminate()
@@ -231,8 +233,11 @@ void SGpiod::run()
   bool stopSwitchPressed = false;
   auto sampleTime =  1ms;
   auto loopTime = std::chrono::steady_clock::now() + sampleTime;
+  ULoopProbe * probe = loopStat.probe("gpio", 0.001);
+  float late = -1;
   while (not service.stop and chip != nullptr)
   {
+    probe->begin(late);
     loop++;
     changed = false;
     for (int i = 0; i < MAX_PINS; i++)
@@ -266,7 +271,11 @@ void SGpiod::run()
       stopSwitchPressed = false;
     }
     //
+    probe->end();
     std::this_thread::sleep_until(loopTime);
+    // a late wake-up is an overrun, when more than a sample time
+    std::chrono::duration<float> dt = std::chrono::steady_clock::now() - loopTime;
+    late = dt.count();
     loopTime += sampleTime;
   }
 }
@@ -299,7 +308,7 @@ void SGpiod::toLog(bool pv[])
   UTime t("now");
   if (logfile != nullptr)
   {
-    fprintf(logfile,"%lu.%04ld %d %d %d %d %d %d %d\n",
+    logRow.add(logfile,
             t.getSec(), t.getMicrosec()/100,
             pv[0], pv[1], pv[2], pv[3], pv[4], pv[5], pv[6]);
   }
@@ -26,6 +26,7 @@
 
 #include <gpiod.h>
 #include "utime.h"
+#include "ulogger.h"
 
 
 /**
@@ -83,6 +84,8 @@ private:
   // logfile
   bool toConsole = false;
   FILE * logfile = nullptr;
+  /// row format
+  ULogStream logRow;
 
 private:
   static void runObj(SGpiod * obj)
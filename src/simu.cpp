@@ -27,6 +27,8 @@
 #include "simu.h"
 #include "steensy.h"
 #include "uservice.h"
+#include "ufields.h"
+#include "usubscribe.h"
 // create value
 SImu imu;
 
@@ -41,12 +43,47 @@ void SImu::setup()
     ini["imu"]["print_gyro"] = "false";
     ini["imu"]["print_acc"] = "false";
   }
+  // log channels first, as data may arrive when the decoders are added
+  printGyroCh = logChannels.add("imu.print_gyro", ini["imu"]["print_gyro"] == "true");
+  printAccCh = logChannels.add("imu.print_acc", ini["imu"]["print_acc"] == "true");
+  // one log key in the ini-file, but a channel for each logfile
+  logGyroCh = logChannels.add("imu.log_gyro", ini["imu"]["log"] == "true" or logger.recorder);
+  logAccCh = logChannels.add("imu.log_acc", ini["imu"]["log"] == "true" or logger.recorder);
+  logGyroCh->setOpen([this]()
+  { // open logfile when the channel is first on
+    std::string fn = service.logPath + "log_gyro.txt";
+    logfile = logRow.open(fn, "%lu.%04ld %.4f %.4f %.4f\n");
+    if (logfile == nullptr)
+      return;
+    fprintf(logfile, "%% Gyro logfile\n");
+    fprintf(logfile, "%% 1 \tTime (sec)\n");
+    fprintf(logfile, "%% 2-4 \tGyro (x,y,z)\n");
+    fprintf(logfile, "%% Gyro offset %g %g %g\n", gyroOffset[0], gyroOffset[1], gyroOffset[2]);
+  });
+  logAccCh->setOpen([this]()
+  { // open logfile when the channel is first on
+    std::string fn = service.logPath + "log_acc.txt";
+    logfileAcc = logAccRow.open(fn, "%lu.%04ld %.4f %.4f %.4f\n");
+    if (logfileAcc == nullptr)
+      return;
+    fprintf(logfileAcc, "%% Accelerometer logfile\n");
+    fprintf(logfileAcc, "%% 1 \tTime (sec)\n");
+    fprintf(logfileAcc, "%% 2-4 \tAccelerometer (x,y,z)\n");
+  });
+  // decode gyro and accelerometer messages
+  teensy1.addDecoder("gyro0", [](const char * msg, UTime & msgTime)
+                     { return imu.decode(msg, msgTime); });
+  teensy1.addDecoder("acc0", [](const char * msg, UTime & msgTime)
+                     { return imu.decode(msg, msgTime); });
+  teensy1.addBinDecoder(BIN_GYRO, [](uint8_t type, const uint8_t * data, int n, UTime & msgTime)
+                        { return imu.decodeBin(type, data, n, msgTime); });
+  teensy1.addBinDecoder(BIN_ACC, [](uint8_t type, const uint8_t * data, int n, UTime & msgTime)
+                        { return imu.decodeBin(type, data, n, msgTime); });
   // use values and subscribe to source data
   // like teensy1.send("sub pose 4\n");
-  std::string s = "sub gyro0 " + ini["imu"]["rate_ms"] + "\n";
-  teensy1.send(s.c_str());
-  s = "sub acc0 " + ini["imu"]["rate_ms"] + "\n";
-  teensy1.send(s.c_str());
+  int ms = strtol(ini["imu"]["rate_ms"].c_str(), nullptr, 10);
+  subscribe.request("gyro0", ms, "imu");
+  subscribe.request("acc0", ms, "imu");
   // gyro offset
   const char * p1 = ini["imu"]["gyro_offset"].c_str();
   gyroOffset[0] = strtof(p1, (char**)&p1);
@@ -57,24 +94,6 @@ void SImu::setup()
   char ss[MSL];
   snprintf(ss, MSL, "gyrocal %g %g %g\n", gyroOffset[0], gyroOffset[1], gyroOffset[2]);
   teensy1.send(ss);
-  //
-  toConsoleGyro = ini["imu"]["print_gyro"] == "true";
-  toConsoleAcc = ini["imu"]["print_acc"] == "true";
-  if (ini["imu"]["log"] == "true")
-  { // open logfile
-    std::string fn = service.logPath + "log_gyro.txt";
-    logfile = fopen(fn.c_str(), "w");
-    fprintf(logfile, "%% Gyro logfile\n");
-    fprintf(logfile, "%% 1 \tTime (sec)\n");
-    fprintf(logfile, "%% 2-4 \tGyro (x,y,z)\n");
-    fprintf(logfile, "%% Gyro offset %g %g %g\n", gyroOffset[0], gyroOffset[1], gyroOffset[2]);
-    //
-    fn = service.logPath + "log_acc.txt";
-    logfileAcc = fopen(fn.c_str(), "w");
-    fprintf(logfileAcc, "%% Accelerometer logfile\n");
-    fprintf(logfileAcc, "%% 1 \tTime (sec)\n");
-    fprintf(logfileAcc, "%% 2-4 \tAccelerometer (x,y,z)\n");
-  }
 }
 
 void SImu::terminate()
@@ -93,73 +112,101 @@ void SImu::terminate()
 bool SImu::decode(const char* msg, UTime & msgTime)
 {
   bool used = true;
-  const char * p1 = msg;
-  if (strncmp(p1, "acc0 ", 4) == 0)
+  if (strncmp(msg, "acc0 ", 5) == 0)
   {
-    if (strlen(p1) > 4)
-      p1 += 4;
-    else
+    UFields f(msg);
+    UBinXyz d;
+    for (int i = 0; i < 3; i++)
+      f.get(d.v[i]);
+    if (not f.isOK())
       return false;
-    updTimeAcc = msgTime;
-    acc[0] = strtof(p1, (char**)&p1);
-    acc[1] = strtof(p1, (char**)&p1);
-    acc[2] = strtof(p1, (char**)&p1);
-    // notify users of a new update
-    updateCnt++;
-    // save to log
-    toLog(true);
+    newAcc(d, msgTime);
   }
-  else if (strncmp(p1, "gyro0 ", 5) == 0)
+  else if (strncmp(msg, "gyro0 ", 6) == 0)
   {
-    if (strlen(p1) > 5)
-      p1 += 5;
-    else
+    UFields f(msg);
+    UBinXyz d;
+    for (int i = 0; i < 3; i++)
+      f.get(d.v[i]);
+    if (not f.isOK())
       return false;
-    updTime = msgTime;
-    gyro[0] = strtof(p1, (char**)&p1);
-    gyro[1] = strtof(p1, (char**)&p1);
-    gyro[2] = strtof(p1, (char**)&p1);
-    // notify users of a new update
-    updateCnt++;
-    // save to log
-    toLog(false);
-    //
-    if (inCalibration)
-    {
-      for (int j = 0; j < 3; j++)
-        calibSum[j] = gyro[j];
-      calibCount++;
-      if (calibCount >= calibCountMax)
-      {
-        for (int j = 0; j < 3; j++)
-          gyroOffset[j] = calibSum[j]/calibCount;
-        // implement new values
-        const int MSL = 100;
-        char s[MSL];
-        snprintf(s, MSL, "%g %g %g", gyroOffset[0], gyroOffset[1], gyroOffset[2]);
-        ini["imu"]["gyro_offset"] = s;
-        inCalibration = false;
-        printf("# gyro calibration finished: %s\n", s);
-      }
-    }
+    newGyro(d, msgTime);
   }
   else
     used = false;
   return used;
 }
 
+bool SImu::decodeBin(uint8_t type, const uint8_t * data, int n, UTime & msgTime)
+{
+  bool used = n == sizeof(UBinXyz);
+  if (used)
+  {
+    UBinXyz d;
+    memcpy(&d, data, n);
+    if (type == BIN_ACC)
+      newAcc(d, msgTime);
+    else if (type == BIN_GYRO)
+      newGyro(d, msgTime);
+    else
+      used = false;
+  }
+  return used;
+}
+
+void SImu::newAcc(const UBinXyz & d, UTime & msgTime)
+{
+  updTimeAcc = msgTime;
+  for (int i = 0; i < 3; i++)
+    acc[i] = d.v[i];
+  // notify users of a new update
+  updateCnt++;
+  // save to log
+  toLog(true);
+}
+
+void SImu::newGyro(const UBinXyz & d, UTime & msgTime)
+{
+  updTime = msgTime;
+  for (int i = 0; i < 3; i++)
+    gyro[i] = d.v[i];
+  // notify users of a new update
+  updateCnt++;
+  // save to log
+  toLog(false);
+  //
+  if (inCalibration)
+  {
+    for (int j = 0; j < 3; j++)
+      calibSum[j] = gyro[j];
+    calibCount++;
+    if (calibCount >= calibCountMax)
+    {
+      for (int j = 0; j < 3; j++)
+        gyroOffset[j] = calibSum[j]/calibCount;
+      // implement new values
+      const int MSL = 100;
+      char s[MSL];
+      snprintf(s, MSL, "%g %g %g", gyroOffset[0], gyroOffset[1], gyroOffset[2]);
+      ini["imu"]["gyro_offset"] = s;
+      inCalibration = false;
+      printf("# gyro calibration finished: %s\n", s);
+    }
+  }
+}
+
 void SImu::toLog(bool accChanged)
 {
   if (service.stop)
     return;
   if (accChanged)
   { // accelerometer
-    if (logfileAcc != nullptr)
+    if (logAccCh->active() and logfileAcc != nullptr)
     {
-      fprintf(logfileAcc,"%lu.%04ld %.4f %.4f %.4f\n", updTimeAcc.getSec(), updTimeAcc.getMicrosec()/100,
+      logAccRow.add(logfileAcc, updTimeAcc.getSec(), updTimeAcc.getMicrosec()/100,
               acc[0], acc[1], acc[2]);
     }
-    if (toConsoleAcc)
+    if (printAccCh != nullptr and printAccCh->active())
     {
       printf("%lu.%04ld %.4f %.4f %.4f\n", updTimeAcc.getSec(), updTimeAcc.getMicrosec()/100,
              acc[0], acc[1], acc[2]);
@@ -167,12 +214,12 @@ void SImu::toLog(bool accChanged)
   }
   else
   { // gyro data
-    if (logfile != nullptr)
+    if (logGyroCh->active() and logfile != nullptr)
     {
-      fprintf(logfile,"%lu.%04ld %.4f %.4f %.4f\n", updTimeAcc.getSec(), updTimeAcc.getMicrosec()/100,
+      logRow.add(logfile, updTimeAcc.getSec(), updTimeAcc.getMicrosec()/100,
               gyro[0], gyro[1], gyro[2]);
     }
-    if (toConsoleGyro)
+    if (printGyroCh != nullptr and printGyroCh->active())
     {
       printf("%lu.%04ld %.4f %.4f %.4f\n", updTimeAcc.getSec(), updTimeAcc.getMicrosec()/100,
               gyro[0], gyro[1], gyro[2]);
@@ -25,6 +25,9 @@
 #define SIMU_H
 
 #include "utime.h"
+#include "ubinlink.h"
+#include "ulogchannel.h"
+#include "ulogger.h"
 
 using namespace std;
 
@@ -42,6 +45,9 @@ public:
   /** decode an unpacked incoming messages
    * \returns true if the message us used */
   bool decode(const char * msg, UTime & msgTime);
+  /** decode a binary packet (BIN_GYRO or BIN_ACC)
+   * \returns true if the packet is used */
+  bool decodeBin(uint8_t type, const uint8_t * data, int n, UTime & msgTime);
   /**
    * terminate */
   void terminate();
@@ -60,14 +66,24 @@ public:
   bool inCalibration = false;
 
 private:
+  /** use new accelerometer values */
+  void newAcc(const UBinXyz & d, UTime & msgTime);
+  /** use new gyro values */
+  void newGyro(const UBinXyz & d, UTime & msgTime);
   /** save to logfile (and/or console)
    * \param accChanged if new data is from accelerometer, else it is gyro */
   void toLog(bool accChanged);
   //
   FILE * logfile = nullptr;
   FILE * logfileAcc = nullptr;
-  bool toConsoleAcc = false;
-  bool toConsoleGyro = false;
+  /// row formats
+  ULogStream logRow;
+  ULogStream logAccRow;
+  /// log and print channels (can be switched while running)
+  ULogChannel * logGyroCh = nullptr;
+  ULogChannel * logAccCh = nullptr;
+  ULogChannel * printAccCh = nullptr;
+  ULogChannel * printGyroCh = nullptr;
   // calibration
   const static int calibCountMax = 100;
   int calibCount = 0;
@@ -30,9 +30,12 @@
 #include <string.h>
 #include <unistd.h>
 #include "sjoylogitech.h"
+#include "uthreads.h"
+#include "uloopstat.h"
 #include "uservice.h"
 #include "cmixer.h"
 #include "cservo.h"
+#include "uclock.h"
 
 #define JS_EVENT_BUTTON         0x01    /* button pressed/released */
 #define JS_EVENT_AXIS           0x02    /* joystick moved */
@@ -125,7 +128,7 @@ void SJoyLogitech::setup()
     if (ini["Joy_Logitech"]["log"] == "true")
     { // open logfile
       std::string fn = service.logPath + "log_joy_logitech.txt";
-      logfile = fopen(fn.c_str(), "w");
+      logfile = service.openLog(fn);
       fprintf(logfile, "%% Logitech gamepad interface logfile\n");
       fprintf(logfile, "%% Device %s\n", joyDevice.c_str());
       fprintf(logfile, "%% Device type %s\n", deviceName.c_str());
@@ -147,7 +150,7 @@ void SJoyLogitech::setup()
       fprintf(logfile, "%% %d-%d \tAxis value\n", number_of_buttons + 6, number_of_axes + number_of_buttons + 5);
     }
     // start listen thread
-    th1 = new std::thread(runObj, this);
+    th1 = threads.spawn("joy", runObj, this);
     printf("# UJoyLogitech:: joystick found (%s on %s)\n", deviceName.c_str(), joyDevice.c_str());
   }
 //   else
@@ -173,12 +176,14 @@ void SJoyLogitech::run()
   sleep(3);
   bool automaticMode = true;
   bool automaticModeOld = false;
+  ULoopProbe * probe = loopStat.probe("joy");
   while (not service.stop and joyRunning)
   { // handling gamepad events
     // Device is present
     bool gotEvent = getNewJsData();
     if (gotEvent)
     { //Detect manual override toggling
+      probe->begin();
       if (joyValues.button[BUTTON_START] == 1)
         automaticMode = true;
       if (joyValues.button[BUTTON_BACK] == 1)
@@ -196,9 +201,11 @@ void SJoyLogitech::run()
         t.now();
         toLog();
       }
+      probe->end();
     }
     else
-      usleep(10000);
+      // no device, so not on the (virtual) clock
+      clockService.sleepRealUs(10000);
     // state change
     if (automaticMode != automaticModeOld)
     { // there is a change
@@ -261,7 +268,7 @@ bool SJoyLogitech::getNewJsData()
     { // may be an error, or just nothing send (buffer full)
       case EAGAIN:
         //not all send - just continue
-        usleep(100);
+        clockService.sleepRealUs(100);
         break;
       default:
         perror("UJoy::getNewJsData (other error device error): ");
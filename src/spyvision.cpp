@@ -26,8 +26,11 @@
 #include <string.h>
 #include <sys/types.h>
 #include "spyvision.h"
+#include "uthreads.h"
+#include "uloopstat.h"
 #include "steensy.h"
 #include "uservice.h"
+#include "uclock.h"
 
 // create connection object
 SPyVision pyvision;
@@ -64,7 +67,7 @@ void SPyVision::setup()
     if (ini["pyvision"]["log"] == "true")
     { // open logfile
       std::string fn = service.logPath + "log_pyvision.txt";
-      logfile = fopen(fn.c_str(), "w");
+      logfile = service.openLog(fn);
       fprintf(logfile, "%% connection to python vision - logfile\n");
       fprintf(logfile, "%% connection to %s port %s (%s)\n", ini["pyvision"]["host"].c_str(), ini["pyvision"]["port"].c_str(), c.c_str());
       fprintf(logfile, "%% 1 \tTime (sec)\n");
@@ -72,7 +75,7 @@ void SPyVision::setup()
       fprintf(logfile, "%% 3 \tRx or Tx message count\n");
       fprintf(logfile, "%% 4 \tCommand send or string received\n");
     }
-    th1 = new std::thread(runObj, this);
+    th1 = threads.spawn("pyvision", runObj, this);
   }
   else
     printf("# SpyVision:: disabled in robot.ini\n");
@@ -88,7 +91,7 @@ void SPyVision::terminate()
     {
       const char * q = "quit\n";
       sock->sendCommand(q);
-      usleep(100);
+      clockService.sleepRealUs(100);
       UTime t("now");
       toLogTx(q);
     }
@@ -111,13 +114,16 @@ bool SPyVision::sendCommand(const char* command)
 void SPyVision::run()
 {
   printf("# SPyVision is running\n");
+  ULoopProbe * probe = loopStat.probe("pyvision");
   while (not service.stop)
   { // wait for reply
     std::string r = sock->waitForReply(40); // ms
     if (r.length() > 1)
     { // decode the reply
+      probe->begin();
       toLogRx(r.c_str());
       decodeReply(r.c_str());
+      probe->end();
     }
   }
   th1 = nullptr;
@@ -152,7 +158,7 @@ bool SPyVision::waitForAruco(float timeoutMs)
       updated = true;
       break;
     }
-    usleep(1000);
+    clockService.sleepUs(1000);
   }
   return updated;
 }
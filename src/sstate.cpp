@@ -27,6 +27,8 @@
 #include "steensy.h"
 #include "sstate.h"
 #include "uservice.h"
+#include "ufields.h"
+#include "usubscribe.h"
 
 // create the class with received info
 SState state;
@@ -40,12 +42,14 @@ void SState::setup()
     ini["state"]["print"] = "false";
     ini["state"]["regbot_version"] = "000";
   }
-  toConsole = ini["state"]["print"] == "true";
-  teensy1.send("sub hbt 500\n");
-  if (ini["state"]["log"] == "true")
-  { // open logfile
+  printCh = logChannels.add("state.print", ini["state"]["print"] == "true");
+  logCh = logChannels.add("state.log", ini["state"]["log"] == "true" or logger.recorder);
+  logCh->setOpen([this]()
+  { // open logfile when the channel is first on
     std::string fn = service.logPath + "log_hbt.txt";
-    logfile = fopen(fn.c_str(), "w");
+    logfile = logRow.open(fn, "%lu.%03ld %d %d %d %.2f %.1f %d %d\n");
+    if (logfile == nullptr)
+      return;
     fprintf(logfile, "%% Heartbeat logfile\n");
     fprintf(logfile, "%% 1 \tTime (sec)\n");
     fprintf(logfile, "%% 2 \tRobot name index\n");
@@ -54,7 +58,12 @@ void SState::setup()
     fprintf(logfile, "%% 5 \tBattery voltage (V)\n");
     fprintf(logfile, "%% 6 \tTeensy load (%%)\n");
     fprintf(logfile, "%% 7-8 \tMotor enabled flag (left,right) (may be 0 after overload)\n");
-  }
+  });
+  teensy1.addDecoder("hbt", [](const char * msg, UTime & msgTime)
+                     { return state.decode(msg, msgTime); });
+  teensy1.addBinDecoder(BIN_HBT, [](uint8_t type, const uint8_t * data, int n, UTime & msgTime)
+                        { return state.decodeBin(type, data, n, msgTime); });
+  subscribe.request("hbt", 500, "state");
 //   printf("# SState:: setup finished\n");
 }
 
@@ -82,63 +91,92 @@ bool SState::decode(const char* msg, UTime & msgTime)
   *     8,9 : motor enabled (left,right)
   */
   bool used = true;
-  const char * p1 = msg;
-  if (strncmp(p1, "hbt ", 4) == 0)
+  if (strncmp(msg, "hbt ", 4) == 0)
   { // decode pose message
-    // advance to first parameter
-    if (strlen(p1) > 5)
-      p1 += 5;
-    else
+    UFields f(msg);
+    UBinHbt d;
+    int v[5];
+    f.get(d.teensyTime); // time in seconds from Teensy
+    f.get(v[0]); // index (robot number)
+    f.get(d.version); // version (from SVN)
+    f.get(d.batteryVoltage);
+    f.get(v[1]); // control state 0=no control, 2=user mission
+    f.get(v[2]); // hardware type
+    f.get(d.load); // Teensy load in %
+    f.get(v[3]); // motor 1 enabled
+    f.get(v[4]); // motor 2 enabled
+    if (not f.isOK())
       return false;
-    // get data
-    dataLock.lock();
-    // time in seconds from Teensy
-    double tt = strtof64(p1, (char**)&p1);
-    teensyTime = tt;
-    int x = strtol(p1, (char**)&p1, 10); // index (robot number)
-    if (x != idx)
-    { // set robot number into ini-file
-      idx = x;
-      ini["id"]["idx"] = to_string(idx);
-      // also ask for the new name
-      teensy1.send("idi\n", true);
-      printf("# SState::decode: asked for new name (idi -> dname)\n");
-    }
-    int rv = strtol(p1, (char**)&p1, 10); // index (from SVN)
-    if (rv != version)
-    {
-      version = rv;
-      ini["state"]["regbot_version"] = to_string(rv);
-    }
-    batteryVoltage = strtof(p1, (char**)&p1); // y
-    controlState = strtol(p1, (char**)&p1, 10); // control state 0=no control, 2=user mission
-    type = strtol(p1, (char**)&p1, 10); // hardware type
-    load = strtol(p1, (char**)&p1, 10); // Teensy load in %
-    motorEnabled[0] = strtol(p1, (char**)&p1, 10); // motor 1
-    motorEnabled[1] = strtol(p1, (char**)&p1, 10); // motor 2
-    //
-    hbtTime = msgTime;
-    // save to log if file is open
-    toLog();
-    dataLock.unlock();
+    d.idx = v[0];
+    d.controlState = v[1];
+    d.hwType = v[2];
+    d.motorEnabled[0] = v[3];
+    d.motorEnabled[1] = v[4];
+    newData(d, msgTime);
   }
   else
     used = false;
   return used;
 }
 
+bool SState::decodeBin(uint8_t type, const uint8_t * data, int n, UTime & msgTime)
+{
+  bool used = type == BIN_HBT and n == sizeof(UBinHbt);
+  if (used)
+  {
+    UBinHbt d;
+    memcpy(&d, data, n);
+    newData(d, msgTime);
+  }
+  return used;
+}
+
+void SState::newData(const UBinHbt & d, UTime & msgTime)
+{
+  // Teensy time to host time, to get sample time of other messages
+  teensy1.clockSync.addSample(d.teensyTime, msgTime);
+  dataLock.lock();
+  teensyTime = d.teensyTime;
+  if (d.idx != idx)
+  { // set robot number into ini-file
+    idx = d.idx;
+    ini["id"]["idx"] = to_string(idx);
+    // also ask for the new name
+    teensy1.send("idi\n", true);
+    printf("# SState::decode: asked for new name (idi -> dname)\n");
+  }
+  if (d.version != version)
+  {
+    version = d.version;
+    ini["state"]["regbot_version"] = to_string(version);
+  }
+  batteryVoltage = d.batteryVoltage;
+  controlState = d.controlState;
+  type = d.hwType;
+  load = d.load;
+  motorEnabled[0] = d.motorEnabled[0];
+  motorEnabled[1] = d.motorEnabled[1];
+  // system time at this Teensy time
+  hbtTime = msgTime;
+  if (teensy1.useClockSync)
+    teensy1.clockSync.toHost(d.teensyTime, hbtTime);
+  // save to log if file is open
+  toLog();
+  dataLock.unlock();
+}
+
 
 void SState::toLog()
 {
   if (service.stop)
     return;
-  if (logfile != nullptr)
+  if (logCh->active() and logfile != nullptr)
   {
-    fprintf(logfile, "%lu.%03ld %d %d %d %.2f %.1f %d %d\n", hbtTime.getSec(), hbtTime.getMilisec(),
+    logRow.add(logfile, hbtTime.getSec(), hbtTime.getMilisec(),
             idx, version, controlState, batteryVoltage,
             load, motorEnabled[0], motorEnabled[1]);
   }
-  if (toConsole)
+  if (printCh != nullptr and printCh->active())
     printf("%lu.%03ld state %d %d %d %.2f %.1f %d %d\n", hbtTime.getSec(), hbtTime.getMilisec(),
             idx, version, controlState, batteryVoltage,
             load, motorEnabled[0], motorEnabled[1]);
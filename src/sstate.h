@@ -24,6 +24,10 @@
 #ifndef SSTATE_H
 #define SSTATE_H
 
+#include "ubinlink.h"
+#include "ulogchannel.h"
+#include "ulogger.h"
+
 using namespace std;
 
 /**
@@ -37,6 +41,9 @@ public:
   /** decode an unpacked incoming messages
    * \returns true if the message us used */
   bool decode(const char * msg, UTime & msgTime);
+  /** decode a binary packet (BIN_HBT)
+   * \returns true if the message us used */
+  bool decodeBin(uint8_t type, const uint8_t * data, int n, UTime & msgTime);
   /**
    * terminate */
   void terminate();
@@ -63,10 +70,16 @@ public:
   /// mutex should be used to get consistent values
   std::mutex dataLock;
 private:
+  /** use new values from either text or binary message */
+  void newData(const UBinHbt & d, UTime & msgTime);
   void toLog();
   // logfile
-  bool toConsole = false;
+  /// log and print channels (can be switched while running)
+  ULogChannel * logCh = nullptr;
+  ULogChannel * printCh = nullptr;
   FILE * logfile = nullptr;
+  /// row format
+  ULogStream logRow;
 };
 
 /**
@@ -32,12 +32,20 @@
 #include <unistd.h>
 #include <math.h>
 #include <string.h>
+#include <ctype.h>
 #include <termios.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 
 #include "steensy.h"
+#include "uthreads.h"
+#include "uloopstat.h"
 #include "uservice.h"
 #include "sstate.h"
 #include "sencoder.h"
+#include "ufields.h"
+#include "ulogreader.h"
+#include "uclock.h"
 
 using namespace std;
 
@@ -58,6 +66,18 @@ bool UOutQueue::setMessage(const char* message)
     }
     // terminate string
     msg[len] = '\0';
+    // key is the keyword, and the next word if it is a name, not a value
+    const char * p1 = &msg[4];
+    const char * p2 = p1;
+    while (*p2 > ' ')
+      p2++;
+    if (*p2 == ' ' and isalpha(p2[1]))
+    {
+      p2++;
+      while (*p2 > ' ')
+        p2++;
+    }
+    keyLen = p2 - p1;
     // add crc in front
     const int MCL = 4;
     char cc[MCL];
@@ -72,6 +92,72 @@ bool UOutQueue::setMessage(const char* message)
   return isOK;
 }
 
+bool UTxLane::add(const char* message, int keyWords,
+                  uint8_t binType, const void * bin, int binLen)
+{ // key is the first keyWords words of the message
+  char key[UTxSlot::MKL];
+  int k = 0;
+  if (keyWords > 0)
+  {
+    int w = 0;
+    for (const char * p1 = message; *p1 >= ' ' and k < UTxSlot::MKL - 1; p1++)
+    {
+      if (*p1 == ' ' and ++w >= keyWords)
+        break;
+      key[k++] = *p1;
+    }
+  }
+  key[k] = '\0';
+  int len = strnlen(message, UTxSlot::MML);
+  if (len + 2 >= UTxSlot::MML or binLen > UTxSlot::MBL)
+    return false;
+  UTxSlot * slt = nullptr;
+  if (k > 0)
+  { // replace a pending message with the same key
+    for (int i = 0; i < cnt; i++)
+    {
+      if (strcmp(slot[i].key, key) == 0)
+      {
+        slt = &slot[i];
+        break;
+      }
+    }
+  }
+  if (slt == nullptr)
+  { // use a new slot
+    if (cnt >= MAX_SLOTS)
+      return false;
+    slt = &slot[cnt++];
+    memcpy(slt->key, key, k + 1);
+  }
+  memcpy(slt->msg, message, len);
+  if (len == 0 or message[len - 1] != '\n')
+    slt->msg[len++] = '\n';
+  slt->msg[len] = '\0';
+  slt->len = len;
+  slt->binType = binType;
+  if (binType > 0)
+    memcpy(slt->bin, bin, binLen);
+  slt->binLen = binLen;
+  return true;
+}
+
+
+void UTxLane::remove(const char* keyPrefix)
+{
+  int n = strlen(keyPrefix);
+  int j = 0;
+  for (int i = 0; i < cnt; i++)
+  {
+    if (strncmp(slot[i].key, keyPrefix, n) != 0)
+    { // keep
+      if (j < i)
+        slot[j] = slot[i];
+      j++;
+    }
+  }
+  cnt = j;
+}
 
 
 void STeensy::setup()
@@ -91,25 +177,94 @@ void STeensy::setup()
     ini["teensy"]["print"] = "false";
     ini["teensy"]["confirm_timeout"] = "0.04";
   }
+  if (not ini["teensy"].has("tx_window"))
+  { // max number of unconfirmed messages
+    ini["teensy"]["tx_window"] = "8";
+  }
+  if (not ini["teensy"].has("tx_interval"))
+  { // minimum time between writes to the Teensy (sec)
+    ini["teensy"]["tx_interval"] = "0.0005";
+  }
+  if (not ini["teensy"].has("rto_min"))
+  { // limits for the adaptive confirm timeout (sec)
+    ini["teensy"]["rto_min"] = "0.02";
+    ini["teensy"]["rto_max"] = "0.2";
+  }
+  if (not ini["teensy"].has("stat_interval"))
+  { // link statistics line in log every (sec), and round trip pings at connect
+    ini["teensy"]["stat_interval"] = "10";
+    ini["teensy"]["ping"] = "10";
+  }
+  if (not ini["teensy"].has("replay"))
+  { // keywords for session state, that is send again after a reconnect
+    ini["teensy"]["replay"] = "sub irc gyrocal encrev lip servo";
+  }
+  if (not ini["teensy"].has("clock_sync"))
+  { // use estimated sample time for received messages, rather than receive time
+    ini["teensy"]["clock_sync"] = "true";
+  }
+  if (not ini["teensy"].has("binary"))
+  { // use binary frames, if the Teensy firmware supports it
+    ini["teensy"]["binary"] = "false";
+    ini["teensy"]["binary_timeout"] = "0.5";
+  }
   // get ini-file values
   usbDevName = ini["teensy"]["device"];
-  toConsole = ini["teensy"]["print"] == "true";
+  printCh = logChannels.add("teensy.print", ini["teensy"]["print"] == "true");
   robotName = ini.get("id").get("type");
   confirmTimeout = strtof(ini["teensy"]["confirm_timeout"].c_str(), nullptr);
   if (confirmTimeout < 0.01)
     confirmTimeout = 0.02;
+  rtoMin = strtof(ini["teensy"]["rto_min"].c_str(), nullptr);
+  rtoMax = strtof(ini["teensy"]["rto_max"].c_str(), nullptr);
+  if (rtoMax < confirmTimeout)
+    rtoMax = confirmTimeout;
+  // the configured value is used until the first confirm is received
+  rto = confirmTimeout;
+  txInterval = strtof(ini["teensy"]["tx_interval"].c_str(), nullptr);
+  statInterval = strtof(ini["teensy"]["stat_interval"].c_str(), nullptr);
+  pingCnt = strtol(ini["teensy"]["ping"].c_str(), nullptr, 10);
+  { // session state keywords, separated by space
+    const char * p1 = ini["teensy"]["replay"].c_str();
+    sessionKeyCnt = 0;
+    while (*p1 != '\0' and sessionKeyCnt < MAX_SESSION_KEYS)
+    {
+      while (*p1 == ' ')
+        p1++;
+      uint64_t key = UDispatch::getKey(p1);
+      if (key != 0)
+        sessionKeys[sessionKeyCnt++] = key;
+      while (*p1 > ' ')
+        p1++;
+    }
+  }
+  useClockSync = ini["teensy"]["clock_sync"] == "true";
+  binaryWanted = ini["teensy"]["binary"] == "true";
+  binaryTimeout = strtof(ini["teensy"]["binary_timeout"].c_str(), nullptr);
+  txWindow = strtol(ini["teensy"]["tx_window"].c_str(), nullptr, 10);
+  if (txWindow < 1)
+    txWindow = 1;
+  else if (txWindow > MAX_TX_WINDOW)
+    txWindow = MAX_TX_WINDOW;
   //
-  if (ini["teensy"]["log"] == "true")
-  { // open log file and write the header - else no logging
+  logCh = logChannels.add("teensy.log", ini["teensy"]["log"] == "true" or logger.recorder);
+  logCh->setOpen([this]()
+  { // open log file and write the header, when the channel is first on
     std::string fn = service.logPath + "log_teensy_io.txt";
-    logfile = fopen(fn.c_str(), "w");
+    logfile = logRx.open(fn, "%lu.%04ld Rx %s");
+    if (logfile == nullptr)
+      return;
+    logTx.share(logRx, "%lu.%04ld Tx %.*s");
+    logTxd.share(logRx, "%lu.%04ld Txd %s");
+    logQu.share(logRx, "%lu.%04ld Qu %d %s");
+    logNote.share(logRx, "%lu.%04ld ## %s");
     fprintf(logfile, "%% teensy communication to/from Teensy\n");
     fprintf(logfile, "%% 1 \tTime (sec) from system\n");
     fprintf(logfile, "%% 2 \t(Tx) Send to Teensy\n");
     fprintf(logfile, "%%   \t(Rx) Received from Teensy\n");
     fprintf(logfile, "%%   \t(Qu N) Put in queue to Teensy, now queue size N\n");
     fprintf(logfile, "%% 3 \tMessage string queued, send or received\n");
-  }
+  });
   // tell the Teensy its type-name - should be "robobot"
   // as this will change the function of Teensy to not do all the Regbot stuff.
   // request the robot name (returns in a 'dname' message)
@@ -126,13 +281,20 @@ void STeensy::setup()
     // save to Regbot flash
     teensy1.send("eew\n");
   }
-  // start thread and open teensy connection
-  th1 = new std::thread(runObj, this);
+  // the name is returned in a 'dname' message
+  addDecoder("dname", decodeName);
+  // answer to binary mode request
+  addDecoder("bin", decodeBinMode);
+  // event to wake the transmit thread, when there is something to send
+  wakeFd = eventfd(0, EFD_NONBLOCK);
+  // start transmit thread, then receive thread that opens the teensy connection
+  th2 = threads.spawn("teensy_tx", runTxObj, this);
+  th1 = threads.spawn("teensy_rx", runObj, this);
   // allow thread to open connection
   UTime t("now");
-  while (not teensyConnectionOpen and t.getTimePassed() < 10.0)
+  while (not teensyConnectionOpen and not stopUSB and t.getTimePassed() < 10.0)
   {
-    usleep(10000);
+    usleep(1000);
   }
   printf("# STeensy::setup: took %f sec to open to Teensy\n", t.getTimePassed());
   //
@@ -145,14 +307,29 @@ void STeensy::terminate()
   send("disp stopped\n", true);
   // wait until output queue is empty
   UTime t("now");
-  while (outQueue.size() > 0 and t.getTimePassed() < 1)
+  while (getTeensyCommQueueSize() > 0 and t.getTimePassed() < 1)
     usleep(1000);
+  if (useClockSync)
+    clockSync.printStatus();
+  linkStat.printStatus();
+  printf("# STeensy:: received %d, send %d messages, receive thread used %.3f sec opening, %.3f sec waiting, %.3f sec reading and decoding\n",
+         gotCnt, sendCnt, titsum[1], titsum[5], titsum[4]);
   stopUSB = true;
   if (th1 != nullptr)
   {
     th1->join();
 //     printf("# STeensy:: read thread closed\n");
   }
+  if (th2 != nullptr)
+  {
+    wakeTxThread();
+    th2->join();
+  }
+  if (wakeFd >= 0)
+  {
+    close(wakeFd);
+    wakeFd = -1;
+  }
   // close logfile if open
   if (logfile != nullptr)
   {
@@ -168,6 +345,10 @@ void STeensy::terminate()
 bool STeensy::send(const char* message, bool direct)
 {
   bool sendOK = false;
+  if (strncmp(message, "sub ", 4) == 0)
+    // stream period is used for the sample time
+    clockSync.setPeriod(message);
+  remember(message);
   if (direct)
   {
     sendOK = sendDirect(message);
@@ -182,27 +363,45 @@ bool STeensy::send(const char* message, bool direct)
 
 void STeensy::sendToQueue(const char* message)
 {
+  if (not replayFile.empty())
+    // no Teensy to confirm
+    return;
   // debug
 //   if (strncmp(message, "sub enc", 7) == 0)
 //     printf("# STeensy 'sub enc' just before queue %s", message);
   // debug end
-  outQueue.push(UOutQueue(message));
-  dataLock.lock(); // ensure consistency
-  toLogQu();
-//   printf("# STeensy::sendToQueue: added '%s' tx-queue, now size %d\n", outQueue.back().msg, (int)outQueue.size());
-  dataLock.unlock();
+  queueLock.lock();
+  if (outCnt < MAX_OUT_QUEUE)
+  { // use next free slot
+    UOutQueue & q = outQueue[(outHead + outCnt) % MAX_OUT_QUEUE];
+    q.setMessage(message);
+    q.queuedAt.now();
+    q.isSend = false;
+    q.confirmed = false;
+    q.resendCnt = 0;
+    q.seq = outSeq++;
+    outCnt++;
+    dataLock.lock(); // ensure consistency
+    toLogQu(q, outCnt);
+//   printf("# STeensy::sendToQueue: added '%s' tx-queue, now size %d\n", q.msg, outCnt);
+    dataLock.unlock();
+  }
+  else
+    printf("# STeensy::sendToQueue: queue full (%d messages), dropped: %s", outCnt, message);
+  queueLock.unlock();
+  // let the transmit thread send it
+  wakeTxThread();
 }
 
 bool STeensy::generateCRC(const char * cmd, char * crc)
 {
-  int n = strlen(cmd);
   // add CRC code
   const int MCL = 4;
 //   char crc[MCL];
   const char * p1 = cmd;
   bool gotNewline = false;
   int sum = 0;
-  for (int i = 0; i < n; i++)
+  while (*p1 != '\0')
   { // do not count \t, \r, \n etc
     // as these gives problems for systems with auto \n or \n\r or similar
     if (*p1 >= ' ')
@@ -220,83 +419,143 @@ bool STeensy::generateCRC(const char * cmd, char * crc)
 
 bool STeensy::sendDirect(const char* message)
 { // this function may be called by more than one thread
-  // so make sure that only one send at any one time
+  bool sendOK = false;
+  // remove any source information as this is not relevant for the Teensy
+  if (message[0] != '#')
+    sendOK = addToLane(message, 0);
+  return sendOK;
+}
+
+bool STeensy::sendMotv(float left, float right)
+{
+  const int MSL = 100;
+  char s[MSL];
+  snprintf(s, MSL, "motv %.2f %.2f\n", left, right);
+  UBinMotv d;
+  d.u[0] = left;
+  d.u[1] = right;
+  return addToLane(s, 1, BIN_MOTV, &d, sizeof(d));
+}
+
+bool STeensy::sendLatest(const char* message, int keyWords)
+{
+  remember(message);
+  return addToLane(message, keyWords);
+}
+
+void STeensy::remember(const char* message)
+{ // the last message for each session state keyword is kept,
+  // the keywords are known (from ini-file) before the port is opened
+  if (strncmp(message, "leave", 5) == 0 and message[5] <= ' ')
+  { // all subscriptions are stopped
+    sessionLock.lock();
+    session.remove("sub ");
+    sessionLock.unlock();
+    return;
+  }
+  if (message[0] == '#' or not isSessionKey(message))
+    return;
+  // subscriptions and servo has an index as second word
+  int keyWords = 1;
+  if (strncmp(message, "sub ", 4) == 0 or strncmp(message, "servo ", 6) == 0)
+    keyWords = 2;
+  sessionLock.lock();
+  if (not session.add(message, keyWords))
+    printf("# STeensy::remember: no space for session state: %s", message);
+  sessionLock.unlock();
+}
+
+bool STeensy::isSessionKey(const char* message)
+{
+  uint64_t key = UDispatch::getKey(message);
+  for (int k = 0; k < sessionKeyCnt; k++)
+  {
+    if (sessionKeys[k] == key)
+      return true;
+  }
+  return false;
+}
+
+int STeensy::replaySession()
+{ // queue all in one batch, the tx thread sends as many as the tx window allows
+  int n = 0;
+  sessionLock.lock();
+  for (int i = 0; i < session.cnt; i++)
+  { // only session state is saved
+    sendToQueue(session.slot[i].msg);
+    n++;
+  }
+  sessionLock.unlock();
+  return n;
+}
+
+bool STeensy::addToLane(const char* message, int keyWords,
+                        uint8_t binType, const void * bin, int binLen)
+{ // called by control threads, so no waiting for the port here
+  bool isOK = false;
+  if (teensyConnectionOpen)
+  {
+    txLock.lock();
+    isOK = txLane[txActive].add(message, keyWords, binType, bin, binLen);
+    if (not isOK)
+      txLaneFullCnt++;
+    int n = txLaneFullCnt;
+    txLock.unlock();
+    if (isOK)
+      wakeTxThread();
+    else if (n < 5)
+      printf("# STeensy::addToLane: lane full or message too long, dropped: %s", message);
+  }
+  return isOK;
+}
+
+bool STeensy::writeDirect(const void* data, int n)
+{ // the port is not closed while writing
   int timeoutMs = 100;
-//   printf("# STeensy try to send timeout=%dms, confirmSend=%d, msg:%s", timeoutMs, confirmSend, message);
   int t = 0;
-  bool lostConnection = false;
   bool sendOK = false;
-  std::string cmd = message;
-  // remove any source information as this is not relevant for the Teensy
-  if (teensyConnectionOpen and cmd[0] != '#')
-  { // simulator or not
-    // add CRC code
-    const int MCL = 4;
-    char crc[MCL];
-    bool gotNewline = generateCRC(message, crc);
-    cmd.insert(0, crc);
-    if (not gotNewline)
-      cmd.append(1, '\n');
-    int n = cmd.size();
-    //
-    sendLock.lock();
-    // may have been closed in the meantime
-    if (teensyConnectionOpen)
-    {
-      sendCnt++;
-//       printf("# STeensy sending directly CRC:'%s', msg:'%s'\n", crc, cmd);
-//       int m = write(usbport, crc, 3);
-      int d = 0;
-      int m;
-      while ((d < n) and (t < timeoutMs))
-      { // want to send n bytes to usbport within timeout period
-        m = write(usbport, &cmd[d], n - d);
-        if (m < 0)
-        { // error - an error occurred while sending
-          switch (errno)
-          { // may be an error, or just nothing send (buffer full)
-            case EAGAIN:
-              //not all send - just continue
-              printf("STeensy::sendDirect: waiting - nothing send %d/%d\n", d, n);
-              usleep(1000);
-              t += 1;
-              break;
-            default:
-              perror("STeensy::sendDirect (closing connection): ");
-              lostConnection = true;
-              break;
-          }
-          // dump the rest on most errors
-          if (lostConnection)
-            break;
+  const char * p1 = (const char *)data;
+  sendLock.lock();
+  if (not replayFile.empty())
+  { // discarded
+    lastTxTime.now();
+    sendOK = true;
+  }
+  // may have been closed in the meantime
+  else if (teensyConnectionOpen)
+  {
+    int d = 0;
+    while ((d < n) and (t < timeoutMs))
+    { // want to send n bytes to usbport within timeout period
+      int m = write(usbport, &p1[d], n - d);
+      if (m < 0)
+      { // error - an error occurred while sending
+        if (errno == EAGAIN)
+        { // output buffer full - wait for space
+          struct pollfd pfd;
+          pfd.fd = usbport;
+          pfd.events = POLLOUT;
+          pfd.revents = 0;
+          poll(&pfd, 1, 1);
+          t += 1;
         }
         else
-          // count bytes send
-          d += m;
-      }
-      sendOK = d == n;
-      dataLock.lock();
-      if (logfile != nullptr)
-      {
-        UTime t;
-        t.now();
-        fprintf(logfile, "%lu.%04ld Txd %s", t.getSec(), t.getMicrosec()/100, cmd.c_str());
-        if (not gotNewline)
-          fprintf(logfile, "\n");
+        { // lost connection is detected (and closed) by the receive thread
+          perror("STeensy::writeDirect");
+          break;
+        }
       }
-      dataLock.unlock();
-      // include a short break to ensure that Teensy do not get overloaded
-      usleep(500);
-    }
-    if (lostConnection)
-    {
-      closeUSB();
+      else
+        // count bytes send
+        d += m;
     }
-    else
-      lastTxTime.now();
-    sendLock.unlock();
+    sendOK = d == n;
+    if (not sendOK)
+      // queued messages will be resend after confirm timeout
+      printf("# STeensy::writeDirect: send %d of %d bytes\n", d, n);
+    lastTxTime.now();
   }
-//  printf("# STeensy:: send finished\n");
+  sendLock.unlock();
   return sendOK;
 }
 
@@ -311,15 +570,40 @@ void STeensy::closeUSB()
 //     printf("# STeensy::run - no relevant activity, shutting down\n");
 //     printf("# STeensy::run but open=%d, gotAct=%d, lastTime=%f, just=%d, justTime=%g\n",
 //           teensyConnectionOpen, gotActivityRecently, lastRxTime.getTimePassed(), justConnected, justConnectedTime.getTimePassed());
-    // then close the connection (after 100ms)
-    usleep(100000);
+    // don't close while sending
+    sendLock.lock();
     close(usbport);
     usbport = -1;
+    sendLock.unlock();
     justConnected = false;
+    sessionStart = false;
+    if (not stopUSB)
+    { // time the recovery
+      recovering = true;
+      lostTime.now();
+    }
+    // start in text mode on next connection
+    binaryMode = false;
+    // Teensy may be restarted
+    clockSync.reset();
+    binaryRequested = false;
+    // discard any unfinished line
+    rxCnt = 0;
+    rxStart = 0;
     // stop the tx queue and empty any remaining
     confirmSend = false;
-    while (not outQueue.empty())
-      outQueue.pop();
+    queueLock.lock();
+    outCnt = 0;
+    txInFlight = 0;
+    // round trip may differ on the new connection, start with the configured timeout
+    rto = confirmTimeout;
+    rtoBackoff = 0;
+    rttCnt = 0;
+    queueLock.unlock();
+    // the lane being send (if any) is discarded by the transmit thread
+    txLock.lock();
+    txLane[txActive].cnt = 0;
+    txLock.unlock();
   }
 }
 
@@ -329,31 +613,28 @@ void STeensy::closeUSB()
   * receive thread */
 void STeensy::run()
 { // read thread for REGBOT messages
-  int n = 0;
   rxCnt = 0;
-  int readIdleLoops = 0;
+  rxStart = 0;
   UTime t, terr;
   t.now();
   terr.now();
-  const int MTS = 10;
   UTime tit[MTS];
-  UTime msgTime;
-  float titsum[MTS] = {0};
-  // get robot name
-  tit[9].now();
-  bool ntpUpdate = false;
+  statTime.now();
+  ULoopProbe * probe = loopStat.probe("teensy_rx");
+  if (not replayFile.empty())
+  { // recorded session as data source
+    runReplay();
+    return;
+  }
   while (not stopUSB)
   { // handle Teensy connection
-    if ((not ntpUpdate) and
-        (
-          (teensyConnectionOpen and
-            not gotActivityRecently and
-            lastRxTime.getTimePassed() > 10
-          )
-          or
-          ( justConnected and
-            justConnectedTime.getTimePassed() > 20.0
-          )
+    if ((teensyConnectionOpen and
+          not gotActivityRecently and
+          lastRxTime.getTimePassed() > 10
+        )
+        or
+        ( justConnected and
+          justConnectedTime.getTimePassed() > 20.0
         ))
     { // connection timeout or failed to get connection name within 10 seconds, probably a wrong device
       // - shut down connection and try another
@@ -379,181 +660,647 @@ void STeensy::run()
       { // no name is received yet, so try again
         tit[2].now();
         // justconnected flag is cleared when receiving a 'dname' message from Teensy
-        send("hbti\n", true); // this may be lost - but no problem
-        send("leave\n", true); // stop any old subscriptions
+        // (hbti and leave is send when the connection is opened)
         justConnected = false;
         t.now();
         titsum[2] += tit[2].getTimePassed();
       }
+      if (binaryRequested and not binaryMode and
+          binaryRequestTime.getTimePassed() > binaryTimeout)
+      { // old firmware - stay in text mode
+        binaryRequested = false;
+        // don't ask again after a reconnect
+        binaryWanted = false;
+        printf("# STeensy:: no answer to binary mode request, using text mode\n");
+      }
+      if (sessionStart and not binaryRequested)
+      { // link mode is settled
+        sessionStart = false;
+        if (recovering)
+          // reconnect - send subscriptions and configuration again
+          replayCnt = replaySession();
+        else if (pingCnt > 0)
+        { // first connect - measure round trip time, one ping at a time
+          pingLeft = pingCnt;
+          send("idi\n");
+        }
+      }
+      if (recovering and not sessionStart and getTeensyCommQueueSize() == 0)
+      { // all replayed messages are confirmed
+        recovering = false;
+        const int MSL = 200;
+        char s[MSL];
+        snprintf(s, MSL, "# STeensy:: link recovered %.1f ms after loss (%.1f ms after reopen), %d messages replayed\n",
+                 lostTime.getTimePassed() * 1000, reopenTime.getTimePassed() * 1000, replayCnt);
+        printf("%s", s);
+        dataLock.lock();
+        toLog(&s[2]);
+        dataLock.unlock();
+      }
+      if (statInterval > 0 and statTime.getTimePassed() > statInterval)
+      { // link statistics to log
+        statTime.now();
+        const int MSL = 1000;
+        char s[MSL];
+        int n = snprintf(s, MSL, "stat got %d send %d, ", gotCnt, sendCnt);
+        linkStat.statLine(&s[n], MSL - n - 1);
+        strcat(s, "\n");
+        dataLock.lock();
+        toLog(s);
+        dataLock.unlock();
+      }
       if (gotActivityRecently and lastRxTime.getTimePassed() > 2)
       { // are loosing data - may be just temporarily
         gotActivityRecently = false;
       }
-      // read from USB
-      tit[3].now();
+      // wait for data from USB
+      tit[5].now();
+      bool gotData = waitForData(100);
+      titsum[5] += tit[5].getTimePassed();
       //
-      n = read(usbport, &rx[rxCnt], 1);
-      if (n < 0 and errno == EAGAIN)
-      { // no data
-        n = 0;
-      }
-      else if (n < 0)
-      { // other error - close connection
-        perror("Teensy::run port error");
-        usleep(100000);
-        sendLock.lock();
-        // don't close while sending
-        closeUSB();
-        sendLock.unlock();
-      }
-      titsum[3] += tit[3].getTimePassed();
-      //
-      // got a character - assemble to a text line
-      if (n == 1)
-      { // got a new character
+      if (gotData)
+      { // read all there is, and handle all complete lines
         tit[4].now(); // timing
-        //
-        if (rxCnt > 0)
-        {
-          rxCnt++;
-        }
-        else if (rx[0] == ';')
-        { // first character in a new message
-          msgTime.now();
-          rxCnt = 1;
-        }
-        // check for end of message, i.e. a new-line
-        if (rx[rxCnt-1] == '\n')
-        { // terminate string - end of new line
-          rx[rxCnt] = '\0';
-          // save to logfile if open
-          dataLock.lock();
-          toLogRx(rx, msgTime);
-          dataLock.unlock();
-          // handle this message line
-          if (crcCheck(rx))
-          { // got (at least) one valid message
-            const char * okMsg = &rx[3];
-            // check if this is a confirm message
-            if (strncmp(okMsg, "confirm", 7) == 0)
-            { // release next message
-              confirmSend = true;
-//               printf("# STeensy::run: received a confirm: '%s'\n", rx);
-              messageConfirmed(rx);
-            }
-            else
-            {
-              decode(okMsg, msgTime);
-            }
-          }
-          else
-            printf("# Teenst message discarded (crc-error) %s\n", rx);
-          // set activity timeer
-          gotActivityRecently = true;
-          lastRxTime.now();
-          // reset receive buffer
-          rxCnt = 0;
-          n = 0;
-          gotCnt++;
+        probe->begin();
+        if (not receiveData())
+        { // error - close connection
+          closeUSB();
         }
+        probe->end();
         titsum[4] += tit[4].getTimePassed();
       }
-      else if (n == 0)
-      {  // no data, so wait a bit
-        tit[5].now();
-        //
-        usleep(1000);
-        readIdleLoops++;
-        titsum[5] += tit[5].getTimePassed();
-      }
-      else
-      { // debug n!= 0 and n!= 1
-        tit[6].now();
-        printf("# Teensy::run: got n=%d chars, when asking for 1!\n", n);
-        fflush(nullptr);
-        titsum[6] += tit[6].getTimePassed();
-      }
-      if (not outQueue.empty())
-      { // got the first confirm
-//         printf("#STeensy:: que not empty\n");
-        tit[7].now();
-        if (not outQueue.front().isSend)
-        { // new message to send
-          sendLock.lock();
-          if (teensyConnectionOpen)
-          { // send queued message to Teensy
-            write(usbport, outQueue.front().msg, outQueue.front().len);
-            outQueue.front().sendAt.now();
-            outQueue.front().isSend = true;
-            outQueue.front().resendCnt++;
-            toLogTx();
-          }
-          sendLock.unlock();
+    } // connected
+  }
+  closeUSB();
+}
+
+void STeensy::runTx()
+{ // transmit thread, the only thread writing to the port
+  ULoopProbe * probe = loopStat.probe("teensy_tx");
+  while (not stopUSB)
+  {
+    int us = 100000;
+    if (teensyConnectionOpen)
+      us = txWaitUs();
+    float late = 0;
+    if (us > 0)
+    { // woken by a new message, or late after the timeout
+      UTime t("now");
+      waitForTx(us);
+      late = fmaxf(t.getTimePassed() - us * 1e-6, 0);
+    }
+    if (teensyConnectionOpen)
+    { // real-time lane first, then the queue, in one write
+      probe->begin(late);
+      int n = serviceLane(txBuf, 0);
+      n = serviceQueue(txBuf, n);
+      if (n > 0)
+        writeDirect(txBuf, n);
+      probe->end();
+    }
+  }
+}
+
+int STeensy::txWaitUs()
+{ // the transmit thread needs to wake
+  // to send new messages or resend queued messages
+  int us = 100000;
+  txLock.lock();
+  bool pending = txLane[txActive].cnt > 0;
+  txLock.unlock();
+  queueLock.lock();
+  for (int i = 0; i < outCnt; i++)
+  {
+    UOutQueue & q = outQueue[(outHead + i) % MAX_OUT_QUEUE];
+    if (q.confirmed)
+      continue;
+    if (not q.isSend)
+    { // waiting to be send
+      if (txInFlight >= txWindow)
+        break;
+      if (heldBySameKey(i))
+        // released by its confirm (a wake-up) or
+        // by the timeout of the earlier message (in 'us' already)
+        continue;
+      pending = true;
+      break;
+    }
+    // wait until confirm timeout
+    int dt = int((q.timeout - q.sendAt.getTimePassed()) * 1e6) + 1;
+    if (dt < us)
+      us = dt;
+  }
+  queueLock.unlock();
+  if (pending)
+  { // keep a minimum time between writes, so that Teensy do not get overloaded
+    int dt = int((txInterval - lastTxTime.getTimePassed()) * 1e6);
+    if (dt < us)
+      us = dt;
+  }
+  if (us < 0)
+    us = 0;
+  return us;
+}
+
+int STeensy::serviceLane(char * buf, int bufCnt)
+{ // swap lanes, so that new messages can be added while sending
+  txLock.lock();
+  UTxLane & lane = txLane[txActive];
+  txActive = 1 - txActive;
+  txLock.unlock();
+  if (lane.cnt == 0)
+    return bufCnt;
+  bool binary = binaryMode;
+  for (int i = 0; i < lane.cnt; i++)
+  {
+    UTxSlot & slt = lane.slot[i];
+    if (binary and slt.binType > 0)
+      bufCnt += UBinLink::encodeFrame(slt.binType, slt.bin, slt.binLen, (uint8_t*)&buf[bufCnt]);
+    else if (binary)
+      // as text packet (CRC is in the frame)
+      bufCnt += UBinLink::encodeFrame(BIN_TEXT, slt.msg, slt.len, (uint8_t*)&buf[bufCnt]);
+    else
+    { // check code in front (the terminating zero is overwritten)
+      generateCRC(slt.msg, &buf[bufCnt]);
+      memcpy(&buf[bufCnt + 3], slt.msg, slt.len);
+      bufCnt += slt.len + 3;
+    }
+  }
+  dataLock.lock();
+  if (logCh->active() and logfile != nullptr)
+  {
+    UTime t("now");
+    for (int i = 0; i < lane.cnt; i++)
+      logTxd.add(logfile, t.getSec(), t.getMicrosec()/100, lane.slot[i].msg);
+  }
+  sendCnt += lane.cnt;
+  dataLock.unlock();
+  txLock.lock();
+  lane.cnt = 0;
+  txLock.unlock();
+  return bufCnt;
+}
+
+int STeensy::serviceQueue(char * buf, int bufCnt)
+{ // send new messages and resend timed out messages
+  bool binary = binaryMode;
+  UTime now("now");
+  // the backoff is increased once per timeout event, by the oldest message,
+  // not by every message in a window that times out together
+  bool oldest = true;
+  queueLock.lock();
+  for (int i = 0; i < outCnt; i++)
+  {
+    UOutQueue & q = outQueue[(outHead + i) % MAX_OUT_QUEUE];
+    if (q.confirmed)
+      continue;
+    if (q.isSend)
+    { // waiting for confirmation - check for too old
+      float dt = now - q.sendAt;
+      if (dt > q.timeout)
+      {
+        // debug
+        const int MSL = 150;
+        char s[MSL];
+        snprintf(s, MSL, "# STeensy::run: msg %d retry after %.5f sec (retry=%d, queue=%d):%s",
+                q.seq, dt, q.resendCnt, outCnt, q.msg);
+        dataLock.lock();
+        toLog(s);
+        dataLock.unlock();
+        // debug end
+        txInFlight--;
+        // back off for the following messages
+        if (oldest)
+          rtoBackoff++;
+        if (q.resendCnt < confirmRetryCntMax)
+        { // just try again
+          q.isSend = false;
+          confirmRetryCnt++;
         }
         else
-        { // waiting for confirmation - check for too old
-//           printf("# STeensy:: is send - waiting for confirm\n");
-          float dt = outQueue.front().sendAt.getTimePassed();
-          if (dt > confirmTimeout)
-          {
-            // debug
-            const int MSL = 150;
-            char s[MSL];
-            snprintf(s, MSL, "# STeensy::run: msg retry after %.5f sec (retry=%d, queue=%d):%s",
-                    outQueue.front().sendAt.getTimePassed(),
-                    outQueue.front().resendCnt,
-                    (int)outQueue.size(),
-                    outQueue.front().msg);
-            toLog(s);
-//             printf("%s\n", s);
-            // debug end
-            if (outQueue.front().resendCnt < confirmRetryCntMax)
-            { // just try again
-              outQueue.front().isSend = false;
-              confirmRetryCnt++;
-            }
-            else
-            { // remove from queue
-              outQueue.pop();
-              confirmRetryDump++;
-            }
-          }
+        { // give up on this message
+          q.confirmed = true;
+          confirmRetryDump++;
         }
-        titsum[7] += tit[7].getTimePassed();
       }
-    } // connected
-    ntpUpdate = false;
-    if (tit[9].getTimePassed() > 2.0)
-    { // likely NTP update received
-      titsum[9]+= tit[9].getTimePassed();
-      // don't close connection based on a NPT update
-      ntpUpdate = true;
-      printf("# NTP update? time glitch of %.3f sec\n", tit[9].getTimePassed());
-      fflush(nullptr);
+      oldest = false;
+    }
+    if (not q.confirmed and not q.isSend)
+    { // ready to send, if window allows
+      if (txInFlight >= txWindow)
+        break;
+      // a (resend) earlier message with the same key must get there first,
+      // else e.g. 'sub enc 0' could be executed after 'sub enc 8'
+      if (heldBySameKey(i))
+        continue;
+      if (binary)
+        // as text packet without the ';NN' check code
+        bufCnt += UBinLink::encodeFrame(BIN_TEXT, &q.msg[3], q.len - 3, (uint8_t*)&buf[bufCnt]);
+      else
+      {
+        memcpy(&buf[bufCnt], q.msg, q.len);
+        bufCnt += q.len;
+      }
+      // log now, as the slot may be reused when the queue is unlocked
+      dataLock.lock();
+      toLogTx(q.msg, now);
+      dataLock.unlock();
+      q.sendAt = now;
+      q.timeout = getRto();
+      q.isSend = true;
+      q.resendCnt++;
+      txInFlight++;
     }
-    tit[9].now();
   }
-  closeUSB();
-}  
+  // release dropped messages from the queue
+  while (outCnt > 0 and outQueue[outHead].confirmed)
+  {
+    outHead = (outHead + 1) % MAX_OUT_QUEUE;
+    outCnt--;
+  }
+  queueLock.unlock();
+  return bufCnt;
+}
+
+bool STeensy::heldBySameKey(int i)
+{ // an earlier message with the same key is not confirmed yet
+  const UOutQueue & q = outQueue[(outHead + i) % MAX_OUT_QUEUE];
+  for (int j = 0; j < i; j++)
+  {
+    const UOutQueue & p = outQueue[(outHead + j) % MAX_OUT_QUEUE];
+    if (not p.confirmed and p.sameKey(q))
+      return true;
+  }
+  return false;
+}
+
+bool STeensy::waitForData(int timeoutMs)
+{ // wait for data from the USB port
+  struct pollfd pfd;
+  pfd.fd = usbport;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  int n = poll(&pfd, 1, timeoutMs);
+  // any error (or hangup) is detected by the following read
+  return n > 0 and (pfd.revents != 0);
+}
+
+void STeensy::waitForTx(int us)
+{ // wait for a wake-up event from another thread, or timeout
+  struct pollfd pfd;
+  pfd.fd = wakeFd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  struct timespec ts;
+  ts.tv_sec = us / 1000000;
+  ts.tv_nsec = (us % 1000000) * 1000;
+  if (ppoll(&pfd, 1, &ts, nullptr) > 0)
+  { // clear the wake-up event
+    uint64_t v;
+    read(wakeFd, &v, sizeof(v));
+  }
+}
+
+void STeensy::wakeTxThread()
+{
+  if (wakeFd >= 0)
+  {
+    uint64_t v = 1;
+    write(wakeFd, &v, sizeof(v));
+  }
+}
+
+bool STeensy::receiveData()
+{ // read all available characters in one go
+  int n = read(usbport, &rx[rxCnt], MAX_RX_CNT - rxCnt - 1);
+  if (n < 0 and errno == EAGAIN)
+    // no data after all
+    return true;
+  if (n <= 0)
+  { // device is gone or other error
+    if (n < 0)
+      perror("Teensy::run port error");
+    else
+      printf("# Teensy::run port closed\n");
+    return false;
+  }
+  UTime readTime("now");
+  if (rxStart == rxCnt)
+  { // no unfinished line, so new line starts in this block
+    rxStart = 0;
+    rxCnt = 0;
+    rxSum = 0;
+    rxLineTime = readTime;
+  }
+  int end = rxCnt + n;
+  // scan new data only
+  int scan = rxCnt;
+  rxCnt = end;
+  while (rxStart < end)
+  {
+    if (binaryMode)
+    { // frames end with a zero
+      if (scan < rxStart)
+        scan = rxStart;
+      char * p2 = (char*)memchr(&rx[scan], 0, end - scan);
+      if (p2 == nullptr)
+        // no more full frames
+        break;
+      int nz = p2 - rx;
+      handleFrame((uint8_t*)&rx[rxStart], nz - rxStart, rxLineTime);
+      rxStart = nz + 1;
+      scan = rxStart;
+      rxLineTime = readTime;
+      continue;
+    }
+    if (rx[rxStart] != ';')
+    { // not a message start - skip to next start character
+      char * p1 = (char*)memchr(&rx[rxStart], ';', end - rxStart);
+      if (p1 == nullptr)
+      { // no message start
+        rxStart = end;
+        break;
+      }
+      rxStart = p1 - rx;
+      if (rxStart >= scan)
+        // start of line is from this read
+        rxLineTime = readTime;
+    }
+    if (scan < rxStart)
+    { // skipped to a new line start
+      scan = rxStart;
+      rxSum = 0;
+    }
+    // find end of line and the CRC sum in the same pass
+    const char * p2 = scanLine(&rx[scan], &rx[end], rxSum);
+    if (p2 == nullptr)
+    { // no more full lines
+      // the sum so far is kept in rxSum
+      break;
+    }
+    // terminate line in place (after the new-line)
+    int nl = p2 - rx;
+    char next = rx[nl + 1];
+    rx[nl + 1] = '\0';
+    handleLine(&rx[rxStart], rxLineTime, rxSum);
+    rx[nl + 1] = next;
+    // next line starts after the new-line, and is from this read
+    rxStart = nl + 1;
+    scan = rxStart;
+    rxSum = 0;
+    rxLineTime = readTime;
+  }
+  if (rxStart >= end)
+  { // all used
+    rxStart = 0;
+    rxCnt = 0;
+  }
+  else if (rxStart > 0)
+  { // move the unfinished line to start of buffer
+    rxCnt = end - rxStart;
+    memmove(rx, &rx[rxStart], rxCnt);
+    rxStart = 0;
+  }
+  else if (rxCnt >= MAX_RX_CNT - 1)
+  { // line too long to be a valid message - discard
+    printf("# Teensy::run: no new-line in %d characters - discarded\n", rxCnt);
+    rxStart = 0;
+    rxCnt = 0;
+  }
+  return true;
+}
+
+void STeensy::handleLine(const char * line, UTime & msgTime, int sum)
+{
+  // save to logfile if open
+  dataLock.lock();
+  toLogRx(line, msgTime);
+  dataLock.unlock();
+  // handle this message line
+  bool crcMatch = true;
+  if (crcCheck(line, sum, &crcMatch))
+  { // got (at least) one valid message
+    if (not crcMatch)
+      linkStat.crcError(UDispatch::getKey(&line[3]));
+    handleMessage(&line[3], msgTime);
+  }
+  else
+  {
+    linkStat.crcError(0);
+    printf("# Teenst message discarded (crc-error) %s\n", line);
+  }
+  // set activity timeer
+  gotActivityRecently = true;
+  lastRxTime.now();
+  gotCnt++;
+}
+
+void STeensy::handleMessage(const char * msg, UTime & msgTime)
+{ // check if this is a confirm message
+  if (strncmp(msg, "confirm", 7) == 0)
+  { // release next message
+    confirmSend = true;
+//       printf("# STeensy::run: received a confirm: '%s'\n", msg);
+    messageConfirmed(msg);
+  }
+  else
+  { // time of sampling, rather than time of reception
+    UTime sampleTime = msgTime;
+    uint64_t key = UDispatch::getKey(msg);
+    if (useClockSync)
+      clockSync.correct(key, sampleTime);
+    bool used = decode(msg, sampleTime);
+    linkStat.decoded(key, msgTime, used);
+  }
+}
+
+void STeensy::handleFrame(const uint8_t * frame, int n, UTime & msgTime)
+{
+  uint8_t packet[UBinLink::MAX_PACKET];
+  uint8_t type;
+  int m = UBinLink::decodeFrame(frame, n, packet, type);
+  if (m < 0)
+  {
+    binaryErrCnt++;
+    linkStat.crcError(0);
+    printf("# Teensy binary frame discarded (crc-error, %d bytes)\n", n);
+  }
+  else if (type == BIN_TEXT)
+  { // a text message, as in text mode but without check code
+    char * msg = (char*)&packet[1];
+    msg[m] = '\0';
+    dataLock.lock();
+    toLogRx(msg, msgTime);
+    dataLock.unlock();
+    handleMessage(msg, msgTime);
+  }
+  else
+  { // typed packet
+    if (logCh->on or (printCh != nullptr and printCh->on))
+    { // log as the same message in text
+      const int MSL = 200;
+      char s[MSL];
+      UBinLink::toText(type, &packet[1], m, s, MSL);
+      dataLock.lock();
+      toLogRx(s, msgTime);
+      dataLock.unlock();
+    }
+    // time of sampling, rather than time of reception
+    UTime sampleTime = msgTime;
+    uint64_t key = UDispatch::getKey(UBinLink::keyword(type));
+    if (useClockSync)
+      clockSync.correct(key, sampleTime);
+    BinDecodeFunc func = nullptr;
+    if (type < BIN_TYPE_CNT)
+      func = binDecoders[type];
+    bool used = func != nullptr and func(type, &packet[1], m, sampleTime);
+    if (not used)
+      printf(" UTeensy:: unused Teensy binary packet type %d (%d bytes)\n", type, m);
+    linkStat.decoded(key, msgTime, used);
+  }
+  // set activity timeer
+  gotActivityRecently = true;
+  lastRxTime.now();
+  gotCnt++;
+}
+
+void STeensy::runReplay()
+{
+  ULogReader rd;
+  if (not rd.open(replayFile.c_str()))
+  { // setup fails as with no Teensy
+    stopUSB = true;
+    return;
+  }
+  int rxStream = rd.find("log_teensy_io.txt", "%lu.%04ld Rx %s");
+  if (rxStream == 0)
+  {
+    printf("# STeensy::replay: no received messages (log_teensy_io.txt) in %s\n", replayFile.c_str());
+    stopUSB = true;
+    return;
+  }
+  rd.select(rxStream);
+  printf("# STeensy::replay: %s, %.1f sec (%s), speed %g\n", replayFile.c_str(),
+         (rd.endTime - rd.startTime) * 1e-9, rd.indexed ? "indexed" : "no index", replaySpeed);
+  // as if connected, but nothing is send
+  replaying = true;
+  teensyConnectionOpen = true;
+  // wait for all modules to subscribe to the messages
+  while (not service.setupComplete and not stopUSB)
+    // the driver is not a user of the clock
+    clockService.sleepRealUs(1000);
+  // real time start (before a virtual clock)
+  UTime start("now");
+  bool virtualClock = replaySpeed <= 0;
+  if (virtualClock)
+    // the recorded time drives the clock
+    clockService.startVirtual();
+  int64_t virtualStart = UTime("now").getNs();
+  int64_t recStart = 0;
+  int cnt = 0;
+  ULogRecord rec;
+  ULoopProbe * probe = loopStat.probe("teensy_rx");
+  while (not stopUSB and rd.next(rec))
+  { // time as recorded: seconds and 1/10 ms, then the message
+    int64_t sec, dec;
+    if (rec.size < 17)
+      continue;
+    memcpy(&sec, rec.data, sizeof(sec));
+    memcpy(&dec, &rec.data[8], sizeof(dec));
+    const char * line = (const char *)&rec.data[16];
+    if (recStart == 0)
+      recStart = rec.time;
+    if (virtualClock)
+      // wake the threads due before this message,
+      // and wait for all threads to be idle
+      clockService.advanceTo(virtualStart + rec.time - recStart);
+    else
+    { // wait for the (scaled) recorded time
+      float due = (rec.time - recStart) * 1e-9 / replaySpeed;
+      float dt = due - start.getTimePassed();
+      if (dt > 0.0005)
+        clockService.sleepRealUs(int(dt * 1e6));
+    }
+    UTime msgTime;
+    msgTime.setTime(sec, dec * 100);
+    probe->begin();
+    dataLock.lock();
+    toLogRx(line, msgTime);
+    dataLock.unlock();
+    if (line[0] == ';')
+      // text mode line, check code is not tested
+      handleMessage(&line[3], msgTime);
+    else
+      handleMessage(line, msgTime);
+    probe->end();
+    gotActivityRecently = true;
+    lastRxTime.now();
+    gotCnt++;
+    cnt++;
+  }
+  if (virtualClock)
+  { // let the last messages be handled
+    clockService.advanceTo(UTime("now").getNs());
+    printf("# STeensy::replay: %.3f sec on the virtual clock\n", (UTime("now").getNs() - virtualStart) * 1e-9);
+    clockService.stopVirtual();
+  }
+  printf("# STeensy::replay: %d messages in %.3f sec\n", cnt, start.getTimePassed());
+  replaying = false;
+}
 
-bool STeensy::crcCheck(const char* msg)
+bool STeensy::addBinDecoder(uint8_t type, BinDecodeFunc func)
+{
+  bool isOK = type > BIN_TEXT and type < BIN_TYPE_CNT;
+  if (isOK)
+    binDecoders[type] = func;
+  return isOK;
+}
+
+bool STeensy::decodeBinMode(const char* msg, UTime&)
+{ // answer to 'bin 1' request, the Teensy sends binary frames after this message
+  UFields f(msg);
+  int mode = 0;
+  f.get(mode);
+  if (teensy1.binaryRequested)
+  {
+    teensy1.binaryRequested = false;
+    teensy1.binaryMode = mode == 1;
+    if (teensy1.binaryMode)
+      printf("# STeensy:: using binary mode\n");
+    else
+    { // don't ask again after a reconnect
+      teensy1.binaryWanted = false;
+      printf("# STeensy:: binary mode refused, using text mode\n");
+    }
+  }
+  return true;
+}
+
+const char * STeensy::scanLine(const char * p1, const char * end, int & sum)
+{
+  while (p1 < end)
+  { // sum all visible characters
+    if (*p1 >= ' ')
+      sum += *p1;
+    else if (*p1 == '\n')
+      return p1;
+    p1++;
+  }
+  return nullptr;
+}
+
+bool STeensy::crcCheck(const char* msg, int sum, bool * crcMatch)
 { // not really a standard CRC check, just modulus of all visible characters
   bool dataOK = false;
   if (msg[0] == ';')
   { // there is a CRC check code
     if (isdigit(msg[1]) and isdigit(msg[2]))
-    {
-      const char * p1 = &msg[3];
-      int sum = 0;
-      int m = strlen(p1);
-      for (int i = 0; i < m; i++)
-      { // sum all visible characters
-        if (*p1 >= ' ')
-          sum += *p1;
-        p1++;
-      }
+    { // the sum includes the CRC code itself
+      sum -= msg[0] + msg[1] + msg[2];
       int q1 = (sum % 99) + 1;
       int q2 = (msg[1] - '0') * 10 + msg[2] - '0';
+      if (crcMatch != nullptr)
+        *crcMatch = q1 == q2;
       if (q1 != q2)
         printf("# UHandler::handleCommand: CRC check failed (from Teensy) q1=%d != q2=%d (msg=%s\n", q1, q2, msg);
       dataOK = true;
@@ -565,28 +1312,60 @@ bool STeensy::crcCheck(const char* msg)
 
 void STeensy::messageConfirmed(const char* confirm)
 { // got a confirm message
-  // test for first message in tx queue
-  // remove if a match - else ignore
-  if (not outQueue.empty())
-  {
-    if (outQueue.front().isSend)
-    { // this message is send, but is it equal
-      bool eq = outQueue.front().compare(&confirm[11]);
-      if (eq)
+  // find the oldest send message that matches,
+  // confirms may arrive out of order
+  bool found = false;
+  queueLock.lock();
+  for (int i = 0; i < outCnt; i++)
+  {
+    UOutQueue & q = outQueue[(outHead + i) % MAX_OUT_QUEUE];
+    if (q.isSend and not q.confirmed and q.compare(&confirm[8]))
+    {
+      if (q.resendCnt > 1)
       {
-        if (outQueue.front().resendCnt > 1)
-        {
-          printf("# STeensy::run: Confirm OK after %d retry and %.4fs: send'%s'",
-                  outQueue.front().resendCnt,
-                  outQueue.front().queuedAt.getTimePassed(),
-                  outQueue.front().msg);
-        }
-        outQueue.pop();
+        printf("# STeensy::run: Confirm OK after %d retry and %.4fs: send'%s'",
+                q.resendCnt,
+                q.queuedAt.getTimePassed(),
+                q.msg);
       }
       else
-      { // no match
-        confirmMismatchCnt++;
+      { // only messages send once gives an unambiguous round trip time
+        float dt = q.sendAt.getTimePassed();
+        updateRtt(dt);
+        linkStat.addRtt(dt);
       }
+      rtoBackoff = 0;
+      q.confirmed = true;
+      txInFlight--;
+      found = true;
+      break;
+    }
+  }
+  if (not found)
+  { // no match
+    confirmMismatchCnt++;
+  }
+  // release confirmed messages from the queue
+  while (outCnt > 0 and outQueue[outHead].confirmed)
+  {
+    outHead = (outHead + 1) % MAX_OUT_QUEUE;
+    outCnt--;
+  }
+  queueLock.unlock();
+  // the tx window may allow more messages now
+  if (found)
+    wakeTxThread();
+  if (pingLeft > 0 and found and strncmp(&confirm[8], "!idi", 4) == 0)
+  { // a ping is returned
+    pingLeft--;
+    if (pingLeft > 0)
+      sendToQueue("idi\n");
+    else
+    {
+      float rMin, rAvg, rMax;
+      int n = linkStat.getRtt(rMin, rAvg, rMax);
+      printf("# STeensy:: round trip %.3f ms (min), %.3f ms (avg), %.3f ms (max) from %d confirmed messages\n",
+             rMin * 1000, rAvg * 1000, rMax * 1000, n);
     }
   }
 }
@@ -616,8 +1395,12 @@ bool STeensy::openToTeensy()
         snprintf(s, MSL, "# STeensy::openToTeensy open '%s' failed:",  usbDevName.c_str());
         perror(s);
       }
-      // wait a bit before re-connection
-      usleep(300000);
+      // wait a bit before re-connection,
+      // shortly after a lost connection, the device is likely to be back soon
+      if (recovering and lostTime.getTimePassed() < 2.0)
+        usleep(5000);
+      else
+        usleep(300000);
       connectErrCnt++;
     }
     else
@@ -646,10 +1429,20 @@ bool STeensy::openToTeensy()
       justConnected = true;
       toLog("Connection to USB open\n");
       justConnectedTime.now();
-      teensy1.send("hbti\n", true);
-      usleep(5000);
-      teensy1.send("sub hbt 50\n", true);
-      usleep(50000);
+      reopenTime.now();
+      // not through send(), as this is not session state,
+      // and a 'leave' (stop any old subscriptions) would clear the saved subscriptions
+      sendDirect("hbti\n");
+      sendDirect("leave\n");
+      sendDirect("sub hbt 50\n");
+      if (binaryWanted)
+      { // ask for binary mode, the answer is 'bin 1' if supported
+        binaryRequested = true;
+        binaryRequestTime.now();
+        sendDirect("bin 1\n");
+      }
+      // pings or replay, when binary mode is settled
+      sessionStart = true;
       //         initMessageTypes();
       // assume there is activity - in order not to
       // get an error right away
@@ -672,41 +1465,102 @@ bool STeensy::decode(const char * msg, UTime & msgTime)
     printf("#STeensy got %s for decoding:%s", s, msg);
   }
   // debug end
-  bool used = true;
-  const char * p1 = msg;
-
-  if      (service.decode(msg, msgTime))
-  { // nothing to do here
-  }
-  else if (strncmp(p1, "dname ", 6) == 0)
-  { // got the robot name from Teensy
-    p1 += 6;
-    p1 = strchr(p1, ' ');
-    if (p1 != nullptr and *p1 == ' ')
-    {
-      ini["id"]["name"] = ++p1;
-    }
+  bool used = false;
+  UDispatch::DecodeFunc func = decoders.find(msg);
+  if (func != nullptr)
+  { // a module has registered this keyword
+    used = func(msg, msgTime);
   }
   else if (msg[0] == '#')
   { // service message - just ignored
 //     printf("# UTeensy:: service message from Teensy: %s", msg);
+    used = true;
   }
-  else
+  if (not used)
   {
     printf(" UTeensy:: unused Teensy message: %s", msg);
   }
   return used;
 }
 
+bool STeensy::decodeName(const char* msg, UTime&)
+{ // got the robot name from Teensy
+  const char * p1 = msg;
+  if (strncmp(p1, "dname ", 6) == 0)
+  {
+    p1 += 6;
+    p1 = strchr(p1, ' ');
+    if (p1 != nullptr and *p1 == ' ')
+    {
+      ini["id"]["name"] = ++p1;
+    }
+  }
+  return true;
+}
+
 int STeensy::getTeensyCommError(int& retryCnt)
 {
   retryCnt = confirmRetryCnt;
   return confirmRetryDump;
 }
 
+void STeensy::updateRtt(float rtt)
+{ // smoothed round trip time and variation as in TCP (RFC 6298)
+  if (rttCnt == 0)
+  {
+    rttSmooth = rtt;
+    rttVar = rtt / 2;
+  }
+  else
+  {
+    rttVar = 0.75 * rttVar + 0.25 * fabsf(rttSmooth - rtt);
+    rttSmooth = 0.875 * rttSmooth + 0.125 * rtt;
+  }
+  rttCnt++;
+  // allow at least 1ms variation (poll resolution)
+  rto = rttSmooth + fmaxf(0.001, 4 * rttVar);
+  if (rto < rtoMin)
+    rto = rtoMin;
+  else if (rto > rtoMax)
+    rto = rtoMax;
+}
+
+float STeensy::getRto()
+{ // double the timeout for every consecutive timeout
+  float t = rto;
+  for (int i = 0; i < rtoBackoff and t < rtoMax; i++)
+    t *= 2;
+  if (t > rtoMax)
+    t = rtoMax;
+  return t;
+}
+
+int STeensy::getTeensyCommRtt(float& rtt, float& rttVariation, float& rtoNow)
+{
+  queueLock.lock();
+  rtt = rttSmooth;
+  rttVariation = rttVar;
+  rtoNow = getRto();
+  int n = rttCnt;
+  queueLock.unlock();
+  return n;
+}
+
+int STeensy::getTeensyCommCount(int & send)
+{
+  send = sendCnt;
+  return gotCnt;
+}
+
 int STeensy::getTeensyCommQueueSize()
 {
-  return outQueue.size();
+  queueLock.lock();
+  int n = outCnt;
+  queueLock.unlock();
+  txLock.lock();
+  n += txLane[0].cnt + txLane[1].cnt;
+  txLock.unlock();
+  return n;
 }
 
 void STeensy::toLog(const char* msg)
@@ -714,69 +1568,70 @@ void STeensy::toLog(const char* msg)
   UTime t("now");
   if (service.stop)
     return;
-  if (logfile != nullptr)
+  if (logCh->active() and logfile != nullptr)
   {
-    fprintf(logfile, "%lu.%04ld ## %s", t.getSec(), t.getMicrosec()/100, msg);
+    logNote.add(logfile, t.getSec(), t.getMicrosec()/100, msg);
   }
-  if (toConsole)
+  if (printCh != nullptr and printCh->active())
   {
     printf("%lu.%04ld ## %s", t.getSec(), t.getMicrosec()/100, msg);
   }
 }
 
 
-void STeensy::toLogRx(const char*, UTime & mt)
+void STeensy::toLogRx(const char * line, UTime & mt)
 {
   if (service.stop)
     return;
-  if (logfile != nullptr)
+  if (logCh->active() and logfile != nullptr)
   {
-    fprintf(logfile, "%lu.%04ld Rx %s", mt.getSec(), mt.getMicrosec()/100, rx);
+    logRx.add(logfile, mt.getSec(), mt.getMicrosec()/100, line);
   }
-  if (toConsole)
+  if (printCh != nullptr and printCh->active())
   {
-    printf("%lu.%04ld Rx %s", mt.getSec(), mt.getMicrosec()/100, rx);
+    printf("%lu.%04ld Rx %s", mt.getSec(), mt.getMicrosec()/100, line);
   }
 }
 
-void STeensy::toLogTx()
-{
+void STeensy::toLogTx(const char * msg, UTime & sendAt)
+{ // msg is a queued message (with check code), ending with a new-line
   if (service.stop)
     return;
-  if (logfile != nullptr)
+  int n = strchr(msg, '\n') - msg + 1;
+  if (logCh->active() and logfile != nullptr)
   {
-    fprintf(logfile, "%lu.%04ld Tx %s",
-            outQueue.front().sendAt.getSec(),
-            outQueue.front().sendAt.getMicrosec()/100,
-            outQueue.front().msg);
+    logTx.add(logfile,
+            sendAt.getSec(),
+            sendAt.getMicrosec()/100,
+            n, msg);
   }
-  if (toConsole)
+  if (printCh != nullptr and printCh->active())
   {
-    printf("%lu.%04ld Tx %s",
-            outQueue.front().sendAt.getSec(),
-            outQueue.front().sendAt.getMicrosec()/100,
-            outQueue.front().msg);
+    printf("%lu.%04ld Tx %.*s",
+            sendAt.getSec(),
+            sendAt.getMicrosec()/100,
+            n, msg);
   }
 }
 
-void STeensy::toLogQu()
+void STeensy::toLogQu(UOutQueue & q, int queueSize)
 {
   if (service.stop)
     return;
-  if (logfile != nullptr)
+  if (logCh->active() and logfile != nullptr)
   {
-    fprintf(logfile, "%lu.%04ld Qu %d %s",
-            outQueue.back().queuedAt.getSec(),
-            outQueue.back().queuedAt.getMicrosec()/100,
-            (int)outQueue.size(),
-            outQueue.back().msg);
+    logQu.add(logfile,
+            q.queuedAt.getSec(),
+            q.queuedAt.getMicrosec()/100,
+            queueSize,
+            q.msg);
   }
-  if (toConsole)
+  if (printCh != nullptr and printCh->active())
   {
     printf("%lu.%04ld Qu %d %s",
-            outQueue.back().queuedAt.getSec(),
-            outQueue.back().queuedAt.getMicrosec()/100,
-            (int)outQueue.size(),
-            outQueue.back().msg);
+            q.queuedAt.getSec(),
+            q.queuedAt.getMicrosec()/100,
+            queueSize,
+            q.msg);
   }
 }
@@ -25,13 +25,18 @@
 #ifndef SREGBOT_H
 #define SREGBOT_H
 
+#include <atomic>
 #include <mutex>
-#include <queue>
 #include <thread>
 #include <string.h>
 #include <string>
 
 #include "utime.h"
+#include "udispatch.h"
+#include "ubinlink.h"
+#include "uclocksync.h"
+#include "ulinkstat.h"
+#include "ulogger.h"
 
 /**
  * Queue class for messages that require confirmation
@@ -45,9 +50,23 @@ public:
   bool isSend = false;
   UTime queuedAt;
   UTime sendAt;
-  int resendCnt;
+  /// confirm timeout used when this message was send (sec)
+  float timeout = 0.04;
+  int resendCnt = 0;
+  /// confirmed (or dropped), i.e. slot can be reused
+  bool confirmed = false;
+  /// sequence number (queue order) of this message
+  int seq = 0;
+  /// length of the key (keyword and an address like 'enc' in 'sub enc 8'),
+  /// messages with the same key are send in queue order
+  int keyLen = 0;
   /**
    * Constructor */
+  UOutQueue()
+  {
+    msg[0] = '\0';
+    len = 0;
+  }
   UOutQueue(const char * msg)
   {
     setMessage(msg);
@@ -58,6 +77,13 @@ public:
   /**
    * set new message */
   bool setMessage(const char* message);
+  /**
+   * Same key (keyword and address) as the other message,
+   * i.e. the Teensy must get them in this order */
+  bool sameKey(const UOutQueue & other) const
+  {
+    return keyLen == other.keyLen and strncmp(&msg[4], &other.msg[4], keyLen) == 0;
+  }
   /**
    * Confirm a match */
   bool compare(const char * got)
@@ -68,6 +94,55 @@ public:
   }
 };
 
+/**
+ * Slot in the real-time transmit lane for messages that are not confirmed.
+ * A message with a key replaces a pending message with the same key,
+ * so only the latest value is send (e.g. 'motv').
+ *  */
+class UTxSlot
+{
+public:
+  /// key is the first word(s) of the message, empty if never replaced
+  static const int MKL = 16;
+  char key[MKL];
+  /// message text (without check code)
+  static const int MML = 200;
+  char msg[MML];
+  int len = 0;
+  /// binary version of the message, used in binary mode (binType == 0 if none)
+  uint8_t binType = 0;
+  static const int MBL = 16;
+  uint8_t bin[MBL];
+  int binLen = 0;
+};
+
+/**
+ * Real-time transmit lane, a list of preallocated slots
+ * in the order the messages are added.
+ *  */
+class UTxLane
+{
+public:
+  static const int MAX_SLOTS = 32;
+  UTxSlot slot[MAX_SLOTS];
+  /// slots in use
+  int cnt = 0;
+  /**
+   * Add or replace a message
+   * \param message is the text message, ending with a new-line (or one is added)
+   * \param keyWords is the number of words in the key, 0 adds the message always
+   * \param binType is the type of the binary version (0 for none)
+   * \param bin is the binary payload
+   * \param binLen is the size of the binary payload
+   * \returns false if the lane is full or the message too long */
+  bool add(const char * message, int keyWords,
+           uint8_t binType = 0, const void * bin = nullptr, int binLen = 0);
+  /**
+   * Remove all messages where the key starts with this prefix
+   * \param keyPrefix is e.g. "sub " for all subscriptions */
+  void remove(const char * keyPrefix);
+};
+
 
 /**
  * The robot class handles the 
@@ -86,6 +161,19 @@ public:
   // flag to allocate a number (and robobot type) to the Teensy (Regbot)
   // must be in range [0..149]
   int saveRegbotNumber = -1;
+  /// Teensy time to host time, and sample time of streamed messages
+  UClockSync clockSync;
+  /// use sample time (from clockSync) as message time (from ini-file)
+  bool useClockSync = true;
+  /// statistics for received messages per keyword, and round trip time
+  ULinkStat linkStat;
+  /// replay received messages from this binary log (log_all.bin), rather than the Teensy
+  std::string replayFile;
+  /// replay speed relative to real time,
+  /// 0 is as fast as possible, driving a virtual clock (UClock), so no samples are skipped
+  float replaySpeed = 5;
+  /// replay is in progress
+  bool replaying = false;
 
   
 private:
@@ -101,12 +189,22 @@ private:
 //   mutex txLock;
 //   mutex logMtx;
   std::mutex eventUpdate;
+  // held while writing to (or closing) the port
   std::mutex sendLock;
-  // receive buffer
-  static const int MAX_RX_CNT = 1000;
+  // receive buffer, filled by one read() of all available bytes,
+  // lines are framed and decoded in place
+  static const int MAX_RX_CNT = 4096;
   char rx[MAX_RX_CNT];
   // number of characters in rx buffer
   int rxCnt;
+  // start of first (unfinished) line in rx buffer
+  int rxStart;
+  // CRC sum of the unfinished line so far
+  int rxSum = 0;
+  // time when the first byte of the unfinished line was read
+  UTime rxLineTime;
+  // eventfd used to wake the transmit thread (e.g. new message in a lane)
+  int wakeFd = -1;
   //
   UTime lastTxTime;
   // socket to simulator
@@ -115,12 +213,30 @@ private:
    * communication count */
   int gotCnt = 0;
   int sendCnt = 0;
+  /// time used by the receive thread (sec): 0 closing, 1 opening, 2 just connected, 4 read and decode, 5 waiting
+  static const int MTS = 10;
+  float titsum[MTS] = {0};
+  /// interval for the stat line in the log (sec), 0 is no stat line (from ini-file)
+  float statInterval = 10;
+  UTime statTime;
+  /// number of ping (confirmed 'idi') at connect (from ini-file), and pings left
+  int pingCnt = 10;
+  int pingLeft = 0;
+  /// connection is just opened, send pings or replay session state,
+  /// when binary mode request is answered
+  bool sessionStart = false;
+  /// connection is lost, and not recovered yet
+  bool recovering = false;
+  UTime lostTime;
+  UTime reopenTime;
+  int replayCnt = 0;
   /** interface just opened */
   bool justConnected = false;
   bool confirmSend = false;
 //   bool sendDirectFromNowOn = false;
 
   std::thread * th1;
+  std::thread * th2 = nullptr;
 
   
 public:
@@ -139,14 +255,63 @@ public:
    * \param direct for bypassing the default message queue
    * \returns true if send direct and delivered OK */
   bool send(const char * message, bool direct = false);
+  /**
+   * Send motor voltage (not confirmed) in the real-time lane,
+   * as a 'motv' message in text mode, or as a binary packet in binary mode.
+   * A pending (not yet send) motor voltage is replaced.
+   * \param left is left motor voltage
+   * \param right is right motor voltage
+   * \returns true if accepted for sending */
+  bool sendMotv(float left, float right);
+  /**
+   * Send a message (not confirmed) in the real-time lane,
+   * where a pending message with the same key is replaced,
+   * i.e. latest value wins.
+   * \param message is the message, e.g. "servo 1 200 0\n"
+   * \param keyWords is the number of words to use as key, e.g. 2 for "servo 1"
+   * \returns true if accepted for sending */
+  bool sendLatest(const char * message, int keyWords = 1);
   /**
    * runs the receive thread 
    * This run() function is called in a thread after a start() call.
    * This function will not return until the thread is stopped. */
   void run();
   /**
-  * decode commands potentially for this device */
+   * runs the transmit thread,
+   * sends the real-time lane and the queue (reliable lane)
+   * in one write, when there is something to send. */
+  void runTx();
+  /**
+  * decode a received message using the decoder registered for its keyword */
   bool decode(const char* msg, UTime & msgTime);
+  /**
+   * Register a decode function for messages starting with this keyword,
+   * e.g. "enc" for encoder messages.
+   * Can be called at any time, a new function for a keyword replaces the old.
+   * \param keyword is the first word in the message (max 8 characters)
+   * \param func is the function to call with the message
+   * \returns false if not added */
+  bool addDecoder(const char * keyword, UDispatch::DecodeFunc func)
+  {
+    return decoders.add(keyword, func);
+  }
+  /**
+   * Function to decode a typed binary packet
+   * \param type is the packet type (BIN_ENC, ...)
+   * \param data is the payload
+   * \param n is the payload size
+   * \param msgTime is the time the packet was received
+   * \returns true if the packet is used */
+  typedef bool (*BinDecodeFunc)(uint8_t type, const uint8_t * data, int n, UTime & msgTime);
+  /**
+   * Register a decode function for typed binary packets (used in binary mode only),
+   * \param type is the packet type (from ubinlink.h)
+   * \param func is the function to call with the payload
+   * \returns false if type is not valid */
+  bool addBinDecoder(uint8_t type, BinDecodeFunc func);
+  /**
+   * Is the link in binary mode */
+  inline bool isBinaryMode() { return binaryMode; }
   /** Generate 3 character CRC as ";XX", where
    * NN is sum of character value modulus 99 + 1.
    * Only characters with a value c>' ' counts
@@ -158,8 +323,35 @@ public:
    * Get Teensy communication errors */
   int getTeensyCommError(int & retryCnt);
   /**
-   * get messages queued, but not send */
+   * Get round trip statistics for confirmed messages
+   * \param rtt is the smoothed round trip time (sec)
+   * \param rttVar is the round trip time variation (sec)
+   * \param rto is the current retransmit timeout, including backoff (sec)
+   * \returns number of round trip samples used */
+  int getTeensyCommRtt(float & rtt, float & rttVar, float & rto);
+  /**
+   * Get number of messages received and send (not including queued messages)
+   * \param send is set to the number of messages send
+   * \returns number of messages received */
+  int getTeensyCommCount(int & send);
+  /**
+   * get messages queued, but not send (or not confirmed) in both lanes */
   int getTeensyCommQueueSize();
+  /**
+   * Find end of a received line, and sum the visible characters
+   * for the CRC check on the way.
+   * \param p1 is where to start the scan
+   * \param end is the end of the received data
+   * \param sum is the sum so far, visible characters are added
+   * \returns pointer to the new-line, or nullptr if not found */
+  static const char * scanLine(const char * p1, const char * end, int & sum);
+  /**
+   * Check for crc error
+   * \param rawMsg is the message preceded by crc
+   * \param sum is the sum of all visible characters in the line (from scanLine)
+   * \param crcMatch if not nullptr, then set to false if the check code does not match
+   * \return true if OK */
+  static bool crcCheck(const char * rawMsg, int sum, bool * crcMatch = nullptr);
 
 private:
   /**
@@ -167,13 +359,79 @@ private:
    * @param message  */
   void sendToQueue(const char* message);
   /**
-   * send this message directly to the Teensy port */
+   * send this message (not confirmed) in the real-time lane,
+   * without replacing any pending message */
   bool sendDirect(const char* message);
   /**
-   * Check for crc error
-   * \param rawMsg is the message preceded by crc
-   * \return true if OK */
-  bool crcCheck(const char * rawMsg);
+   * Add a message to the real-time lane and wake the transmit thread */
+  bool addToLane(const char * message, int keyWords,
+                 uint8_t binType = 0, const void * bin = nullptr, int binLen = 0);
+  /**
+   * Wait (in poll) for data from the Teensy.
+   * \param timeoutMs is max wait time in ms
+   * \returns true if there is data to read */
+  bool waitForData(int timeoutMs);
+  /**
+   * Wait for a wake-up event to the transmit thread
+   * \param us is max wait time in micro seconds */
+  void waitForTx(int us);
+  /**
+   * Read all available data from the Teensy and handle
+   * all complete lines in the receive buffer
+   * \returns false if connection is lost */
+  bool receiveData();
+  /**
+   * Handle one received line (CRC check, confirm or decode)
+   * \param line is the full line (starting with ';'), terminated by a '\n' and a zero
+   * \param msgTime is the time when the first character was read
+   * \param sum is the sum of visible characters in the line (for CRC) */
+  void handleLine(const char * line, UTime & msgTime, int sum);
+  /**
+   * Handle one received binary frame (CRC check, confirm or decode)
+   * \param frame is the frame without the final zero
+   * \param n is the frame size
+   * \param msgTime is the time when the first byte was read */
+  void handleFrame(const uint8_t * frame, int n, UTime & msgTime);
+  /**
+   * Handle a message (after the check code),
+   * either a confirm or a message to decode */
+  void handleMessage(const char * msg, UTime & msgTime);
+  /**
+   * Write data to the Teensy port (from the transmit thread only)
+   * \param data is the data to send
+   * \param n is the number of bytes
+   * \returns true if all is send */
+  bool writeDirect(const void * data, int n);
+  /**
+   * Get time (us) the transmit thread can wait before
+   * one of the lanes needs attention */
+  int txWaitUs();
+  /**
+   * Add the pending real-time lane messages to the transmit buffer
+   * \param buf is the transmit buffer
+   * \param bufCnt is the number of bytes used in the buffer already
+   * \returns the new number of bytes in the buffer */
+  int serviceLane(char * buf, int bufCnt);
+  /**
+   * Add queued messages to the transmit buffer as allowed by the tx window,
+   * including messages to resend, as they are not confirmed in time
+   * \param buf is the transmit buffer
+   * \param bufCnt is the number of bytes used in the buffer already
+   * \returns the new number of bytes in the buffer */
+  int serviceQueue(char * buf, int bufCnt);
+  /**
+   * Is queue entry i held back by an earlier unconfirmed message
+   * with the same key (queueLock must be locked) */
+  bool heldBySameKey(int i);
+  /**
+   * Wake the transmit thread, e.g. if a message is queued */
+  void wakeTxThread();
+  /**
+   * decode robot name message (dname) */
+  static bool decodeName(const char * msg, UTime & msgTime);
+  /**
+   * decode answer to binary mode request (bin) */
+  static bool decodeBinMode(const char * msg, UTime & msgTime);
   /**
    * is data source active (is device open) */
   virtual bool isActive()
@@ -186,14 +444,30 @@ private:
     // transfer to the class run() function.
     obj->run();
   }
+  static void runTxObj(STeensy * obj)
+  { // transmit thread
+    obj->runTx();
+  }
 
 private:
   /**
    * Open the connection.
    * \returns true if successful */
   bool openToTeensy();
+  /**
+   * Feed the received (Rx) messages of a recorded session
+   * through the decoders, with the recorded time (replaces the connection).
+   * Messages to the Teensy are discarded. */
+  void runReplay();
   std::string robotName;
   int confirm_timeout_ms = 100;
+  /**
+   * Update round trip estimate with a new sample
+   * \param rtt is measured time from send to confirm (sec) */
+  void updateRtt(float rtt);
+  /**
+   * Get retransmit timeout including backoff */
+  float getRto();
   /**
    * A confirm message is received,
    * Check, and
@@ -208,9 +482,70 @@ private:
   bool initialized = false;
   bool stopUSB = false;
   /**
-   * uotgoing message queue */
-  std::queue<UOutQueue> outQueue;
-  float confirmTimeout = 0.03; // timeout in seconds for writing to Teensy
+   * outgoing message queue, a ring of preallocated slots.
+   * The oldest message is at outHead, and there are outCnt slots in use.
+   * Protected by queueLock. */
+  static const int MAX_OUT_QUEUE = 200;
+  UOutQueue outQueue[MAX_OUT_QUEUE];
+  int outHead = 0;
+  int outCnt = 0;
+  /// sequence number for the next queued message
+  int outSeq = 0;
+  /// max number of send, but unconfirmed, messages (from ini-file)
+  static const int MAX_TX_WINDOW = 32;
+  int txWindow = 8;
+  /// messages send, but not confirmed yet
+  int txInFlight = 0;
+  std::mutex queueLock;
+  /**
+   * Real-time lane (not confirmed messages), double buffered:
+   * new messages are added to txLane[txActive],
+   * the transmit thread swaps and sends the other.
+   * Protected by txLock. */
+  UTxLane txLane[2];
+  int txActive = 0;
+  std::mutex txLock;
+  /// messages not added, as the real-time lane was full
+  int txLaneFullCnt = 0;
+  /**
+   * Session state, i.e. active subscriptions and the last value of
+   * configuration messages, to be send again after a reconnect.
+   * Protected by sessionLock */
+  UTxLane session;
+  std::mutex sessionLock;
+  /// keywords of messages that are session state (from ini-file)
+  static const int MAX_SESSION_KEYS = 16;
+  uint64_t sessionKeys[MAX_SESSION_KEYS];
+  int sessionKeyCnt = 0;
+  /**
+   * Save message as the last with this key (keyword),
+   * if the keyword is session state, a 'leave' removes all subscriptions */
+  void remember(const char * message);
+  /**
+   * Is the keyword of this message a session state keyword ('replay' in ini-file) */
+  bool isSessionKey(const char * message);
+  /**
+   * Queue all saved (session state) messages
+   * \returns number of messages queued */
+  int replaySession();
+  /// minimum time between writes to the Teensy (from ini-file)
+  float txInterval = 0.0005;
+  /// transmit buffer for both lanes (used by the transmit thread only)
+  static const int MAX_TX_BUF = UTxLane::MAX_SLOTS * (UTxSlot::MML + 8) +
+                                MAX_TX_WINDOW * UBinLink::MAX_FRAME;
+  char txBuf[MAX_TX_BUF];
+  float confirmTimeout = 0.03; // initial timeout in seconds for writing to Teensy
+  /// round trip estimate (like TCP retransmit timer)
+  float rttSmooth = 0;
+  float rttVar = 0;
+  float rto = 0.03;
+  /// limits for retransmit timeout (from ini-file)
+  float rtoMin = 0.02;
+  float rtoMax = 0.2;
+  /// round trip samples used
+  int rttCnt = 0;
+  /// number of consecutive timeouts (for exponential backoff)
+  int rtoBackoff = 0;
   // transmission statistics
   int confirmMismatchCnt = 0;
   int confirmRetryCnt = 0;
@@ -221,12 +556,34 @@ private:
   /// save in log with different time + marking
   void toLog(const char * msg);
   void toLogRx(const char*, UTime& mt);
-  void toLogTx();
-  void toLogQu();
-  /// should logged messages be printed on console too.
-  bool toConsole = false;
+  void toLogTx(const char * msg, UTime & sendAt);
+  void toLogQu(UOutQueue & q, int queueSize);
+  /// log and print channels (can be switched while running)
+  ULogChannel * logCh = nullptr;
+  ULogChannel * printCh = nullptr;
   /// data io logfile
   FILE * logfile = nullptr;
+  /// row formats for the io logfile
+  ULogStream logRx;
+  ULogStream logTx;
+  ULogStream logTxd;
+  ULogStream logQu;
+  ULogStream logNote;
+  /// decode function for each message keyword
+  UDispatch decoders;
+  /// decode function for each binary packet type
+  std::atomic<BinDecodeFunc> binDecoders[BIN_TYPE_CNT] = {};
+  /// binary mode wanted (from ini-file)
+  bool binaryWanted = false;
+  /// max wait for an answer to a binary mode request (sec)
+  float binaryTimeout = 0.5;
+  /// binary mode is requested, but not answered yet
+  bool binaryRequested = false;
+  UTime binaryRequestTime;
+  /// link is in binary mode (both directions)
+  std::atomic<bool> binaryMode = false;
+  /// binary frames with errors (COBS or CRC)
+  int binaryErrCnt = 0;
   std::mutex dataLock; // ensure consistency
 
 };
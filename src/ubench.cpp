@@ -0,0 +1,666 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <unistd.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "ubench.h"
+#include "udispatch.h"
+#include "ufields.h"
+#include "ubinlink.h"
+#include "utime.h"
+#include "steensy.h"
+#include "sstate.h"
+#include "sencoder.h"
+#include "simu.h"
+#include "cservo.h"
+#include "sedge.h"
+#include "sdist.h"
+#include "utopic.h"
+#include "useqlock.h"
+#include "ulogger.h"
+
+UBench bench;
+
+namespace
+{
+  /// typical message mix from the Teensy (enc and liv at 8ms, imu at 12ms, ir at 45ms ...)
+  const char * msgMix[] =
+  {
+    "enc -123456 234567\n",
+    "liv 512 533 601 588 590 512 498 432\n",
+    "gyro0 0.1234 -0.2345 0.0012\n",
+    "acc0 0.0123 -0.0234 9.8012\n",
+    "enc -123459 234570\n",
+    "liv 512 533 601 588 590 512 498 432\n",
+    "gyro0 0.1234 -0.2345 0.0012\n",
+    "acc0 0.0123 -0.0234 9.8012\n",
+    "enc -123462 234573\n",
+    "liv 512 533 601 588 590 512 498 432\n",
+    "ir 0.512 0.623 30012 25034\n",
+    "svo 1 512 0 0 0 0 0 0 0 0 0 0 0 0 0\n",
+    "enc -123465 234576\n",
+    "liv 512 533 601 588 590 512 498 432\n",
+    "hbt 1234.5678 113 1646 12.10 0 6 20 1 1\n",
+    "dname robobot June\n",
+  };
+  const int msgMixCnt = sizeof(msgMix) / sizeof(msgMix[0]);
+
+  /**
+   * Find decoder index as the previous decode chain did:
+   * state, encoder, imu, servo, sedge, dist, and then the teensy itself */
+  int chainFind(const char * p1)
+  {
+    if (strncmp(p1, "hbt ", 4) == 0) return 1;
+    if (strncmp(p1, "enc ", 4) == 0) return 2;
+    if (strncmp(p1, "acc0 ", 4) == 0) return 3;
+    if (strncmp(p1, "gyro0 ", 5) == 0) return 4;
+    if (strncmp(p1, "svo ", 4) == 0) return 5;
+    if (strncmp(p1, "liv ", 4) == 0) return 6;
+    if (strncmp(p1, "ls ", 3) == 0) return 7;
+    if (strncmp(p1, "ir ", 3) == 0) return 8;
+    if (strncmp(p1, "dname ", 6) == 0) return 9;
+    return 0;
+  }
+
+  bool dummyDecode(const char *, UTime &)
+  {
+    return true;
+  }
+}
+
+void UBench::run(const char * corpus)
+{
+  decodeDispatch();
+  decodeCorpus(corpus);
+  binaryCodec();
+  dataBus();
+  snapshot();
+  logRows();
+  clockRead();
+}
+
+void UBench::decodeDispatch()
+{
+  const int loops = 2000000;
+  // result sum, so that the compiler can't skip the work
+  volatile int sink = 0;
+  // the old way
+  UTime t("now");
+  int sum = 0;
+  for (int i = 0; i < loops; i++)
+    sum += chainFind(msgMix[i % msgMixCnt]);
+  float chainTime = t.getTimePassed();
+  sink = sink + sum;
+  // using a dispatch table
+  UDispatch table;
+  const char * keywords[] = {"hbt", "enc", "acc0", "gyro0", "svo", "liv", "ls", "ir", "dname"};
+  for (const char * k : keywords)
+    table.add(k, dummyDecode);
+  t.now();
+  sum = 0;
+  for (int i = 0; i < loops; i++)
+    sum += table.find(msgMix[i % msgMixCnt]) != nullptr;
+  float tableTime = t.getTimePassed();
+  sink = sink + sum;
+  printf("# UBench:: decode dispatch, %d messages (mix of %d keywords)\n", loops, table.size());
+  printf("# UBench::   strncmp chain  %7.1f ns/msg\n", chainTime / loops * 1e9);
+  printf("# UBench::   dispatch table %7.1f ns/msg\n", tableTime / loops * 1e9);
+}
+
+void UBench::decodeCorpus(const char * corpus)
+{
+  // all received lines (like ";NNenc 123 456\n") in one buffer,
+  // as if received from the Teensy
+  std::vector<char> rx;
+  if (corpus != nullptr)
+  {
+    FILE * f = fopen(corpus, "r");
+    if (f == nullptr)
+    {
+      printf("# UBench:: failed to open corpus file '%s'\n", corpus);
+      return;
+    }
+    const int MSL = 1000;
+    char s[MSL];
+    while (fgets(s, MSL, f) != nullptr)
+    { // like "1701345678.1234 Rx ;44enc 123 456\n"
+      const char * p1 = strstr(s, " Rx ;");
+      if (p1 != nullptr)
+      {
+        p1 += 4;
+        rx.insert(rx.end(), p1, p1 + strlen(p1));
+      }
+    }
+    fclose(f);
+  }
+  else
+  { // use the message mix with a CRC
+    corpus = "built-in message mix";
+    for (int i = 0; i < msgMixCnt; i++)
+    {
+      char crc[4];
+      teensy1.generateCRC(msgMix[i], crc);
+      rx.insert(rx.end(), crc, crc + 3);
+      rx.insert(rx.end(), msgMix[i], msgMix[i] + strlen(msgMix[i]));
+    }
+  }
+  // find the lines (framing and CRC as in STeensy)
+  std::vector<int> lineStart;
+  const char * end = rx.data() + rx.size();
+  const char * p1 = rx.data();
+  while (p1 < end)
+  {
+    int sum = 0;
+    const char * p2 = STeensy::scanLine(p1, end, sum);
+    if (p2 == nullptr)
+      break;
+    lineStart.push_back(p1 - rx.data());
+    p1 = p2 + 1;
+  }
+  int lineCnt = lineStart.size();
+  if (lineCnt == 0)
+  {
+    printf("# UBench:: no Rx lines in %s\n", corpus);
+    return;
+  }
+  // zero terminate all lines (after the new-line) in a copy
+  std::vector<char> lines(rx.size() + lineCnt);
+  std::vector<const char *> line(lineCnt);
+  {
+    char * p3 = lines.data();
+    for (int i = 0; i < lineCnt; i++)
+    {
+      const char * p4 = &rx[lineStart[i]];
+      const char * p5 = (const char*)memchr(p4, '\n', end - p4);
+      int n = p5 - p4 + 1;
+      memcpy(p3, p4, n);
+      p3[n] = '\0';
+      line[i] = p3;
+      p3 += n + 1;
+    }
+  }
+  // the real module decoders
+  UDispatch table;
+  table.add("hbt", [](const char * msg, UTime & msgTime){ return state.decode(msg, msgTime); });
+  table.add("enc", [](const char * msg, UTime & msgTime){ return encoder.decode(msg, msgTime); });
+  table.add("gyro0", [](const char * msg, UTime & msgTime){ return imu.decode(msg, msgTime); });
+  table.add("acc0", [](const char * msg, UTime & msgTime){ return imu.decode(msg, msgTime); });
+  table.add("svo", [](const char * msg, UTime & msgTime){ return servo.decode(msg, msgTime); });
+  table.add("liv", [](const char * msg, UTime & msgTime){ return sedge.decode(msg, msgTime); });
+  table.add("ir", [](const char * msg, UTime & msgTime){ return dist.decode(msg, msgTime); });
+  // repeat the corpus to get at least this many messages
+  const int minMsgs = 1000000;
+  int loops = minMsgs / lineCnt + 1;
+  UTime msgTime("now");
+  int decoded = 0;
+  int crcErr = 0;
+  // framing, CRC and decode
+  UTime t("now");
+  for (int k = 0; k < loops; k++)
+  {
+    p1 = rx.data();
+    while (p1 < end)
+    {
+      int sum = 0;
+      const char * p2 = STeensy::scanLine(p1, end, sum);
+      if (p2 == nullptr)
+        break;
+      if (STeensy::crcCheck(p1, sum))
+      {
+        UDispatch::DecodeFunc func = table.find(&p1[3]);
+        if (func != nullptr and func(&p1[3], msgTime))
+          decoded++;
+      }
+      else
+        crcErr++;
+      p1 = p2 + 1;
+    }
+  }
+  float decodeTime = t.getTimePassed();
+  // field parsing only, as before (strtof) and with UFields
+  volatile float sink = 0;
+  t.now();
+  for (int k = 0; k < loops; k++)
+  {
+    for (int i = 0; i < lineCnt; i++)
+    {
+      const char * p3 = strchr(&line[i][3], ' ');
+      float v = 0;
+      while (p3 != nullptr and *p3 >= ' ')
+      {
+        char * p4;
+        v += strtof(p3, &p4);
+        if (p4 == p3)
+          break;
+        p3 = p4;
+      }
+      sink = sink + v;
+    }
+  }
+  float strtofTime = t.getTimePassed();
+  t.now();
+  for (int k = 0; k < loops; k++)
+  {
+    for (int i = 0; i < lineCnt; i++)
+    {
+      UFields f(&line[i][3]);
+      float v = 0;
+      float w;
+      while (f.get(w))
+        v += w;
+      sink = sink + v;
+    }
+  }
+  float fieldsTime = t.getTimePassed();
+  int msgs = loops * lineCnt;
+  printf("# UBench:: decode %d messages (%d lines from %s), %d decoded, %d CRC errors\n",
+         msgs, lineCnt, corpus, decoded, crcErr);
+  printf("# UBench::   framing, CRC and decode %7.1f ns/msg (%.0f msg/s)\n",
+         decodeTime / msgs * 1e9, msgs / decodeTime);
+  printf("# UBench::   fields using strtof     %7.1f ns/msg\n", strtofTime / msgs * 1e9);
+  printf("# UBench::   fields using UFields    %7.1f ns/msg\n", fieldsTime / msgs * 1e9);
+}
+
+void UBench::binaryCodec()
+{
+  // the typed messages from the message mix as text lines and as binary frames
+  std::vector<char> text;
+  std::vector<uint8_t> bin;
+  int msgCnt = 0;
+  for (int i = 0; i < msgMixCnt; i++)
+  {
+    const char * msg = msgMix[i];
+    UFields f(msg);
+    uint8_t type = 0;
+    uint8_t payload[UBinLink::MAX_PACKET];
+    int n = 0;
+    if (strncmp(msg, "enc ", 4) == 0)
+    {
+      UBinEnc d;
+      f.get(d.enc[0]);
+      f.get(d.enc[1]);
+      type = BIN_ENC;
+      n = sizeof(d);
+      memcpy(payload, &d, n);
+    }
+    else if (strncmp(msg, "liv ", 4) == 0)
+    {
+      UBinLiv d;
+      for (int j = 0; j < 8; j++)
+      {
+        int v;
+        f.get(v);
+        d.liv[j] = v;
+      }
+      type = BIN_LIV;
+      n = sizeof(d);
+      memcpy(payload, &d, n);
+    }
+    else if (strncmp(msg, "gyro0 ", 6) == 0 or strncmp(msg, "acc0 ", 5) == 0)
+    {
+      UBinXyz d;
+      for (int j = 0; j < 3; j++)
+        f.get(d.v[j]);
+      type = msg[0] == 'g' ? BIN_GYRO : BIN_ACC;
+      n = sizeof(d);
+      memcpy(payload, &d, n);
+    }
+    else if (strncmp(msg, "ir ", 3) == 0)
+    {
+      UBinIr d;
+      f.get(d.dist[0]);
+      f.get(d.dist[1]);
+      f.get(d.ad[0]);
+      f.get(d.ad[1]);
+      type = BIN_IR;
+      n = sizeof(d);
+      memcpy(payload, &d, n);
+    }
+    else
+      // not a typed message
+      continue;
+    char crc[4];
+    teensy1.generateCRC(msg, crc);
+    text.insert(text.end(), crc, crc + 3);
+    text.insert(text.end(), msg, msg + strlen(msg));
+    uint8_t frame[UBinLink::MAX_FRAME];
+    int m = UBinLink::encodeFrame(type, payload, n, frame);
+    bin.insert(bin.end(), frame, frame + m);
+    msgCnt++;
+  }
+  const int loops = 1000000 / msgCnt + 1;
+  volatile float sink = 0;
+  // text: framing, CRC and get all fields
+  UTime t("now");
+  for (int k = 0; k < loops; k++)
+  {
+    const char * p1 = text.data();
+    const char * end = p1 + text.size();
+    while (p1 < end)
+    {
+      int sum = 0;
+      const char * p2 = STeensy::scanLine(p1, end, sum);
+      if (STeensy::crcCheck(p1, sum))
+      {
+        UFields f(&p1[3]);
+        float v = 0;
+        float w;
+        while (f.get(w))
+          v += w;
+        sink = sink + v;
+      }
+      p1 = p2 + 1;
+    }
+  }
+  float textTime = t.getTimePassed();
+  // binary: framing, COBS and CRC (the payload is used as is)
+  t.now();
+  for (int k = 0; k < loops; k++)
+  {
+    const uint8_t * p1 = bin.data();
+    const uint8_t * end = p1 + bin.size();
+    while (p1 < end)
+    {
+      const uint8_t * p2 = (const uint8_t *)memchr(p1, 0, end - p1);
+      uint8_t packet[UBinLink::MAX_PACKET];
+      uint8_t type;
+      int n = UBinLink::decodeFrame(p1, p2 - p1, packet, type);
+      sink = sink + n + packet[1];
+      p1 = p2 + 1;
+    }
+  }
+  float binTime = t.getTimePassed();
+  int msgs = loops * msgCnt;
+  printf("# UBench:: text and binary link format, %d typed messages\n", msgs);
+  printf("# UBench::   text   %5.1f bytes/msg %7.1f ns/msg\n",
+         float(text.size()) / msgCnt, textTime / msgs * 1e9);
+  printf("# UBench::   binary %5.1f bytes/msg %7.1f ns/msg\n",
+         float(bin.size()) / msgCnt, binTime / msgs * 1e9);
+}
+
+void UBench::dataBus()
+{
+  // samples published every 8ms (like enc), latency to the consumer
+  const int samples = 100;
+  const int periodUs = 8000;
+  // polling an update count (as the modules did before)
+  std::atomic<int> updateCnt{0};
+  UTime pubTime;
+  std::atomic<bool> stop{false};
+  double pollSum = 0;
+  float pollMax = 0;
+  int pollCnt = 0;
+  std::thread poller([&]{
+    int lastCnt = 0;
+    while (not stop)
+    {
+      if (updateCnt != lastCnt)
+      {
+        lastCnt = updateCnt;
+        float lat = pubTime.getTimePassed();
+        pollSum += lat;
+        if (lat > pollMax)
+          pollMax = lat;
+        pollCnt++;
+      }
+      else
+        usleep(2000);
+    }
+  });
+  for (int i = 0; i < samples; i++)
+  {
+    usleep(periodUs);
+    pubTime.now();
+    updateCnt++;
+  }
+  stop = true;
+  poller.join();
+  // waiting on a topic
+  UTopic<int> topic;
+  stop = false;
+  double waitSum = 0;
+  float waitMax = 0;
+  int waitCnt = 0;
+  int missed = 0;
+  std::thread waiter([&]{
+    uint64_t seq = 0;
+    int v;
+    UTime published;
+    while (not stop)
+    {
+      int n = topic.wait(v, seq, 0.1, &published);
+      if (n > 0)
+      {
+        float lat = published.getTimePassed();
+        waitSum += lat;
+        if (lat > waitMax)
+          waitMax = lat;
+        waitCnt++;
+        missed += n - 1;
+      }
+    }
+  });
+  for (int i = 0; i < samples; i++)
+  {
+    usleep(periodUs);
+    topic.publish(i);
+  }
+  stop = true;
+  waiter.join();
+  printf("# UBench:: publish to use latency, %d samples at %.0f ms\n", samples, periodUs / 1000.0);
+  if (pollCnt > 0)
+    printf("# UBench::   poll update count %7.3f ms avg, %7.3f ms max (%d used)\n",
+           pollSum / pollCnt * 1000, pollMax * 1000, pollCnt);
+  if (waitCnt > 0)
+    printf("# UBench::   wait on topic     %7.3f ms avg, %7.3f ms max (%d used, %d missed)\n",
+           waitSum / waitCnt * 1000, waitMax * 1000, waitCnt, missed);
+}
+
+namespace
+{
+  /// test sample, all values are equal, when not torn
+  struct TestSample
+  {
+    int64_t v[12];
+  };
+}
+
+void UBench::snapshot()
+{
+  const int writes = 2000000;
+  const int readers = 3;
+  // plain copy of a shared structure (as the public module values)
+  // and a copy from a sequence lock
+  volatile TestSample plain;
+  USeqLock<TestSample> locked;
+  std::atomic<bool> stop{false};
+  std::atomic<int> tornPlain{0};
+  std::atomic<int> tornLocked{0};
+  std::atomic<int> reads{0};
+  std::vector<std::thread> th;
+  for (int r = 0; r < readers; r++)
+    th.emplace_back([&]{
+      int n = 0;
+      while (not stop)
+      {
+        TestSample a;
+        for (int i = 0; i < 12; i++)
+          a.v[i] = plain.v[i];
+        TestSample b = locked.read();
+        for (int i = 1; i < 12; i++)
+        {
+          if (a.v[i] != a.v[0])
+          {
+            tornPlain++;
+            break;
+          }
+        }
+        for (int i = 1; i < 12; i++)
+        {
+          if (b.v[i] != b.v[0])
+          {
+            tornLocked++;
+            break;
+          }
+        }
+        n++;
+      }
+      reads += n;
+    });
+  UTime t("now");
+  for (int k = 1; k <= writes; k++)
+  {
+    TestSample s;
+    for (int i = 0; i < 12; i++)
+    {
+      s.v[i] = k;
+      plain.v[i] = k;
+    }
+    locked.write(s);
+  }
+  float dt = t.getTimePassed();
+  stop = true;
+  for (auto & h : th)
+    h.join();
+  printf("# UBench:: shared sample copy, %d writes, %d reads in %d threads (%.0f ns/write)\n",
+         writes, reads.load(), readers, dt / writes * 1e9);
+  printf("# UBench::   plain copy    %d torn reads\n", tornPlain.load());
+  printf("# UBench::   sequence lock %d torn reads\n", tornLocked.load());
+}
+
+void UBench::logRows()
+{
+  const int rows = 200000;
+  const char * fmt = "%lu.%04ld %.4f %.4f %.4f %.5f %.3f %.3f %.3f %.4f %.3f %.4f\n";
+  float v[10] = {0.1234, -0.2345, 0.0555, 1.2345, 12.345, 1.234, -2.345, 3.1415, 10.123, -6.2832};
+  UTime t("now");
+  // fprintf (text logfile)
+  FILE * f = tmpfile();
+  float maxPrint = 0;
+  UTime t0("now");
+  for (int i = 0; i < rows; i++)
+  {
+    UTime t1("now");
+    fprintf(f, fmt, t.getSec(), t.getMicrosec()/100,
+            v[0] + i, v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8], v[9]);
+    float dt = t1.getTimePassed();
+    if (dt > maxPrint)
+      maxPrint = dt;
+  }
+  float dtPrint = t0.getTimePassed();
+  fclose(f);
+  // binary record in a ring, saved by a writer thread
+  f = tmpfile();
+  ULogRing ring(32 * 1024 * 1024);
+  std::atomic<bool> stop{false};
+  std::thread writer([&]{
+    while (true)
+    {
+      bool last = stop;
+      uint64_t h = ring.head.load(std::memory_order_acquire);
+      uint64_t p = ring.tail.load(std::memory_order_relaxed);
+      if (h > p)
+      {
+        ring.write(f, p, h - p);
+        ring.tail.store(h, std::memory_order_release);
+      }
+      if (last)
+        break;
+      usleep(1000);
+    }
+  });
+  float maxPush = 0;
+  uint8_t data[ULogCodec::MAX_ROW];
+  t0.now();
+  for (int i = 0; i < rows; i++)
+  {
+    UTime t1("now");
+    int n = ULogStream::packRow(data, t.getSec(), t.getMicrosec()/100,
+            v[0] + i, v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8], v[9]);
+    ULogHead rh = {1, (uint16_t)n, (uint32_t)i, t1.getWallNs()};
+    ring.push(rh, data, n);
+    float dt = t1.getTimePassed();
+    if (dt > maxPush)
+      maxPush = dt;
+  }
+  float dtPush = t0.getTimePassed();
+  stop = true;
+  writer.join();
+  fclose(f);
+  // conversion back to text (offline)
+  char s[200];
+  int n = ULogStream::packRow(data, t.getSec(), t.getMicrosec()/100,
+            v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8], v[9]);
+  t0.now();
+  for (int i = 0; i < rows; i++)
+    ULogCodec::toText(fmt, data, n, s, 200);
+  float dtConvert = t0.getTimePassed();
+  printf("# UBench:: log_pose rows (12 values, %d bytes binary), %d rows\n", n, rows);
+  printf("# UBench::   fprintf      %6.0f ns/row (max %.1f us)\n", dtPrint / rows * 1e9, maxPrint * 1e6);
+  printf("# UBench::   binary ring  %6.0f ns/row (max %.1f us), %d dropped\n", dtPush / rows * 1e9, maxPush * 1e6, ring.dropped.load());
+  printf("# UBench::   convert      %6.0f ns/row (offline, to text)\n", dtConvert / rows * 1e9);
+}
+
+void UBench::clockRead()
+{
+  const int loops = 2000000;
+  volatile double sink = 0;
+  // the old way, wall clock and float seconds
+  timeval tv0, tv;
+  gettimeofday(&tv0, nullptr);
+  UTime t0("now");
+  double sum = 0;
+  for (int i = 0; i < loops; i++)
+  {
+    gettimeofday(&tv, nullptr);
+    sum += float(tv.tv_sec - tv0.tv_sec) + float(tv.tv_usec - tv0.tv_usec) * 1e-6;
+  }
+  float dtOld = t0.getTimePassed();
+  sink = sink + sum;
+  // monotonic clock and integer ns
+  UTime t;
+  int64_t sumNs = 0;
+  t0.now();
+  for (int i = 0; i < loops; i++)
+  {
+    t.now();
+    sumNs += t.getNsSince(t0);
+  }
+  float dtNew = t0.getTimePassed();
+  sink = sink + sumNs;
+  // float seconds from 1970 can not resolve less than about 100 s
+  float epoch = t.getDecSec();
+  float tick = epoch;
+  tick = nextafterf(tick, 1e10f) - epoch;
+  printf("# UBench:: clock read and time difference, %d loops\n", loops);
+  printf("# UBench::   gettimeofday, float sec  %5.1f ns/read (float epoch seconds resolve %.0f s)\n",
+         dtOld / loops * 1e9, tick);
+  printf("# UBench::   UTime, monotonic ns      %5.1f ns/read (exact to 1 ns)\n", dtNew / loops * 1e9);
+}
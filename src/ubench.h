@@ -0,0 +1,79 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+/**
+ * Benchmarks for the message handling,
+ * to be run from the command line (option --bench)
+ * without connection to the robot.
+ * */
+class UBench
+{
+public:
+  /**
+   * Run all benchmarks and print the result
+   * \param corpus is an optional log_teensy_io.txt file
+   * with received messages to replay in the decode benchmark */
+  void run(const char * corpus = nullptr);
+  /**
+   * Time spend to find the decoder for a message,
+   * using the old strncmp chain and the dispatch table. */
+  void decodeDispatch();
+  /**
+   * Replay received messages through line framing, CRC check,
+   * dispatch and the module decoders, and report messages decoded per second.
+   * Also compare field parsing with strtof and the UFields parser.
+   * \param corpus is a log_teensy_io.txt file (Rx lines are used),
+   * if nullptr, then a built-in message mix is used. */
+  void decodeCorpus(const char * corpus);
+  /**
+   * Compare size and decode time of text lines and binary frames
+   * for the typed messages (enc, liv, gyro0, acc0, ir and hbt). */
+  void binaryCodec();
+  /**
+   * Latency from publish to use of a sample,
+   * when the consumer polls an update count (with a 2ms sleep),
+   * and when the consumer waits on a UTopic. */
+  void dataBus();
+  /**
+   * Stress test of shared sample copies: one thread writes as fast
+   * as possible, other threads read and check for torn values
+   * (a mix of two writes), with and without a sequence lock. */
+  void snapshot();
+  /**
+   * Time used by the logging thread for one log_pose row,
+   * with fprintf to a file and with a binary record in a
+   * log ring (saved by another thread),
+   * and the time to convert a record back to text. */
+  void logRows();
+  /**
+   * Time to read the clock and get a time difference,
+   * with gettimeofday and float seconds (as UTime was)
+   * and with UTime (monotonic clock, integer ns). */
+  void clockRead();
+};
+
+/**
+ * Make this visible to the rest of the software */
+extern UBench bench;
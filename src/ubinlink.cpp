@@ -0,0 +1,222 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ubinlink.h"
+
+uint16_t UBinLink::crc16(const uint8_t* data, int n, uint16_t crc)
+{ // byte wise CRC-16 CCITT without a table
+  for (int i = 0; i < n; i++)
+  {
+    uint8_t x = (crc >> 8) ^ data[i];
+    x ^= x >> 4;
+    crc = (crc << 8) ^ (uint16_t(x) << 12) ^ (uint16_t(x) << 5) ^ x;
+  }
+  return crc;
+}
+
+int UBinLink::cobsEncode(const uint8_t* src, int n, uint8_t* dst)
+{
+  int codeIdx = 0;
+  uint8_t code = 1;
+  int d = 1;
+  for (int i = 0; i < n; i++)
+  {
+    if (src[i] == 0)
+    { // end of block
+      dst[codeIdx] = code;
+      codeIdx = d++;
+      code = 1;
+    }
+    else
+    {
+      dst[d++] = src[i];
+      code++;
+      if (code == 0xff and i < n - 1)
+      { // max block size
+        dst[codeIdx] = code;
+        codeIdx = d++;
+        code = 1;
+      }
+    }
+  }
+  dst[codeIdx] = code;
+  return d;
+}
+
+int UBinLink::cobsDecode(const uint8_t* src, int n, uint8_t* dst, int dstCnt)
+{
+  int s = 0;
+  int d = 0;
+  while (s < n)
+  {
+    uint8_t code = src[s++];
+    if (code == 0 or s + code - 1 > n)
+      // not valid
+      return -1;
+    if (d + code - 1 > dstCnt)
+      // too big for destination
+      return -1;
+    for (int i = 1; i < code; i++)
+      dst[d++] = src[s++];
+    if (code < 0xff and s < n)
+    { // the block ended with a zero
+      if (d >= dstCnt)
+        return -1;
+      dst[d++] = 0;
+    }
+  }
+  return d;
+}
+
+int UBinLink::encodeFrame(uint8_t type, const void* payload, int n, uint8_t* frame)
+{
+  if (n + 3 > MAX_PACKET)
+    return 0;
+  uint8_t packet[MAX_PACKET];
+  packet[0] = type;
+  memcpy(&packet[1], payload, n);
+  uint16_t crc = crc16(packet, n + 1);
+  packet[n + 1] = crc & 0xff;
+  packet[n + 2] = crc >> 8;
+  int m = cobsEncode(packet, n + 3, frame);
+  frame[m++] = 0;
+  return m;
+}
+
+int UBinLink::decodeFrame(const uint8_t* frame, int n, uint8_t* packet, uint8_t& type)
+{
+  if (n < 4 or n > MAX_FRAME)
+    // too short for type and CRC (or too long)
+    return -1;
+  int m = cobsDecode(frame, n, packet, MAX_PACKET);
+  if (m < 3)
+    return -1;
+  uint16_t crc = crc16(packet, m - 2);
+  if ((crc & 0xff) != packet[m - 2] or (crc >> 8) != packet[m - 1])
+    return -1;
+  type = packet[0];
+  return m - 3;
+}
+
+int UBinLink::payloadSize(uint8_t type)
+{
+  switch (type)
+  {
+    case BIN_ENC:  return sizeof(UBinEnc);
+    case BIN_LIV:  return sizeof(UBinLiv);
+    case BIN_GYRO: return sizeof(UBinXyz);
+    case BIN_ACC:  return sizeof(UBinXyz);
+    case BIN_IR:   return sizeof(UBinIr);
+    case BIN_HBT:  return sizeof(UBinHbt);
+    case BIN_MOTV: return sizeof(UBinMotv);
+    default:
+      return -1;
+  }
+}
+
+const char * UBinLink::keyword(uint8_t type)
+{
+  switch (type)
+  {
+    case BIN_ENC:  return "enc";
+    case BIN_LIV:  return "liv";
+    case BIN_GYRO: return "gyro0";
+    case BIN_ACC:  return "acc0";
+    case BIN_IR:   return "ir";
+    case BIN_HBT:  return "hbt";
+    case BIN_MOTV: return "motv";
+    default:
+      return "";
+  }
+}
+
+int UBinLink::toText(uint8_t type, const uint8_t* payload, int n, char* s, int sCnt)
+{
+  int m = 0;
+  if (n != payloadSize(type))
+  {
+    if (type == BIN_TEXT)
+      m = snprintf(s, sCnt, "%.*s", n, (const char*)payload);
+    else
+      m = snprintf(s, sCnt, "bin %d (%d bytes)\n", type, n);
+    return m;
+  }
+  switch (type)
+  {
+    case BIN_ENC:
+    {
+      UBinEnc d;
+      memcpy(&d, payload, n);
+      m = snprintf(s, sCnt, "enc %lld %lld\n", (long long)d.enc[0], (long long)d.enc[1]);
+      break;
+    }
+    case BIN_LIV:
+    {
+      UBinLiv d;
+      memcpy(&d, payload, n);
+      m = snprintf(s, sCnt, "liv %d %d %d %d %d %d %d %d\n",
+                   d.liv[0], d.liv[1], d.liv[2], d.liv[3],
+                   d.liv[4], d.liv[5], d.liv[6], d.liv[7]);
+      break;
+    }
+    case BIN_GYRO:
+    case BIN_ACC:
+    {
+      UBinXyz d;
+      memcpy(&d, payload, n);
+      m = snprintf(s, sCnt, "%s %g %g %g\n", type == BIN_GYRO ? "gyro0" : "acc0",
+                   d.v[0], d.v[1], d.v[2]);
+      break;
+    }
+    case BIN_IR:
+    {
+      UBinIr d;
+      memcpy(&d, payload, n);
+      m = snprintf(s, sCnt, "ir %g %g %d %d\n", d.dist[0], d.dist[1], d.ad[0], d.ad[1]);
+      break;
+    }
+    case BIN_HBT:
+    {
+      UBinHbt d;
+      memcpy(&d, payload, n);
+      m = snprintf(s, sCnt, "hbt %.4f %d %d %.2f %d %d %g %d %d\n",
+                   d.teensyTime, d.idx, d.version, d.batteryVoltage,
+                   d.controlState, d.hwType, d.load,
+                   d.motorEnabled[0], d.motorEnabled[1]);
+      break;
+    }
+    case BIN_MOTV:
+    {
+      UBinMotv d;
+      memcpy(&d, payload, n);
+      m = snprintf(s, sCnt, "motv %.2f %.2f\n", d.u[0], d.u[1]);
+      break;
+    }
+    default:
+      break;
+  }
+  return m;
+}
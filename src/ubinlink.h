@@ -0,0 +1,166 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Binary link format for the Teensy connection.
+ * A packet is a type byte, a payload and a CRC-16 (CCITT, little endian)
+ * of type and payload.
+ * The packet is COBS encoded, so that it has no zero bytes,
+ * and a zero byte ends the frame.
+ * Typed payloads are the packed structs below (little endian, as
+ * both the Teensy and the Raspberry are),
+ * other messages are send as text (BIN_TEXT) with the same
+ * content as in text mode (including the new-line), but without the ';NN' check code.
+ *
+ * The binary mode is requested by the host with a 'bin 1' text message,
+ * a Teensy that supports binary mode answers 'bin 1' (as text),
+ * and sends binary frames from then on.
+ * The host sends binary frames when the answer is received.
+ * This file has no dependencies to the rest of raubase, so that
+ * it can be used by tools too.
+ * */
+
+/// packet types (first byte in packet)
+enum UBinType : uint8_t
+{
+  BIN_TEXT = 1,
+  BIN_ENC,
+  BIN_LIV,
+  BIN_GYRO,
+  BIN_ACC,
+  BIN_IR,
+  BIN_HBT,
+  BIN_MOTV,
+  BIN_TYPE_CNT
+};
+
+#pragma pack(push, 1)
+/// encoder values (as 'enc')
+struct UBinEnc
+{
+  int64_t enc[2];
+};
+/// line sensor values (as 'liv')
+struct UBinLiv
+{
+  int16_t liv[8];
+};
+/// gyro (as 'gyro0') or accelerometer (as 'acc0') values
+struct UBinXyz
+{
+  float v[3];
+};
+/// IR distance (as 'ir')
+struct UBinIr
+{
+  float dist[2];
+  int32_t ad[2];
+};
+/// heartbeat (as 'hbt')
+struct UBinHbt
+{
+  double teensyTime;
+  int32_t version;
+  float batteryVoltage;
+  float load;
+  int16_t idx;
+  uint8_t controlState;
+  uint8_t hwType;
+  uint8_t motorEnabled[2];
+};
+/// motor voltage (as 'motv') from host to Teensy
+struct UBinMotv
+{
+  float u[2];
+};
+#pragma pack(pop)
+
+class UBinLink
+{
+public:
+  /// max packet size (type, payload and CRC)
+  static const int MAX_PACKET = 512;
+  /// max frame size, with COBS overhead and the zero
+  static const int MAX_FRAME = MAX_PACKET + MAX_PACKET / 254 + 2;
+  /**
+   * CRC-16 CCITT (polynomial 0x1021)
+   * \param data is the data to check
+   * \param n is number of bytes
+   * \param crc is the start value (or the CRC so far)
+   * \returns the CRC */
+  static uint16_t crc16(const uint8_t * data, int n, uint16_t crc = 0xffff);
+  /**
+   * COBS encode data
+   * \param src is data to encode
+   * \param n is number of bytes
+   * \param dst is destination, must have space for n + n/254 + 1 bytes
+   * \returns number of bytes in dst (no zero added) */
+  static int cobsEncode(const uint8_t * src, int n, uint8_t * dst);
+  /**
+   * COBS decode data
+   * \param src is the frame (without the zero)
+   * \param n is number of bytes
+   * \param dst is destination
+   * \param dstCnt is the size of dst
+   * \returns number of decoded bytes, or -1 if not valid (or too big for dst) */
+  static int cobsDecode(const uint8_t * src, int n, uint8_t * dst, int dstCnt);
+  /**
+   * Make a frame with this payload
+   * \param type is the packet type
+   * \param payload is the payload data
+   * \param n is the payload size
+   * \param frame is the destination of MAX_FRAME bytes
+   * \returns frame size (including the final zero), or 0 if payload is too big */
+  static int encodeFrame(uint8_t type, const void * payload, int n, uint8_t * frame);
+  /**
+   * Decode a frame
+   * \param frame is the received frame (without the zero)
+   * \param n is the frame size
+   * \param packet is a buffer of MAX_PACKET bytes for the decoded packet,
+   * the payload starts at packet[1], and there is space for a terminating
+   * zero after the payload (payload size is at most MAX_PACKET - 3)
+   * \param type is set to the packet type
+   * \returns payload size, or -1 if frame or CRC is not valid */
+  static int decodeFrame(const uint8_t * frame, int n, uint8_t * packet, uint8_t & type);
+  /**
+   * Payload size for typed packets
+   * \returns size, or -1 for BIN_TEXT and unknown types */
+  static int payloadSize(uint8_t type);
+  /**
+   * Keyword of the text message with the same content
+   * \returns keyword, like "enc", or "" for BIN_TEXT and unknown types */
+  static const char * keyword(uint8_t type);
+  /**
+   * Format a typed payload as the corresponding text message (e.g. for logging)
+   * \param type is packet type
+   * \param payload is the payload
+   * \param n is payload size
+   * \param s is destination string
+   * \param sCnt is size of destination
+   * \returns length of the text */
+  static int toText(uint8_t type, const uint8_t * payload, int n, char * s, int sCnt);
+};
@@ -0,0 +1,228 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <algorithm>
+#include <chrono>
+
+#include "uclock.h"
+
+UClock clockService;
+
+thread_local UClock::UserMark UClock::userMark;
+
+namespace
+{
+  void sleepUntilMonotonic(int64_t ns)
+  { // absolute time, so an interrupted sleep can just continue
+    timespec ts;
+    ts.tv_sec = ns / UTime::NS_PER_SEC;
+    ts.tv_nsec = ns % UTime::NS_PER_SEC;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR)
+      ;
+  }
+}
+
+void UClock::sleepNs(int64_t ns)
+{
+  if (not isVirtual())
+  {
+    if (not userMark.counted)
+      addUser();
+    if (ns > 0)
+    {
+      timespec ts;
+      ts.tv_sec = ns / UTime::NS_PER_SEC;
+      ts.tv_nsec = ns % UTime::NS_PER_SEC;
+      nanosleep(&ts, nullptr);
+    }
+    return;
+  }
+  UTime t("now");
+  t.addNs(ns);
+  sleepUntil(t);
+}
+
+void UClock::sleepRealUs(int64_t us)
+{
+  if (us > 0)
+  {
+    timespec ts;
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000;
+    nanosleep(&ts, nullptr);
+  }
+}
+
+void UClock::sleepUntil(UTime t)
+{
+  std::unique_lock<std::mutex> guard(lock);
+  if (not isVirtual())
+  {
+    guard.unlock();
+    if (not userMark.counted)
+      addUser();
+    sleepUntilMonotonic(t.getNs());
+    return;
+  }
+  addUserLocked();
+  if (t.getNs() <= UTime::virtualNs)
+    return;
+  Sleeper s;
+  s.deadline = t.getNs();
+  sleepers.push_back(&s);
+  idle++;
+  allIdle.notify_all();
+  wakeUp.wait(guard, [&s]{ return s.woken; });
+}
+
+void UClock::startVirtual()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  UTime t("now");
+  UTime::virtualNs = t.getNs();
+  // users are counted idle when they start a sleep or wait
+  idle = 0;
+  steps = 0;
+  idleTimeouts = 0;
+  sleepers.clear();
+  UTime::virtualTime = true;
+  printf("# UClock:: using a virtual clock\n");
+}
+
+void UClock::stopVirtual()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  if (not isVirtual())
+    return;
+  // back to the OS clock, the time may jump (forward)
+  UTime::virtualTime = false;
+  for (Sleeper * s : sleepers)
+    s->woken = true;
+  sleepers.clear();
+  wakeUp.notify_all();
+  printf("# UClock:: virtual clock ended, %d threads, %d time steps, %d idle timeouts\n",
+         users, steps, idleTimeouts);
+}
+
+void UClock::advanceTo(int64_t ns)
+{
+  std::unique_lock<std::mutex> guard(lock);
+  if (not isVirtual())
+    return;
+  waitIdle(guard);
+  while (not sleepers.empty())
+  { // wake sleepers in deadline order
+    int64_t first = sleepers.front()->deadline;
+    for (Sleeper * s : sleepers)
+      first = std::min(first, s->deadline);
+    if (first > ns)
+      break;
+    if (first > UTime::virtualNs)
+      UTime::virtualNs = first;
+    // the woken sleepers last (remove_if would not keep them)
+    auto woken = std::partition(sleepers.begin(), sleepers.end(),
+                                [first](Sleeper * s){ return s->deadline > first; });
+    for (auto it = woken; it != sleepers.end(); it++)
+    { // busy from now
+      (*it)->woken = true;
+      idle--;
+    }
+    sleepers.erase(woken, sleepers.end());
+    wakeUp.notify_all();
+    steps++;
+    waitIdle(guard);
+  }
+  if (ns > UTime::virtualNs)
+    UTime::virtualNs = ns;
+}
+
+bool UClock::waitBegin()
+{
+  if (not isVirtual())
+  {
+    if (not userMark.counted)
+      addUser();
+    return false;
+  }
+  std::lock_guard<std::mutex> guard(lock);
+  addUserLocked();
+  idle++;
+  allIdle.notify_all();
+  return true;
+}
+
+void UClock::waitEnd(bool woken)
+{
+  if (woken)
+    return;
+  std::lock_guard<std::mutex> guard(lock);
+  if (isVirtual() and idle > 0)
+    idle--;
+}
+
+void UClock::wake(int n)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  if (isVirtual())
+    idle = std::max(0, idle - n);
+}
+
+void UClock::addUser()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  addUserLocked();
+}
+
+void UClock::addUserLocked()
+{
+  if (not userMark.counted)
+  {
+    userMark.counted = true;
+    users++;
+  }
+}
+
+void UClock::removeUser()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  users--;
+  // the driver may wait for this thread
+  allIdle.notify_all();
+}
+
+UClock::UserMark::~UserMark()
+{ // the thread ends
+  if (counted)
+    clockService.removeUser();
+}
+
+void UClock::waitIdle(std::unique_lock<std::mutex> & guard)
+{ // a user may be blocked on something else than this clock,
+  // so don't wait forever (real time)
+  if (not allIdle.wait_for(guard, std::chrono::milliseconds(100),
+                           [this]{ return idle >= users; }))
+    idleTimeouts++;
+}
@@ -0,0 +1,141 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+#include "utime.h"
+
+/**
+ * The clock and sleep service.
+ * Normally the OS clock (CLOCK_MONOTONIC), and a sleep is a
+ * clock_nanosleep.
+ * For test (e.g. a replay of a recorded session) a driver can
+ * switch to a virtual clock (UTime::now() then returns the virtual time),
+ * that the driver advances with advanceTo().
+ * Threads that sleep on this clock, or wait on a UTopic,
+ * then sleep and wake on the virtual time, and the driver advances
+ * the time only when all these threads are idle (sleeping or waiting),
+ * so a run is deterministic and as fast as the CPU allows.
+ * A thread is a user of the clock from its first sleep or wait
+ * until it ends.
+ * Threads that wait for hardware or the network (e.g. a device read loop),
+ * and the driver itself, use sleepRealUs(), so they are not users,
+ * and the driver does not wait for them.
+ * */
+class UClock
+{
+public:
+  /**
+   * Sleep this number of microseconds (replaces usleep) */
+  inline void sleepUs(int64_t us)
+  {
+    sleepNs(us * 1000);
+  }
+  /**
+   * Sleep this number of nanoseconds */
+  void sleepNs(int64_t ns);
+  /**
+   * Sleep this number of microseconds in real time, also on a
+   * virtual clock, and without making the thread a user of the clock */
+  void sleepRealUs(int64_t us);
+  /**
+   * Sleep until this time */
+  void sleepUntil(UTime t);
+  /**
+   * Is the virtual clock in use */
+  inline bool isVirtual()
+  {
+    return UTime::virtualTime.load(std::memory_order_relaxed);
+  }
+  /**
+   * Switch to the virtual clock, starting at the current time.
+   * To be called by the driver. */
+  void startVirtual();
+  /**
+   * Switch back to the OS clock, e.g. at the end of a replay.
+   * Sleeping threads are woken. */
+  void stopVirtual();
+  /**
+   * Advance the virtual time to 'ns' (monotonic scale).
+   * Each sleeping thread is woken at its deadline
+   * (in deadline order), and the driver waits until all threads
+   * are idle again, before the time is advanced further.
+   * Returns when all threads are idle at the new time. */
+  void advanceTo(int64_t ns);
+  /**
+   * A thread starts waiting (on a UTopic), i.e. is idle.
+   * \returns true if counted (virtual clock), then
+   * waitEnd() must be called after the wait */
+  bool waitBegin();
+  /**
+   * A counted wait has ended.
+   * \param woken is true if the wait was ended by wake() (the
+   * thread is counted as busy already) */
+  void waitEnd(bool woken);
+  /**
+   * A publisher wakes 'n' counted waiting threads,
+   * they are busy from now (before they are scheduled) */
+  void wake(int n);
+
+private:
+  /// a thread sleeping on the virtual clock
+  struct Sleeper
+  {
+    int64_t deadline;
+    bool woken = false;
+  };
+  /// count the calling thread as a user of this clock (once),
+  /// as the driver must know how many threads to wait for
+  void addUser();
+  void addUserLocked();
+  /// a user thread has ended
+  void removeUser();
+  /// the registration of a thread, removed when the thread ends
+  struct UserMark
+  {
+    bool counted = false;
+    ~UserMark();
+  };
+  static thread_local UserMark userMark;
+  /// wait until all users are idle (or a real-time timeout)
+  void waitIdle(std::unique_lock<std::mutex> & lock);
+  std::mutex lock;
+  /// sleepers are woken, or the driver is told that all are idle
+  std::condition_variable wakeUp;
+  std::condition_variable allIdle;
+  std::vector<Sleeper*> sleepers;
+  /// threads that use this clock (sleep or wait on a UTopic), and those idle now
+  int users = 0;
+  int idle = 0;
+  /// statistics
+  int steps = 0;
+  int idleTimeouts = 0;
+};
+
+/**
+ * Make this visible to the rest of the software */
+extern UClock clockService;
@@ -0,0 +1,266 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "uclocksync.h"
+#include "udispatch.h"
+
+double UClockSync::toSec(UTime& t)
+{
+  if (not hostRefValid)
+  {
+    hostRef = t;
+    hostRefValid = true;
+  }
+  return UTime::nsToSec(t.getNsSince(hostRef));
+}
+
+void UClockSync::addSample(double teensyTime, UTime& rxTime)
+{
+  lock.lock();
+  if (sampleCnt > 0)
+  {
+    int last = (sampleNext + MAX_SAMPLES - 1) % MAX_SAMPLES;
+    if (teensyTime < sampleTeensy[last])
+    { // Teensy is restarted, start over
+      sampleCnt = 0;
+      synchronized = false;
+    }
+  }
+  sampleTeensy[sampleNext] = teensyTime;
+  sampleHost[sampleNext] = toSec(rxTime);
+  sampleNext = (sampleNext + 1) % MAX_SAMPLES;
+  if (sampleCnt < MAX_SAMPLES)
+    sampleCnt++;
+  fit();
+  lock.unlock();
+}
+
+void UClockSync::fit()
+{ // oldest sample
+  int first = (sampleNext + MAX_SAMPLES - sampleCnt) % MAX_SAMPLES;
+  // rate from the least delayed sample in each of a number of segments
+  const int MAX_SEG = 8;
+  int segCnt = sampleCnt / 4;
+  if (segCnt > MAX_SEG)
+    segCnt = MAX_SEG;
+  double rate = 1.0;
+  if (segCnt >= 2)
+  { // least squares fit of the segment minima
+    double st = 0, sh = 0, stt = 0, sth = 0;
+    // relative to first sample to keep precision
+    double t0 = sampleTeensy[first];
+    double h0 = sampleHost[first];
+    for (int s = 0; s < segCnt; s++)
+    {
+      int i0 = s * sampleCnt / segCnt;
+      int i1 = (s + 1) * sampleCnt / segCnt;
+      double tb = 0, hb = 0, db = 1e9;
+      for (int i = i0; i < i1; i++)
+      {
+        int j = (first + i) % MAX_SAMPLES;
+        double t = sampleTeensy[j] - t0;
+        double h = sampleHost[j] - h0;
+        if (h - t < db)
+        {
+          db = h - t;
+          tb = t;
+          hb = h;
+        }
+      }
+      st += tb;
+      sh += hb;
+      stt += tb * tb;
+      sth += tb * hb;
+    }
+    double den = segCnt * stt - st * st;
+    if (den > 1e-6)
+      rate = (segCnt * sth - st * sh) / den;
+    // a crystal is better than 500 ppm, else use no drift
+    if (fabs(rate - 1.0) > 500e-6)
+      rate = 1.0;
+  }
+  // offset so that the line touches the lower envelope
+  double offset = 1e9;
+  for (int i = 0; i < sampleCnt; i++)
+  {
+    int j = (first + i) % MAX_SAMPLES;
+    double o = sampleHost[j] - rate * sampleTeensy[j];
+    if (o < offset)
+      offset = o;
+  }
+  syncOffset = offset;
+  syncRate = rate;
+  synchronized = sampleCnt >= 2;
+}
+
+bool UClockSync::toHost(double teensyTime, UTime& hostTime)
+{
+  lock.lock();
+  bool isOK = synchronized;
+  if (isOK)
+  {
+    double h = syncOffset + syncRate * teensyTime;
+    double s = floor(h);
+    long sec = long(hostRef.getSec()) + long(s);
+    long usec = long(hostRef.getMicrosec()) + lround((h - s) * 1e6);
+    if (usec >= 1000000)
+    {
+      sec++;
+      usec -= 1000000;
+    }
+    hostTime.setTime(sec, usec);
+  }
+  lock.unlock();
+  return isOK;
+}
+
+void UClockSync::setPeriod(const char* msg)
+{ // like "sub enc 8"
+  const char * p1 = msg + 4;
+  while (*p1 == ' ')
+    p1++;
+  uint64_t key = UDispatch::getKey(p1);
+  if (key == 0 or strncmp(p1, "hbt ", 4) == 0)
+    // heartbeat has Teensy time
+    return;
+  const char * p2 = p1;
+  while (*p2 > ' ')
+    p2++;
+  float ms = strtof(p2, nullptr);
+  lock.lock();
+  Stream * st = nullptr;
+  for (int i = 0; i < streamCnt; i++)
+    if (streams[i].key == key)
+      st = &streams[i];
+  if (st == nullptr and streamCnt < MAX_STREAMS)
+  {
+    st = &streams[streamCnt++];
+    st->key = key;
+    int n = p2 - p1;
+    if (n > 8)
+      n = 8;
+    strncpy(st->name, p1, n);
+  }
+  if (st != nullptr)
+  { // restart phase lock with new period
+    st->period = ms / 1000.0;
+    st->valid = false;
+  }
+  lock.unlock();
+}
+
+void UClockSync::correct(uint64_t key, UTime& msgTime)
+{
+  lock.lock();
+  Stream * st = nullptr;
+  for (int i = 0; i < streamCnt; i++)
+    if (streams[i].key == key)
+    {
+      st = &streams[i];
+      break;
+    }
+  if (st != nullptr and st->period > 0)
+  {
+    double a = toSec(msgTime);
+    double p = st->period * syncRate;
+    // number of periods since last sample (more than one if messages are lost)
+    double k = round((a - st->sampleTime) / p);
+    if (not st->valid or k < 1 or k > 10)
+    { // start (or restart) phase lock
+      st->sampleTime = a;
+      st->valid = true;
+      st->minDelay = 1e9;
+      st->windowCnt = 0;
+    }
+    else
+    { // expected sample time
+      double s = st->sampleTime + k * p;
+      double d = a - s;
+      if (d < 0)
+      { // received before expected - move phase
+        s = a;
+        d = 0;
+      }
+      if (d < st->minDelay)
+        st->minDelay = d;
+      st->windowCnt++;
+      if (st->windowCnt * st->period > 1.0)
+      { // all messages in window (1 sec) were delayed - move phase
+        s += st->minDelay;
+        d -= st->minDelay;
+        st->minDelay = 1e9;
+        st->windowCnt = 0;
+      }
+      st->sampleTime = s;
+      // statistics
+      st->cnt++;
+      st->delaySum += d;
+      if (d > st->delayMax)
+        st->delayMax = d;
+      msgTime -= float(d);
+    }
+  }
+  lock.unlock();
+}
+
+int UClockSync::getSync(float& drift, double& offset)
+{
+  lock.lock();
+  drift = (syncRate - 1.0) * 1e6;
+  offset = syncOffset + hostRef.getSec() + hostRef.getMicrosec() * 1e-6;
+  int n = synchronized ? sampleCnt : 0;
+  lock.unlock();
+  return n;
+}
+
+void UClockSync::printStatus()
+{
+  float drift;
+  double offset;
+  int n = getSync(drift, offset);
+  printf("# UClockSync:: %d heartbeat samples, Teensy clock drift %.1f ppm\n", n, drift);
+  lock.lock();
+  for (int i = 0; i < streamCnt; i++)
+  {
+    Stream & st = streams[i];
+    if (st.cnt > 0)
+      printf("# UClockSync::   %-6s period %.1f ms, %d samples, delay removed avg %.3f ms, max %.3f ms\n",
+             st.name, st.period * 1000, st.cnt, st.delaySum / st.cnt * 1000, st.delayMax * 1000);
+  }
+  lock.unlock();
+}
+
+void UClockSync::reset()
+{
+  lock.lock();
+  sampleCnt = 0;
+  synchronized = false;
+  for (int i = 0; i < streamCnt; i++)
+    streams[i].valid = false;
+  lock.unlock();
+}
@@ -0,0 +1,126 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <mutex>
+#include <stdint.h>
+
+#include "utime.h"
+
+/**
+ * Estimate of when a Teensy message was sampled, in host time.
+ *
+ * The receive time of a message includes the USB delay, that varies
+ * with the USB batching (up to a few ms).
+ * The heartbeat (hbt) has the Teensy time, and the offset and drift
+ * between Teensy time and host time is estimated from the
+ * lower envelope of (host receive time - Teensy time), as the
+ * messages with the least delay is the best estimate.
+ *
+ * Streamed messages (enc, liv, gyro0 ...) have no Teensy time,
+ * but are send with a fixed period (from the 'sub' message).
+ * For each stream the sample times are phase locked to the
+ * lower envelope of the receive times, using the period and the drift.
+ *
+ * The corrected times includes the minimum USB delay (a constant),
+ * but not the variation.
+ * */
+class UClockSync
+{
+public:
+  /**
+   * Add a heartbeat sample
+   * \param teensyTime is the Teensy time (sec) in the message
+   * \param rxTime is the host time, when the message was received */
+  void addSample(double teensyTime, UTime & rxTime);
+  /**
+   * Convert Teensy time to host time
+   * \param teensyTime is the Teensy time
+   * \param hostTime is set to the estimated host time
+   * \returns false if not synchronized yet (hostTime is unchanged) */
+  bool toHost(double teensyTime, UTime & hostTime);
+  /**
+   * Set the stream period, e.g. from a 'sub enc 8' message
+   * \param msg is the subscribe message, like 'sub enc 8' */
+  void setPeriod(const char * msg);
+  /**
+   * Correct the receive time to the estimated sample time
+   * \param key is the stream keyword key (from UDispatch::getKey())
+   * \param msgTime is the receive time, and is changed to the sample time */
+  void correct(uint64_t key, UTime & msgTime);
+  /**
+   * Get synchronization state
+   * \param drift is the Teensy clock drift (ppm)
+   * \param offset is host time - Teensy time (sec)
+   * \returns number of heartbeat samples used */
+  int getSync(float & drift, double & offset);
+  /**
+   * Print status for each stream */
+  void printStatus();
+  /**
+   * Forget all (e.g. after a reconnect) */
+  void reset();
+
+private:
+  /// host time in seconds relative to hostRef
+  double toSec(UTime & t);
+  /// heartbeat samples (ring)
+  static const int MAX_SAMPLES = 128;
+  double sampleTeensy[MAX_SAMPLES];
+  double sampleHost[MAX_SAMPLES];
+  int sampleCnt = 0;
+  int sampleNext = 0;
+  /// host time reference, set at first use
+  UTime hostRef;
+  bool hostRefValid = false;
+  /// host = offset + rate * teensy
+  double syncOffset = 0;
+  double syncRate = 1.0;
+  bool synchronized = false;
+  /**
+   * Fit offset and rate to the lower envelope of the samples */
+  void fit();
+  /// a streamed message type
+  struct Stream
+  {
+    uint64_t key = 0;
+    char name[9] = {0};
+    /// period in Teensy time (sec), 0 is unknown
+    double period = 0;
+    /// last sample time (host sec)
+    double sampleTime = 0;
+    bool valid = false;
+    /// least delay in this window, and messages in window
+    double minDelay = 0;
+    int windowCnt = 0;
+    /// statistics of removed delay
+    int cnt = 0;
+    double delaySum = 0;
+    double delayMax = 0;
+  };
+  static const int MAX_STREAMS = 16;
+  Stream streams[MAX_STREAMS];
+  int streamCnt = 0;
+  std::mutex lock;
+};
@@ -0,0 +1,98 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "udispatch.h"
+
+uint64_t UDispatch::getKey(const char* msg)
+{ // pack up to 8 characters, the keyword ends at a space or control character
+  uint64_t key = 0;
+  for (int i = 0; i < 9; i++)
+  {
+    unsigned char c = msg[i];
+    if (c <= ' ')
+      return key;
+    if (i == 8)
+      // too long
+      break;
+    key |= uint64_t(c) << (i * 8);
+  }
+  return 0;
+}
+
+bool UDispatch::add(const char* keyword, DecodeFunc func)
+{
+  uint64_t key = getKey(keyword);
+  if (key == 0)
+  {
+    printf("# UDispatch::add: keyword '%s' is empty or longer than 8 characters - ignored\n", keyword);
+    return false;
+  }
+  bool isOK = false;
+  addLock.lock();
+  int idx = getIndex(key);
+  for (int i = 0; i < TABLE_SIZE; i++)
+  {
+    uint64_t k = keys[idx].load(std::memory_order_relaxed);
+    if (k == key)
+    { // replace function
+      funcs[idx].store(func, std::memory_order_release);
+      isOK = true;
+      break;
+    }
+    if (k == 0)
+    { // free slot - set function before key
+      funcs[idx].store(func, std::memory_order_release);
+      keys[idx].store(key, std::memory_order_release);
+      count++;
+      isOK = true;
+      break;
+    }
+    idx = (idx + 1) % TABLE_SIZE;
+  }
+  addLock.unlock();
+  if (not isOK)
+    printf("# UDispatch::add: table is full, keyword '%s' is ignored\n", keyword);
+  return isOK;
+}
+
+UDispatch::DecodeFunc UDispatch::find(const char* msg)
+{
+  uint64_t key = getKey(msg);
+  if (key == 0)
+    return nullptr;
+  int idx = getIndex(key);
+  for (int i = 0; i < TABLE_SIZE; i++)
+  {
+    uint64_t k = keys[idx].load(std::memory_order_acquire);
+    if (k == key)
+      return funcs[idx].load(std::memory_order_acquire);
+    if (k == 0)
+      // not in table
+      break;
+    idx = (idx + 1) % TABLE_SIZE;
+  }
+  return nullptr;
+}
@@ -0,0 +1,84 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+
+#include "utime.h"
+
+/**
+ * Table to find the decode function for a message from the Teensy
+ * from the first word (keyword) in the message.
+ * The keyword (max 8 characters) is packed into a 64 bit key,
+ * and the table is a hash table with linear probing,
+ * so lookup is (almost) independent of the number of keywords.
+ * Lookup is lock free, and functions can be added at any time.
+ * */
+class UDispatch
+{
+public:
+  /**
+   * Function to decode a message
+   * \param msg is the (CRC checked) message, starting with the keyword
+   * \param msgTime is the time the message was received
+   * \returns true if the message is used */
+  typedef bool (*DecodeFunc)(const char * msg, UTime & msgTime);
+  /**
+   * Add (or replace) decode function for this keyword
+   * \param keyword is first word of the message, e.g. "enc" (max 8 characters)
+   * \param func is the function to call for messages starting with this keyword
+   * \returns false if keyword is too long or the table is full */
+  bool add(const char * keyword, DecodeFunc func);
+  /**
+   * Find decode function for this message
+   * \param msg is the message starting with the keyword
+   * \returns the decode function, or nullptr if keyword is unknown */
+  DecodeFunc find(const char * msg);
+  /**
+   * Get the key for the first word in this message
+   * \param msg is the message, where the keyword ends with a space or a control character
+   * \returns 0 if keyword is longer than 8 characters */
+  static uint64_t getKey(const char * msg);
+  /**
+   * Number of registered keywords */
+  inline int size() { return count; }
+
+private:
+  /**
+   * hash of key to table index */
+  static inline int getIndex(uint64_t key)
+  {
+    return int((key * 0x9E3779B97F4A7C15ULL) >> (64 - TABLE_BITS));
+  }
+  static const int TABLE_BITS = 6;
+  static const int TABLE_SIZE = 1 << TABLE_BITS;
+  /// key is set after the function, so a found key has a valid function
+  std::atomic<uint64_t> keys[TABLE_SIZE] = {};
+  std::atomic<DecodeFunc> funcs[TABLE_SIZE] = {};
+  /// only one may add at a time
+  std::mutex addLock;
+  int count = 0;
+};
@@ -0,0 +1,141 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <charconv>
+#include <stdlib.h>
+
+#include "ufields.h"
+
+UFields::UFields(const char* msg, bool skipKeyword)
+{
+  p1 = msg;
+  if (skipKeyword)
+  { // skip to first space (or end of line)
+    while (*p1 > ' ')
+      p1++;
+  }
+}
+
+bool UFields::fullField(const std::from_chars_result & result)
+{ // the number must use the whole field, so "12.5" is not an int, and "3x" is no number
+  return result.ec == std::errc() and result.ptr == fieldEnd;
+}
+
+bool UFields::next()
+{ // skip separating spaces
+  while (*p1 == ' ')
+    p1++;
+  fieldStart = p1;
+  // then to end of field, all control characters ends the line
+  while (*p1 > ' ')
+    p1++;
+  fieldEnd = p1;
+  return fieldEnd > fieldStart;
+}
+
+bool UFields::get(int& value)
+{
+  int v = 0;
+  bool isValid = next() and fullField(std::from_chars(fieldStart, fieldEnd, v));
+  if (isValid)
+  {
+    value = v;
+    cnt++;
+  }
+  else
+    ok = false;
+  return isValid;
+}
+
+bool UFields::get(int64_t& value)
+{
+  int64_t v = 0;
+  bool isValid = next() and fullField(std::from_chars(fieldStart, fieldEnd, v));
+  if (isValid)
+  {
+    value = v;
+    cnt++;
+  }
+  else
+    ok = false;
+  return isValid;
+}
+
+bool UFields::get(bool& value)
+{
+  int v = 0;
+  bool isValid = get(v);
+  if (isValid)
+    value = v != 0;
+  return isValid;
+}
+
+bool UFields::get(double& value)
+{
+  double v;
+  bool isValid = next();
+  if (isValid)
+  {
+#ifdef __cpp_lib_to_chars
+    isValid = fullField(std::from_chars(fieldStart, fieldEnd, v));
+#else
+    // no floating point from_chars in this compiler (before GCC 11)
+    char * pe;
+    v = strtod(fieldStart, &pe);
+    isValid = pe == fieldEnd;
+#endif
+  }
+  if (isValid)
+  {
+    value = v;
+    cnt++;
+  }
+  else
+    ok = false;
+  return isValid;
+}
+
+bool UFields::get(float& value)
+{
+  float v;
+  bool isValid = next();
+  if (isValid)
+  {
+#ifdef __cpp_lib_to_chars
+    isValid = fullField(std::from_chars(fieldStart, fieldEnd, v));
+#else
+    // no floating point from_chars in this compiler (before GCC 11)
+    char * pe;
+    v = strtof(fieldStart, &pe);
+    isValid = pe == fieldEnd;
+#endif
+  }
+  if (isValid)
+  {
+    value = v;
+    cnt++;
+  }
+  else
+    ok = false;
+  return isValid;
+}
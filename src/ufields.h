@@ -0,0 +1,81 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <charconv>
+#include <stdint.h>
+
+/**
+ * Get numeric fields from a message line, like "enc 1234 5678\n".
+ * Fields are separated by spaces, and the line ends
+ * at a new-line or a zero.
+ * Numbers are converted using std::from_chars, that is locale independent
+ * and do not allocate, and the line is read in one pass only.
+ * A get(..) fails if the field is missing or not a valid number
+ * (all of the field must be used, so "12.5" is not a valid int),
+ * then the value is unchanged, and isOK() returns false,
+ * so a decoder can check that all fields were valid.
+ * */
+class UFields
+{
+public:
+  /**
+   * Constructor
+   * \param msg is the line to parse
+   * \param skipKeyword if true, then skip the first word (the keyword) */
+  UFields(const char * msg, bool skipKeyword = true);
+  /**
+   * Get next field as a number
+   * \param value is set to the field value, if valid
+   * \returns true if valid */
+  bool get(int & value);
+  bool get(int64_t & value);
+  bool get(float & value);
+  bool get(double & value);
+  /**
+   * Get next field as a bool (integer 0 is false) */
+  bool get(bool & value);
+  /**
+   * Are all fields so far valid */
+  inline bool isOK() { return ok; }
+  /**
+   * Number of valid fields so far */
+  inline int count() { return cnt; }
+
+private:
+  /**
+   * Find start and end of next field
+   * \returns false if there are no more fields */
+  bool next();
+  /**
+   * Is the conversion valid and used all of the current field */
+  bool fullField(const std::from_chars_result & result);
+  /// current position in line
+  const char * p1;
+  /// start and end of current field
+  const char * fieldStart = nullptr;
+  const char * fieldEnd = nullptr;
+  bool ok = true;
+  int cnt = 0;
+};
@@ -0,0 +1,211 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "ulinkstat.h"
+#include "udispatch.h"
+
+const float ULinkStat::histLimit[HIST_BINS] = {0.1, 0.2, 0.5, 1, 2, 5, 10, 1e9};
+
+ULinkStat::Stat * ULinkStat::find(uint64_t key, bool add)
+{ // called with lock
+  for (int i = 0; i < statCnt; i++)
+    if (stats[i].key == key)
+      return &stats[i];
+  if (not add or statCnt >= MAX_STATS or key == 0)
+    return nullptr;
+  Stat & st = stats[statCnt++];
+  st.key = key;
+  // the key is the keyword characters
+  memcpy(st.name, &key, 8);
+  st.name[8] = '\0';
+  return &st;
+}
+
+void ULinkStat::decoded(uint64_t key, UTime & rxTime, bool used)
+{
+  UTime now("now");
+  lock.lock();
+  // unused keywords are counted only if known (may be garbage)
+  Stat * st = find(key, used);
+  if (st != nullptr)
+  {
+    if (st->cnt == 0)
+      st->firstRx = rxTime;
+    else
+    { // inter-arrival time
+      float dt = rxTime - st->lastRx;
+      if (st->cnt == 1)
+        st->interval = dt;
+      float jitter = fabsf(dt - st->interval);
+      int b = 0;
+      while (jitter * 1000 > histLimit[b])
+        b++;
+      st->hist[b]++;
+      if (jitter > st->jitterMax)
+        st->jitterMax = jitter;
+      st->interval += (dt - st->interval) / 16;
+      float all = rxTime - st->firstRx;
+      if (all > 0.1)
+        st->rateAvg = st->cnt / all;
+    }
+    st->lastRx = rxTime;
+    st->cnt++;
+    st->windowCnt++;
+    if (not used)
+      st->unusedCnt++;
+    float dd = now - rxTime;
+    st->decodeSum += dd;
+    if (dd > st->decodeMax)
+      st->decodeMax = dd;
+    st->lastDecoded = now;
+    st->used = false;
+  }
+  lock.unlock();
+}
+
+void ULinkStat::crcError(uint64_t key)
+{
+  lock.lock();
+  Stat * st = find(key, false);
+  if (st != nullptr)
+    st->crcErrCnt++;
+  else
+    crcErrOther++;
+  lock.unlock();
+}
+
+void ULinkStat::consumed(const char * keyword)
+{
+  uint64_t key = UDispatch::getKey(keyword);
+  lock.lock();
+  Stat * st = find(key, false);
+  if (st != nullptr and not st->used)
+  { // first use after decode
+    float dt = st->lastDecoded.getTimePassed();
+    st->useCnt++;
+    st->useSum += dt;
+    if (dt > st->useMax)
+      st->useMax = dt;
+    st->used = true;
+  }
+  lock.unlock();
+}
+
+void ULinkStat::addRtt(float rtt)
+{
+  lock.lock();
+  if (rttCnt == 0 or rtt < rttMin)
+    rttMin = rtt;
+  if (rtt > rttMax)
+    rttMax = rtt;
+  rttSum += rtt;
+  rttCnt++;
+  lock.unlock();
+}
+
+bool ULinkStat::get(const char* keyword, Stat& stat)
+{
+  uint64_t key = UDispatch::getKey(keyword);
+  lock.lock();
+  Stat * st = find(key, false);
+  if (st != nullptr)
+    stat = *st;
+  lock.unlock();
+  return st != nullptr;
+}
+
+int ULinkStat::getRtt(float& rttMinimum, float& rttAvg, float& rttMaximum)
+{
+  lock.lock();
+  rttMinimum = rttMin;
+  rttMaximum = rttMax;
+  rttAvg = 0;
+  if (rttCnt > 0)
+    rttAvg = rttSum / rttCnt;
+  int n = rttCnt;
+  lock.unlock();
+  return n;
+}
+
+void ULinkStat::statLine(char * s, int n)
+{ // like "enc 125.0Hz j0.45 d0.012 u0.310 e0, liv ..."
+  // with max jitter, average decode and use latency in ms
+  UTime now("now");
+  lock.lock();
+  float dt = 0;
+  if (windowValid)
+    dt = now - windowStart;
+  windowStart = now;
+  windowValid = true;
+  int m = 0;
+  s[0] = '\0';
+  for (int i = 0; i < statCnt and m < n - 1; i++)
+  {
+    Stat & st = stats[i];
+    if (dt > 0)
+      st.rate = st.windowCnt / dt;
+    else
+      st.rate = st.rateAvg;
+    st.windowCnt = 0;
+    float useAvg = 0;
+    if (st.useCnt > 0)
+      useAvg = st.useSum / st.useCnt;
+    m += snprintf(&s[m], n - m, "%s%s %.1fHz j%.2f d%.3f u%.3f e%d",
+                  i > 0 ? ", " : "", st.name, st.rate,
+                  st.jitterMax * 1000, st.decodeSum / st.cnt * 1000,
+                  useAvg * 1000, st.crcErrCnt);
+  }
+  lock.unlock();
+}
+
+void ULinkStat::printStatus()
+{
+  float rMin, rAvg, rMax;
+  int n = getRtt(rMin, rAvg, rMax);
+  printf("# ULinkStat:: round trip %d samples, min %.3f ms, avg %.3f ms, max %.3f ms, CRC errors (other) %d\n",
+         n, rMin * 1000, rAvg * 1000, rMax * 1000, crcErrOther);
+  printf("# ULinkStat::   %-8s %6s %7s %7s %7s %7s %7s %4s  jitter (ms) %g %g %g %g %g %g %g >\n",
+         "keyword", "cnt", "Hz", "jit-max", "dec-avg", "dec-max", "use-avg", "crc",
+         histLimit[0], histLimit[1], histLimit[2], histLimit[3],
+         histLimit[4], histLimit[5], histLimit[6]);
+  lock.lock();
+  for (int i = 0; i < statCnt; i++)
+  {
+    Stat & st = stats[i];
+    float useAvg = 0;
+    if (st.useCnt > 0)
+      useAvg = st.useSum / st.useCnt;
+    printf("# ULinkStat::   %-8s %6d %7.1f %7.3f %7.3f %7.3f %7.3f %4d ",
+           st.name, st.cnt, st.rateAvg, st.jitterMax * 1000,
+           st.decodeSum / st.cnt * 1000, st.decodeMax * 1000,
+           useAvg * 1000, st.crcErrCnt);
+    for (int b = 0; b < HIST_BINS; b++)
+      printf(" %d", st.hist[b]);
+    printf("\n");
+  }
+  lock.unlock();
+}
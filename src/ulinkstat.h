@@ -0,0 +1,139 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <mutex>
+#include <stdint.h>
+
+#include "utime.h"
+
+/**
+ * Statistics for the messages received from the Teensy,
+ * per message keyword:
+ * rate, inter-arrival jitter histogram, CRC errors,
+ * latency from receive to end of decode and
+ * latency from decode to use (e.g. by MPose).
+ * Further the round trip time for confirmed messages.
+ *
+ * Used to tell if a control hiccup is due to USB, decode or
+ * thread scheduling.
+ * */
+class ULinkStat
+{
+public:
+  /// number of bins in the jitter histogram
+  static const int HIST_BINS = 8;
+  /// upper limit (ms) for each jitter bin, the last bin has the rest
+  static const float histLimit[HIST_BINS];
+  /// statistics for one message keyword
+  struct Stat
+  {
+    uint64_t key = 0;
+    char name[9] = {0};
+    /// messages received, and messages not used by any decoder
+    int cnt = 0;
+    int unusedCnt = 0;
+    /// messages with a CRC error
+    int crcErrCnt = 0;
+    /// message rate (Hz) in last stat interval, and for all time
+    float rate = 0;
+    float rateAvg = 0;
+    /// average inter-arrival time (sec)
+    double interval = 0;
+    /// inter-arrival deviation from average, histogram and max (sec)
+    int hist[HIST_BINS] = {0};
+    float jitterMax = 0;
+    /// receive to end of decode (sec)
+    double decodeSum = 0;
+    float decodeMax = 0;
+    /// end of decode to use (sec)
+    int useCnt = 0;
+    double useSum = 0;
+    float useMax = 0;
+    /// internal
+    UTime firstRx;
+    UTime lastRx;
+    UTime lastDecoded;
+    bool used = true;
+    int windowCnt = 0;
+  };
+  /**
+   * A message is decoded
+   * \param key is the keyword key (from UDispatch::getKey())
+   * \param rxTime is the receive time (not corrected)
+   * \param used is true if a decoder used the message */
+  void decoded(uint64_t key, UTime & rxTime, bool used);
+  /**
+   * A message failed the CRC check
+   * \param key is the keyword key (0 if not known) */
+  void crcError(uint64_t key);
+  /**
+   * Decoded data is used, e.g. by MPose,
+   * the first use after each decode is timed.
+   * \param keyword is the message keyword, e.g. "enc" */
+  void consumed(const char * keyword);
+  /**
+   * Add a round trip sample (send to confirm)
+   * \param rtt is the round trip time (sec) */
+  void addRtt(float rtt);
+  /**
+   * Get statistics for one keyword
+   * \param keyword is the message keyword, e.g. "enc"
+   * \param stat is where the statistics is copied to
+   * \returns false if the keyword is not received */
+  bool get(const char * keyword, Stat & stat);
+  /**
+   * Get round trip statistics
+   * \param rttMin, rttAvg, rttMax are the round trip times (sec)
+   * \returns number of samples */
+  int getRtt(float & rttMin, float & rttAvg, float & rttMax);
+  /**
+   * Get CRC errors where the keyword is not known (e.g. binary frames) */
+  inline int getCrcErrOther() { return crcErrOther; }
+  /**
+   * Make a one line summary for all keywords,
+   * and restart the rate measurement window.
+   * \param s is the destination string
+   * \param n is the size of s */
+  void statLine(char * s, int n);
+  /**
+   * Print statistics for all keywords */
+  void printStatus();
+
+private:
+  Stat * find(uint64_t key, bool add);
+  static const int MAX_STATS = 32;
+  Stat stats[MAX_STATS];
+  int statCnt = 0;
+  int crcErrOther = 0;
+  /// round trip
+  int rttCnt = 0;
+  double rttSum = 0;
+  float rttMin = 0;
+  float rttMax = 0;
+  /// start of rate window
+  UTime windowStart;
+  bool windowValid = false;
+  std::mutex lock;
+};
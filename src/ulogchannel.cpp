@@ -0,0 +1,129 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "ulogchannel.h"
+
+ULogChannels logChannels;
+
+
+void ULogChannel::setOpen(std::function<void()> openFunction)
+{
+  opener = openFunction;
+}
+
+void ULogChannel::open()
+{
+  std::call_once(openOnce, [this]()
+                 {
+                   if (opener)
+                     opener();
+                 });
+  opened.store(true, std::memory_order_release);
+}
+
+ULogChannel * ULogChannels::add(const std::string & name, bool on)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  for (auto & ch : channels)
+    if (ch.name == name)
+      // shared by more modules
+      return &ch;
+  channels.emplace_back();
+  ULogChannel & ch = channels.back();
+  ch.name = name;
+  ch.on = on;
+  return &ch;
+}
+
+bool ULogChannels::command(const std::string & cmd)
+{
+  const int MSL = 100;
+  char word[3][MSL] = {"", "", ""};
+  int n = sscanf(cmd.c_str(), "%99s %99s %99s", word[0], word[1], word[2]);
+  if (n < 1 or strcmp(word[0], "log") != 0)
+    return false;
+  if (n == 1)
+  {
+    list();
+    return true;
+  }
+  // new state, on (default), off or decimation
+  bool on = true;
+  int every = 1;
+  if (n < 3 or strcmp(word[2], "on") == 0)
+    on = true;
+  else if (strcmp(word[2], "off") == 0)
+    on = false;
+  else
+  {
+    every = strtol(word[2], nullptr, 10);
+    if (every < 1)
+    {
+      printf("# log: use 'log name on', 'log name off' or 'log name N' (every N'th row)\n");
+      return true;
+    }
+  }
+  std::string pattern = word[1];
+  bool prefix = pattern.back() == '*';
+  if (prefix)
+    pattern.pop_back();
+  int cnt = 0;
+  std::lock_guard<std::mutex> guard(lock);
+  for (auto & ch : channels)
+  {
+    // not case sensitive, as the ini-file keys
+    if (strncasecmp(ch.name.c_str(), pattern.c_str(), pattern.size()) == 0 and
+        (prefix or ch.name.size() == pattern.size()))
+    {
+      ch.every = every;
+      ch.on = on;
+      printf("# log: %s %s", ch.name.c_str(), on ? "on" : "off");
+      if (on and every > 1)
+        printf(" (every %d)", every);
+      printf("\n");
+      cnt++;
+    }
+  }
+  if (cnt == 0)
+    printf("# log: no channel '%s' (type 'log' for a list)\n", word[1]);
+  return true;
+}
+
+void ULogChannels::list()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  printf("# log channels (change with 'log name on|off|N'):\n");
+  for (auto & ch : channels)
+  {
+    int every = ch.every;
+    if (ch.on and every > 1)
+      printf("#   %-20s every %d\n", ch.name.c_str(), every);
+    else
+      printf("#   %-20s %s\n", ch.name.c_str(), ch.on ? "on" : "off");
+  }
+}
@@ -0,0 +1,107 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <deque>
+#include <functional>
+
+/**
+ * A log or print channel of a module, e.g. "pose.log" or "motor.print_m1".
+ * Can be switched on or off, or decimated, while running.
+ * */
+class ULogChannel
+{
+public:
+  /**
+   * Should this row be logged (or printed).
+   * When the channel is off, this is one load and one branch. */
+  inline bool active()
+  {
+    if (not on.load(std::memory_order_relaxed))
+      return false;
+    if (not opened.load(std::memory_order_acquire))
+      open();
+    int n = every.load(std::memory_order_relaxed);
+    return n == 1 or ++cnt % n == 0;
+  }
+  /// name, normally section.key in the ini-file
+  std::string name;
+  std::atomic<bool> on{false};
+  /// use every n'th row only
+  std::atomic<int> every{1};
+  /**
+   * Set the function that opens the logfile of this channel
+   * (and writes its header). It is called the first time the channel
+   * is active, so no (empty) logfile is made for a channel that is never on.
+   * The logfile pointer is tested after active(), as it is set by this function. */
+  void setOpen(std::function<void()> openFunction);
+
+private:
+  /// open the logfile once (by the first active thread)
+  void open();
+  int cnt = 0;
+  std::function<void()> opener;
+  std::once_flag openOnce;
+  std::atomic<bool> opened{false};
+};
+
+/**
+ * Register of the log and print channels of all modules.
+ * The initial state is from the ini-file,
+ * then the channels can be changed with the 'log' command
+ * from the keyboard (UService::run) or any other command source.
+ * The logfile of a module is opened (with its header)
+ * when its channel is first on (see ULogChannel::setOpen).
+ * */
+class ULogChannels
+{
+public:
+  /**
+   * Add a channel (in module setup), or get it if added already.
+   * \param name is section.key from the ini-file
+   * \param on is the initial state
+   * \returns the channel (valid until the end) */
+  ULogChannel * add(const std::string & name, bool on);
+  /**
+   * Handle a 'log' command:
+   * "log" lists all channels,
+   * "log pose.* off" switches channels off ('*' at the end matches any rest),
+   * "log motor.log 5" switches on, but logs every 5th row only.
+   * \returns false if not a log command */
+  bool command(const std::string & cmd);
+  /** print all channels and their state */
+  void list();
+
+private:
+  /// a deque, as the channels must stay in place
+  std::deque<ULogChannel> channels;
+  std::mutex lock;
+};
+
+/**
+ * Make this visible to the rest of the software */
+extern ULogChannels logChannels;
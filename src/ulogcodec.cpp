@@ -0,0 +1,337 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <cmath>
+
+#include "ulogcodec.h"
+
+const char ULogCodec::magic[9] = "RAULOG2\n";
+
+
+char ULogCodec::parseSpec(const char *& p, char * spec, int specCnt, int & stars)
+{
+  int n = 0;
+  int longCnt = 0;
+  bool longDouble = false;
+  stars = 0;
+  spec[n++] = '%';
+  // flags, width and precision
+  while (*p != '\0' and n < specCnt - 3 and strchr("-+ #0'.*0123456789", *p) != nullptr)
+  {
+    if (*p == '*')
+      stars++;
+    spec[n++] = *p++;
+  }
+  // length modifiers (int64 values are formatted as long long)
+  while (*p != '\0' and strchr("hljztLq", *p) != nullptr)
+  {
+    if (*p == 'h')
+      spec[n++] = *p;
+    else if (*p == 'L' or *p == 'q')
+      longDouble = true;
+    else
+      longCnt++;
+    p++;
+  }
+  char c = *p;
+  if (c == '\0' or n >= specCnt - 3)
+    return 0;
+  p++;
+  char type = 0;
+  if (strchr("diouxXc", c) != nullptr and not longDouble)
+  {
+    if (longCnt > 0)
+    {
+      spec[n++] = 'l';
+      spec[n++] = 'l';
+      type = 'l';
+    }
+    else
+      type = 'i';
+  }
+  else if (strchr("fFeEgGaA", c) != nullptr and not longDouble)
+    type = 'd';
+  else if (c == 's' and longCnt == 0)
+    type = 's';
+  else if (c == '%' and n == 1)
+    type = '%';
+  spec[n++] = c;
+  spec[n] = '\0';
+  return type;
+}
+
+int ULogCodec::argTypes(const char * format, char * types, int typesCnt)
+{
+  const char * p = format;
+  int n = 0;
+  char spec[32];
+  while (*p != '\0')
+  {
+    if (*p++ != '%')
+      continue;
+    int stars;
+    char type = parseSpec(p, spec, 32, stars);
+    if (type == 0)
+      return -1;
+    if (type == '%')
+      continue;
+    if (n + stars + 1 >= typesCnt)
+      return -1;
+    for (int i = 0; i < stars; i++)
+      types[n++] = 'i';
+    types[n++] = type;
+  }
+  types[n] = '\0';
+  return n;
+}
+
+int ULogCodec::toText(const char * format, const uint8_t * data, int size, char * out, int outCnt)
+{
+  const char * p = format;
+  const uint8_t * end = data + size;
+  int n = 0;
+  char spec[32];
+  char spec2[64];
+  while (*p != '\0' and n < outCnt - 1)
+  {
+    if (*p != '%')
+    {
+      out[n++] = *p++;
+      continue;
+    }
+    p++;
+    int stars;
+    char type = parseSpec(p, spec, 32, stars);
+    if (type == 0)
+      return -1;
+    if (type == '%')
+    {
+      out[n++] = '%';
+      continue;
+    }
+    // replace '*' with the width or precision value
+    int m = 0;
+    for (const char * s = spec; *s != '\0' and m < 48; s++)
+    {
+      if (*s == '*')
+      {
+        int32_t v;
+        if (data + sizeof(v) > end)
+          return -1;
+        memcpy(&v, data, sizeof(v));
+        data += sizeof(v);
+        m += snprintf(&spec2[m], 64 - m, "%d", v);
+      }
+      else
+        spec2[m++] = *s;
+    }
+    spec2[m] = '\0';
+    int r = 0;
+    switch (type)
+    {
+      case 'i':
+      {
+        int32_t v;
+        if (data + sizeof(v) > end)
+          return -1;
+        memcpy(&v, data, sizeof(v));
+        data += sizeof(v);
+        r = snprintf(&out[n], outCnt - n, spec2, v);
+        break;
+      }
+      case 'l':
+      {
+        int64_t v;
+        if (data + sizeof(v) > end)
+          return -1;
+        memcpy(&v, data, sizeof(v));
+        data += sizeof(v);
+        r = snprintf(&out[n], outCnt - n, spec2, (long long)v);
+        break;
+      }
+      case 'd':
+      {
+        double v;
+        if (data + sizeof(v) > end)
+          return -1;
+        memcpy(&v, data, sizeof(v));
+        data += sizeof(v);
+        r = snprintf(&out[n], outCnt - n, spec2, v);
+        break;
+      }
+      default:
+      { // string
+        const uint8_t * z = (const uint8_t *)memchr(data, '\0', end - data);
+        if (z == nullptr)
+          return -1;
+        r = snprintf(&out[n], outCnt - n, spec2, (const char *)data);
+        data = z + 1;
+        break;
+      }
+    }
+    if (r < 0)
+      return -1;
+    n += r;
+    if (n >= outCnt)
+      n = outCnt - 1;
+  }
+  out[n] = '\0';
+  return n;
+}
+
+int ULogCodec::toValues(const char * types, const uint8_t * data, int size, double * v, int vCnt)
+{
+  int n = 0;
+  int i = 0;
+  for (const char * t = types; *t != '\0'; t++)
+  {
+    double d = NAN;
+    if (*t == 's')
+    { // skip the string
+      const void * p = memchr(&data[n], '\0', size - n);
+      if (p == nullptr)
+        return -1;
+      n = (const uint8_t *)p - data + 1;
+    }
+    else
+    {
+      int m = *t == 'i' ? 4 : 8;
+      if (n + m > size)
+        return -1;
+      if (*t == 'i')
+      {
+        int32_t w;
+        memcpy(&w, &data[n], m);
+        d = w;
+      }
+      else if (*t == 'l')
+      {
+        int64_t w;
+        memcpy(&w, &data[n], m);
+        d = w;
+      }
+      else
+        memcpy(&d, &data[n], m);
+      n += m;
+    }
+    if (i < vCnt)
+      v[i++] = d;
+  }
+  return i;
+}
+
+int ULogCodec::convert(const char * binFile, const char * outDir, bool verbose)
+{
+  FILE * f = fopen(binFile, "r");
+  if (f == nullptr)
+  {
+    printf("# ULogCodec::convert: failed to open %s\n", binFile);
+    return -1;
+  }
+  char m[8];
+  if (fread(m, 1, 8, f) != 8 or memcmp(m, magic, 8) != 0)
+  {
+    printf("# ULogCodec::convert: %s is not a binary log\n", binFile);
+    fclose(f);
+    return -1;
+  }
+  struct Stream
+  {
+    std::string format;
+    FILE * out = nullptr;
+  };
+  std::vector<Stream> streams;
+  std::map<std::string, FILE *> files;
+  const int MLL = 4096;
+  char line[MLL];
+  uint8_t * buf = new uint8_t[UINT16_MAX + 1];
+  int cnt = 0;
+  int bad = 0;
+  bool truncated = false;
+  ULogHead h;
+  while (fread(&h, sizeof(h), 1, f) == 1)
+  {
+    if (fread(buf, 1, h.size, f) != h.size)
+    { // stopped in the middle of a record (crash or still running)
+      truncated = true;
+      break;
+    }
+    buf[h.size] = '\0';
+    int id = h.stream & ~TEXT_FLAG;
+    if (h.stream == INDEX_STREAM)
+      // index and trailer
+      continue;
+    if (h.stream == DEF_STREAM)
+    { // stream definition: id, name, format
+      uint16_t sid;
+      memcpy(&sid, buf, sizeof(sid));
+      const char * name = (const char *)&buf[2];
+      const char * fmt = name + strlen(name) + 1;
+      if (fmt >= (const char *)&buf[h.size])
+      {
+        bad++;
+        continue;
+      }
+      if (sid >= streams.size())
+        streams.resize(sid + 1);
+      FILE *& out = files[name];
+      if (out == nullptr)
+      {
+        std::string fn = std::string(outDir) + name;
+        out = fopen(fn.c_str(), "w");
+        if (out == nullptr)
+          printf("# ULogCodec::convert: failed to create %s\n", fn.c_str());
+        else if (verbose)
+          printf("# ULogCodec::convert: created %s\n", fn.c_str());
+      }
+      streams[sid].format = fmt;
+      streams[sid].out = out;
+    }
+    else if (id >= (int)streams.size() or streams[id].out == nullptr)
+      bad++;
+    else if (h.stream & TEXT_FLAG)
+      fwrite(buf, 1, h.size, streams[id].out);
+    else
+    {
+      int n = toText(streams[id].format.c_str(), buf, h.size, line, MLL);
+      if (n < 0)
+        bad++;
+      else
+        fwrite(line, 1, n, streams[id].out);
+    }
+    cnt++;
+  }
+  for (auto & fo : files)
+    if (fo.second != nullptr)
+      fclose(fo.second);
+  fclose(f);
+  delete [] buf;
+  if (bad > 0 or truncated)
+    printf("# ULogCodec::convert: %s: %d bad records%s\n", binFile, bad, truncated ? ", last record truncated" : "");
+  return cnt;
+}
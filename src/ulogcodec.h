@@ -0,0 +1,120 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Binary log format, shared by the logger (ULogger) and the
+ * converter tool (tools/logconvert.cpp).
+ *
+ * The file starts with the 8 byte 'magic' string, followed by records.
+ * A record is a ULogHead and 'size' bytes of payload.
+ * Records are saved in sequence number order (the order they were added).
+ * Stream 0 is a stream definition, payload is the stream id (uint16),
+ * the log filename and the printf format for the stream rows (both zero terminated).
+ * A row payload has the printf arguments packed in format order as
+ * int32 ('i'), int64 ('l'), double ('d') or zero terminated string ('s').
+ * If the stream id has the TEXT_FLAG set, the payload is verbatim text
+ * (file headers and comments).
+ *
+ * A log that is closed normally ends with a trailer (INDEX_STREAM records):
+ * the time index ('i', an ULogIndex entry for about every second),
+ * the file position of the stream definitions ('d', uint64 each),
+ * and as the last record the file position of the trailer, the time of
+ * the first and the last record ('f', uint64, int64, int64).
+ * The first payload byte is the record kind.
+ * */
+struct ULogHead
+{
+  uint16_t stream;
+  uint16_t size;
+  uint32_t seq;
+  /// time the record was added (ns since epoch, same clock as UTime)
+  int64_t time;
+};
+
+/**
+ * Time index entry, the first record at or after a time */
+struct ULogIndex
+{
+  int64_t time;
+  uint64_t offset;
+  uint32_t seq;
+  uint32_t reserved;
+};
+
+class ULogCodec
+{
+public:
+  static const char magic[9];
+  static const uint16_t DEF_STREAM = 0;
+  static const uint16_t TEXT_FLAG = 0x8000;
+  /// trailer records (not a row stream)
+  static const uint16_t INDEX_STREAM = 0x7fff;
+  /// index entries in one trailer record
+  static const int INDEX_PER_RECORD = 2048;
+  /// max payload of a row record
+  static const int MAX_ROW = 1024;
+  /// max arguments in a row format
+  static const int MAX_ARGS = 32;
+  /**
+   * Argument types for a printf format.
+   * \param format is the printf format string
+   * \param types gets one character per argument ('i', 'l', 'd' or 's'), zero terminated
+   * \param typesCnt is the size of the types buffer
+   * \returns number of arguments, or -1 if the format has an unsupported conversion */
+  static int argTypes(const char * format, char * types, int typesCnt);
+  /**
+   * Format a row payload as text, as fprintf would have done.
+   * \param format is the stream format
+   * \param data, size is the packed arguments
+   * \param out, outCnt is the destination buffer
+   * \returns number of characters in out, or -1 if the payload does not match */
+  static int toText(const char * format, const uint8_t * data, int size, char * out, int outCnt);
+  /**
+   * Get the numeric arguments of a row payload.
+   * \param types is the argument types of the stream (from argTypes)
+   * \param data, size is the packed arguments
+   * \param v gets one value for each argument (string arguments are NaN)
+   * \param vCnt is the size of v
+   * \returns number of values, or -1 if the payload does not match */
+  static int toValues(const char * types, const uint8_t * data, int size, double * v, int vCnt);
+  /**
+   * Convert a binary log to the text logfiles it was recorded from.
+   * \param binFile is the binary log file
+   * \param outDir is the path prepended to the logfile names (should end with '/')
+   * \param verbose prints one line per created file
+   * \returns number of records converted, or -1 if the file is not a binary log */
+  static int convert(const char * binFile, const char * outDir, bool verbose);
+
+private:
+  /**
+   * Parse one conversion specification (after the '%').
+   * \param p is advanced past the specification
+   * \param spec gets the specification (with the '%'), of max specCnt characters
+   * \param stars gets the number of '*' width/precision arguments
+   * \returns the argument type ('i', 'l', 'd', 's'), '%' for a literal '%', or 0 if unsupported */
+  static char parseSpec(const char *& p, char * spec, int specCnt, int & stars);
+};
@@ -0,0 +1,643 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <filesystem>
+#include <algorithm>
+
+#include "ulogger.h"
+#include "uservice.h"
+#include "uthreads.h"
+
+ULogger logger;
+
+namespace
+{
+  /**
+   * The ring used by this thread,
+   * released for another thread when this thread ends */
+  struct URingOwner
+  {
+    ULogRing * ring = nullptr;
+    ~URingOwner()
+    {
+      if (ring != nullptr)
+        ring->owned.store(false, std::memory_order_release);
+    }
+  };
+  thread_local URingOwner owner;
+
+  /**
+   * Logfile kept in memory (openMemory()),
+   * saved by the stdio close (cookie functions) */
+  struct UMemoryFile
+  {
+    std::string name;
+    std::string data;
+    static ssize_t write(void * cookie, const char * buf, size_t size)
+    {
+      ((UMemoryFile *)cookie)->data.append(buf, size);
+      return size;
+    }
+    static int close(void * cookie)
+    {
+      UMemoryFile * m = (UMemoryFile *)cookie;
+      FILE * f = fopen(m->name.c_str(), "w");
+      if (f != nullptr)
+      {
+        fwrite(m->data.data(), 1, m->data.size(), f);
+        fclose(f);
+      }
+      delete m;
+      return 0;
+    }
+  };
+
+  /** record time, same clock as UTime (as wall clock ns) */
+  int64_t clockNs()
+  {
+    UTime t("now");
+    return t.getWallNs();
+  }
+}
+
+
+ULogRing::ULogRing(int sizeBytes)
+{
+  size = 4096;
+  while ((int)size < sizeBytes)
+    size *= 2;
+  buf = new uint8_t[size];
+  // touch all pages now, not on the first records
+  memset(buf, 0, size);
+}
+
+ULogRing::~ULogRing()
+{
+  delete [] buf;
+}
+
+bool ULogRing::push(const ULogHead & rh, const void * data, int n)
+{
+  uint32_t need = sizeof(ULogHead) + n;
+  uint64_t h = head.load(std::memory_order_relaxed);
+  if (h + need - tail.load(std::memory_order_acquire) > size)
+  {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  const uint8_t * src[2] = {(const uint8_t *)&rh, (const uint8_t *)data};
+  uint32_t cnt[2] = {sizeof(rh), (uint32_t)n};
+  for (int k = 0; k < 2; k++)
+  { // copy with wrap-around
+    uint32_t i = h & (size - 1);
+    uint32_t first = cnt[k];
+    if (first > size - i)
+      first = size - i;
+    memcpy(&buf[i], src[k], first);
+    memcpy(buf, src[k] + first, cnt[k] - first);
+    h += cnt[k];
+  }
+  head.store(h, std::memory_order_release);
+  return true;
+}
+
+void ULogRing::peek(uint64_t pos, void * dst, uint32_t n)
+{
+  uint32_t i = pos & (size - 1);
+  uint32_t first = n;
+  if (first > size - i)
+    first = size - i;
+  memcpy(dst, &buf[i], first);
+  memcpy((uint8_t *)dst + first, buf, n - first);
+}
+
+void ULogRing::write(FILE * f, uint64_t pos, uint32_t n)
+{
+  uint32_t i = pos & (size - 1);
+  uint32_t first = n;
+  if (first > size - i)
+    first = size - i;
+  fwrite(&buf[i], 1, first, f);
+  if (n > first)
+    fwrite(buf, 1, n - first, f);
+}
+
+void ULogRing::writeFd(int fd, uint64_t pos, uint32_t n)
+{
+  uint32_t i = pos & (size - 1);
+  uint32_t first = n;
+  if (first > size - i)
+    first = size - i;
+  if (::write(fd, &buf[i], first) == (ssize_t)first and n > first)
+    ::write(fd, buf, n - first);
+}
+
+
+void ULogger::setup()
+{ // ensure default values
+  if (not ini.has("logger"))
+  { // no data yet, so generate some default values
+    ini["logger"]["binary"] = "true"; // rows to log_all.bin (else fprintf to text logs)
+    ini["logger"]["ring_kb"] = "256"; // ring buffer for each thread that logs
+    ini["logger"]["flush_ms"] = "50"; // time between saving the rings
+    ini["logger"]["convert"] = "true"; // convert to text logfiles at terminate
+  }
+  if (not ini["logger"].has("recorder"))
+  { // flight recorder settings
+    ini["logger"]["recorder"] = "false"; // keep logs in memory only, save on stop
+    ini["logger"]["recorder_sec"] = "30"; // seconds kept
+    ini["logger"]["recorder_mb"] = "32"; // max memory used
+  }
+  if (not ini["logger"].has("index_sec"))
+  { // time between entries in the time index of log_all.bin
+    ini["logger"]["index_sec"] = "1.0";
+  }
+  binary = ini["logger"]["binary"] == "true";
+  ringSize = strtol(ini["logger"]["ring_kb"].c_str(), nullptr, 10) * 1024;
+  flushMs = strtol(ini["logger"]["flush_ms"].c_str(), nullptr, 10);
+  if (flushMs < 1)
+    flushMs = 1;
+  convertAtEnd = ini["logger"]["convert"] == "true";
+  recorder = ini["logger"]["recorder"] == "true";
+  recorderSec = strtof(ini["logger"]["recorder_sec"].c_str(), nullptr);
+  float indexSec = strtof(ini["logger"]["index_sec"].c_str(), nullptr);
+  if (indexSec < 0.001)
+    indexSec = 0.001;
+  indexStep = int64_t(indexSec * 1e9);
+  if (recorder)
+  { // all in memory (the ring is allocated and touched now)
+    binary = true;
+    int mb = strtol(ini["logger"]["recorder_mb"].c_str(), nullptr, 10);
+    if (mb < 1)
+      mb = 1;
+    history = new ULogRing(mb * 1024 * 1024);
+    preamble.reserve(256 * 1024);
+    preamble.insert(preamble.end(), ULogCodec::magic, ULogCodec::magic + 8);
+    marks.resize(recorderSec * 1000 / flushMs + 2);
+    snprintf(fatalName, sizeof(fatalName), "%srecorder_crash.bin", service.logPath.c_str());
+    th1 = threads.spawn("logger", runObj, this);
+  }
+  else if (binary)
+  {
+    binName = service.logPath + "log_all.bin";
+    binFile = service.openLog(binName);
+    if (binFile == nullptr)
+    {
+      printf("# ULogger:: failed to create %s, using text logs\n", binName.c_str());
+      binary = false;
+    }
+    else
+    {
+      setvbuf(binFile, nullptr, _IOFBF, 256 * 1024);
+      fwrite(ULogCodec::magic, 1, 8, binFile);
+      th1 = threads.spawn("logger", runObj, this);
+    }
+  }
+}
+
+void ULogger::run()
+{
+  while (not service.stop)
+  {
+    usleep(flushMs * 1000);
+    std::lock_guard<std::mutex> guard(writeLock);
+    drainAll();
+    if (history != nullptr)
+      trimHistory();
+  }
+}
+
+void ULogger::terminate()
+{
+  if (th1 != nullptr)
+  {
+    th1->join();
+    th1 = nullptr;
+  }
+  if (binFile != nullptr)
+  {
+    int dropped = 0;
+    writeLock.lock();
+    drainAll();
+    writeTrailer();
+    fclose(binFile);
+    binFile = nullptr;
+    writeLock.unlock();
+    for (int i = 0; i < ringCnt; i++)
+      dropped += rings[i]->dropped;
+    printf("# ULogger:: saved %.2f MB in %d streams to %s, %d index entries, %d records dropped (ring full)\n",
+           written / 1e6, streamCnt, binName.c_str(), (int)index.size(), dropped);
+    if (convertAtEnd)
+    {
+      int n = ULogCodec::convert(binName.c_str(), service.logPath.c_str(), false);
+      printf("# ULogger:: converted %d records to text logfiles\n", n);
+    }
+  }
+  if (history != nullptr)
+  {
+    int dropped = 0;
+    for (int i = 0; i < ringCnt; i++)
+      dropped += rings[i]->dropped;
+    printf("# ULogger:: flight recorder passed %.2f MB in %d streams, %d dumps, %d records dropped (ring full)\n",
+           written / 1e6, streamCnt, dumpCnt, dropped);
+  }
+  // the rings are not deleted, as a thread may still try to log
+}
+
+int ULogger::define(const char * name, const char * format)
+{
+  if (not binary)
+    return 0;
+  const int MSL = 1024;
+  char s[MSL];
+  std::lock_guard<std::mutex> guard(writeLock);
+  if ((binFile == nullptr and history == nullptr) or streamCnt >= ULogCodec::TEXT_FLAG - 1)
+    return 0;
+  uint16_t id = ++streamCnt;
+  rowSeen.resize(streamCnt + 1, false);
+  memcpy(s, &id, sizeof(id));
+  int n = sizeof(id);
+  n += snprintf(&s[n], MSL - n, "%s", name) + 1;
+  if (n < MSL)
+    n += snprintf(&s[n], MSL - n, "%s", format) + 1;
+  if (n > MSL)
+  {
+    printf("# ULogger::define: name and format too long for %s\n", name);
+    return 0;
+  }
+  write(ULogCodec::DEF_STREAM, s, n);
+  return id;
+}
+
+void ULogger::push(int stream, const void * data, int n)
+{
+  ULogRing * r = ring();
+  if (r != nullptr)
+  {
+    int64_t t = clockNs();
+    ULogHead rh = {(uint16_t)stream, (uint16_t)n, seq.fetch_add(1, std::memory_order_relaxed), t};
+    r->push(rh, data, n);
+  }
+}
+
+void ULogger::text(int stream, const char * data, int n)
+{
+  std::lock_guard<std::mutex> guard(writeLock);
+  if (binFile == nullptr and history == nullptr)
+    return;
+  // keep the order with records from this (or other) threads
+  drainAll();
+  while (n > 0)
+  {
+    int m = n;
+    if (m > UINT16_MAX)
+      m = UINT16_MAX;
+    write(stream | ULogCodec::TEXT_FLAG, data, m);
+    data += m;
+    n -= m;
+  }
+}
+
+ULogRing * ULogger::ring()
+{
+  if (owner.ring != nullptr)
+    return owner.ring;
+  std::lock_guard<std::mutex> guard(ringLock);
+  int n = ringCnt.load(std::memory_order_relaxed);
+  for (int i = 0; i < n; i++)
+  { // reuse the ring of a thread that has ended
+    bool used = false;
+    if (rings[i]->owned.compare_exchange_strong(used, true, std::memory_order_acquire))
+    {
+      owner.ring = rings[i];
+      return owner.ring;
+    }
+  }
+  if (n >= MAX_RINGS)
+  {
+    printf("# ULogger::ring: no space for more threads (%d)\n", n);
+    return nullptr;
+  }
+  ULogRing * r = new ULogRing(ringSize);
+  r->owned = true;
+  rings[n] = r;
+  ringCnt.store(n + 1, std::memory_order_release);
+  owner.ring = r;
+  return r;
+}
+
+void ULogger::drainAll()
+{
+  if (binFile == nullptr and history == nullptr)
+    return;
+  int n = ringCnt.load(std::memory_order_acquire);
+  uint64_t pos[MAX_RINGS];
+  uint64_t end[MAX_RINGS];
+  for (int i = 0; i < n; i++)
+  { // records available now
+    end[i] = rings[i]->head.load(std::memory_order_acquire);
+    pos[i] = rings[i]->tail.load(std::memory_order_relaxed);
+  }
+  int bytes = 0;
+  while (true)
+  { // merge the rings, oldest record first
+    int best = -1;
+    ULogHead bh = {0, 0, 0, 0};
+    for (int i = 0; i < n; i++)
+    {
+      if (pos[i] < end[i])
+      {
+        ULogHead rh;
+        rings[i]->peek(pos[i], &rh, sizeof(rh));
+        if (best < 0 or int32_t(rh.seq - bh.seq) < 0)
+        {
+          best = i;
+          bh = rh;
+        }
+      }
+    }
+    if (best < 0)
+      break;
+    uint32_t m = sizeof(bh) + bh.size;
+    if (binFile != nullptr and bh.time >= indexNext)
+    { // first record after an index step
+      index.push_back({bh.time, 8 + written + bytes, bh.seq, 0});
+      indexNext = bh.time + indexStep;
+    }
+    lastTime = bh.time;
+    sink(rings[best], pos[best], m);
+    pos[best] += m;
+    bytes += m;
+  }
+  for (int i = 0; i < n; i++)
+    rings[i]->tail.store(pos[i], std::memory_order_release);
+  if (bytes > 0)
+  {
+    if (binFile != nullptr)
+      fflush(binFile);
+    written += bytes;
+  }
+}
+
+void ULogger::sink(ULogRing * from, uint64_t pos, uint32_t n)
+{
+  if (history != nullptr)
+  {
+    from->peek(pos, recBuf, n);
+    rowSeen[((ULogHead *)recBuf)->stream] = true;
+    toHistory(recBuf, n);
+  }
+  else
+    from->write(binFile, pos, n);
+}
+
+void ULogger::toHistory(const uint8_t * rec, uint32_t n)
+{
+  if (n > history->size)
+    return;
+  uint64_t h = history->head;
+  uint64_t t = history->tail;
+  while (h + n - t > history->size)
+  { // remove the oldest record
+    ULogHead rh;
+    history->peek(t, &rh, sizeof(rh));
+    t += sizeof(rh) + rh.size;
+  }
+  history->tail = t;
+  const ULogHead * rh = (const ULogHead *)rec;
+  history->push(*rh, rec + sizeof(ULogHead), n - sizeof(ULogHead));
+}
+
+void ULogger::trimHistory()
+{
+  int m = marks.size();
+  UPassMark & mark = marks[(markHead + markCnt) % m];
+  mark.t.now();
+  mark.pos = history->head;
+  if (markCnt < m)
+    markCnt++;
+  else
+    markHead = (markHead + 1) % m;
+  // remove passes older than recorderSec (but not the last)
+  while (markCnt > 1 and mark.t - marks[markHead].t > recorderSec)
+  {
+    markHead = (markHead + 1) % m;
+    markCnt--;
+    uint64_t p = marks[markHead].pos;
+    // the history may be trimmed (by size) already
+    if (p > history->tail)
+    {
+      uint64_t t = history->tail;
+      while (t < p)
+      { // move to a record boundary
+        ULogHead rh;
+        history->peek(t, &rh, sizeof(rh));
+        t += sizeof(rh) + rh.size;
+      }
+      history->tail = t;
+    }
+  }
+}
+
+void ULogger::dump(const char * reason)
+{
+  if (history == nullptr)
+    return;
+  std::lock_guard<std::mutex> guard(writeLock);
+  drainAll();
+  dumpCnt++;
+  std::string base = service.logPath + "recorder_" + std::to_string(dumpCnt) + "_";
+  for (const char * p = reason; *p != '\0'; p++)
+    base += isalnum(*p) ? *p : '_';
+  std::string fn = base + ".bin";
+  FILE * f = fopen(fn.c_str(), "w");
+  if (f == nullptr)
+  {
+    printf("# ULogger::dump: failed to create %s\n", fn.c_str());
+    return;
+  }
+  fwrite(preamble.data(), 1, preamble.size(), f);
+  uint64_t t = history->tail;
+  uint64_t h = history->head;
+  history->write(f, t, h - t);
+  fclose(f);
+  float sec = 0;
+  if (markCnt > 0)
+    sec = marks[(markHead + markCnt - 1) % marks.size()].t - marks[markHead].t;
+  std::error_code e;
+  std::filesystem::create_directory(base, e);
+  int n = ULogCodec::convert(fn.c_str(), (base + "/").c_str(), false);
+  printf("# ULogger:: flight recorder (%s) saved %.1f sec, %.2f MB, %d records to %s/\n",
+         reason, sec, (h - t) / 1e6, n, base.c_str());
+}
+
+void ULogger::dumpFatal()
+{ // no locks, no allocation and no stdio - the state may be broken
+  if (history == nullptr)
+    return;
+  int fd = ::open(fatalName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return;
+  if (::write(fd, preamble.data(), preamble.size()) > 0)
+  {
+    uint64_t t = history->tail;
+    history->writeFd(fd, t, history->head - t);
+    // and what is not yet moved to the history
+    int n = ringCnt;
+    for (int i = 0; i < n; i++)
+    {
+      t = rings[i]->tail;
+      rings[i]->writeFd(fd, t, rings[i]->head - t);
+    }
+  }
+  ::close(fd);
+  const char msg[] = "# ULogger:: flight recorder saved to recorder_crash.bin\n";
+  ::write(STDOUT_FILENO, msg, sizeof(msg) - 1);
+}
+
+void ULogger::write(uint16_t stream, const void * data, int n)
+{
+  int64_t t = clockNs();
+  ULogHead h = {stream, (uint16_t)n, seq.fetch_add(1, std::memory_order_relaxed), t};
+  if (history != nullptr)
+  {
+    int id = stream & ~ULogCodec::TEXT_FLAG;
+    if (stream == ULogCodec::DEF_STREAM or not rowSeen[id])
+    { // definitions and headers are kept
+      const uint8_t * p = (const uint8_t *)&h;
+      preamble.insert(preamble.end(), p, p + sizeof(h));
+      p = (const uint8_t *)data;
+      preamble.insert(preamble.end(), p, p + n);
+    }
+    else
+    { // later text (comments) is in time order with the rows
+      memcpy(recBuf, &h, sizeof(h));
+      memcpy(&recBuf[sizeof(h)], data, n);
+      toHistory(recBuf, sizeof(h) + n);
+    }
+  }
+  else
+  {
+    if (stream == ULogCodec::DEF_STREAM)
+      defPos.push_back(8 + written);
+    fwrite(&h, sizeof(h), 1, binFile);
+    fwrite(data, 1, n, binFile);
+  }
+  written += sizeof(h) + n;
+}
+
+void ULogger::writeTrailer()
+{
+  uint64_t start = 8 + written;
+  std::vector<uint8_t> rec;
+  // time index
+  for (size_t i = 0; i < index.size(); i += ULogCodec::INDEX_PER_RECORD)
+  {
+    size_t n = std::min(index.size() - i, size_t(ULogCodec::INDEX_PER_RECORD));
+    rec.assign(1, 'i');
+    const uint8_t * p = (const uint8_t *)&index[i];
+    rec.insert(rec.end(), p, p + n * sizeof(ULogIndex));
+    write(ULogCodec::INDEX_STREAM, rec.data(), rec.size());
+  }
+  // stream definitions
+  const size_t defPerRecord = UINT16_MAX / sizeof(uint64_t) - 1;
+  for (size_t i = 0; i < defPos.size(); i += defPerRecord)
+  {
+    size_t n = std::min(defPos.size() - i, defPerRecord);
+    rec.assign(1, 'd');
+    const uint8_t * p = (const uint8_t *)&defPos[i];
+    rec.insert(rec.end(), p, p + n * sizeof(uint64_t));
+    write(ULogCodec::INDEX_STREAM, rec.data(), rec.size());
+  }
+  // and where to find it
+  int64_t first = index.empty() ? 0 : index.front().time;
+  rec.assign(1, 'f');
+  const uint8_t * p = (const uint8_t *)&start;
+  rec.insert(rec.end(), p, p + sizeof(start));
+  p = (const uint8_t *)&first;
+  rec.insert(rec.end(), p, p + sizeof(first));
+  p = (const uint8_t *)&lastTime;
+  rec.insert(rec.end(), p, p + sizeof(lastTime));
+  write(ULogCodec::INDEX_STREAM, rec.data(), rec.size());
+}
+
+
+FILE * ULogger::openMemory(const std::string & filename)
+{
+  UMemoryFile * m = new UMemoryFile();
+  m->name = filename;
+  m->data.reserve(64 * 1024);
+  cookie_io_functions_t io = {nullptr, UMemoryFile::write, nullptr, UMemoryFile::close};
+  FILE * f = fopencookie(m, "w", io);
+  if (f == nullptr)
+    delete m;
+  return f;
+}
+
+FILE * ULogStream::open(const std::string & filename, const char * rowFormat)
+{
+  format = rowFormat;
+  size_t n = filename.rfind('/');
+  name = filename.substr(n == std::string::npos ? 0 : n + 1);
+  id = logger.define(name.c_str(), format);
+  if (id == 0)
+    return service.openLog(filename);
+  if (ULogCodec::argTypes(format, types, ULogCodec::MAX_ARGS) < 0)
+    printf("# ULogStream::open: unsupported format for %s: %s", name.c_str(), format);
+  // header and comments go to the binary log too
+  cookie_io_functions_t io = {nullptr, textWrite, nullptr, nullptr};
+  FILE * f = fopencookie(this, "w", io);
+  if (f != nullptr)
+    setvbuf(f, nullptr, _IONBF, 0);
+  return f;
+}
+
+void ULogStream::share(ULogStream & first, const char * rowFormat)
+{
+  format = rowFormat;
+  name = first.name;
+  if (first.id != 0)
+  {
+    id = logger.define(name.c_str(), format);
+    if (ULogCodec::argTypes(format, types, ULogCodec::MAX_ARGS) < 0)
+      printf("# ULogStream::share: unsupported format for %s: %s", name.c_str(), format);
+  }
+}
+
+void ULogStream::check(const char * sig)
+{
+  checked = true;
+  matched = strcmp(sig, types) == 0;
+  if (not matched)
+    printf("# ULogStream::add: %s arguments (%s) do not match format (%s) '%s' - rows dropped\n",
+           name.c_str(), sig, types, format);
+}
+
+ssize_t ULogStream::textWrite(void * cookie, const char * buf, size_t size)
+{
+  ULogStream * s = (ULogStream *)cookie;
+  logger.text(s->id, buf, size);
+  return size;
+}
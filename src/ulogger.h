@@ -0,0 +1,320 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <type_traits>
+
+#include "ulogcodec.h"
+#include "ulogchannel.h"
+#include "utime.h"
+
+/**
+ * Single producer, single consumer byte ring for log records.
+ * One ring for each thread that logs, the writer thread is the consumer.
+ * The ring holds records in file format (ULogHead and payload).
+ * */
+class ULogRing
+{
+public:
+  ULogRing(int sizeBytes);
+  ~ULogRing();
+  /**
+   * Add a record (producer only), no blocking and no system calls.
+   * \returns false if there is no space (the record is dropped) */
+  bool push(const ULogHead & rh, const void * data, int n);
+  /**
+   * Copy from the ring at this (not folded) position (consumer only) */
+  void peek(uint64_t pos, void * dst, uint32_t n);
+  /**
+   * Write n bytes from this position to a file (consumer only) */
+  void write(FILE * f, uint64_t pos, uint32_t n);
+  /**
+   * Write n bytes from this position to a file descriptor,
+   * used from a signal handler */
+  void writeFd(int fd, uint64_t pos, uint32_t n);
+  /// ring size (a power of 2)
+  uint32_t size;
+  uint8_t * buf;
+  /// write and read position (not folded)
+  std::atomic<uint64_t> head{0};
+  std::atomic<uint64_t> tail{0};
+  /// records dropped, as the ring was full
+  std::atomic<int> dropped{0};
+  /// ring is used by a running thread
+  std::atomic<bool> owned{false};
+};
+
+/**
+ * Asynchronous binary logger.
+ * Producers pack the arguments of a log row into a record
+ * in a ring owned by the thread (no formatting and no disk I/O).
+ * A writer thread saves all rings to log_all.bin in batches.
+ * Every record has the time it was added, and log_all.bin
+ * ends with a time index (see ULogCodec), so that it can be read
+ * from any time (ULogReader) or replayed (STeensy, option --replay).
+ * The binary log can be converted to the original text logfiles
+ * at terminate (convert=true) or with the logconvert tool.
+ *
+ * As flight recorder (recorder=true) all logs are enabled, but
+ * the writer thread keeps the records in a preallocated memory ring
+ * with the last 'recorder_sec' seconds, and nothing is saved while running.
+ * The ring is saved (dumped) when the service stops, on demand (key 'dump'),
+ * and after a fatal signal.
+ * */
+class ULogger
+{
+public:
+  /** setup and start the writer thread */
+  void setup();
+  /** writer thread */
+  void run();
+  /** save the rest, close and convert to text logs */
+  void terminate();
+  /**
+   * Define a log stream in the binary log.
+   * \param name is the filename for the text version of the stream
+   * \param format is the printf format of a row
+   * \returns the stream id, or 0 if not logging to a binary log */
+  int define(const char * name, const char * format);
+  /**
+   * Add a row record to the ring of this thread */
+  void push(int stream, const void * data, int n);
+  /**
+   * Save verbatim text (header or comment) for a stream,
+   * after all records already in the rings.
+   * Not for the hot path, as it waits for the file. */
+  void text(int stream, const char * data, int n);
+  /**
+   * Save the flight recorder history to recorder_N_reason.bin in the log path,
+   * and convert it to text logfiles in the directory recorder_N_reason/.
+   * \param reason is added to the name */
+  void dump(const char * reason);
+  /**
+   * Save the flight recorder history to recorder_crash.bin,
+   * using system calls only, as called from a fatal signal handler.
+   * Convert with the logconvert tool. */
+  void dumpFatal();
+  /**
+   * Open a logfile that is kept in memory and saved when closed,
+   * used in flight recorder mode for logfiles without ULogStream rows,
+   * so that there is no disk I/O while running.
+   * \returns a stdio file handle, or nullptr if failed */
+  FILE * openMemory(const std::string & filename);
+  /// rows go to the binary log (else text logfiles as before)
+  bool binary = false;
+  /// flight recorder mode, all logs are enabled, but kept in memory
+  bool recorder = false;
+
+private:
+  /** get the ring of this thread, created if needed */
+  ULogRing * ring();
+  /** write all rings to the file in sequence order (writeLock must be locked) */
+  void drainAll();
+  /** write a record directly (writeLock must be locked) */
+  void write(uint16_t stream, const void * data, int n);
+  /** save a record from a thread ring to file or history (writeLock must be locked) */
+  void sink(ULogRing * from, uint64_t pos, uint32_t n);
+  /** add a record to the recorder history, the oldest records are removed to make space */
+  void toHistory(const uint8_t * rec, uint32_t n);
+  /** remove history older than recorderSec (writeLock must be locked) */
+  void trimHistory();
+  /** save the time index and definition positions at the end of the file */
+  void writeTrailer();
+  static const int MAX_RINGS = 64;
+  ULogRing * rings[MAX_RINGS] = {nullptr};
+  std::atomic<int> ringCnt{0};
+  /// record sequence number, to merge the rings
+  std::atomic<uint32_t> seq{0};
+  std::mutex ringLock;
+  std::mutex writeLock;
+  FILE * binFile = nullptr;
+  std::string binName;
+  int ringSize = 256 * 1024;
+  int flushMs = 50;
+  bool convertAtEnd = true;
+  int streamCnt = 0;
+  uint64_t written = 0;
+  /// time index of log_all.bin
+  std::vector<ULogIndex> index;
+  int64_t indexStep = 1000000000;
+  int64_t indexNext = 0;
+  int64_t lastTime = 0;
+  /// file position of the stream definitions
+  std::vector<uint64_t> defPos;
+  /// flight recorder history (records in file format)
+  ULogRing * history = nullptr;
+  /// stream definitions and headers, never removed from the history
+  std::vector<uint8_t> preamble;
+  /// streams with rows in the history (later text is not a header)
+  std::vector<bool> rowSeen;
+  /// history position at each writer pass, to remove old records
+  struct UPassMark
+  {
+    UTime t;
+    uint64_t pos;
+  };
+  std::vector<UPassMark> marks;
+  int markHead = 0;
+  int markCnt = 0;
+  float recorderSec = 30;
+  int dumpCnt = 0;
+  char fatalName[256] = "";
+  /// a record copied from a thread ring
+  uint8_t recBuf[sizeof(ULogHead) + UINT16_MAX];
+  std::thread * th1 = nullptr;
+  static void runObj(ULogger * obj)
+  { // called, when thread is started
+    // transfer to the class run() function.
+    obj->run();
+  }
+};
+
+/**
+ * Make this visible to the rest of the software */
+extern ULogger logger;
+
+/**
+ * One row format of a logfile.
+ * In text mode a row is written with fprintf to the logfile,
+ * else the arguments are packed and added to the binary logger.
+ * Arguments must match the format:
+ * int (or smaller) for %d, %u, %x, %c and '*',
+ * long or unsigned long for %ld, %lu,
+ * float or double for %f, %g, %e, and char pointer for %s.
+ * */
+class ULogStream
+{
+public:
+  /**
+   * Open a logfile with this row format.
+   * \param filename is the full name of the text logfile
+   * \param format is the printf format for a row
+   * \returns a file handle for the header and comments
+   *          (a text stream in the binary log in binary mode) */
+  FILE * open(const std::string & filename, const char * format);
+  /**
+   * Another row format to the same logfile as 'first' */
+  void share(ULogStream & first, const char * format);
+  /**
+   * Add a row
+   * \param logfile is the file handle from open() */
+  template<typename... Args>
+  void add(FILE * logfile, Args... args)
+  {
+    if (id == 0)
+      fprintf(logfile, format, args...);
+    else
+    {
+      static constexpr char sig[] = {typeCode<std::decay_t<Args>>()..., '\0'};
+      if (not checked)
+        check(sig);
+      if (matched)
+      {
+        uint8_t data[ULogCodec::MAX_ROW];
+        int n = packRow(data, args...);
+        logger.push(id, data, n);
+      }
+    }
+  }
+  /**
+   * Pack row arguments as a record payload
+   * \param data must have space for ULogCodec::MAX_ROW bytes
+   * \returns number of bytes used */
+  template<typename... Args>
+  static int packRow(uint8_t * data, Args... args)
+  {
+    int n = 0;
+    (pack(data, n, args), ...);
+    return n;
+  }
+  /// binary log stream id, 0 is text mode
+  int id = 0;
+  /// row format
+  const char * format = "";
+  /// logfile name (without path)
+  std::string name;
+
+private:
+  /** compare the argument types with the format (once) */
+  void check(const char * sig);
+  template<typename T>
+  static constexpr char typeCode()
+  {
+    if constexpr (std::is_same_v<T, long> or std::is_same_v<T, unsigned long> or
+                  std::is_same_v<T, long long> or std::is_same_v<T, unsigned long long>)
+      return 'l';
+    else if constexpr (std::is_integral_v<T> or std::is_enum_v<T>)
+      return 'i';
+    else if constexpr (std::is_floating_point_v<T>)
+      return 'd';
+    else
+      return 's';
+  }
+  template<typename T>
+  static void pack(uint8_t * data, int & n, T v)
+  {
+    constexpr char c = typeCode<T>();
+    if constexpr (c == 's')
+    { // zero terminated string, truncated if too long
+      if (n >= ULogCodec::MAX_ROW - 1)
+        return;
+      int m = strnlen(v, ULogCodec::MAX_ROW - 1 - n);
+      memcpy(&data[n], v, m);
+      n += m;
+      data[n++] = '\0';
+    }
+    else if (n + 8 <= ULogCodec::MAX_ROW)
+    {
+      if constexpr (c == 'l')
+      {
+        int64_t w = static_cast<int64_t>(v);
+        memcpy(&data[n], &w, sizeof(w));
+        n += sizeof(w);
+      }
+      else if constexpr (c == 'i')
+      {
+        int32_t w = static_cast<int32_t>(v);
+        memcpy(&data[n], &w, sizeof(w));
+        n += sizeof(w);
+      }
+      else
+      {
+        double w = v;
+        memcpy(&data[n], &w, sizeof(w));
+        n += sizeof(w);
+      }
+    }
+  }
+  char types[ULogCodec::MAX_ARGS] = "";
+  bool checked = false;
+  bool matched = false;
+  static ssize_t textWrite(void * cookie, const char * buf, size_t size);
+};
@@ -0,0 +1,288 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <string.h>
+#include <algorithm>
+
+#include "ulogreader.h"
+
+ULogReader::~ULogReader()
+{
+  close();
+}
+
+bool ULogReader::open(const char * filename)
+{
+  close();
+  f = fopen(filename, "r");
+  if (f == nullptr)
+  {
+    printf("# ULogReader::open: failed to open %s\n", filename);
+    return false;
+  }
+  char m[8];
+  if (fread(m, 1, 8, f) != 8 or memcmp(m, ULogCodec::magic, 8) != 0)
+  {
+    printf("# ULogReader::open: %s is not a binary log (of this version)\n", filename);
+    close();
+    return false;
+  }
+  buf = new uint8_t[UINT16_MAX + 1];
+  fseeko(f, 0, SEEK_END);
+  uint64_t fileSize = ftello(f);
+  indexed = readTrailer(fileSize);
+  if (not indexed)
+    scan();
+  return seek(startTime);
+}
+
+void ULogReader::close()
+{
+  if (f != nullptr)
+    fclose(f);
+  f = nullptr;
+  delete [] buf;
+  buf = nullptr;
+  streams.clear();
+  index.clear();
+  selected.clear();
+  anySelected = false;
+  startTime = 0;
+  endTime = 0;
+  indexed = false;
+}
+
+bool ULogReader::readRecord(ULogHead & h)
+{
+  if (pos + sizeof(h) > dataEnd or fread(&h, sizeof(h), 1, f) != 1)
+    return false;
+  if (pos + sizeof(h) + h.size > dataEnd or fread(buf, 1, h.size, f) != h.size)
+    return false;
+  buf[h.size] = '\0';
+  pos += sizeof(h) + h.size;
+  return true;
+}
+
+void ULogReader::define(const uint8_t * data, int n)
+{
+  if (n < 3)
+    return; // no room for a name
+  uint16_t sid;
+  memcpy(&sid, data, sizeof(sid));
+  const char * name = (const char *)&data[2];
+  const char * fmt = name + strnlen(name, n - 2) + 1;
+  if (fmt >= (const char *)&data[n])
+    return;
+  if (sid >= streams.size())
+    streams.resize(sid + 1);
+  UStream & s = streams[sid];
+  s.name = name;
+  s.format = fmt;
+  ULogCodec::argTypes(fmt, s.types, ULogCodec::MAX_ARGS);
+}
+
+bool ULogReader::readTrailer(uint64_t fileSize)
+{
+  const int footSize = sizeof(ULogHead) + 25;
+  if (fileSize < 8 + footSize)
+    return false;
+  pos = fileSize - footSize;
+  dataEnd = fileSize;
+  fseeko(f, pos, SEEK_SET);
+  ULogHead h;
+  if (not readRecord(h) or h.stream != ULogCodec::INDEX_STREAM or h.size != 25 or buf[0] != 'f')
+    return false;
+  uint64_t start;
+  memcpy(&start, &buf[1], sizeof(start));
+  memcpy(&startTime, &buf[9], sizeof(startTime));
+  memcpy(&endTime, &buf[17], sizeof(endTime));
+  if (start < 8 or start > fileSize - footSize)
+    return false;
+  // index and definition positions
+  std::vector<uint64_t> defPos;
+  pos = start;
+  fseeko(f, pos, SEEK_SET);
+  while (pos < fileSize - footSize and readRecord(h))
+  {
+    if (h.stream != ULogCodec::INDEX_STREAM or h.size < 1)
+      return false;
+    if (buf[0] == 'i')
+    {
+      // buf[1] is not aligned, so copy
+      int n = (h.size - 1) / sizeof(ULogIndex);
+      size_t at = index.size();
+      index.resize(at + n);
+      memcpy(&index[at], &buf[1], n * sizeof(ULogIndex));
+    }
+    else if (buf[0] == 'd')
+    {
+      int n = (h.size - 1) / sizeof(uint64_t);
+      size_t at = defPos.size();
+      defPos.resize(at + n);
+      memcpy(&defPos[at], &buf[1], n * sizeof(uint64_t));
+    }
+  }
+  for (uint64_t p : defPos)
+  {
+    pos = p;
+    fseeko(f, pos, SEEK_SET);
+    if (readRecord(h) and h.stream == ULogCodec::DEF_STREAM)
+      define(buf, h.size);
+  }
+  dataEnd = start;
+  return true;
+}
+
+void ULogReader::scan()
+{
+  const int64_t step = 1000000000;
+  int64_t next = 0;
+  bool first = true;
+  pos = 8;
+  fseeko(f, 0, SEEK_END);
+  dataEnd = ftello(f);
+  fseeko(f, pos, SEEK_SET);
+  ULogHead h;
+  uint64_t p = pos;
+  while (readRecord(h))
+  {
+    if (h.stream == ULogCodec::DEF_STREAM)
+      define(buf, h.size);
+    else if (h.stream != ULogCodec::INDEX_STREAM)
+    {
+      if (first)
+      {
+        startTime = h.time;
+        first = false;
+      }
+      if (h.time >= next)
+      {
+        index.push_back({h.time, p, h.seq, 0});
+        next = h.time + step;
+      }
+      endTime = h.time;
+    }
+    p = pos;
+  }
+  // a crash may leave a partial record at the end
+  dataEnd = p;
+}
+
+int ULogReader::find(const char * name, const char * format)
+{
+  for (int i = 1; i < (int)streams.size(); i++)
+  {
+    const UStream & s = streams[i];
+    if (s.name == name and
+        (format == nullptr or strncmp(s.format.c_str(), format, strlen(format)) == 0))
+      return i;
+  }
+  return 0;
+}
+
+void ULogReader::select(int stream)
+{
+  if (stream >= (int)selected.size())
+    selected.resize(stream + 1, false);
+  selected[stream] = true;
+  anySelected = true;
+}
+
+void ULogReader::selectAll()
+{
+  selected.clear();
+  anySelected = false;
+}
+
+bool ULogReader::seek(int64_t time)
+{
+  if (f == nullptr)
+    return false;
+  // last index entry before this time
+  auto it = std::upper_bound(index.begin(), index.end(), time,
+                             [](int64_t t, const ULogIndex & e) { return t < e.time; });
+  pos = 8;
+  if (it != index.begin())
+    pos = (it - 1)->offset;
+  // then skip records (without reading the payload)
+  ULogHead h;
+  while (true)
+  {
+    fseeko(f, pos, SEEK_SET);
+    if (pos + sizeof(h) > dataEnd or fread(&h, sizeof(h), 1, f) != 1)
+      break;
+    if (h.time >= time and h.stream != ULogCodec::DEF_STREAM)
+      break;
+    pos += sizeof(h) + h.size;
+  }
+  fseeko(f, pos, SEEK_SET);
+  return pos < dataEnd;
+}
+
+bool ULogReader::next(ULogRecord & rec)
+{
+  if (f == nullptr)
+    return false;
+  ULogHead h;
+  while (readRecord(h))
+  {
+    if (h.stream == ULogCodec::DEF_STREAM)
+    { // known already (from trailer or scan)
+      continue;
+    }
+    if (h.stream == ULogCodec::INDEX_STREAM)
+      continue;
+    int id = h.stream & ~ULogCodec::TEXT_FLAG;
+    if (anySelected and (id >= (int)selected.size() or not selected[id]))
+      continue;
+    rec.stream = id;
+    rec.text = (h.stream & ULogCodec::TEXT_FLAG) != 0;
+    rec.seq = h.seq;
+    rec.time = h.time;
+    rec.data = buf;
+    rec.size = h.size;
+    return true;
+  }
+  return false;
+}
+
+int ULogReader::toText(const ULogRecord & rec, char * out, int outCnt)
+{
+  if (rec.stream >= streams.size() or outCnt < 1)
+    return -1;
+  if (rec.text)
+  {
+    int n = std::min(rec.size, outCnt - 1);
+    memcpy(out, rec.data, n);
+    out[n] = '\0';
+    return n;
+  }
+  return ULogCodec::toText(streams[rec.stream].format.c_str(), rec.data, rec.size, out, outCnt);
+}
+
+int ULogReader::toValues(const ULogRecord & rec, double * v, int vCnt)
+{
+  if (rec.stream >= streams.size() or rec.text)
+    return -1;
+  return ULogCodec::toValues(streams[rec.stream].types, rec.data, rec.size, v, vCnt);
+}
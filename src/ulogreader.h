@@ -0,0 +1,127 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "ulogcodec.h"
+
+/**
+ * One record from a binary log */
+struct ULogRecord
+{
+  /// stream id (without the TEXT_FLAG)
+  uint16_t stream;
+  /// verbatim text (header or comment), else a row
+  bool text;
+  uint32_t seq;
+  /// time the record was added (ns)
+  int64_t time;
+  /// payload, valid until the next call to the reader
+  const uint8_t * data;
+  int size;
+};
+
+/**
+ * Read a binary log (log_all.bin or a flight recorder dump).
+ * The records of all streams are read in the order they were added,
+ * that is, merged in time order.
+ * The time index at the end of the file is used to seek to a time;
+ * if the file has no index (crash or recorder dump), the file is
+ * scanned once at open to make one.
+ * Used by the replay mode (STeensy) and the logconvert tool.
+ * */
+class ULogReader
+{
+public:
+  ~ULogReader();
+  /**
+   * Open a binary log and read (or make) the index
+   * \returns false if not a binary log */
+  bool open(const char * filename);
+  /** close the file */
+  void close();
+  /**
+   * Find a stream
+   * \param name is the logfile name, e.g. "log_pose.txt"
+   * \param format, if not nullptr, must match the start of the row format
+   * \returns the stream id, or 0 if not found */
+  int find(const char * name, const char * format = nullptr);
+  /**
+   * Read only these streams (all streams, if none are selected) */
+  void select(int stream);
+  void selectAll();
+  /**
+   * Continue reading from the first record at or after this time (ns) */
+  bool seek(int64_t time);
+  /**
+   * Get the next record (of the selected streams)
+   * \returns false at the end of the log */
+  bool next(ULogRecord & rec);
+  /**
+   * Row as text, as in the text logfile
+   * \returns number of characters, or -1 if the row does not match the format */
+  int toText(const ULogRecord & rec, char * out, int outCnt);
+  /**
+   * Numeric values of a row (see ULogCodec::toValues)
+   * \returns number of values, or -1 if the row does not match the format */
+  int toValues(const ULogRecord & rec, double * v, int vCnt);
+  /** a stream definition */
+  struct UStream
+  {
+    std::string name;
+    std::string format;
+    char types[ULogCodec::MAX_ARGS] = "";
+  };
+  /// stream definitions, by stream id
+  std::vector<UStream> streams;
+  /// time index
+  std::vector<ULogIndex> index;
+  /// time of the first and last record (ns)
+  int64_t startTime = 0;
+  int64_t endTime = 0;
+  /// the index is from the file (else made at open)
+  bool indexed = false;
+
+private:
+  /** read a record at the current position into buf */
+  bool readRecord(ULogHead & h);
+  /** add a stream definition from a definition payload */
+  void define(const uint8_t * data, int n);
+  /** read the trailer, if the file has one */
+  bool readTrailer(uint64_t fileSize);
+  /** read all records, to make the index */
+  void scan();
+  FILE * f = nullptr;
+  /// record data end (start of trailer)
+  uint64_t dataEnd = 0;
+  /// position of the next record
+  uint64_t pos = 0;
+  std::vector<bool> selected;
+  bool anySelected = false;
+  uint8_t * buf = nullptr;
+};
@@ -0,0 +1,262 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uloopstat.h"
+#include "uservice.h"
+#include "uthreads.h"
+
+ULoopStat loopStat;
+
+const float ULoopProbe::histLimit[HIST] = {0.01, 0.03, 0.1, 0.3, 1, 3, 10, 1e9};
+
+
+void ULoopProbe::begin(float late)
+{
+  if (tid.load(std::memory_order_relaxed) == 0)
+    tid = gettid();
+  UTime t("now");
+  if (started)
+  {
+    float period = t - tBegin;
+    stat.periodSum += period;
+    if (period > stat.periodMax)
+      stat.periodMax = period;
+  }
+  started = true;
+  tBegin = t;
+  if (late >= 0)
+  {
+    stat.lateSum += late;
+    if (late > stat.lateMax)
+      stat.lateMax = late;
+    stat.lateCnt++;
+    if (nominal > 0 and late > nominal)
+      // a full period too late
+      stat.deadlineMiss++;
+  }
+}
+
+void ULoopProbe::end()
+{
+  float exec = tBegin.getTimePassed();
+  stat.execSum += exec;
+  if (exec > stat.execMax)
+    stat.execMax = exec;
+  int i = 0;
+  while (i < HIST - 1 and exec * 1000 > histLimit[i])
+    i++;
+  stat.hist[i]++;
+  stat.cnt++;
+  published.write(stat);
+}
+
+void ULoopProbe::missed(int n)
+{ // published at the end of the iteration
+  if (n > 0)
+    stat.missedCnt += n;
+}
+
+
+void ULoopStat::setup()
+{ // ensure default values
+  if (not ini.has("loopstat"))
+  { // no data yet, so generate some default values
+    ini["loopstat"]["interval"] = "10"; // seconds between log lines
+    ini["loopstat"]["log"] = "true";
+  }
+  interval = strtof(ini["loopstat"]["interval"].c_str(), nullptr);
+  if (ini["loopstat"]["log"] == "true")
+  { // open logfile
+    std::string fn = service.logPath + "log_loopstat.txt";
+    logfile = service.openLog(fn);
+    fprintf(logfile, "%% Thread loop timing, totals since start (%s)\n", fn.c_str());
+    fprintf(logfile, "%% 1 \tTime (sec)\n");
+    fprintf(logfile, "%% 2 \tLoop (thread) name\n");
+    fprintf(logfile, "%% 3 \tIterations\n");
+    fprintf(logfile, "%% 4,5 \tPeriod average and max (ms)\n");
+    fprintf(logfile, "%% 6,7 \tExecution time average and max (ms)\n");
+    fprintf(logfile, "%% 8,9 \tWake-up lateness average and max (ms), fixed period loops only\n");
+    fprintf(logfile, "%% 10 \tDeadline misses (woke more than a period late)\n");
+    fprintf(logfile, "%% 11 \tInput samples missed (coalesced)\n");
+    fprintf(logfile, "%% 12,13 \tThread CPU time user and system (sec)\n");
+    fprintf(logfile, "%% 14-21 \tExecution time histogram, count up to");
+    for (int i = 0; i < ULoopProbe::HIST - 1; i++)
+      fprintf(logfile, " %g", ULoopProbe::histLimit[i]);
+    fprintf(logfile, " ms and above\n");
+  }
+  if (logfile != nullptr and interval > 0)
+    th1 = threads.spawn("loopstat", runObj, this);
+}
+
+void ULoopStat::terminate()
+{
+  if (th1 != nullptr)
+  {
+    th1->join();
+    th1 = nullptr;
+  }
+  // threads that are still running (if no log thread)
+  updateCpuTime();
+  if (logfile != nullptr)
+  { // final values
+    statLines(logfile, "");
+    fclose(logfile);
+    logfile = nullptr;
+  }
+  if (probeCnt > 0)
+  {
+    printf("# ULoopStat::   loop          cnt  per-avg  per-max  exe-avg  exe-max late-avg late-max  dl-miss skipped  cpu-usr cpu-sys  exec (ms)");
+    for (int i = 0; i < ULoopProbe::HIST - 1; i++)
+      printf(" %g", ULoopProbe::histLimit[i]);
+    printf(" >\n");
+    statLines(stdout, "# ULoopStat::   ");
+  }
+}
+
+void ULoopStat::run()
+{
+  UTime t("now");
+  while (not service.stop)
+  {
+    if (t.getTimePassed() >= interval)
+    {
+      t.now();
+      updateCpuTime();
+      statLines(logfile, "");
+    }
+    usleep(100000);
+  }
+  // the other threads are stopping too, so get CPU time now
+  updateCpuTime();
+}
+
+void ULoopStat::updateCpuTime()
+{
+  int n;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    n = probeCnt;
+  }
+  for (int i = 0; i < n; i++)
+  {
+    ULoopProbe & p = probes[i];
+    float user, sys;
+    if (p.tid > 0 and cpuTime(p.tid, user, sys))
+    {
+      p.cpuUser = user;
+      p.cpuSys = sys;
+    }
+  }
+}
+
+ULoopProbe * ULoopStat::probe(const char * name, float nominal)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  for (int i = 0; i < probeCnt; i++)
+  {
+    if (strcmp(probes[i].name, name) == 0)
+      return &probes[i];
+  }
+  if (probeCnt >= MAX_PROBES)
+  {
+    printf("# ULoopStat::probe: ### no space for loop '%s' (max %d), it is not timed\n", name, MAX_PROBES);
+    // a probe of its own (one writer), that is not reported (and not deleted)
+    return new ULoopProbe();
+  }
+  ULoopProbe * p = &probes[probeCnt];
+  snprintf(p->name, sizeof(p->name), "%s", name);
+  p->nominal = nominal;
+  probeCnt++;
+  return p;
+}
+
+bool ULoopStat::cpuTime(pid_t tid, float & user, float & sys)
+{
+  const int MSL = 600;
+  char s[MSL];
+  snprintf(s, MSL, "/proc/self/task/%d/stat", tid);
+  FILE * f = fopen(s, "r");
+  if (f == nullptr)
+    return false;
+  bool isOK = fgets(s, MSL, f) != nullptr;
+  fclose(f);
+  // the name (field 2) may hold spaces, so start after the ')'
+  const char * p1 = isOK ? strrchr(s, ')') : nullptr;
+  if (p1 == nullptr)
+    return false;
+  // field 3 is state, utime and stime are field 14 and 15
+  unsigned long ut = 0, st = 0;
+  int n = sscanf(p1 + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &ut, &st);
+  if (n != 2)
+    return false;
+  float tick = sysconf(_SC_CLK_TCK);
+  user = ut / tick;
+  sys = st / tick;
+  return true;
+}
+
+void ULoopStat::statLines(FILE * f, const char * pre)
+{
+  if (f == nullptr)
+    return;
+  UTime t("now");
+  int n;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    n = probeCnt;
+  }
+  for (int i = 0; i < n; i++)
+  {
+    ULoopProbe & p = probes[i];
+    ULoopProbe::Stat st = p.read();
+    int cnt = st.cnt;
+    float perAvg = st.cnt > 1 ? st.periodSum / (st.cnt - 1) : 0;
+    float perMax = st.periodMax;
+    float exeAvg = st.cnt > 0 ? st.execSum / st.cnt : 0;
+    float exeMax = st.execMax;
+    float lateAvg = st.lateCnt > 0 ? st.lateSum / st.lateCnt : 0;
+    float lateMax = st.lateMax;
+    int dlMiss = st.deadlineMiss;
+    int missed = st.missedCnt;
+    const int * hist = st.hist;
+    float user = p.cpuUser;
+    float sys = p.cpuSys;
+    if (cnt == 0)
+      // not used (e.g. no GPIO)
+      continue;
+    if (strlen(pre) == 0)
+      fprintf(f, "%lu.%04ld ", t.getSec(), t.getMicrosec()/100);
+    else
+      fprintf(f, "%s", pre);
+    fprintf(f, "%-12s %6d %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f %8d %7d %8.2f %7.2f ",
+            p.name, cnt, perAvg * 1000, perMax * 1000, exeAvg * 1000, exeMax * 1000,
+            lateAvg * 1000, lateMax * 1000, dlMiss, missed, user, sys);
+    for (int j = 0; j < ULoopProbe::HIST; j++)
+      fprintf(f, " %d", hist[j]);
+    fprintf(f, "\n");
+  }
+}
@@ -0,0 +1,153 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <sys/types.h>
+
+#include "utime.h"
+#include "useqlock.h"
+
+/**
+ * Timing of one thread loop:
+ * period between iterations, execution time (with histogram),
+ * wake-up lateness and deadline misses (for fixed-period loops),
+ * and input samples that were missed (coalesced) by the loop.
+ * Updated by the loop thread only, without a lock,
+ * and published at the end of each iteration,
+ * so that the statistics thread can read a consistent copy.
+ * */
+class ULoopProbe
+{
+public:
+  /**
+   * Start of an iteration (after wake-up)
+   * \param late is how late (sec) the wake-up is compared to the planned time,
+   *        negative if not a fixed-period loop */
+  void begin(float late = -1);
+  /**
+   * End of an iteration */
+  void end();
+  /**
+   * Input samples that were not used, as newer arrived first */
+  void missed(int n);
+
+public:
+  static const int HIST = 8;
+  /// upper limit of execution time histogram bins (ms)
+  static const float histLimit[HIST];
+  /// totals since start
+  struct Stat
+  {
+    int cnt = 0;
+    double periodSum = 0;
+    float periodMax = 0;
+    double execSum = 0;
+    float execMax = 0;
+    int hist[HIST] = {0};
+    int lateCnt = 0;
+    double lateSum = 0;
+    float lateMax = 0;
+    int deadlineMiss = 0;
+    int missedCnt = 0;
+  };
+  /**
+   * Get the totals as of the end of the last iteration (any thread) */
+  inline Stat read() const
+  {
+    return published.read();
+  }
+  char name[16] = "";
+  /// nominal period (sec), 0 is event driven
+  float nominal = 0;
+  /// thread ID, for CPU time
+  std::atomic<pid_t> tid{0};
+  /// thread CPU time (sec), last value read while the thread was running
+  /// (used by the statistics thread only)
+  float cpuUser = 0;
+  float cpuSys = 0;
+
+private:
+  /// totals, updated by the loop thread
+  Stat stat;
+  /// copy for the statistics thread
+  USeqLock<Stat> published;
+  UTime tBegin;
+  bool started = false;
+};
+
+/**
+ * Loop timing for all worker threads.
+ * A summary is printed at terminate, and
+ * saved to log_loopstat.txt every 'interval' seconds.
+ * The thread CPU time is read from /proc/self/task/.
+ * */
+class ULoopStat
+{
+public:
+  /** setup and start thread (for periodic log) */
+  void setup();
+  /**
+   * thread saving statistics to log */
+  void run();
+  /**
+   * print summary and terminate */
+  void terminate();
+  /**
+   * Get the probe for a loop, created if new.
+   * \param name is the loop (thread) name
+   * \param nominal is the nominal period (sec), 0 if event driven
+   * \returns the probe (never nullptr, if there is no space for more,
+   *          then an error is printed and the loop is not timed) */
+  ULoopProbe * probe(const char * name, float nominal = 0);
+
+private:
+  /**
+   * get CPU time (sec) used by a thread so far
+   * \returns false if not available */
+  bool cpuTime(pid_t tid, float & user, float & sys);
+  /** read CPU time of all running loop threads */
+  void updateCpuTime();
+  /** one line per loop (that has run), to log or console */
+  void statLines(FILE * f, const char * pre);
+  static const int MAX_PROBES = 32;
+  ULoopProbe probes[MAX_PROBES];
+  int probeCnt = 0;
+  std::mutex lock;
+  /// time between saving to log (sec)
+  float interval = 10;
+  FILE * logfile = nullptr;
+  std::thread * th1 = nullptr;
+  static void runObj(ULoopStat * obj)
+  { // called, when thread is started
+    // transfer to the class run() function.
+    obj->run();
+  }
+};
+
+/**
+ * Make this visible to the rest of the software */
+extern ULoopStat loopStat;
@@ -0,0 +1,250 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <algorithm>
+
+#include "umaplog.h"
+#include "uservice.h"
+#include "uthreads.h"
+
+UMapLog mapLog;
+
+namespace
+{
+  /// prefault this far ahead of the writer
+  const size_t PREFAULT_AHEAD = 256 * 1024;
+
+  ssize_t cookieWrite(void * cookie, const char * buf, size_t size)
+  {
+    return ((UMapFile *)cookie)->write(buf, size);
+  }
+
+  int cookieClose(void * cookie)
+  {
+    UMapFile * f = (UMapFile *)cookie;
+    mapLog.closed(f);
+    f->close();
+    delete f;
+    return 0;
+  }
+}
+
+
+bool UMapFile::open(const std::string & filename, size_t allocStep, size_t maxSize)
+{
+  size_t page = sysconf(_SC_PAGESIZE);
+  name = filename;
+  step = (allocStep + page - 1) & ~(page - 1);
+  mapSize = (maxSize + page - 1) & ~(page - 1);
+  if (mapSize < step)
+    mapSize = step;
+  fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return false;
+  // the whole range is reserved now, so the mapping never moves
+  void * p = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED)
+  {
+    ::close(fd);
+    fd = -1;
+    return false;
+  }
+  base = (char *)p;
+  if (not grow(step))
+  {
+    munmap(base, mapSize);
+    ::close(fd);
+    fd = -1;
+    return false;
+  }
+  advance();
+  return true;
+}
+
+bool UMapFile::grow(size_t size)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  size_t a = allocated;
+  while (a < size)
+  { // fallocate, or posix_fallocate where not supported by the file system
+    if (fallocate(fd, 0, a, step) != 0 and posix_fallocate(fd, a, step) != 0)
+      return false;
+    a += step;
+  }
+  allocated.store(a, std::memory_order_release);
+  return true;
+}
+
+ssize_t UMapFile::write(const char * buf, size_t n)
+{
+  size_t at = len.load(std::memory_order_relaxed);
+  size_t end = at + n;
+  if (finished)
+  { // after terminate, a normal file
+    if (pwrite(fd, buf, n, at) != (ssize_t)n)
+      return -1;
+  }
+  else
+  {
+    if (end > allocated.load(std::memory_order_acquire) and not grow(end + step))
+      return -1;
+    if (end <= mapSize)
+      memcpy(base + at, buf, n);
+    else if (pwrite(fd, buf, n, at) != (ssize_t)n)
+      // beyond the mapped range
+      return -1;
+  }
+  len.store(end, std::memory_order_release);
+  return n;
+}
+
+void UMapFile::advance()
+{
+  if (finished)
+    return;
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t l = len.load(std::memory_order_acquire);
+  // allocate ahead, so that the writer need not
+  if (allocated - l < step / 2)
+    grow(allocated + step);
+  size_t a = std::min(allocated.load(), mapSize);
+  // start writeback of the written pages
+  size_t w = std::min(l, mapSize);
+  if (w > synced)
+  {
+    size_t from = synced & ~(page - 1);
+    msync(base + from, w - from, MS_ASYNC);
+    synced = w;
+  }
+  // prefault the next pages, so that the writer gets no page faults
+  size_t ahead = std::min((w + PREFAULT_AHEAD) & ~(page - 1), a);
+  size_t from = std::max(prefaulted, w & ~(page - 1));
+  if (ahead > from)
+  {
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(base + from, ahead - from, MADV_POPULATE_WRITE) != 0)
+#endif
+      madvise(base + from, ahead - from, MADV_WILLNEED);
+    prefaulted = ahead;
+  }
+}
+
+void UMapFile::finish()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  if (finished)
+    return;
+  finished = true;
+  munmap(base, mapSize);
+  base = nullptr;
+  if (ftruncate(fd, len) != 0)
+    printf("# UMapFile::finish: failed to truncate %s\n", name.c_str());
+}
+
+void UMapFile::close()
+{
+  finish();
+  ::close(fd);
+  fd = -1;
+}
+
+
+void UMapLog::setup()
+{ // ensure default values
+  if (not ini["service"].has("log_backend"))
+  { // logfile settings
+    ini["service"]["log_backend"] = "stdio"; // or 'mmap' for preallocated, memory mapped logfiles
+    ini["service"]["log_map_mb"] = "4"; // mmap: allocation step
+    ini["service"]["log_map_max_mb"] = "256"; // mmap: mapped size (written with pwrite after this)
+  }
+  enabled = ini["service"]["log_backend"] == "mmap";
+  step = strtol(ini["service"]["log_map_mb"].c_str(), nullptr, 10) * 1024 * 1024;
+  maxSize = strtol(ini["service"]["log_map_max_mb"].c_str(), nullptr, 10) * 1024 * 1024;
+  if (step < 64 * 1024)
+    step = 64 * 1024;
+}
+
+void UMapLog::start()
+{
+  if (enabled)
+    th1 = threads.spawn("logsync", runObj, this);
+}
+
+void UMapLog::run()
+{
+  while (not service.stop)
+  {
+    lock.lock();
+    for (auto * f : files)
+      f->advance();
+    lock.unlock();
+    usleep(100000);
+  }
+}
+
+void UMapLog::terminate()
+{
+  if (th1 != nullptr)
+  {
+    th1->join();
+    th1 = nullptr;
+  }
+  std::lock_guard<std::mutex> guard(lock);
+  // files not closed by the modules
+  for (auto * f : files)
+    f->finish();
+}
+
+FILE * UMapLog::open(const std::string & filename)
+{
+  UMapFile * m = new UMapFile();
+  if (not m->open(filename, step, maxSize))
+  {
+    printf("# UMapLog::open: failed to map %s, using stdio\n", filename.c_str());
+    delete m;
+    return fopen(filename.c_str(), "w");
+  }
+  cookie_io_functions_t io = {nullptr, cookieWrite, nullptr, cookieClose};
+  FILE * f = fopencookie(m, "w", io);
+  if (f == nullptr)
+  {
+    m->close();
+    delete m;
+    return fopen(filename.c_str(), "w");
+  }
+  std::lock_guard<std::mutex> guard(lock);
+  files.push_back(m);
+  return f;
+}
+
+void UMapLog::closed(UMapFile * f)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  auto it = std::find(files.begin(), files.end(), f);
+  if (it != files.end())
+    files.erase(it);
+}
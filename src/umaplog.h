@@ -0,0 +1,125 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A logfile written through a memory mapping.
+ * The file is allocated (fallocate) in steps ahead of the writer,
+ * and a large address range is mapped at open, so the mapping never moves.
+ * A write is a memcpy into the mapping (no system call),
+ * unless the writer is ahead of the allocation.
+ * Used as a stdio FILE (fopencookie), so stdio serializes the writes.
+ * */
+class UMapFile
+{
+public:
+  /**
+   * Open, allocate and map the file
+   * \returns false if the file can not be created or mapped */
+  bool open(const std::string & filename, size_t step, size_t maxSize);
+  /** append data (stdio cookie write) */
+  ssize_t write(const char * buf, size_t n);
+  /** truncate to the used length, unmap and close */
+  void close();
+  /**
+   * Truncate to the used length and unmap,
+   * later writes (if any) are appended with pwrite */
+  void finish();
+  /**
+   * Background work, allocate ahead,
+   * start writeback of written pages and prefault the next pages */
+  void advance();
+  /** file name */
+  std::string name;
+  /// bytes written
+  std::atomic<size_t> len{0};
+
+private:
+  /** extend the file allocation to at least this size */
+  bool grow(size_t size);
+  int fd = -1;
+  char * base = nullptr;
+  /// size of the mapped address range (max size written by memcpy)
+  size_t mapSize = 0;
+  /// file size allocated
+  std::atomic<size_t> allocated{0};
+  /// allocation step
+  size_t step = 0;
+  /// written pages up to here are handed to writeback
+  size_t synced = 0;
+  /// pages are prefaulted up to here
+  size_t prefaulted = 0;
+  bool finished = false;
+  std::mutex lock;
+};
+
+/**
+ * Memory mapped logfiles (log_backend = mmap in [service]).
+ * Opens logfiles as UMapFile, and a thread
+ * advances the allocation, writeback and prefault for all open files.
+ * */
+class UMapLog
+{
+public:
+  /** get settings, before any logfile is opened */
+  void setup();
+  /** start the thread (when thread settings are available) */
+  void start();
+  /** background thread */
+  void run();
+  /** truncate the files that are still open, and stop */
+  void terminate();
+  /**
+   * Open a memory mapped logfile
+   * \returns a stdio file handle, or nullptr if failed */
+  FILE * open(const std::string & filename);
+  /** a file is closed (by fclose) */
+  void closed(UMapFile * f);
+  /// logfiles are memory mapped (else stdio)
+  bool enabled = false;
+  /// allocation step and mapped size for each file (bytes)
+  size_t step = 4 * 1024 * 1024;
+  size_t maxSize = 256 * 1024 * 1024;
+
+private:
+  std::vector<UMapFile *> files;
+  std::mutex lock;
+  std::thread * th1 = nullptr;
+  static void runObj(UMapLog * obj)
+  { // called, when thread is started
+    // transfer to the class run() function.
+    obj->run();
+  }
+};
+
+/**
+ * Make this visible to the rest of the software */
+extern UMapLog mapLog;
@@ -163,11 +163,16 @@ void UPID::resetHistory()
 }
 
 
+FILE * UPID::openLog(const std::string & filename)
+{
+  return logRow.open(filename, "%lu.%04ld %.3f %.3f %.3f %.3f %.3f %.3f %d\n");
+}
+
 void UPID::saveToLog(FILE* logfile, UTime t)
 {// log_pose
   if (logfile != nullptr)
   {
-    fprintf(logfile, "%lu.%04ld %.3f %.3f %.3f %.3f %.3f %.3f %d\n",
+    logRow.add(logfile,
             t.getSec(), t.getMicrosec()/100,
             r, m,
             ep1,
@@ -177,7 +182,7 @@ void UPID::saveToLog(FILE* logfile, UTime t)
             limited
     );
   }
-  if (toConsole)
+  if (printCh != nullptr and printCh->active())
   {
     printf("%lu.%04ld %.3f %.3f %.3f %.3f %.3f %.3f %d\n",
             t.getSec(), t.getMicrosec()/100,
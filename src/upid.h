@@ -24,7 +24,10 @@
 #ifndef UPID_H
 #define UPID_H
 
+#include <string>
+
 #include "utime.h"
+#include "ulogger.h"
 
 using namespace std;
 // forward declaration
@@ -53,9 +56,14 @@ public:
   /**
    * save PID parameters to this logfile */
   void logPIDparams(FILE * logfile, bool andColumns);
+  /**
+   * Open a logfile for the control values (saveToLog)
+   * \param filename is the full logfile name
+   * \returns the file handle, for header and comments */
+  FILE * openLog(const std::string & filename);
   /**
    * Sage the current control values to this logfile
-   * \param logfile is a valid file handle
+   * \param logfile is a valid file handle (or nullptr if log channel is off)
    * \param t is the time where the values are valid
    * */
   void saveToLog(FILE * logfile, UTime t);
@@ -81,13 +89,15 @@ protected:
 public:
   // is output limited, this may be valuable for other controllers.
   bool limited = false;
-  // should be printed on console during run (debug feature)
-  bool toConsole = false;
+  // print channel for the control values (debug feature), set by owner
+  ULogChannel * printCh = nullptr;
 
 protected:
   /// more private internal values
   float r = 0, m = 0;
   float sampleTime;
+  /// row format for saveToLog
+  ULogStream logRow;
   /// old values for PID
   float ep1 = 0, up1 = 0, ui1 = 0;
   /// pre-calculated lead values
@@ -0,0 +1,101 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <atomic>
+#include <type_traits>
+#include <string.h>
+#include <stdint.h>
+
+/**
+ * Sequence lock for a small data structure with one writer thread
+ * and any number of reader threads.
+ * The writer is never blocked, a reader retries its copy
+ * if the writer changed the data while it was copied.
+ * The data is copied as atomic 64-bit words, so the type
+ * must be trivially copyable (no pointers to owned data).
+ * */
+template <class T>
+class USeqLock
+{
+  static_assert(std::is_trivially_copyable<T>::value,
+                "USeqLock data must be trivially copyable");
+public:
+  USeqLock()
+  {
+    write(T());
+    seq.store(0);
+  }
+  /**
+   * Save a new value (from the writer thread only) */
+  void write(const T & value)
+  {
+    uint64_t buf[WORDS] = {0};
+    memcpy(buf, &value, sizeof(T));
+    uint64_t s = seq.load(std::memory_order_relaxed);
+    // odd while writing
+    seq.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (int i = 0; i < WORDS; i++)
+      data[i].store(buf[i], std::memory_order_relaxed);
+    seq.store(s + 2, std::memory_order_release);
+  }
+  /**
+   * Get a consistent copy of the latest value.
+   * \param version if not nullptr, then set to the number of writes
+   *        that this value is the result of. */
+  T read(uint64_t * version = nullptr) const
+  {
+    uint64_t buf[WORDS];
+    uint64_t s1, s2;
+    do
+    {
+      s1 = seq.load(std::memory_order_acquire);
+      while (s1 & 1)
+      { // writer is busy (a few ns)
+        s1 = seq.load(std::memory_order_acquire);
+      }
+      for (int i = 0; i < WORDS; i++)
+        buf[i] = data[i].load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      s2 = seq.load(std::memory_order_relaxed);
+    } while (s1 != s2);
+    if (version != nullptr)
+      *version = s1 / 2;
+    T value;
+    memcpy(&value, buf, sizeof(T));
+    return value;
+  }
+  /**
+   * Number of completed writes */
+  uint64_t getSeq() const
+  {
+    return seq.load(std::memory_order_acquire) / 2;
+  }
+
+private:
+  static const int WORDS = (sizeof(T) + 7) / 8;
+  std::atomic<uint64_t> seq{0};
+  std::atomic<uint64_t> data[WORDS];
+};
@@ -46,6 +46,14 @@
 #include "spyvision.h"
 #include "sstate.h"
 #include "steensy.h"
+#include "ubench.h"
+#include "usubscribe.h"
+#include "cpipeline.h"
+#include "uthreads.h"
+#include "uloopstat.h"
+#include "ulogger.h"
+#include "umaplog.h"
+#include "uclock.h"
 #include "uservice.h"
 
 #define REV "$Id: uservice.cpp 583 2024-01-22 12:02:05Z jcan $"
@@ -56,6 +64,14 @@ mINI::INIStructure ini;
 
 void signal_callback_handler(int signum)
 { // called when pressing ctrl-C
+  if (signum == SIGSEGV or signum == SIGBUS or signum == SIGFPE or
+      signum == SIGILL or signum == SIGABRT)
+  { // fatal error, just save the flight recorder, then die as intended
+    logger.dumpFatal();
+    signal(signum, SIG_DFL);
+    raise(signum);
+    return;
+  }
   cout << "Caught signal " << signum << endl;
   service.terminate();
   exit(signum);
@@ -69,6 +85,12 @@ bool UService::setup(int argc,char **argv)
   signal(SIGHUP, signal_callback_handler); // 1
   signal(SIGPWR, signal_callback_handler); // 30
   signal(SIGTERM, signal_callback_handler); // 15 (pkill default)
+  // fatal errors (flight recorder is saved)
+  signal(SIGSEGV, signal_callback_handler); // 11
+  signal(SIGBUS, signal_callback_handler); // 7
+  signal(SIGFPE, signal_callback_handler); // 8
+  signal(SIGILL, signal_callback_handler); // 4
+  signal(SIGABRT, signal_callback_handler); // 6
   //
   bool teensyConnect = true;
   CLI::App cli{"ROBOBOT app"};
@@ -102,6 +124,14 @@ bool UService::setup(int argc,char **argv)
   // print 4x4_100 ArUco code
   int arucoID = -1;
   cli.add_option("-a,--aruco", arucoID, "Save an image with an ArUco number [0..249]");
+  // benchmarks
+  bool runBench = false;
+  cli.add_flag("--bench", runBench, "Run message decode benchmarks (no robot needed)");
+  std::string benchCorpus;
+  cli.add_option("--bench-file", benchCorpus, "Run benchmarks using Rx messages from this log_teensy_io.txt");
+  // replay a recorded session
+  cli.add_option("--replay", teensy1.replayFile, "Replay received messages from this log_all.bin (no robot needed)");
+  cli.add_option("--replay-speed", teensy1.replaySpeed, "Replay speed, 1 is real time, 0 is as fast as possible on a virtual clock (default 5)");
   // Parse for command line options
   cli.allow_windows_style_options();
   theEnd = true;
@@ -144,12 +174,23 @@ bool UService::setup(int argc,char **argv)
     ini["service"]["; The '%d' will be replaced with date and timestamp (Must end with a '/')."] = "";
   }
   teensyConnect = not (camImg or camCal or ini["service"]["use_robot_hardware"] == "false");
+  if (not teensy1.replayFile.empty())
+    // the recorded session replaces the Teensy
+    teensyConnect = true;
   //
   if (arucoID >= 0)
   { // just save an image with an ArUco code
     aruco.saveCodeImage(arucoID);
     theEnd = true;
   }
+  if (runBench or not benchCorpus.empty())
+  { // just run benchmarks
+    if (benchCorpus.empty())
+      bench.run();
+    else
+      bench.run(benchCorpus.c_str());
+    theEnd = true;
+  }
   // for setup timing
   UTime t("now");
   if (not theEnd)
@@ -170,6 +211,19 @@ bool UService::setup(int argc,char **argv)
     { // failed (probably: path exist already)
       std::perror("#*** UService:: Failed to create log path:");
     }
+    // logfile backend, before any logfile is opened
+    mapLog.setup();
+    // thread settings, before any thread is started
+    threads.setup();
+    mapLog.start();
+    // binary logger, before any logfile is opened
+    logger.setup();
+    // loop timing of all threads
+    loopStat.setup();
+    // stream subscriptions are requested by the modules
+    subscribe.setup();
+    // control pipeline settings (used by the control modules)
+    pipeline.setup();
     if (teensyConnect)
     { // open the main data source
       printf("# UService::setup: open to Teensy\n");
@@ -179,9 +233,9 @@ bool UService::setup(int argc,char **argv)
       // wait for base setup to finish
       if (teensy1.teensyConnectionOpen)
       { // wait for initial setup
-        usleep(10000);
+        clockService.sleepUs(1000);
         while (teensy1.getTeensyCommQueueSize() > 0 and t.getTimePassed() < 5.0)
-          usleep(10000);
+          clockService.sleepUs(1000);
         if (t.getTimePassed() >= 5.0)
           printf("# UService::setup - waited %g sec for initial Teensy setup\n", t.getTimePassed());
       }
@@ -207,8 +261,10 @@ bool UService::setup(int argc,char **argv)
     joyLogi.setup();
     cam.setup();
     aruco.setup();
+    // one thread for the control chain (if enabled)
+    pipeline.start();
     setupComplete = true;
-    usleep(2000);
+    clockService.sleepUs(2000);
     //
   }
   if (not theEnd and setupComplete)
@@ -227,7 +283,7 @@ bool UService::setup(int argc,char **argv)
     if (teensy1.teensyConnectionOpen)
     {
       while (teensy1.getTeensyCommQueueSize() > 0 and t.getTimePassed() < 5.0)
-        usleep(10000);
+        clockService.sleepUs(1000);
       printf("# UService::setup - waited %g sec for full setup\n", t.getTimePassed());
       // decide if all setup is OK
       int retry = 0;
@@ -242,6 +298,10 @@ bool UService::setup(int argc,char **argv)
       }
       else
         printf("# UService:: setup of all modules finished OK.\n");
+      float rtt, rttVar, rto;
+      int n = teensy1.getTeensyCommRtt(rtt, rttVar, rto);
+      printf("# UService:: Teensy confirm round trip %.2f ms (var %.2f ms, %d samples), retransmit timeout %.1f ms\n",
+             rtt * 1000, rttVar * 1000, n, rto * 1000);
       theEnd = dumped > 0 or teensy1.getTeensyCommQueueSize() > 0;
     }
     else
@@ -252,8 +312,8 @@ bool UService::setup(int argc,char **argv)
   }
   if (not theEnd)
   { // start listen to the keyboard
-    th1 = new std::thread(runObj, this);
-    th2 = new std::thread(runObj2, this);
+    th1 = threads.spawn("service_key", runObj, this);
+    th2 = threads.spawn("service_stop", runObj2, this);
   }
   // wait for optional tasks that require system to run.
   if ((calibBlack or
@@ -272,33 +332,17 @@ bool UService::setup(int argc,char **argv)
       imu.inCalibration or t.getTimePassed() < testSec)
     {
       printf("# Service is waiting for a specified action to finish\n");
-      sleep(1);
+      clockService.sleepUs(1000000);
     }
     theEnd = true;
   }
   return theEnd;
 }
 
-bool UService::decode(const char* msg, UTime& msgTime)
-{ // decode messages from Teensy
-  bool used = true;
-  if      (state.decode(msg, msgTime)) {}
-  else if (encoder.decode(msg, msgTime)) {}
-  else if (imu.decode(msg, msgTime)) {}
-  else if (servo.decode(msg, msgTime)) {}
-  else if (sedge.decode(msg, msgTime)) {}
-  else if (dist.decode(msg, msgTime)) {}
-  //
-  // add other Teensy data users here
-  //
-  else
-    used = false;
-  return used;
-}
-
 void UService::stopNow(const char * who)
 { // request a terminate and exit
   printf("# UService:: %s say stop now\n", who);
+  stopReason = who;
   stopNowRequest = true;
 }
 
@@ -309,10 +353,14 @@ void UService::terminate()
     return;
   printf("# --------- terminating -----------\n");
   terminating = true;
+  // save the flight recorder, before anything is stopped
+  logger.dump(stopReason.c_str());
   stop = true; // stop all threads, when finished current activity
   //
   usleep(100000);
   joyLogi.terminate();
+  // before the modules it uses
+  pipeline.terminate();
   encoder.terminate();
   pose.terminate();
   imu.terminate();
@@ -326,11 +374,19 @@ void UService::terminate()
   state.terminate();
   servo.terminate();
   dist.terminate();
+  subscribe.terminate();
+  // summary when all loops are stopped
+  loopStat.terminate();
+  threads.terminate();
   // terminate sensors before Teensy
   teensy1.terminate();
   pyvision.terminate();
   cam.terminate();
   aruco.terminate();
+  // save the remaining log records, when all logfiles are closed
+  logger.terminate();
+  // truncate memory mapped logfiles to their length
+  mapLog.terminate();
   // service must be the last to close
   if (not ini.has("ini"))
   {
@@ -346,6 +402,16 @@ void UService::terminate()
   }
 }
 
+FILE * UService::openLog(const std::string & filename)
+{
+  if (logger.recorder)
+    // no disk I/O while running, saved when closed
+    return logger.openMemory(filename);
+  if (mapLog.enabled)
+    return mapLog.open(filename);
+  return fopen(filename.c_str(), "w");
+}
+
 std::string UService::getVersionString()
 {
   // #define REV "$Id: uservice.cpp 583 2024-01-22 12:02:05Z jcan $"
@@ -363,9 +429,18 @@ void UService::run()
   {
     if (not asDaemon)
     {
-      cin >> keyString;
+      // a line, as the 'log' command has parameters
+      if (not std::getline(cin, keyString))
+      { // no (more) keyboard input
+        usleep(100000);
+        continue;
+      }
       if (keyString == "stop")
         signal_callback_handler(-1);
+      else if (keyString == "dump")
+        logger.dump("key");
+      else if (logChannels.command(keyString))
+        ; // log channel changed or listed
       else
         gotKeyInput = true;
     }
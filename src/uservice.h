@@ -36,10 +36,6 @@ public:
      * \returns true if app is to end now (error, help or calibration)
     */
     bool setup(int argc,char **argv);
-    /**
-     * decode messages from Teensy
-     * \param msg already CRC checked text line from teensy */
-    bool decode(const char * msg, UTime & msgTime);
     /**
      * decode command-line parameters */
     bool readCommandLineParameters(int argc, char ** argv);
@@ -61,6 +57,12 @@ public:
     /**
      * Return the SVN version string (version part) */
     std::string getVersionString();
+    /**
+     * Open a logfile for writing, using the
+     * log_backend from [service] (stdio or memory mapped).
+     * As flight recorder the file is kept in memory until closed.
+     * \returns file handle, nullptr if failed */
+    FILE * openLog(const std::string & filename);
 
 public:
     // file with calibration values etc.
@@ -70,7 +72,11 @@ public:
     // stop all processing
     bool stop = false;
     bool theEnd;
+    // all modules are set up
+    bool setupComplete = false;
     bool stopNowRequest = false;
+    // who stopped the service (flight recorder dump name)
+    std::string stopReason = "stop";
 //     bool start = false;
     // keyboard input
     bool gotKeyInput;
@@ -92,7 +98,6 @@ private:
     std::thread * th2;
     //
     bool terminating = false;
-    bool setupComplete = false;
 };
 
 extern UService service;
@@ -26,6 +26,8 @@
 #include <string.h>
 #include <sys/types.h>
 #include "usocket.h"
+#include "uthreads.h"
+#include "uclock.h"
 #include <stdio.h>
 
 
@@ -56,7 +58,7 @@ USocket::USocket(const char * host, const char * port)
     { // connection established
       connected = true;
       // start read thread
-      th1 = new std::thread(runObj, this);
+      th1 = threads.spawn("socket", runObj, this);
     }
   }
 }
@@ -134,8 +136,8 @@ void USocket::run()
       close(sockfd);
     }
     else
-    { // no data, wait a bit
-      usleep(900);
+    { // no data, wait a bit (real time, as the data is from the network)
+      clockService.sleepRealUs(900);
     }
   }
   if (connected)
@@ -153,7 +155,7 @@ std::string USocket::waitForReply(float timeoutMs)
   t.now();
   while (replyCnt == replyCntLast and t.getTimePassed() < timeoutMs/1000.0)
   { // wait a ms
-    usleep(1000);
+    clockService.sleepUs(1000);
   }
   if (replyCnt != replyCntLast)
   { // got a reply
@@ -0,0 +1,232 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "usubscribe.h"
+#include "uthreads.h"
+#include "uloopstat.h"
+#include "steensy.h"
+#include "uservice.h"
+#include "uclock.h"
+
+USubscribe subscribe;
+
+
+void USubscribe::setup()
+{ // ensure default values
+  if (not ini.has("subscribe"))
+  { // no data yet, so generate some default values
+    ini["subscribe"]["linger"] = "1.0";
+    ini["subscribe"]["log"] = "true";
+    ini["subscribe"]["print"] = "false";
+  }
+  linger = strtof(ini["subscribe"]["linger"].c_str(), nullptr);
+  toConsole = ini["subscribe"]["print"] == "true";
+  if (ini["subscribe"]["log"] == "true")
+  { // open logfile
+    std::string fn = service.logPath + "log_subscribe.txt";
+    logfile = service.openLog(fn);
+    fprintf(logfile, "%% Teensy stream subscriptions (%s)\n", fn.c_str());
+    fprintf(logfile, "%% 1 \tTime (sec)\n");
+    fprintf(logfile, "%% 2 \tStream keyword\n");
+    fprintf(logfile, "%% 3 \tSubscribed period (ms), 0 is unsubscribed\n");
+    fprintf(logfile, "%% 4 \tReason\n");
+  }
+  th1 = threads.spawn("subscribe", runObj, this);
+}
+
+void USubscribe::terminate()
+{
+  if (th1 != nullptr)
+  {
+    th1->join();
+    th1 = nullptr;
+  }
+  if (logfile != nullptr)
+  {
+    fclose(logfile);
+    logfile = nullptr;
+  }
+}
+
+void USubscribe::run()
+{ // timed requests may expire, and unused streams stopped
+  ULoopProbe * probe = loopStat.probe("subscribe");
+  while (not service.stop)
+  {
+    probe->begin();
+    lock.lock();
+    update();
+    lock.unlock();
+    probe->end();
+    clockService.sleepUs(50000);
+  }
+}
+
+bool USubscribe::request(const char* key, int periodMs, const char* consumer, float duration)
+{
+  bool isOK = true;
+  lock.lock();
+  Demand * d = nullptr;
+  for (int i = 0; i < demandCnt; i++)
+  {
+    if (strcmp(demands[i].key, key) == 0 and strcmp(demands[i].consumer, consumer) == 0)
+    {
+      d = &demands[i];
+      break;
+    }
+  }
+  if (d == nullptr and demandCnt < MAX_DEMANDS)
+  { // new request
+    d = &demands[demandCnt++];
+    snprintf(d->key, sizeof(d->key), "%s", key);
+    snprintf(d->consumer, sizeof(d->consumer), "%s", consumer);
+  }
+  if (d != nullptr)
+  {
+    d->periodMs = periodMs;
+    d->forever = duration <= 0;
+    if (not d->forever)
+    {
+      d->until.now();
+      d->until += duration;
+    }
+    update();
+  }
+  else
+  {
+    printf("# USubscribe::request: no space for request from %s for %s\n", consumer, key);
+    isOK = false;
+  }
+  lock.unlock();
+  return isOK;
+}
+
+void USubscribe::release(const char* key, const char* consumer)
+{
+  lock.lock();
+  for (int i = 0; i < demandCnt; i++)
+  {
+    if (strcmp(demands[i].key, key) == 0 and strcmp(demands[i].consumer, consumer) == 0)
+    { // move the last to this place
+      demands[i] = demands[--demandCnt];
+      break;
+    }
+  }
+  update();
+  lock.unlock();
+}
+
+int USubscribe::getPeriod(const char* key)
+{
+  int ms = 0;
+  lock.lock();
+  for (int i = 0; i < streamCnt; i++)
+  {
+    if (strcmp(streams[i].key, key) == 0)
+    {
+      ms = streams[i].periodMs;
+      break;
+    }
+  }
+  lock.unlock();
+  return ms;
+}
+
+void USubscribe::update()
+{ // remove timed out requests
+  for (int i = 0; i < demandCnt; i++)
+  {
+    if (not demands[i].forever and demands[i].until.getTimePassed() > 0)
+      demands[i--] = demands[--demandCnt];
+  }
+  // find the shortest period requested for each stream
+  for (int s = 0; s < streamCnt; s++)
+    streams[s].wantMs = 0;
+  for (int i = 0; i < demandCnt; i++)
+  {
+    Demand & d = demands[i];
+    Stream * st = nullptr;
+    for (int s = 0; s < streamCnt; s++)
+    {
+      if (strcmp(streams[s].key, d.key) == 0)
+      {
+        st = &streams[s];
+        break;
+      }
+    }
+    if (st == nullptr and streamCnt < MAX_STREAMS)
+    { // first request for this stream
+      st = &streams[streamCnt++];
+      memcpy(st->key, d.key, sizeof(st->key));
+      st->periodMs = 0;
+      st->wantMs = 0;
+    }
+    if (st != nullptr and (st->wantMs == 0 or d.periodMs < st->wantMs))
+      st->wantMs = d.periodMs;
+  }
+  // subscribe, retune or unsubscribe
+  const int MSL = 50;
+  char s[MSL];
+  for (int i = 0; i < streamCnt; i++)
+  {
+    Stream & st = streams[i];
+    if (st.wantMs > 0)
+    {
+      st.idle = false;
+      if (st.wantMs != st.periodMs)
+      {
+        toLog(st.key, st.wantMs, st.periodMs == 0 ? "subscribe" : "new period");
+        st.periodMs = st.wantMs;
+        snprintf(s, MSL, "sub %s %d\n", st.key, st.periodMs);
+        teensy1.send(s);
+      }
+    }
+    else if (st.periodMs > 0)
+    { // no consumer
+      if (not st.idle)
+      {
+        st.idle = true;
+        st.idleSince.now();
+      }
+      else if (st.idleSince.getTimePassed() > linger)
+      {
+        toLog(st.key, 0, "unused");
+        st.periodMs = 0;
+        snprintf(s, MSL, "sub %s 0\n", st.key);
+        teensy1.send(s);
+      }
+    }
+  }
+}
+
+void USubscribe::toLog(const char* key, int periodMs, const char* reason)
+{
+  UTime t("now");
+  if (logfile != nullptr)
+    fprintf(logfile, "%lu.%04ld %s %d %s\n", t.getSec(), t.getMicrosec()/100, key, periodMs, reason);
+  if (toConsole)
+    printf("%lu.%04ld %s %d %s\n", t.getSec(), t.getMicrosec()/100, key, periodMs, reason);
+}
@@ -0,0 +1,118 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <mutex>
+#include <thread>
+
+#include "utime.h"
+
+/**
+ * Subscription manager for Teensy data streams (enc, liv, ir ...).
+ * Consumers request a stream with the sample period they need,
+ * either until released or for a limited time.
+ * The stream is subscribed with the shortest period requested
+ * by any active consumer, and unsubscribed ('sub key 0')
+ * when there has been no active consumer for a while (linger time).
+ * */
+class USubscribe
+{
+public:
+  /** setup and start thread (for timed requests) */
+  void setup();
+  /**
+   * thread to remove timed out requests */
+  void run();
+  /**
+   * terminate */
+  void terminate();
+  /**
+   * Request a data stream from the Teensy.
+   * A new request from the same consumer for the same stream replaces the old.
+   * \param key is the stream keyword, e.g. "ir"
+   * \param periodMs is the sample period needed (ms)
+   * \param consumer is the name of the consumer, e.g. "mission"
+   * \param duration is the time (sec) the request is valid, 0 is until released
+   * \returns false if there is no space for more requests */
+  bool request(const char * key, int periodMs, const char * consumer, float duration = 0);
+  /**
+   * Release a request
+   * \param key is the stream keyword
+   * \param consumer is the name used in the request */
+  void release(const char * key, const char * consumer);
+  /**
+   * Get the subscribed period for a stream
+   * \param key is the stream keyword
+   * \returns period in ms, 0 if not subscribed */
+  int getPeriod(const char * key);
+
+private:
+  /// a request from a consumer
+  struct Demand
+  {
+    char key[9];
+    char consumer[24];
+    int periodMs = 0;
+    /// request is valid until this time, if not forever
+    UTime until;
+    bool forever = true;
+  };
+  static const int MAX_DEMANDS = 32;
+  Demand demands[MAX_DEMANDS];
+  int demandCnt = 0;
+  /// a stream and its subscribed period
+  struct Stream
+  {
+    char key[9];
+    int periodMs = 0;
+    /// shortest period requested (0 is not requested)
+    int wantMs = 0;
+    /// time when the last consumer left
+    UTime idleSince;
+    bool idle = false;
+  };
+  static const int MAX_STREAMS = 16;
+  Stream streams[MAX_STREAMS];
+  int streamCnt = 0;
+  /**
+   * Remove timed out requests, and (re)subscribe streams as needed.
+   * Called with lock. */
+  void update();
+  void toLog(const char * key, int periodMs, const char * reason);
+  /// time (sec) before an unused stream is unsubscribed (from ini-file)
+  float linger = 1.0;
+  FILE * logfile = nullptr;
+  bool toConsole = false;
+  std::mutex lock;
+  std::thread * th1 = nullptr;
+  static void runObj(USubscribe * obj)
+  { // called, when thread is started
+    // transfer to the class run() function.
+    obj->run();
+  }
+};
+
+/**
+ * Make this visible to the rest of the software */
+extern USubscribe subscribe;
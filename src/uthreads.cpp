@@ -0,0 +1,280 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <alloca.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "uthreads.h"
+#include "uservice.h"
+
+UThreads threads;
+
+namespace
+{
+  /// default settings, the thread keeps the settings of the process
+  /// (see the [threads] section in robot.ini for a profile for a 4-core Pi)
+  const char * defaults[] =
+  {
+    "main", "teensy_rx", "teensy_tx", "pose", "edge", "edge_ctrl",
+    "heading", "motor", "pipeline", "subscribe", "loopstat", "logger",
+    "logsync", "gpio", "joy", "socket", "cam", "pyvision",
+    "service_key", "service_stop",
+  };
+
+  const char * policyName(int policy)
+  {
+    switch (policy)
+    {
+      case SCHED_FIFO: return "fifo";
+      case SCHED_RR: return "rr";
+      case SCHED_OTHER: return "other";
+      default: return "?";
+    }
+  }
+}
+
+
+void UThreads::setup()
+{ // ensure default values
+  if (not ini["threads"].has("lock_memory"))
+  { // no data yet, so generate some default values
+    ini["threads"]["lock_memory"] = "false";
+    ini["threads"]["prefault_kb"] = "0";
+    ini["threads"]["log"] = "true";
+    ini["threads"]["print"] = "false";
+  }
+  for (auto & d : defaults)
+  {
+    if (not ini["threads"].has(d))
+      ini["threads"][d] = "inherit";
+  }
+  lockMemory = ini["threads"]["lock_memory"] == "true";
+  prefaultKb = strtol(ini["threads"]["prefault_kb"].c_str(), nullptr, 10);
+  toConsole = ini["threads"]["print"] == "true";
+  cpuCnt = sysconf(_SC_NPROCESSORS_CONF);
+  if (ini["threads"]["log"] == "true")
+  { // open logfile
+    std::string fn = service.logPath + "log_threads.txt";
+    logfile = service.openLog(fn);
+    fprintf(logfile, "%% Thread settings (%s), %d CPUs\n", fn.c_str(), cpuCnt);
+    fprintf(logfile, "%% 1 \tTime (sec)\n");
+    fprintf(logfile, "%% 2 \tThread name\n");
+    fprintf(logfile, "%% 3 \tThread ID (tid)\n");
+    fprintf(logfile, "%% 4-6 \tRequested policy, priority and CPU set\n");
+    fprintf(logfile, "%% 7-9 \tActual policy, priority and CPU set\n");
+    fprintf(logfile, "%% 10 \tResult\n");
+  }
+  // all thread settings, so that spawned threads need no ini access
+  configCnt = 0;
+  for (auto const & it : ini["threads"])
+  {
+    Config & c = configs[configCnt];
+    snprintf(c.name, sizeof(c.name), "%s", it.first.c_str());
+    if (parse(it.second.c_str(), c) and configCnt < MAX_CONFIGS - 1)
+      configCnt++;
+  }
+  if (lockMemory)
+  { // lock current and future pages in memory
+    const int MSL = 200;
+    char s[MSL];
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0)
+      snprintf(s, MSL, "memory locked (mlockall)");
+    else
+    {
+      snprintf(s, MSL, "memory lock (mlockall) failed: %s", strerror(errno));
+      printf("# UThreads:: %s\n", s);
+    }
+    toLog(s);
+  }
+  // the main thread (setup and mission)
+  apply("main");
+}
+
+void UThreads::terminate()
+{
+  if (logfile != nullptr)
+  {
+    fclose(logfile);
+    logfile = nullptr;
+  }
+}
+
+bool UThreads::parse(const char * value, Config & c)
+{
+  char policy[16] = "";
+  char cpus[32] = "all";
+  if (strcmp(value, "inherit") == 0)
+  { // as the creator (normally the process)
+    c.inherit = true;
+    return true;
+  }
+  c.inherit = false;
+  int n = sscanf(value, "%15s %d %31s", policy, &c.priority, cpus);
+  if (n < 2)
+    // not a thread setting (e.g. lock_memory)
+    return false;
+  if (strcmp(policy, "fifo") == 0)
+    c.policy = SCHED_FIFO;
+  else if (strcmp(policy, "rr") == 0)
+    c.policy = SCHED_RR;
+  else
+  { // normal scheduling has no priority
+    c.policy = SCHED_OTHER;
+    c.priority = 0;
+  }
+  snprintf(c.cpus, sizeof(c.cpus), "%s", cpus);
+  return true;
+}
+
+bool UThreads::cpuSet(const char * cpus, cpu_set_t & set)
+{
+  CPU_ZERO(&set);
+  if (strcmp(cpus, "all") == 0)
+  {
+    for (int i = 0; i < cpuCnt; i++)
+      CPU_SET(i, &set);
+    return true;
+  }
+  const char * p1 = cpus;
+  while (*p1 >= '0' and *p1 <= '9')
+  { // like 0,2-3
+    char * p2;
+    int a = strtol(p1, &p2, 10);
+    int b = a;
+    if (*p2 == '-')
+      b = strtol(p2 + 1, &p2, 10);
+    for (int i = a; i <= b; i++)
+    { // ignore CPUs that this computer does not have
+      if (i < cpuCnt)
+        CPU_SET(i, &set);
+    }
+    p1 = p2;
+    if (*p1 == ',')
+      p1++;
+  }
+  return CPU_COUNT(&set) > 0;
+}
+
+void UThreads::cpuList(cpu_set_t & set, char * list, int listSize)
+{
+  int n = 0;
+  list[0] = '\0';
+  if (CPU_COUNT(&set) == cpuCnt)
+    snprintf(list, listSize, "all");
+  else
+  {
+    for (int i = 0; i < cpuCnt and n < listSize; i++)
+    {
+      if (CPU_ISSET(i, &set))
+        n += snprintf(&list[n], listSize - n, "%s%d", n > 0 ? "," : "", i);
+    }
+  }
+}
+
+void __attribute__((noinline)) UThreads::prefault()
+{ // get the stack pages mapped now, not when first used
+  int n = prefaultKb * 1024;
+  volatile char * p = (volatile char *)alloca(n);
+  for (int i = 0; i < n; i += 4096)
+    p[i] = 0;
+}
+
+void UThreads::apply(const char * name)
+{
+  pthread_t self = pthread_self();
+  if (gettid() != getpid())
+  { // the main thread keeps the process name
+    char nm[16];
+    snprintf(nm, sizeof(nm), "%s", name);
+    pthread_setname_np(self, nm);
+  }
+  // find settings, default is to keep the settings of the creator
+  Config c;
+  snprintf(c.name, sizeof(c.name), "%s", name);
+  for (int i = 0; i < configCnt; i++)
+  {
+    if (strcmp(configs[i].name, name) == 0)
+    {
+      c = configs[i];
+      break;
+    }
+  }
+  const int MRL = 200;
+  char result[MRL] = "OK";
+  sched_param param;
+  cpu_set_t set;
+  if (not c.inherit)
+  { // set both policy and CPUs explicitly,
+    // as a new thread inherits the settings of its creator
+    param.sched_priority = c.priority;
+    int err = pthread_setschedparam(self, c.policy, &param);
+    if (err != 0)
+      snprintf(result, MRL, "policy failed: %s", strerror(err));
+    if (not cpuSet(c.cpus, set))
+    {
+      snprintf(result, MRL, "no valid CPU in '%s', using all", c.cpus);
+      cpuSet("all", set);
+    }
+    err = pthread_setaffinity_np(self, sizeof(set), &set);
+    if (err != 0)
+      snprintf(result, MRL, "CPU set failed: %s", strerror(err));
+  }
+  if (prefaultKb > 0)
+    prefault();
+  // what took effect
+  int policy;
+  pthread_getschedparam(self, &policy, &param);
+  pthread_getaffinity_np(self, sizeof(set), &set);
+  char cpus[64];
+  cpuList(set, cpus, sizeof(cpus));
+  const int MSL = 400;
+  char s[MSL];
+  if (c.inherit)
+    snprintf(s, MSL, "%-12s %6d inherit - -  %s %d %s  %s",
+             name, gettid(),
+             policyName(policy), param.sched_priority, cpus, result);
+  else
+    snprintf(s, MSL, "%-12s %6d %s %d %s  %s %d %s  %s",
+             name, gettid(), policyName(c.policy), c.priority, c.cpus,
+             policyName(policy), param.sched_priority, cpus, result);
+  if (strcmp(result, "OK") != 0)
+    printf("# UThreads:: %s\n", s);
+  toLog(s);
+}
+
+void UThreads::toLog(const char * s)
+{
+  std::lock_guard<std::mutex> lock(logLock);
+  if (logfile != nullptr)
+  {
+    UTime t("now");
+    fprintf(logfile, "%lu.%04ld %s\n", t.getSec(), t.getMicrosec()/100, s);
+  }
+  if (toConsole)
+    printf("# UThreads:: %s\n", s);
+}
@@ -0,0 +1,110 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <string>
+#include <sched.h>
+
+#include "utime.h"
+
+/**
+ * Start of named threads with scheduling policy, priority
+ * and CPU set from the [threads] section in robot.ini, e.g.
+ *   pose = fifo 40 0-2
+ *   cam = other 0 3
+ * (policy is other, fifo or rr, CPU set is 'all' or a list like 0,2-3).
+ * The default is 'inherit', the thread keeps the settings it is started
+ * with (from the process, e.g. normal scheduling on all CPUs).
+ * Memory may be locked (mlockall) and thread stacks prefaulted,
+ * to avoid page faults in the control threads.
+ * The settings that took effect are saved in log_threads.txt.
+ * */
+class UThreads
+{
+public:
+  /** read settings and lock memory if requested,
+   * must be called before threads are spawned */
+  void setup();
+  /**
+   * terminate */
+  void terminate();
+  /**
+   * Start a named thread with the settings for this name.
+   * \param name is the thread name (max 15 characters) and ini key
+   * \param func is the thread function, called with args
+   * \returns the new thread */
+  template <class F, class... Args>
+  std::thread * spawn(const char * name, F func, Args... args)
+  {
+    std::string n = name;
+    return new std::thread([this, n, func, args...]()
+    {
+      apply(n.c_str());
+      func(args...);
+    });
+  }
+  /**
+   * Name the calling thread and apply the settings for this name */
+  void apply(const char * name);
+
+private:
+  /// settings for one thread
+  struct Config
+  {
+    char name[16];
+    /// keep the settings of the creating thread
+    bool inherit = true;
+    int policy = SCHED_OTHER;
+    int priority = 0;
+    /// CPU set as in ini-file
+    char cpus[32] = "all";
+  };
+  static const int MAX_CONFIGS = 32;
+  Config configs[MAX_CONFIGS];
+  int configCnt = 0;
+  /** parse 'policy priority cpus' */
+  bool parse(const char * value, Config & c);
+  /** make a CPU set from a list like '0,2-3' (or 'all')
+   * \returns false if the list is not valid */
+  bool cpuSet(const char * cpus, cpu_set_t & set);
+  /** get CPU list from a CPU set */
+  void cpuList(cpu_set_t & set, char * list, int listSize);
+  /** touch stack pages to get them mapped now */
+  void prefault();
+  void toLog(const char * s);
+  /// lock all memory (mlockall)
+  bool lockMemory = false;
+  /// stack to prefault (kB), 0 is none
+  int prefaultKb = 0;
+  int cpuCnt = 1;
+  FILE * logfile = nullptr;
+  bool toConsole = false;
+  std::mutex logLock;
+};
+
+/**
+ * Make this visible to the rest of the software */
+extern UThreads threads;
@@ -30,6 +30,9 @@
 #include <math.h>
 #include "utime.h"
 
+std::atomic<bool> UTime::virtualTime{false};
+std::atomic<int64_t> UTime::virtualNs{0};
+
 /////////////////////////////////////////
 
 UTime::UTime()
@@ -44,51 +47,60 @@ UTime::UTime(const char *)
 
 /////////////////////////////////////////////
 
-UTime::~UTime()
-{
+/////////////////////////////////////////
+
+int64_t UTime::measureWallOffset()
+{ // wall clock minus monotonic clock, the monotonic read
+  // is taken on both sides of the wall clock read
+  timespec m1, w, m2;
+  clock_gettime(CLOCK_MONOTONIC, &m1);
+  clock_gettime(CLOCK_REALTIME, &w);
+  clock_gettime(CLOCK_MONOTONIC, &m2);
+  int64_t mono = (int64_t(m1.tv_sec) * NS_PER_SEC + m1.tv_nsec +
+                  int64_t(m2.tv_sec) * NS_PER_SEC + m2.tv_nsec) / 2;
+  return int64_t(w.tv_sec) * NS_PER_SEC + w.tv_nsec - mono;
 }
 
 /////////////////////////////////////////
 
 void UTime::clear()
 { // clear to zero
-  time.tv_sec = 0;
-  time.tv_usec = 0;
+  ns = 0;
   valid = false;
 }
 
 unsigned long UTime::getSec()
 {
   if (valid)
-    return time.tv_sec;
+    return getWallNs() / NS_PER_SEC;
   else
     return 0;
 }
 
 /////////////////////////////////////////
 
-float UTime::getDecSec()
+double UTime::getDecSec()
 {
   if (valid)
-    return float(time.tv_sec) + float(time.tv_usec) * 1e-6;
+    return nsToSec(getWallNs());
   else
     return 0;
 }
 
 /////////////////////////////////////////
 
-float UTime::getDecSec(UTime t1)
-{ // get time compared to t1
-  return float(time.tv_sec - t1.time.tv_sec) + float(time.tv_usec - t1.time.tv_usec) * 1e-6;
+float UTime::getTimePassed()
+{
+  return float(getTimePassedNs()) * 1e-9f;
 }
 
 /////////////////////////////////////////
 
-float UTime::getTimePassed()
+int64_t UTime::getTimePassedNs()
 {
   UTime t;
   t.now();
-  return (t - *this);
+  return t.ns - ns;
 }
 
 /////////////////////////////////////////
@@ -96,7 +108,7 @@ float UTime::getTimePassed()
 long UTime::getMilisec()
 {
   if (valid)
-    return time.tv_usec / 1000;
+    return (getWallNs() % NS_PER_SEC) / 1000000;
   else
     return 0;
 }
@@ -106,7 +118,7 @@ long UTime::getMilisec()
 unsigned long UTime::getMicrosec()
 {
   if (valid)
-    return time.tv_usec;
+    return (getWallNs() % NS_PER_SEC) / 1000;
   else
     return 0;
 }
@@ -116,11 +128,12 @@ unsigned long UTime::getMicrosec()
 int UTime::getTimeAsString(char * info, bool local)
 { // writes time to string in format "hh:mm:ss.msec"
   struct tm ymd;
+  time_t sec = getSec();
   //
   if (local)
-    localtime_r(&time.tv_sec, &ymd);
+    localtime_r(&sec, &ymd);
   else
-    gmtime_r(&time.tv_sec, &ymd);
+    gmtime_r(&sec, &ymd);
   //
   sprintf(info, "%2d:%02d:%02d.%03d", ymd.tm_hour,
             ymd.tm_min, ymd.tm_sec, (int)getMilisec());
@@ -132,11 +145,12 @@ int UTime::getTimeAsString(char * info, bool local)
 char * UTime::getForFilename(char * info, bool local /*= true*/)
 {
   struct tm ymd;
+  time_t sec = getSec();
   //
   if (local)
-    localtime_r(&time.tv_sec, &ymd);
+    localtime_r(&sec, &ymd);
   else
-    gmtime_r(&time.tv_sec, &ymd);
+    gmtime_r(&sec, &ymd);
   //
   sprintf(info, "%04d%02d%02d_%02d%02d%02d.%03d",
             ymd.tm_year+1900, ymd.tm_mon+1, ymd.tm_mday,
@@ -158,11 +172,12 @@ std::string UTime::getForFilename()
 char * UTime::getDateTimeAsString(char * info, bool local /*= true*/)
 {
   struct tm ymd;
+  time_t sec = getSec();
   //
   if (local)
-    localtime_r(&time.tv_sec, &ymd);
+    localtime_r(&sec, &ymd);
   else
-    gmtime_r(&time.tv_sec, &ymd);
+    gmtime_r(&sec, &ymd);
   //
   sprintf(info, "%04d-%02d-%02d %02d:%02d:%02d.%03d",
           ymd.tm_year+1900, ymd.tm_mon+1, ymd.tm_mday,
@@ -176,29 +191,38 @@ char * UTime::getDateTimeAsString(char * info, bool local /*= true*/)
 
 void UTime::setTime(timeval iTime)
 {
-  time = iTime;
-  valid = true;
+  setTime(iTime.tv_sec, iTime.tv_usec);
 }
 
 /////////////////////////////////////////
 
 void UTime::setTime(long sec, long uSec)
-{
-  time.tv_sec = sec;
-  time.tv_usec = uSec;
+{ // from wall clock
+  ns = int64_t(sec) * NS_PER_SEC + int64_t(uSec) * 1000 - wallOffset();
   valid = true;
 }
 
 /////////////////////////////////////////
 
+timeval UTime::getTimeval()
+{
+  timeval tv;
+  tv.tv_sec = getSec();
+  tv.tv_usec = getMicrosec();
+  return tv;
+}
+
+/////////////////////////////////////////
+
 struct tm UTime::getTimeTm(bool local)
 {
   struct tm ymd;
+  time_t sec = getSec();
   //
   if (local)
-    localtime_r(&time.tv_sec, &ymd);
+    localtime_r(&sec, &ymd);
   else
-    gmtime_r(&time.tv_sec, &ymd);
+    gmtime_r(&sec, &ymd);
   //
   return ymd;
 }
@@ -222,37 +246,3 @@ UTime UTime::operator- (float seconds)
 }
 
 /////////////////////////////////////////////
-
-void UTime::add(float seconds)
-{
-  float rem = seconds - long(seconds);
-  long remL = (unsigned long)(rem * 1000000.0);
-  //
-  time.tv_sec += (unsigned long)seconds;
-  if (time.tv_usec + remL > 1000000)
-  { // adjust if overflow
-    time.tv_sec++;
-    time.tv_usec += remL - 1000000;
-  }
-  else
-    time.tv_usec += remL;
-}
-
-void UTime::sub(float seconds)
-{
-  float rem = seconds - long(seconds);
-  long remL = (unsigned long)(rem * 1000000.0);
-  //
-  time.tv_sec -= (unsigned long)seconds;
-  if (time.tv_usec < remL)
-  { // adjust if overflow
-    time.tv_sec--;
-    time.tv_usec += 1000000 - remL;
-  }
-  else
-    time.tv_usec -= remL;
-}
-/////////////////////////////////////////////
-
-
-
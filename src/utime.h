@@ -26,16 +26,28 @@
 #define UTIME_H
 
 #include <sys/time.h>
+#include <time.h>
+#include <stdint.h>
+#include <string>
+#include <atomic>
 
 
 /**
-Class encapsulation the time structure used by 'gettimeofday'
-with resolution in years down to micro-seconds.
+Class encapsulation of a time value from the monotonic clock
+(clock_gettime(CLOCK_MONOTONIC)) in integer nanoseconds.
+The monotonic clock is not changed by NTP or by setting the date,
+so durations and time comparisons are exact and never jump.
+Calendar (wall clock) time is used for log time stamps and filenames only,
+converted with an offset that is taken once, when the program starts,
+so that log time stamps continue without jumps too.
+For test, the time can be taken from a virtual clock instead (see UClock).
 The class has functions to make simple time calculations and
 conversion to and from string in localized format. */
 class UTime
 {
 public:
+  /// nanoseconds per second, for integer durations
+  static constexpr int64_t NS_PER_SEC = 1000000000;
   /**
   Constructor */
   UTime();
@@ -43,8 +55,8 @@ public:
    *  Constructor that init to now */
     UTime(const char*);
   /**
-  Destructor */
-  ~UTime();
+  Destructor (trivial, so that UTime can be copied as plain data) */
+  ~UTime() = default;
   /**
   Clear to 0.0 */
   void clear();
@@ -58,23 +70,61 @@ public:
   Get microsecond value within second in range 0..999999 */
   unsigned long getMicrosec();
   /**
-  Get second value with microsecond as decimals */
-  float getDecSec();
+  Get second value (since 1970) with microsecond as decimals */
+  double getDecSec();
+  /**
+  Get time since t1 in nanoseconds (exact, the preferred duration) */
+  inline int64_t getNsSince(UTime t1) const
+  { return ns - t1.ns; }
   /**
   Get time since t1 as decimal seconds. */
-  float getDecSec(UTime t1);
+  inline float getDecSec(UTime t1)
+  { return float(ns - t1.ns) * 1e-9f; }
   /**
   Get time past since this time in seconds */
   float getTimePassed();
   /**
-  Set time value to system time now using gettimeofday() */
+  Get time past since this time in nanoseconds */
+  int64_t getTimePassedNs();
+  /**
+  Set time value to the monotonic clock now (or the virtual clock) */
   inline void now()
-  { gettimeofday(&time, nullptr); valid = true; }
+  {
+    if (virtualTime.load(std::memory_order_relaxed))
+      ns = virtualNs.load(std::memory_order_relaxed);
+    else
+    {
+      timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      ns = int64_t(ts.tv_sec) * NS_PER_SEC + ts.tv_nsec;
+    }
+    valid = true;
+  }
+  /**
+  Time in nanoseconds on the monotonic clock */
+  inline int64_t getNs() const
+  { return ns; }
+  /**
+  Time in nanoseconds since 1970 (wall clock), e.g. for log records */
+  inline int64_t getWallNs() const
+  { return ns + wallOffset(); }
   /**
-  Set time from a timeval structure */
+  Set time from nanoseconds on the monotonic clock */
+  inline void setNs(int64_t nanoSec)
+  { ns = nanoSec; valid = true; }
+  /**
+  Duration in nanoseconds from decimal seconds, e.g. UTime::secToNs(0.005) */
+  static constexpr int64_t secToNs(double sec)
+  { return int64_t(sec * 1e9 + (sec < 0 ? -0.5 : 0.5)); }
+  /**
+  Duration in decimal seconds from nanoseconds */
+  static constexpr double nsToSec(int64_t nanoSec)
+  { return double(nanoSec) * 1e-9; }
+  /**
+  Set time from a (wall clock) timeval structure */
   void setTime(timeval iTime);
   /**
-  Set time using seconds and microseconds. */
+  Set time using (wall clock) seconds (since 1970) and microseconds. */
   void setTime(long sec, long uSec);
   /**
    * Writes time to INFO in format "hh:mm:ss.msec"
@@ -99,52 +149,28 @@ public:
    * \returns pointer to the info buffer */
   char * getDateTimeAsString(char * info, bool local = true);
   /**
-   *  Compare two times */
+   *  Set from a (wall clock) timeval */
   inline UTime operator=(timeval newTime)
   {
-    time = newTime;
-    valid = true;
+    setTime(newTime);
     return *this;
   };
   /**
   Compare two times */
   inline bool operator==(UTime other)
-  {
-    bool result;
-    if ((time.tv_sec == other.time.tv_sec) and (time.tv_usec == other.time.tv_usec))
-      result = true;
-    else
-      result = false;
-    return result;
-  };
+  { return ns == other.ns; };
   /**
   Compare two times */
   inline bool operator> (UTime other)
-  {
-    bool result;
-    if ((time.tv_sec > other.time.tv_sec) or
-         ((time.tv_sec == other.time.tv_sec) and (time.tv_usec > other.time.tv_usec)))
-      result = true;
-    else
-      result = false;
-    return result;
-  };
+  { return ns > other.ns; };
   /**
   Compare two times */
   inline bool operator>= (UTime other)
-  { return not (*this < other); };
+  { return ns >= other.ns; };
   /**
   Compare two times */
   inline bool operator< (UTime other)
-  {
-    bool result;
-    if ((time.tv_sec < other.time.tv_sec) or
-         ((time.tv_sec == other.time.tv_sec) and (time.tv_usec < other.time.tv_usec)))
-      result = true;
-    else
-      result = false;
-    return result;
-  };
+  { return ns < other.ns; };
   /**
   Compare two times, where other is a float float */
   inline bool operator< (float other)
@@ -172,15 +198,14 @@ public:
   /**
   Compare two times */
   inline bool operator<= (UTime other)
-  { return not (*this > other); };
+  { return ns <= other.ns; };
   /**
   Compare two times */
   inline bool operator!=(UTime other)
-  {
-    return not (*this == other);
-  };
+  { return ns != other.ns; };
   /**
-  Subtract two UTime values and get result in decimal seconds */
+  Subtract two UTime values and get result in decimal seconds.
+  Float is kept for the existing callers; use getNsSince() for exact durations */
   inline float operator- (UTime old)
   { return getDecSec(old);};
   /**
@@ -199,22 +224,24 @@ public:
     { sub(seconds); };
   /**
   Add this number of seconds to the current value */
-  void add(float seconds);
+  inline void add(float seconds)
+    { ns += secToNs(seconds); }
+  /**
+  Subtract a number of seconds from this time. */
+  inline void sub(float seconds)
+    { ns -= secToNs(seconds); }
   /**
-  Subtract a number of seconds from this time.
-  Can not handle negative time, and seconds must be positive. */
-  void sub(float seconds);
+  Add a number of nanoseconds to this time */
+  inline void addNs(int64_t nanoSec)
+    { ns += nanoSec; }
   /**
   Convert seconds to time_tm strucure.
   \param when 'local' is true the local time is returned, else GMT.
   \return the structure with year (year 1900 == 0), month, day, hour, min and sec. */
   struct tm getTimeTm(bool local = true);
   /**
-  Get copy of timevalue structure */
-  inline struct timeval getTimeval()
-  {
-    return time;
-  }
+  Get copy of (wall clock) timevalue structure */
+  struct timeval getTimeval();
   /**
   Get month number form 3 character string.
   String value must match one of:
@@ -228,10 +255,27 @@ public:
   print date and time on console */
   inline void print(const char * prestring = nullptr)
     { show(prestring); };
+  /**
+  Offset from the monotonic clock to the wall clock (ns).
+  Taken once, at first use. */
+  static inline int64_t wallOffset()
+  {
+    static const int64_t offset = measureWallOffset();
+    return offset;
+  }
+  /**
+  Measure the offset from the monotonic clock to the wall clock (ns). */
+  static int64_t measureWallOffset();
+  /**
+  Use the virtual clock (virtualNs) for now(), set by UClock */
+  static std::atomic<bool> virtualTime;
+  /**
+  Virtual time (ns on the monotonic scale), advanced by UClock */
+  static std::atomic<int64_t> virtualNs;
 public:
   /**
-  Time as 'timeval' - i.e. same format as in 'timeofday' call. */
-  timeval time;
+  Time in nanoseconds on the monotonic clock. */
+  int64_t ns;
   /**
   A valid flag, that are used when setting the time */
   bool valid;
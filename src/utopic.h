@@ -0,0 +1,147 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <stdint.h>
+
+#include "utime.h"
+#include "useqlock.h"
+#include "uclock.h"
+
+/**
+ * Data topic, where one module publishes a typed sample
+ * and other modules wait for the next sample.
+ * A waiting consumer is woken at once, when a sample is published,
+ * instead of polling an update count with a sleep.
+ * Every sample gets a sequence number, so that a consumer
+ * can see if samples were missed (overwritten before use).
+ * Only the latest sample is kept, in a sequence lock,
+ * so any thread can get a consistent copy (read()) without locking,
+ * and the publisher is not blocked by readers.
+ * The sample type must be trivially copyable.
+ * A waiting consumer counts as idle for a virtual clock (UClock),
+ * and as busy from the moment a sample is published.
+ * */
+template <class T>
+class UTopic
+{
+public:
+  /**
+   * Publish a new sample (from one thread only)
+   * and wake all waiting consumers */
+  void publish(const T & value)
+  {
+    Entry e;
+    e.value = value;
+    e.published.now();
+    data.write(e);
+    { // a waiting consumer is either before its test or waiting
+      std::lock_guard<std::mutex> lock(waitLock);
+      if (waiting > 0)
+      { // counted waiters (virtual clock) are busy from now
+        clockService.wake(waiting);
+        waiting = 0;
+      }
+      wakeGen++;
+    }
+    newData.notify_all();
+  }
+  /**
+   * Wait for a sample newer than 'lastSeq'.
+   * \param value is set to the latest sample.
+   * \param lastSeq is the sequence number of the last sample used,
+   *        it is updated to the sequence number of the returned sample.
+   * \param timeout in seconds, to allow the consumer to check for stop.
+   *        The timeout is in real time, also on a virtual clock (UClock),
+   *        so a timeout is not a time step on the virtual clock.
+   * \param published if not nullptr, then set to the publish time.
+   * \returns the number of new samples since lastSeq, i.e. 0 on timeout,
+   *          and more than 1 if samples were missed. */
+  int wait(T & value, uint64_t & lastSeq, float timeout, UTime * published = nullptr)
+  {
+    if (data.getSeq() == lastSeq)
+    {
+      std::unique_lock<std::mutex> lock(waitLock);
+      bool counted = clockService.waitBegin();
+      uint64_t gen = wakeGen;
+      if (counted)
+        waiting++;
+      newData.wait_for(lock, std::chrono::microseconds(int(timeout * 1e6)),
+                       [this, lastSeq]{ return data.getSeq() != lastSeq; });
+      if (counted)
+      { // not counted as busy by publish, if timeout
+        bool woken = wakeGen != gen;
+        if (not woken)
+          waiting--;
+        clockService.waitEnd(woken);
+      }
+    }
+    return get(value, lastSeq, published);
+  }
+  /**
+   * Get the latest sample, if newer than lastSeq (without waiting).
+   * \returns the number of new samples since lastSeq (0 if none) */
+  int get(T & value, uint64_t & lastSeq, UTime * published = nullptr)
+  {
+    uint64_t seq;
+    Entry e = data.read(&seq);
+    int n = seq - lastSeq;
+    if (n > 0)
+    {
+      value = e.value;
+      lastSeq = seq;
+      if (published != nullptr)
+        *published = e.published;
+    }
+    return n;
+  }
+  /**
+   * Consistent copy of the latest sample (without waiting or locking) */
+  T read() const
+  {
+    return data.read().value;
+  }
+  /**
+   * Sequence number of the latest sample (0 if none) */
+  uint64_t getSeq() const
+  {
+    return data.getSeq();
+  }
+
+private:
+  struct Entry
+  {
+    T value;
+    UTime published;
+  };
+  USeqLock<Entry> data;
+  std::mutex waitLock;
+  std::condition_variable newData;
+  /// waiting consumers counted by a virtual clock, and publish count
+  int waiting = 0;
+  uint64_t wakeGen = 0;
+};
@@ -0,0 +1,88 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+/**
+ * Convert a binary log (log_all.bin from raubase, see src/ulogger.h)
+ * to the text logfiles (log_pose.txt, log_motor_0.txt, ...),
+ * in the same format as if raubase had written them directly.
+ * Used after a run with 'convert = false' in the [logger] section,
+ * when raubase did not terminate normally, or for a flight recorder
+ * dump after a crash (recorder_crash.bin).
+ * With '--info' the streams and the time index are listed instead.
+ * */
+
+#include <stdio.h>
+#include <string>
+#include "CLI/CLI.hpp"
+
+#include "ulogcodec.h"
+#include "ulogreader.h"
+
+/**
+ * List the streams and the time span of a binary log */
+static int info(const char * binName)
+{
+  ULogReader rd;
+  if (not rd.open(binName))
+    return 1;
+  printf("# %s: %.3f sec, %d index entries (%s)\n", binName,
+         (rd.endTime - rd.startTime) * 1e-9, (int)rd.index.size(),
+         rd.indexed ? "from file" : "made by scan");
+  std::vector<int> rows(rd.streams.size(), 0);
+  ULogRecord rec;
+  while (rd.next(rec))
+    if (not rec.text)
+      rows[rec.stream]++;
+  for (int i = 1; i < (int)rd.streams.size(); i++)
+    printf("%3d %-24s %8d rows  %s", i, rd.streams[i].name.c_str(), rows[i], rd.streams[i].format.c_str());
+  return 0;
+}
+
+int main(int argc, char ** argv)
+{
+  CLI::App cli{"Convert a raubase binary log to text logfiles"};
+  std::string binName;
+  std::string outDir;
+  bool verbose = false;
+  bool listInfo = false;
+  cli.add_option("log", binName, "Binary log file (log_all.bin)")->required();
+  cli.add_option("-o,--out", outDir, "Directory for the text logfiles (default same as the binary log)");
+  cli.add_flag("-v,--verbose", verbose, "List the created files");
+  cli.add_flag("-i,--info", listInfo, "List streams and time span only");
+  CLI11_PARSE(cli, argc, argv);
+  if (listInfo)
+    return info(binName.c_str());
+  if (outDir.empty())
+  { // same directory as the binary log
+    size_t n = binName.rfind('/');
+    if (n != std::string::npos)
+      outDir = binName.substr(0, n + 1);
+  }
+  else if (outDir.back() != '/')
+    outDir += "/";
+  int n = ULogCodec::convert(binName.c_str(), outDir.c_str(), verbose);
+  if (n < 0)
+    return 1;
+  printf("# converted %d records from %s\n", n, binName.c_str());
+  return 0;
+}
@@ -0,0 +1,586 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+/**
+ * Extract the text logfiles of a session (log_pose.txt, log_motor_0.txt, ...)
+ * to binary, column-typed files for analysis,
+ * as MAT-files (version 5, load in Matlab or Octave) or numpy .npy files.
+ *
+ * Column names are taken from the '%' comment lines that each module
+ * writes at the top of its logfile, like "% 7,8 \tPosition x,y (m)",
+ * so the result follows the actual column layout of the log.
+ * Columns with no numeric values (names, messages) are left out,
+ * columns with integer values only are saved as int64, else double.
+ *
+ * A MAT-file has one struct named as the log (log_pose), with a field for each column,
+ * e.g. "load('log_pose.mat'); plot(log_pose.position_x, log_pose.position_y)".
+ * A .npy file has a structured array, e.g. "d = np.load('log_pose.npy'); d['time']".
+ *
+ * Rows can be limited to a time range (seconds from the start of the session)
+ * and decimated, while converting. Files are converted in parallel.
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <filesystem>
+#include "CLI/CLI.hpp"
+
+/**
+ * Settings from the command line */
+struct UExtractSettings
+{
+  std::string outDir;
+  bool mat = true;
+  /// time range relative to session start (sec), to < 0 is to the end
+  double from = 0;
+  double to = -1;
+  /// keep every n'th row
+  int decimate = 1;
+  /// session start time (first row in any log)
+  double sessionStart = 0;
+  bool verbose = false;
+};
+
+/**
+ * One column of a log */
+struct UColumn
+{
+  std::string name;
+  std::vector<double> v;
+  /// values found (not NaN)
+  int numeric = 0;
+  bool integer = true;
+};
+
+/**
+ * Convert a description, like "Velocity left, right (m/s)",
+ * to names for n columns, like velocity_left and velocity_right */
+static void columnNames(const char * desc, int n, std::vector<std::string> & names)
+{
+  // the name is before units and remarks (in parentheses)
+  std::string d(desc, strcspn(desc, "("));
+  if (std::none_of(d.begin(), d.end(), isalnum))
+  { // starts with a remark, so remove all in parentheses
+    d.clear();
+    int level = 0;
+    for (const char * p = desc; *p != '\0'; p++)
+    {
+      if (*p == '(')
+        level++;
+      else if (*p == ')' and level > 0)
+        level--;
+      else if (level == 0)
+        d += *p;
+    }
+  }
+  // split in comma separated items
+  std::vector<std::string> items;
+  size_t start = 0;
+  while (true)
+  {
+    size_t c = d.find(',', start);
+    items.push_back(d.substr(start, c - start));
+    if (c == std::string::npos)
+      break;
+    start = c + 1;
+  }
+  // words of an item (max 4 words)
+  auto words = [](const std::string & s, int maxWords)
+  {
+    std::vector<std::string> w;
+    std::string cur;
+    for (char c : s)
+    {
+      if (isalnum(c))
+        cur += tolower(c);
+      else if (not cur.empty())
+      {
+        w.push_back(cur);
+        cur.clear();
+      }
+    }
+    if (not cur.empty())
+      w.push_back(cur);
+    if ((int)w.size() > maxWords)
+      w.resize(maxWords);
+    return w;
+  };
+  auto join = [](const std::vector<std::string> & w, size_t from, size_t to)
+  {
+    std::string s;
+    for (size_t i = from; i < to and i < w.size(); i++)
+      s += (s.empty() ? "" : "_") + w[i];
+    return s;
+  };
+  names.clear();
+  bool listed = n > 1 and (int)items.size() == n;
+  for (int i = 1; i < (int)items.size() and listed; i++)
+    // items after the first are short, like "y" or "right"
+    listed = words(items[i], 4).size() <= 2;
+  if (listed)
+  { // "Position x,y": the words before the last of the first item are common
+    std::vector<std::string> w0 = words(items[0], 5);
+    std::string prefix = w0.size() > 1 ? join(w0, 0, w0.size() - 1) : "";
+    for (int i = 0; i < n; i++)
+    {
+      std::vector<std::string> w = words(items[i], 4);
+      std::string last = i == 0 ? (w0.empty() ? "" : w0.back()) : join(w, 0, w.size());
+      names.push_back(prefix.empty() ? last : prefix + "_" + last);
+    }
+  }
+  else
+  { // trailing numbers and small words are not needed, e.g. "Sensor value in 0..1000 scale"
+    std::vector<std::string> w = words(d, 4);
+    const char * small[] = {"in", "for", "and", "of", "to", "the", "from", "at", "as"};
+    while (w.size() > 1 and (isdigit(w.back()[0]) or
+           std::find_if(std::begin(small), std::end(small),
+                        [&](const char * s) { return w.back() == s; }) != std::end(small)))
+      w.pop_back();
+    std::string base = join(w, 0, w.size());
+    for (int i = 0; i < n; i++)
+      names.push_back(n == 1 ? base : base + "_" + std::to_string(i + 1));
+  }
+}
+
+/**
+ * Parse a column header comment, like "% 2,3 \tVelocity left, right (m/s)".
+ * The column list is a number, comma separated numbers, or a range ("2..9" or "14-21").
+ * \returns false if not a column header */
+static bool parseHeader(const char * line, std::vector<UColumn> & cols)
+{
+  const char * p = line + 1;
+  while (*p == ' ')
+    p++;
+  if (not isdigit(*p))
+    return false;
+  std::vector<int> idx;
+  char * e;
+  int a = strtol(p, &e, 10);
+  idx.push_back(a);
+  p = e;
+  while (true)
+  {
+    if (*p == ',' and isdigit(p[1]))
+      idx.push_back(strtol(p + 1, &e, 10));
+    else if ((strncmp(p, "..", 2) == 0 and isdigit(p[2])) or (*p == '-' and isdigit(p[1])))
+    {
+      int b = strtol(p + (*p == '-' ? 1 : 2), &e, 10);
+      for (int i = idx.back() + 1; i <= b; i++)
+        idx.push_back(i);
+    }
+    else
+      break;
+    p = e;
+  }
+  if (*p != ' ' and *p != '\t')
+    return false;
+  while (*p == ' ' or *p == '\t')
+    p++;
+  std::vector<std::string> names;
+  columnNames(p, idx.size(), names);
+  for (int i = 0; i < (int)idx.size(); i++)
+  {
+    int c = idx[i] - 1;
+    if (c < 0 or c > 1000)
+      continue;
+    if (c >= (int)cols.size())
+      cols.resize(c + 1);
+    if (cols[c].name.empty())
+      cols[c].name = names[i];
+  }
+  return true;
+}
+
+/**
+ * Make names usable as Matlab struct fields (and unique) */
+static void fixNames(std::vector<UColumn> & cols)
+{
+  for (int i = 0; i < (int)cols.size(); i++)
+  {
+    std::string & s = cols[i].name;
+    if (i == 0 and strncmp(s.c_str(), "time", 4) == 0)
+      s = "time";
+    if (s.empty() or not isalpha(s[0]))
+      s = "col_" + std::to_string(i + 1) + (s.empty() ? "" : "_" + s);
+    if (s.size() > 31)
+      s.resize(31);
+    for (int j = 0; j < i; j++)
+      if (cols[j].name == s)
+      {
+        s = s.substr(0, 26) + "_" + std::to_string(i + 1);
+        break;
+      }
+  }
+}
+
+/**
+ * Time of the first row in a logfile
+ * \returns 0 if no rows */
+static double firstTime(const std::string & fn)
+{
+  FILE * f = fopen(fn.c_str(), "r");
+  if (f == nullptr)
+    return 0;
+  char line[4096];
+  double t = 0;
+  while (fgets(line, sizeof(line), f) != nullptr)
+  {
+    if (line[0] == '%' or line[0] == '\n')
+      continue;
+    t = strtod(line, nullptr);
+    if (t > 0)
+      break;
+  }
+  fclose(f);
+  return t;
+}
+
+/**
+ * Read a text logfile into columns
+ * \returns number of rows, or -1 if the file can not be read */
+static int readLog(const std::string & fn, const UExtractSettings & set, std::vector<UColumn> & cols)
+{
+  FILE * f = fopen(fn.c_str(), "r");
+  if (f == nullptr)
+    return -1;
+  char * line = nullptr;
+  size_t lineCnt = 0;
+  int rows = 0;
+  int inRange = 0;
+  int described = 0;
+  double t0 = set.from > 0 ? set.sessionStart + set.from : -INFINITY;
+  double t1 = set.to >= 0 ? set.sessionStart + set.to : INFINITY;
+  while (getline(&line, &lineCnt, f) > 0)
+  {
+    if (line[0] == '%')
+    { // column names are at the top only
+      if (rows == 0 and parseHeader(line, cols))
+        described = cols.size();
+      continue;
+    }
+    // split the row and parse the numbers
+    const int MAX_TOKENS = 1000;
+    double v[MAX_TOKENS];
+    bool isInt[MAX_TOKENS];
+    int n = 0;
+    char * p = line;
+    while (n < MAX_TOKENS)
+    {
+      while (*p == ' ' or *p == '\t')
+        p++;
+      if (*p == '\0' or *p == '\n' or *p == '\r')
+        break;
+      char * end = p;
+      while (*end > ' ')
+        end++;
+      char * e;
+      v[n] = strtod(p, &e);
+      if (e != end)
+        v[n] = NAN;
+      isInt[n] = strpbrk(p, ".eEnN") == nullptr or strpbrk(p, ".eEnN") >= end;
+      n++;
+      p = end;
+    }
+    if (n == 0)
+      continue;
+    rows++;
+    // time range and decimation
+    if (v[0] < t0 or v[0] > t1)
+      continue;
+    if (inRange++ % set.decimate != 0)
+      continue;
+    if (n > (int)cols.size())
+      cols.resize(n);
+    int m = cols.empty() ? 0 : cols[0].v.size();
+    for (int i = 0; i < (int)cols.size(); i++)
+    {
+      UColumn & c = cols[i];
+      // a column may be missing in earlier rows
+      c.v.resize(m, NAN);
+      double d = i < n ? v[i] : NAN;
+      c.v.push_back(d);
+      if (not isnan(d))
+      {
+        c.numeric++;
+        if (not isInt[i] or fabs(d) > 9e15)
+          c.integer = false;
+      }
+    }
+  }
+  free(line);
+  fclose(f);
+  if (described > 0 and described < (int)cols.size())
+    // the rest is free text, e.g. messages
+    cols.resize(described);
+  for (auto & c : cols)
+    // int64 has no NaN for missing values
+    if (c.numeric < (int)c.v.size())
+      c.integer = false;
+  // remove columns with no numbers
+  std::vector<UColumn> used;
+  for (auto & c : cols)
+    if (c.numeric > 0)
+      used.push_back(std::move(c));
+  cols.swap(used);
+  fixNames(cols);
+  return rows;
+}
+
+/**
+ * Write a MAT-file data element (tag and data, padded to 8 bytes) */
+static void matElement(FILE * f, uint32_t type, const void * data, uint32_t n)
+{
+  uint32_t tag[2] = {type, n};
+  fwrite(tag, 4, 2, f);
+  if (n > 0)
+    fwrite(data, 1, n, f);
+  const uint8_t pad[8] = {0};
+  fwrite(pad, 1, (8 - n % 8) % 8, f);
+}
+
+/**
+ * Save columns as a MAT-file (v5), one struct with a field for each column */
+static bool saveMat(const std::string & fn, const std::string & varName, const std::vector<UColumn> & cols)
+{
+  enum {miINT8 = 1, miINT32 = 5, miUINT32 = 6, miDOUBLE = 9, miINT64 = 12, miMATRIX = 14};
+  enum {mxSTRUCT_CLASS = 2, mxDOUBLE_CLASS = 6, mxINT64_CLASS = 14};
+  const int FIELD_LEN = 32;
+  int rows = cols.empty() ? 0 : cols[0].v.size();
+  int nf = cols.size();
+  // element sizes: flags, dimensions, name, data
+  uint32_t fieldSize = 16 + 16 + 8 + 8 + rows * 8;
+  uint32_t nameSize = (varName.size() + 7) & ~7;
+  uint64_t structSize = 16 + 16 + 8 + nameSize + 8 + 8 + nf * FIELD_LEN + uint64_t(nf) * (8 + fieldSize);
+  if (structSize > UINT32_MAX)
+  {
+    printf("# logextract: %s is too large for a MAT-file (v5), use --decimate or a time range\n", varName.c_str());
+    return false;
+  }
+  FILE * f = fopen(fn.c_str(), "w");
+  if (f == nullptr)
+    return false;
+  char head[128];
+  memset(head, ' ', 116);
+  int n = snprintf(head, 116, "MATLAB 5.0 MAT-file, Platform: raubase, Created by: logextract");
+  head[n] = ' ';
+  memset(&head[116], 0, 8);
+  uint16_t version = 0x0100;
+  memcpy(&head[124], &version, 2);
+  head[126] = 'I';
+  head[127] = 'M';
+  fwrite(head, 1, 128, f);
+  // the struct (1x1)
+  uint32_t tag[2] = {miMATRIX, uint32_t(structSize)};
+  fwrite(tag, 4, 2, f);
+  uint32_t flags[2] = {mxSTRUCT_CLASS, 0};
+  matElement(f, miUINT32, flags, 8);
+  int32_t dims[2] = {1, 1};
+  matElement(f, miINT32, dims, 8);
+  matElement(f, miINT8, varName.c_str(), varName.size());
+  // field name length (small element format)
+  uint32_t fl[2] = {(4 << 16) | miINT32, FIELD_LEN};
+  fwrite(fl, 4, 2, f);
+  std::vector<char> fieldNames(nf * FIELD_LEN, '\0');
+  for (int i = 0; i < nf; i++)
+    strncpy(&fieldNames[i * FIELD_LEN], cols[i].name.c_str(), FIELD_LEN - 1);
+  matElement(f, miINT8, fieldNames.data(), fieldNames.size());
+  // a column vector for each field
+  std::vector<int64_t> iv;
+  for (auto & c : cols)
+  {
+    uint32_t ft[2] = {miMATRIX, fieldSize};
+    fwrite(ft, 4, 2, f);
+    uint32_t ff[2] = {uint32_t(c.integer ? mxINT64_CLASS : mxDOUBLE_CLASS), 0};
+    matElement(f, miUINT32, ff, 8);
+    int32_t fd[2] = {rows, 1};
+    matElement(f, miINT32, fd, 8);
+    matElement(f, miINT8, "", 0);
+    if (c.integer)
+    {
+      iv.resize(rows);
+      for (int i = 0; i < rows; i++)
+        iv[i] = int64_t(c.v[i]);
+      matElement(f, miINT64, iv.data(), rows * 8);
+    }
+    else
+      matElement(f, miDOUBLE, c.v.data(), rows * 8);
+  }
+  bool ok = not ferror(f);
+  fclose(f);
+  return ok;
+}
+
+/**
+ * Save columns as a numpy file, a structured array with a field for each column */
+static bool saveNpy(const std::string & fn, const std::vector<UColumn> & cols)
+{
+  FILE * f = fopen(fn.c_str(), "w");
+  if (f == nullptr)
+    return false;
+  int rows = cols.empty() ? 0 : cols[0].v.size();
+  std::string h = "{'descr': [";
+  for (auto & c : cols)
+    h += "('" + c.name + "', '" + (c.integer ? "<i8" : "<f8") + "'), ";
+  h += "], 'fortran_order': False, 'shape': (" + std::to_string(rows) + ",), }";
+  // header (with magic, version and length) is padded to 64 bytes
+  int total = 10 + h.size() + 1;
+  h.append((64 - total % 64) % 64, ' ');
+  h += '\n';
+  uint16_t hl = h.size();
+  fwrite("\x93NUMPY\x01\x00", 1, 8, f);
+  fwrite(&hl, 2, 1, f);
+  fwrite(h.c_str(), 1, h.size(), f);
+  // rows of mixed types
+  std::vector<uint8_t> buf(cols.size() * 8 * 4096);
+  int n = 0;
+  for (int r = 0; r < rows; r++)
+  {
+    for (auto & c : cols)
+    {
+      if (c.integer)
+      {
+        int64_t w = isnan(c.v[r]) ? 0 : int64_t(c.v[r]);
+        memcpy(&buf[n], &w, 8);
+      }
+      else
+        memcpy(&buf[n], &c.v[r], 8);
+      n += 8;
+    }
+    if (n == (int)buf.size() or r == rows - 1)
+    {
+      fwrite(buf.data(), 1, n, f);
+      n = 0;
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+int main(int argc, char ** argv)
+{
+  CLI::App cli{"Extract raubase text logfiles to MAT-files or numpy files"};
+  std::vector<std::string> inputs;
+  UExtractSettings set;
+  std::string format = "mat";
+  int jobs = std::thread::hardware_concurrency();
+  cli.add_option("logs", inputs, "Session directory (all log_*.txt) or logfiles")->required();
+  cli.add_option("-o,--out", set.outDir, "Directory for the converted files (default same as the logfile)");
+  cli.add_option("-f,--format", format, "Output format: 'mat' (default) or 'npy'");
+  cli.add_option("--from", set.from, "Skip rows before this time (sec from start of session)");
+  cli.add_option("--to", set.to, "Skip rows after this time (sec from start of session)");
+  cli.add_option("-d,--decimate", set.decimate, "Keep every n'th row (default 1)");
+  cli.add_option("-j,--jobs", jobs, "Files converted in parallel (default number of CPUs)");
+  cli.add_flag("-v,--verbose", set.verbose, "List the columns of each file");
+  CLI11_PARSE(cli, argc, argv);
+  set.mat = format != "npy";
+  if (set.decimate < 1)
+    set.decimate = 1;
+  if (jobs < 1)
+    jobs = 1;
+  if (not set.outDir.empty() and set.outDir.back() != '/')
+    set.outDir += "/";
+  // list of logfiles
+  std::vector<std::string> files;
+  for (auto & in : inputs)
+  {
+    std::error_code e;
+    if (std::filesystem::is_directory(in, e))
+    {
+      for (auto & de : std::filesystem::directory_iterator(in, e))
+      {
+        std::string name = de.path().filename().string();
+        if (name.compare(0, 4, "log_") == 0 and de.path().extension() == ".txt")
+          files.push_back(de.path().string());
+      }
+    }
+    else
+      files.push_back(in);
+  }
+  std::sort(files.begin(), files.end());
+  if (files.empty())
+  {
+    printf("# logextract: no logfiles found\n");
+    return 1;
+  }
+  // start of session is the first row in any log
+  for (auto & fn : files)
+  {
+    double t = firstTime(fn);
+    if (t > 0 and (set.sessionStart == 0 or t < set.sessionStart))
+      set.sessionStart = t;
+  }
+  // convert in parallel, each thread takes the next file
+  std::atomic<int> next{0};
+  std::atomic<int> failed{0};
+  std::mutex printLock;
+  auto worker = [&]()
+  {
+    int i;
+    while ((i = next++) < (int)files.size())
+    {
+      const std::string & fn = files[i];
+      std::filesystem::path path(fn);
+      std::string varName = path.stem().string();
+      std::string dir = set.outDir.empty() ? path.parent_path().string() : set.outDir;
+      if (not dir.empty() and dir.back() != '/')
+        dir += "/";
+      std::string out = dir + varName + (set.mat ? ".mat" : ".npy");
+      std::vector<UColumn> cols;
+      int rows = readLog(fn, set, cols);
+      bool ok = rows >= 0;
+      if (ok and not cols.empty())
+        ok = set.mat ? saveMat(out, varName, cols) : saveNpy(out, cols);
+      std::lock_guard<std::mutex> guard(printLock);
+      if (not ok)
+      {
+        failed++;
+        printf("# logextract: failed to convert %s\n", fn.c_str());
+      }
+      else if (cols.empty())
+        printf("# logextract: %s has no numeric columns, skipped\n", fn.c_str());
+      else
+      {
+        printf("# logextract: %s: %d of %d rows, %d columns -> %s\n", fn.c_str(),
+               (int)cols[0].v.size(), rows, (int)cols.size(), out.c_str());
+        if (set.verbose)
+          for (auto & c : cols)
+            printf("#    %-32s %s\n", c.name.c_str(), c.integer ? "int64" : "double");
+      }
+    }
+  };
+  std::vector<std::thread> pool;
+  for (int j = 0; j < jobs and j < (int)files.size(); j++)
+    pool.emplace_back(worker);
+  for (auto & t : pool)
+    t.join();
+  return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,817 @@
+/* #***************************************************************************
+ #*   Copyright (C) 2024 by DTU
+ #*   jcan@dtu.dk
+ #*
+ #*
+ #* The MIT License (MIT)  https://mit-license.org/
+ #*
+ #* Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ #* and associated documentation files (the “Software”), to deal in the Software without restriction,
+ #* including without limitation the rights to use, copy, modify, merge, publish, distribute,
+ #* sublicense, and/or sell copies of the Software, and to permit persons to whom the Software
+ #* is furnished to do so, subject to the following conditions:
+ #*
+ #* The above copyright notice and this permission notice shall be included in all copies
+ #* or substantial portions of the Software.
+ #*
+ #* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ #* INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ #* PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+ #* FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ #* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ #* THE SOFTWARE. */
+
+/**
+ * Teensy emulator on a pseudo terminal.
+ * Answers the messages from raubase like the Teensy firmware does
+ * (confirm, idi, hbti, sub, leave, motv, bin)
+ * and streams enc, liv, gyro0, acc0, ir and hbt as subscribed,
+ * in text mode or binary mode (see src/ubinlink.h).
+ * Set 'device' in the [teensy] section of robot.ini to the link name
+ * (default /tmp/ttyTeensy) to use it.
+ *
+ * A log_teensy_io.txt from a robot can be replayed (the Rx messages),
+ * at the recorded speed or faster, instead of the simulated streams.
+ *
+ * Faults can be injected to test the host:
+ * dropped messages, corrupted check codes, delayed (or lost) confirms,
+ * partial writes and disconnects.
+ * Faults are set from the command line, and can be changed
+ * while running by commands on stdin, like 'drop 0.1' (type 'help').
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <string>
+#include <deque>
+#include <random>
+
+#include "CLI/CLI.hpp"
+#include "ubinlink.h"
+
+/// stop flag set by ctrl-C
+static volatile bool stopEmu = false;
+
+static void signalHandler(int)
+{
+  stopEmu = true;
+}
+
+/**
+ * time in seconds since start (monotonic) */
+static double timeNow()
+{
+  static struct timespec t0 = {0, 0};
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  if (t0.tv_sec == 0 and t0.tv_nsec == 0)
+    t0 = t;
+  return (t.tv_sec - t0.tv_sec) + (t.tv_nsec - t0.tv_nsec) * 1e-9;
+}
+
+class UTeensyEmu
+{
+public:
+  /// settings from command line
+  std::string linkName = "/tmp/ttyTeensy";
+  std::string robotName = "emulator";
+  int idx = 2;
+  bool binarySupport = true;
+  bool verbose = false;
+  /// replay file (log_teensy_io.txt) and speed factor
+  std::string replayName;
+  double replaySpeed = 1.0;
+  bool replayLoop = false;
+  /// fault injection, probability (0..1) per message
+  double dropRate = 0;
+  double corruptRate = 0;
+  double partialRate = 0;
+  double confirmLossRate = 0;
+  /// confirm delay (sec)
+  double confirmDelay = 0;
+  /// disconnect interval (sec), 0 is never
+  double disconnectInterval = 0;
+  /// random seed for faults
+  int seed = 1;
+  /**
+   * Create the pseudo terminal and the link name,
+   * and load the replay file (if any)
+   * \returns false if failed */
+  bool setup();
+  /**
+   * Handle messages and streams until stopped */
+  void run();
+  /**
+   * Remove link and print statistics */
+  void terminate();
+
+private:
+  /// streamed data types
+  enum StreamType {ENC, LIV, GYRO, ACC, IR, HBT, STREAM_CNT};
+  const char * streamName[STREAM_CNT] = {"enc", "liv", "gyro0", "acc0", "ir", "hbt"};
+  /// stream interval (sec), 0 is not subscribed
+  double streamInterval[STREAM_CNT] = {0};
+  double streamNext[STREAM_CNT] = {0};
+  /// master side of the pseudo terminal
+  int ptm = -1;
+  /// receive buffer
+  static const int MAX_RX = 4096;
+  char rx[MAX_RX];
+  int rxCnt = 0;
+  /// in binary mode
+  bool binaryMode = false;
+  /// a client has send something
+  bool connected = false;
+  /// simulated state
+  double encPos[2] = {0};
+  double motv[2] = {0};
+  double lastUpdate = 0;
+  // statistics
+  int rxLines = 0;
+  int rxCrcErr = 0;
+  int txMsgs = 0;
+  int txBytes = 0;
+  int confirmCnt = 0;
+  int dropCnt = 0;
+  int corruptCnt = 0;
+  int partialCnt = 0;
+  int confirmLossCnt = 0;
+  int disconnectCnt = 0;
+  /// replay messages with recorded time (sec from first message)
+  struct ReplayMsg
+  {
+    double t;
+    std::string msg;
+  };
+  std::deque<ReplayMsg> replay;
+  /// next replay message and replay start time
+  size_t replayIdx = 0;
+  double replayStart = 0;
+  /// confirms waiting for the confirm delay
+  std::deque<std::pair<double, std::string>> confirms;
+  /// rest of a partial write
+  std::string txRest;
+  double txRestTime = 0;
+  /// time of last disconnect
+  double lastDisconnect = 0;
+  std::mt19937 rnd;
+  std::uniform_real_distribution<double> uniform{0.0, 1.0};
+  /**
+   * Create pseudo terminal and link
+   * \returns false if failed */
+  bool openPty();
+  /**
+   * Close the pseudo terminal (as if the USB cable was removed) */
+  void closePty();
+  /**
+   * Load replay file
+   * \returns false if file not found */
+  bool loadReplay();
+  /**
+   * Send replay messages that are due */
+  void sendReplay(double now);
+  /**
+   * Handle a command from the console
+   * \param cmd is the command line */
+  void consoleCommand(char * cmd);
+  /**
+   * Should a fault happen now
+   * \param rate is the probability */
+  inline bool fault(double rate)
+  {
+    return rate > 0 and uniform(rnd) < rate;
+  }
+  /**
+   * Handle received data */
+  void receive();
+  /**
+   * Handle a message (after check code)
+   * \param msg is zero terminated message, maybe ending with a new-line */
+  void handleMessage(char * msg);
+  /**
+   * Send a text message, as text line or as BIN_TEXT packet
+   * \param msg is the message without new-line */
+  void sendText(const char * msg);
+  /**
+   * Send a typed packet, in text mode the text version is send */
+  void sendTyped(uint8_t type, const void * payload, int n);
+  /**
+   * Send a binary frame */
+  void sendFrame(uint8_t type, const void * payload, int n);
+  /**
+   * Write to the pseudo terminal */
+  void writeData(const void * data, int n);
+  /**
+   * Send stream data of this type */
+  void sendStream(int stream, double now);
+  /**
+   * Update simulated encoder positions */
+  void simulate(double now);
+};
+
+bool UTeensyEmu::setup()
+{
+  rnd.seed(seed);
+  if (not replayName.empty() and not loadReplay())
+    return false;
+  bool isOK = openPty();
+  if (isOK)
+    printf("# teensyemu: Teensy emulator on %s, binary mode %s\n",
+           linkName.c_str(), binarySupport ? "supported" : "not supported");
+  return isOK;
+}
+
+bool UTeensyEmu::openPty()
+{
+  ptm = posix_openpt(O_RDWR | O_NOCTTY);
+  if (ptm < 0 or grantpt(ptm) != 0 or unlockpt(ptm) != 0)
+  {
+    perror("# teensyemu: failed to create pseudo terminal");
+    return false;
+  }
+  const char * slaveName = ptsname(ptm);
+  // raw mode, as a USB serial device
+  struct termios options;
+  int pts = open(slaveName, O_RDWR | O_NOCTTY);
+  if (pts >= 0)
+  {
+    tcgetattr(pts, &options);
+    cfmakeraw(&options);
+    tcsetattr(pts, TCSANOW, &options);
+    close(pts);
+  }
+  fcntl(ptm, F_SETFL, fcntl(ptm, F_GETFL, 0) | O_NONBLOCK);
+  unlink(linkName.c_str());
+  if (symlink(slaveName, linkName.c_str()) != 0)
+  {
+    perror("# teensyemu: failed to make link");
+    return false;
+  }
+  if (verbose)
+    printf("# teensyemu: %s is %s\n", linkName.c_str(), slaveName);
+  return true;
+}
+
+void UTeensyEmu::closePty()
+{
+  unlink(linkName.c_str());
+  if (ptm >= 0)
+    close(ptm);
+  ptm = -1;
+  // like a Teensy reboot
+  binaryMode = false;
+  connected = false;
+  rxCnt = 0;
+  txRest.clear();
+  confirms.clear();
+  for (int i = 0; i < STREAM_CNT; i++)
+    streamInterval[i] = 0;
+}
+
+void UTeensyEmu::terminate()
+{
+  closePty();
+  printf("# teensyemu: received %d messages (%d CRC errors), send %d messages (%d bytes), %d confirms\n",
+         rxLines, rxCrcErr, txMsgs, txBytes, confirmCnt);
+  printf("# teensyemu: faults: %d dropped, %d corrupted, %d partial writes, %d lost confirms, %d disconnects\n",
+         dropCnt, corruptCnt, partialCnt, confirmLossCnt, disconnectCnt);
+}
+
+bool UTeensyEmu::loadReplay()
+{
+  FILE * fl = fopen(replayName.c_str(), "r");
+  if (fl == nullptr)
+  {
+    printf("# teensyemu: replay file '%s' not found\n", replayName.c_str());
+    return false;
+  }
+  const int MSL = 1000;
+  char s[MSL];
+  double t0 = -1;
+  while (fgets(s, MSL, fl) != nullptr)
+  { // like "1701345678.1234 Rx ;44enc 123 456"
+    // or "1701345678.1234 Rx enc 123 456" (from binary mode)
+    char * p1 = s;
+    double t = strtod(p1, &p1);
+    if (strncmp(p1, " Rx ", 4) != 0)
+      continue;
+    p1 += 4;
+    if (p1[0] == ';' and isdigit(p1[1]) and isdigit(p1[2]))
+      // skip check code
+      p1 += 3;
+    if (strncmp(p1, "confirm", 7) == 0 or strncmp(p1, "bin ", 4) == 0)
+      // confirms and binary mode are for the messages received now
+      continue;
+    int n = strlen(p1);
+    while (n > 0 and p1[n - 1] < ' ')
+      p1[--n] = '\0';
+    if (n == 0)
+      continue;
+    if (t0 < 0)
+      t0 = t;
+    replay.push_back({t - t0, p1});
+  }
+  fclose(fl);
+  printf("# teensyemu: replay of %d messages (%.1f sec) at %gx speed%s\n",
+         int(replay.size()), replay.empty() ? 0.0 : replay.back().t,
+         replaySpeed, replayLoop ? ", looping" : "");
+  return not replay.empty();
+}
+
+void UTeensyEmu::sendReplay(double now)
+{
+  if (replayIdx == 0 and replayStart == 0)
+    replayStart = now;
+  while (replayIdx < replay.size() and
+         replay[replayIdx].t / replaySpeed <= now - replayStart)
+  {
+    sendText(replay[replayIdx].msg.c_str());
+    replayIdx++;
+  }
+  if (replayIdx >= replay.size() and replayLoop)
+  { // start over
+    replayIdx = 0;
+    replayStart = now;
+  }
+}
+
+void UTeensyEmu::consoleCommand(char * cmd)
+{
+  char key[20];
+  double v = 0;
+  int n = sscanf(cmd, "%19s %lf", key, &v);
+  if (n < 1)
+    return;
+  if (strcmp(key, "drop") == 0 and n == 2)
+    dropRate = v;
+  else if (strcmp(key, "corrupt") == 0 and n == 2)
+    corruptRate = v;
+  else if (strcmp(key, "partial") == 0 and n == 2)
+    partialRate = v;
+  else if (strcmp(key, "closs") == 0 and n == 2)
+    confirmLossRate = v;
+  else if (strcmp(key, "cdelay") == 0 and n == 2)
+    confirmDelay = v / 1000.0;
+  else if (strcmp(key, "disconnect") == 0)
+  {
+    if (n == 2)
+      disconnectInterval = v;
+    else
+    { // disconnect now
+      closePty();
+      disconnectCnt++;
+      lastDisconnect = timeNow();
+      openPty();
+    }
+  }
+  else if (strcmp(key, "quit") == 0)
+    stopEmu = true;
+  else
+  {
+    printf("# teensyemu commands:\n");
+    printf("#   drop p       drop send messages with probability p (now %g)\n", dropRate);
+    printf("#   corrupt p    corrupt check code with probability p (now %g)\n", corruptRate);
+    printf("#   partial p    split writes with probability p (now %g)\n", partialRate);
+    printf("#   closs p      lose confirms with probability p (now %g)\n", confirmLossRate);
+    printf("#   cdelay ms    delay confirms (now %g ms)\n", confirmDelay * 1000);
+    printf("#   disconnect [s]  disconnect now, or every s seconds (now %g, 0=never)\n", disconnectInterval);
+    printf("#   quit         stop the emulator\n");
+  }
+  printf("# teensyemu: drop %g, corrupt %g, partial %g, closs %g, cdelay %gms, disconnect %gs\n",
+         dropRate, corruptRate, partialRate, confirmLossRate, confirmDelay * 1000, disconnectInterval);
+}
+
+void UTeensyEmu::run()
+{
+  bool useStdin = true;
+  while (not stopEmu)
+  {
+    double now = timeNow();
+    // time to next thing to do
+    double next = now + 0.1;
+    for (int i = 0; i < STREAM_CNT; i++)
+    {
+      if (streamInterval[i] > 0 and streamNext[i] < next)
+        next = streamNext[i];
+    }
+    if (not confirms.empty() and confirms.front().first < next)
+      next = confirms.front().first;
+    if (not txRest.empty() and txRestTime < next)
+      next = txRestTime;
+    if (connected and replayIdx < replay.size())
+    {
+      double t = replayStart + replay[replayIdx].t / replaySpeed;
+      if (t < next)
+        next = t;
+    }
+    int ms = int((next - now) * 1000);
+    if (ms < 0)
+      ms = 0;
+    struct pollfd pfd[2];
+    pfd[0].fd = ptm;
+    pfd[0].events = POLLIN;
+    pfd[0].revents = 0;
+    pfd[1].fd = useStdin ? 0 : -1;
+    pfd[1].events = POLLIN;
+    pfd[1].revents = 0;
+    int n = poll(pfd, 2, ms);
+    if (n > 0 and (pfd[1].revents & (POLLIN | POLLHUP)))
+    { // console command
+      const int MSL = 200;
+      char s[MSL];
+      if (fgets(s, MSL, stdin) != nullptr)
+        consoleCommand(s);
+      else
+        // no more console input
+        useStdin = false;
+    }
+    if (n > 0 and (pfd[0].revents & POLLIN))
+      receive();
+    else if (n > 0 and (pfd[0].revents & POLLHUP))
+    { // no client, start in text mode with no subscriptions at next connect
+      if (connected)
+        printf("# teensyemu: client closed the connection\n");
+      binaryMode = false;
+      connected = false;
+      rxCnt = 0;
+      txRest.clear();
+      confirms.clear();
+      for (int i = 0; i < STREAM_CNT; i++)
+        streamInterval[i] = 0;
+      usleep(10000);
+      continue;
+    }
+    now = timeNow();
+    if (not txRest.empty() and txRestTime <= now)
+    { // rest of a partial write
+      int m = write(ptm, txRest.c_str(), txRest.size());
+      if (m > 0)
+        txRest.erase(0, m);
+    }
+    while (not confirms.empty() and confirms.front().first <= now)
+    { // delayed confirm
+      sendText(confirms.front().second.c_str());
+      confirms.pop_front();
+    }
+    if (disconnectInterval > 0 and connected and now - lastDisconnect > disconnectInterval)
+    { // like unplugging the USB cable
+      printf("# teensyemu: disconnect\n");
+      closePty();
+      disconnectCnt++;
+      lastDisconnect = now;
+      usleep(100000);
+      openPty();
+      continue;
+    }
+    if (not replay.empty())
+    { // replay recorded data in place of the simulated streams
+      if (connected)
+        sendReplay(now);
+      continue;
+    }
+    simulate(now);
+    for (int i = 0; i < STREAM_CNT; i++)
+    {
+      if (streamInterval[i] > 0 and streamNext[i] <= now)
+      {
+        sendStream(i, now);
+        streamNext[i] += streamInterval[i];
+        if (streamNext[i] < now)
+          // too far behind, skip
+          streamNext[i] = now + streamInterval[i];
+      }
+    }
+  }
+}
+
+void UTeensyEmu::receive()
+{
+  int n = read(ptm, &rx[rxCnt], MAX_RX - rxCnt - 1);
+  if (n <= 0)
+    // no client (EIO) or no data
+    return;
+  rxCnt += n;
+  connected = true;
+  int start = 0;
+  for (int i = 0; i < rxCnt; i++)
+  {
+    if (binaryMode and rx[i] == 0)
+    { // end of frame
+      uint8_t packet[UBinLink::MAX_PACKET];
+      uint8_t type;
+      int m = UBinLink::decodeFrame((uint8_t*)&rx[start], i - start, packet, type);
+      if (m < 0)
+        rxCrcErr++;
+      else if (type == BIN_TEXT)
+      {
+        char * msg = (char*)&packet[1];
+        msg[m] = '\0';
+        handleMessage(msg);
+      }
+      else if (type == BIN_MOTV and m == sizeof(UBinMotv))
+      {
+        UBinMotv d;
+        memcpy(&d, &packet[1], m);
+        motv[0] = d.u[0];
+        motv[1] = d.u[1];
+        rxLines++;
+      }
+      start = i + 1;
+    }
+    else if (not binaryMode and rx[i] == '\n')
+    { // end of line
+      rx[i] = '\0';
+      char * line = &rx[start];
+      // check code
+      int sum = 0;
+      for (char * p1 = &line[3]; *p1 != '\0'; p1++)
+        if (*p1 >= ' ')
+          sum += *p1;
+      if (line[0] == ';' and (sum % 99) + 1 == (line[1] - '0') * 10 + line[2] - '0')
+        handleMessage(&line[3]);
+      else
+        rxCrcErr++;
+      start = i + 1;
+    }
+  }
+  // keep unfinished line
+  rxCnt -= start;
+  memmove(rx, &rx[start], rxCnt);
+  if (rxCnt >= MAX_RX - 1)
+    rxCnt = 0;
+}
+
+void UTeensyEmu::handleMessage(char * msg)
+{
+  rxLines++;
+  // remove new-line
+  int n = strlen(msg);
+  while (n > 0 and msg[n - 1] < ' ')
+    msg[--n] = '\0';
+  if (verbose)
+    printf("# teensyemu: got '%s'\n", msg);
+  if (msg[0] == '!')
+  { // confirm
+    const int MSL = 500;
+    char s[MSL];
+    snprintf(s, MSL, "confirm %s", msg);
+    if (fault(confirmLossRate))
+      confirmLossCnt++;
+    else if (confirmDelay > 0)
+      confirms.push_back({timeNow() + confirmDelay, s});
+    else
+      sendText(s);
+    confirmCnt++;
+    msg++;
+  }
+  char * p1 = msg;
+  if (strncmp(p1, "sub ", 4) == 0)
+  { // like 'sub enc 8'
+    char key[20];
+    int ms;
+    if (sscanf(p1 + 4, "%19s %d", key, &ms) == 2)
+    {
+      for (int i = 0; i < STREAM_CNT; i++)
+      {
+        if (strcmp(key, streamName[i]) == 0)
+        {
+          streamInterval[i] = ms / 1000.0;
+          streamNext[i] = timeNow();
+        }
+      }
+    }
+  }
+  else if (strncmp(p1, "leave", 5) == 0)
+  { // stop all subscriptions
+    for (int i = 0; i < STREAM_CNT; i++)
+      streamInterval[i] = 0;
+  }
+  else if (strncmp(p1, "idi", 3) == 0)
+  {
+    const int MSL = 100;
+    char s[MSL];
+    snprintf(s, MSL, "dname robobot %s", robotName.c_str());
+    sendText(s);
+  }
+  else if (strncmp(p1, "hbti", 4) == 0)
+    sendStream(HBT, timeNow());
+  else if (strncmp(p1, "motv ", 5) == 0)
+  {
+    const char * p2 = p1 + 5;
+    motv[0] = strtod(p2, (char**)&p2);
+    motv[1] = strtod(p2, (char**)&p2);
+  }
+  else if (strncmp(p1, "enc0", 4) == 0)
+  {
+    encPos[0] = 0;
+    encPos[1] = 0;
+  }
+  else if (strncmp(p1, "bin ", 4) == 0 and binarySupport)
+  { // binary mode request, answer in text, then use binary
+    int mode = strtol(p1 + 4, nullptr, 10);
+    sendText(mode == 1 ? "bin 1" : "bin 0");
+    binaryMode = mode == 1;
+    if (verbose)
+      printf("# teensyemu: binary mode %s\n", binaryMode ? "on" : "off");
+  }
+}
+
+void UTeensyEmu::writeData(const void* data, int n)
+{
+  if (ptm < 0 or n <= 0)
+    return;
+  if (fault(dropRate))
+  { // lost message
+    dropCnt++;
+    return;
+  }
+  const char * p1 = (const char *)data;
+  if (not txRest.empty())
+  { // keep the order after a partial write
+    txRest.append(p1, n);
+    return;
+  }
+  int m = n;
+  if (fault(partialRate))
+  { // send first part now, the rest a bit later
+    m = 1 + int(uniform(rnd) * (n - 1));
+    txRest.assign(p1 + m, n - m);
+    txRestTime = timeNow() + 0.002;
+    partialCnt++;
+  }
+  m = write(ptm, p1, m);
+  if (m > 0)
+  {
+    txMsgs++;
+    txBytes += n;
+  }
+}
+
+void UTeensyEmu::sendText(const char* msg)
+{
+  const int MSL = 600;
+  char s[MSL];
+  if (binaryMode)
+  {
+    int n = snprintf(s, MSL, "%s\n", msg);
+    sendFrame(BIN_TEXT, s, n);
+  }
+  else
+  { // add check code
+    int sum = 0;
+    for (const char * p1 = msg; *p1 != '\0'; p1++)
+      if (*p1 >= ' ')
+        sum += *p1;
+    int crc = (sum % 99) + 1;
+    if (fault(corruptRate))
+    { // wrong check code
+      crc = (crc + 1) % 100;
+      corruptCnt++;
+    }
+    int n = snprintf(s, MSL, ";%02d%s\n", crc, msg);
+    writeData(s, n);
+  }
+}
+
+void UTeensyEmu::sendTyped(uint8_t type, const void* payload, int n)
+{
+  if (binaryMode)
+    sendFrame(type, payload, n);
+  else
+  { // same message as text
+    const int MSL = 300;
+    char s[MSL];
+    int m = UBinLink::toText(type, (const uint8_t*)payload, n, s, MSL);
+    // remove new-line
+    if (m > 0 and s[m - 1] == '\n')
+      s[m - 1] = '\0';
+    sendText(s);
+  }
+}
+
+void UTeensyEmu::sendFrame(uint8_t type, const void * payload, int n)
+{
+  uint8_t frame[UBinLink::MAX_FRAME];
+  int m = UBinLink::encodeFrame(type, payload, n, frame);
+  if (m > 2 and fault(corruptRate))
+  { // flip a bit in the frame, but not to a zero
+    int i = int(uniform(rnd) * (m - 1));
+    frame[i] ^= 0x10;
+    if (frame[i] == 0)
+      frame[i] = 0x10;
+    corruptCnt++;
+  }
+  writeData(frame, m);
+}
+
+void UTeensyEmu::simulate(double now)
+{ // encoder ticks follow the motor voltage
+  double dt = now - lastUpdate;
+  lastUpdate = now;
+  const double ticksPerVoltSec = 500;
+  // left encoder counts backwards
+  encPos[0] -= motv[0] * ticksPerVoltSec * dt;
+  encPos[1] += motv[1] * ticksPerVoltSec * dt;
+}
+
+void UTeensyEmu::sendStream(int stream, double now)
+{
+  switch (stream)
+  {
+    case ENC:
+    {
+      UBinEnc d;
+      d.enc[0] = int64_t(encPos[0]);
+      d.enc[1] = int64_t(encPos[1]);
+      sendTyped(BIN_ENC, &d, sizeof(d));
+      break;
+    }
+    case LIV:
+    {
+      UBinLiv d;
+      for (int i = 0; i < 8; i++)
+        d.liv[i] = 100 + i * 50;
+      sendTyped(BIN_LIV, &d, sizeof(d));
+      break;
+    }
+    case GYRO:
+    case ACC:
+    {
+      UBinXyz d;
+      d.v[0] = 0.01;
+      d.v[1] = -0.02;
+      d.v[2] = stream == ACC ? 9.81 : 0.003;
+      sendTyped(stream == ACC ? BIN_ACC : BIN_GYRO, &d, sizeof(d));
+      break;
+    }
+    case IR:
+    {
+      UBinIr d;
+      d.dist[0] = 0.5;
+      d.dist[1] = 0.6;
+      d.ad[0] = 30000;
+      d.ad[1] = 25000;
+      sendTyped(BIN_IR, &d, sizeof(d));
+      break;
+    }
+    case HBT:
+    {
+      UBinHbt d;
+      d.teensyTime = now;
+      d.idx = idx;
+      d.version = 1646;
+      d.batteryVoltage = 12.1;
+      d.controlState = 0;
+      d.hwType = 6;
+      d.load = 20;
+      d.motorEnabled[0] = 1;
+      d.motorEnabled[1] = 1;
+      sendTyped(BIN_HBT, &d, sizeof(d));
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+int main(int argc, char ** argv)
+{
+  UTeensyEmu emu;
+  CLI::App cli{"Teensy emulator for raubase"};
+  cli.add_option("-l,--link", emu.linkName, "Link name for the pseudo terminal (default /tmp/ttyTeensy)");
+  cli.add_option("-n,--name", emu.robotName, "Robot name (in dname)");
+  cli.add_option("-i,--idx", emu.idx, "Robot index (in hbt)");
+  bool noBinary = false;
+  cli.add_flag("-t,--text-only", noBinary, "No binary mode support (as old firmware)");
+  cli.add_flag("-v,--verbose", emu.verbose, "Print received messages");
+  cli.add_option("-r,--replay", emu.replayName, "Replay Rx messages from this log_teensy_io.txt");
+  cli.add_option("-s,--speed", emu.replaySpeed, "Replay speed factor (default 1)");
+  cli.add_flag("--loop", emu.replayLoop, "Repeat the replay");
+  cli.add_option("--drop", emu.dropRate, "Probability of dropping a send message");
+  cli.add_option("--corrupt", emu.corruptRate, "Probability of a wrong check code");
+  cli.add_option("--partial", emu.partialRate, "Probability of a write in two parts");
+  cli.add_option("--confirm-loss", emu.confirmLossRate, "Probability of a lost confirm");
+  double confirmDelayMs = 0;
+  cli.add_option("--confirm-delay", confirmDelayMs, "Confirm delay (ms)");
+  cli.add_option("--disconnect", emu.disconnectInterval, "Disconnect every this many seconds");
+  cli.add_option("--seed", emu.seed, "Random seed for the faults");
+  CLI11_PARSE(cli, argc, argv);
+  emu.binarySupport = not noBinary;
+  emu.confirmDelay = confirmDelayMs / 1000.0;
+  if (emu.replaySpeed <= 0)
+    emu.replaySpeed = 1.0;
+  signal(SIGINT, signalHandler);
+  signal(SIGTERM, signalHandler);
+  if (emu.setup())
+    emu.run();
+  emu.terminate();
+  return 0;
+}